@@ -2,6 +2,7 @@
 #include "AppPage.Xaml.h"
 #include "Common\ModalDialog.xaml.h"
 #include "HostSettingsPage.xaml.h"
+#include "State\ConnectionPrewarmer.h"
 #include "State\MoonlightClient.h"
 #include "StreamPage.xaml.h"
 #include "Utils.hpp"
@@ -50,9 +51,9 @@ void AppPage::OnNavigatedTo(Windows::UI::Xaml::Navigation::NavigationEventArgs^
 		while (that->continueAppFetch.load()) {
 			try {
 				if (that->host != nullptr) {
+					// One status request per round, it tells us both the running app and whether the host is still there
 					that->host->UpdateAppRunningStates();
-					bool connected = false;
-					try { connected = (that->host->Connect() == 0); } catch (...) { connected = false; }
+					bool connected = that->host->Connected;
 					if (that->wasConnected.load() && !connected) {
 						that->wasConnected.store(false);
 						Windows::ApplicationModel::Core::CoreApplication::MainView->CoreWindow->Dispatcher->RunAsync(Windows::UI::Core::CoreDispatcherPriority::High, ref new Windows::UI::Core::DispatchedHandler([that]() {
@@ -107,6 +108,13 @@ void AppPage::AppsGrid_ItemClick(Platform::Object ^ sender, Windows::UI::Xaml::C
 	this->Connect(app->Id);
 }
 
+void AppPage::AppsGrid_GotFocus(Platform::Object ^ sender, Windows::UI::Xaml::RoutedEventArgs ^ e) {
+	// Keep the launch warm while the user browses, this only reconnects once the last prewarm went stale
+	if (host != nullptr && host->Connected && dynamic_cast<GridViewItem ^>(e->OriginalSource) != nullptr) {
+		ConnectionPrewarmer::instance().Prewarm(host->LastHostname);
+	}
+}
+
 void AppPage::Connect(int appId) {
 	StreamConfiguration ^ config = ref new StreamConfiguration();
 	config->hostname = host->LastHostname;
@@ -118,11 +126,14 @@ void AppPage::Connect(int appId) {
 	config->audioConfig = host->AudioConfig;
 	config->videoCodec = host->VideoCodec;
 	config->playAudioOnPC = host->PlayAudioOnPC;
+	config->upmixAudio = host->UpmixAudio;
 	config->enableHDR = host->EnableHDR;
 	config->enableSOPS = host->EnableSOPS;
 	config->framePacing = host->FramePacing;
+	config->avSyncWindow = host->AVSyncWindow;
 	config->enableStats = host->EnableStats;
 	config->enableGraphs = host->EnableGraphs;
+	config->recordPacingTrace = host->RecordPacingTrace;
 	if (config->enableHDR) {
 		host->VideoCodec = "HEVC (H.265)";
 	}
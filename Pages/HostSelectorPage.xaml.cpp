@@ -11,6 +11,8 @@
 #include "Utils.hpp"
 #include "MoonlightSettings.xaml.h"
 #include "State\MDNSHandler.h"
+#include "State\HostProbeScheduler.h"
+#include "State\ConnectionPrewarmer.h"
 #include "MoonlightWelcome.xaml.h"
 #include "Common\ModalDialog.xaml.h"
 #include <string>
@@ -202,6 +204,17 @@ void HostSelectorPage::HostsGrid_RightTapped(Platform::Object^ sender, Windows::
 	this->ShowHostActions(senderElement, currentHost);
 }
 
+void HostSelectorPage::HostsGrid_GotFocus(Platform::Object^ sender, Windows::UI::Xaml::RoutedEventArgs^ e)
+{
+	// Get a head start on connecting while the user decides
+	auto item = dynamic_cast<GridViewItem^>(e->OriginalSource);
+	if (item == nullptr) return;
+	auto host = dynamic_cast<MoonlightHost^>(item->Content);
+	if (host != nullptr && host->Connected && host->Paired) {
+		ConnectionPrewarmer::instance().Prewarm(host->LastHostname);
+	}
+}
+
 void HostSelectorPage::hostSettingsButton_Click(Platform::Object^ sender, Windows::UI::Xaml::RoutedEventArgs^ e)
 {
 	bool result = this->Frame->Navigate(Windows::UI::Xaml::Interop::TypeName(HostSettingsPage::typeid), currentHost);
@@ -218,11 +231,7 @@ void HostSelectorPage::OnStateLoaded() {
 		return;
 	}
 
-	Concurrency::create_task([this]() {
-		for (auto a : GetApplicationState()->SavedHosts) {
-			a->UpdateHostInfo(false);
-		}
-	}).then([this]() {
+	HostProbeScheduler::instance().ProbeAll(GetApplicationState()->SavedHosts, false, true).then([this]() {
 		if (GetApplicationState()->autostartInstance.size() > 0) {
 			auto pii = Utils::StringFromStdString(GetApplicationState()->autostartInstance);
 			for (unsigned int i = 0; i < GetApplicationState()->SavedHosts->Size; i++) {
@@ -266,13 +275,26 @@ void HostSelectorPage::Connect(MoonlightHost^ host) {
 void HostSelectorPage::OnNavigatedTo(Windows::UI::Xaml::Navigation::NavigationEventArgs^ e) {
 	Windows::UI::ViewManagement::ApplicationView::GetForCurrentView()->SetDesiredBoundsMode(Windows::UI::ViewManagement::ApplicationViewBoundsMode::UseVisible);
 	continueFetch.store(true);
+
+	// Discovered hosts show up as soon as they answer, adding one connects to it so keep that off the discovery thread
+	MDNSHandler &mdns = MDNSHandler::instance();
+	if (!mdns.OnHostFound) {
+		mdns.OnHostFound = [](const std::string &host) {
+			Concurrency::create_task([host]() {
+				GetApplicationState()->AddHost(Utils::StringFromStdString(host));
+			});
+		};
+		mdns.OnHostLost = [](const std::string &host) {
+			Utils::Logf("mDNS: %s is no longer announced\n", host.c_str());
+		};
+	}
+	mdns.Start();
+
 	Concurrency::create_task([this] {
-		init_mdns();
+		bool force = true; // don't leave hosts in backoff when the page is opened
 		while (continueFetch.load()) {
-			query_mdns();
-			for (auto a : GetApplicationState()->SavedHosts) {
-				a->UpdateHostInfo(true);
-			}
+			HostProbeScheduler::instance().ProbeAll(GetApplicationState()->SavedHosts, true, force).wait();
+			force = false;
 			Sleep(5000);
 		}
 	}) .then([](concurrency::task<void> t) {
@@ -288,6 +310,12 @@ void HostSelectorPage::OnNavigatedTo(Windows::UI::Xaml::Navigation::NavigationEv
 	});
 }
 
+// Probing and discovery only run while the host list is shown, OnNavigatedTo starts them again
+void HostSelectorPage::OnNavigatedFrom(Windows::UI::Xaml::Navigation::NavigationEventArgs^ e) {
+	continueFetch.store(false);
+	MDNSHandler::instance().Stop();
+}
+
 void HostSelectorPage::OnKeyDown(Platform::Object^ sender, Windows::UI::Xaml::Input::KeyRoutedEventArgs^ e)
 {
 	if (e->Key == Windows::System::VirtualKey::Enter) {
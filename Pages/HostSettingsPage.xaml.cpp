@@ -58,6 +58,11 @@ void HostSettingsPage::OnNavigatedTo(Windows::UI::Xaml::Navigation::NavigationEv
 	AvailableAudioConfigs->Append("Surround 7.1");
 	AvailableFramePacing->Append("Immediate");
 	AvailableFramePacing->Append("Display-locked");
+	AvailableFramePacing->Append("Adaptive");
+	AvailableAVSyncWindows->Append(0);
+	AvailableAVSyncWindows->Append(20);
+	AvailableAVSyncWindows->Append(45);
+	AvailableAVSyncWindows->Append(90);
 	CurrentResolutionIndex = 0;
 	for (int i = 0; i < AvailableResolutions->Size; i++) {
 		if (host->Resolution->Width == AvailableResolutions->GetAt(i)->Width &&
@@ -165,6 +170,12 @@ void HostSettingsPage::FPSSelector_SelectionChanged(Platform::Object^ sender, Wi
 	host->FPS = selectedFPS;
 }
 
+void HostSettingsPage::AVSyncWindowSelector_SelectionChanged(Platform::Object^ sender, Windows::UI::Xaml::Controls::SelectionChangedEventArgs^ e)
+{
+	if (e->AddedItems->Size == 0) return;
+	host->AVSyncWindow = (int)e->AddedItems->GetAt(0);
+}
+
 void HostSettingsPage::AutoStartSelector_SelectionChanged(Platform::Object^ sender, Windows::UI::Xaml::Controls::SelectionChangedEventArgs^ e)
 {
 	int index = AutoStartSelector->SelectedIndex - 1;
@@ -180,11 +191,15 @@ void HostSettingsPage::FramePacing_SelectionChanged(Platform::Object^ sender, Wi
 {
 	auto selectedFramePacing = AvailableFramePacing->GetAt(this->FramePacingComboBox->SelectedIndex);
 
+	FramePacingImmediateDesc->Visibility = Windows::UI::Xaml::Visibility::Collapsed;
+	FramePacingDisplayLockedDesc->Visibility = Windows::UI::Xaml::Visibility::Collapsed;
+	FramePacingAdaptiveDesc->Visibility = Windows::UI::Xaml::Visibility::Collapsed;
+
 	if (selectedFramePacing == "Immediate") {
 		FramePacingImmediateDesc->Visibility = Windows::UI::Xaml::Visibility::Visible;
-		FramePacingDisplayLockedDesc->Visibility = Windows::UI::Xaml::Visibility::Collapsed;
+	} else if (selectedFramePacing == "Adaptive") {
+		FramePacingAdaptiveDesc->Visibility = Windows::UI::Xaml::Visibility::Visible;
 	} else {
-		FramePacingImmediateDesc->Visibility = Windows::UI::Xaml::Visibility::Collapsed;
 		FramePacingDisplayLockedDesc->Visibility = Windows::UI::Xaml::Visibility::Visible;
 	}
 
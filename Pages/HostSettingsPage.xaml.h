@@ -23,6 +23,7 @@ namespace moonlight_xbox_dx
 		Windows::Foundation::Collections::IVector<Platform::String^>^ availableAudioConfigs;
 		Windows::Foundation::Collections::IVector<Platform::String^>^ availableVideoCodecs;
 		Windows::Foundation::Collections::IVector<Platform::String^>^ availableFramePacing;
+		Windows::Foundation::Collections::IVector<int>^ availableAVSyncWindows;
 		int currentResolutionIndex = 0;
 		int currentAppIndex = 0;
 		Windows::Foundation::EventRegistrationToken m_back_cookie;
@@ -87,6 +88,16 @@ namespace moonlight_xbox_dx
 			}
 		}
 
+		property Windows::Foundation::Collections::IVector<int>^ AvailableAVSyncWindows {
+			Windows::Foundation::Collections::IVector<int>^ get() {
+				if (this->availableAVSyncWindows == nullptr)
+				{
+					this->availableAVSyncWindows = ref new Platform::Collections::Vector<int>();
+				}
+				return this->availableAVSyncWindows;
+			}
+		}
+
 		property int CurrentResolutionIndex
 		{
 			int get() { return this->currentResolutionIndex; }
@@ -110,6 +121,7 @@ namespace moonlight_xbox_dx
 		void BitrateInput_TextChanged(Platform::Object^ sender, Windows::UI::Xaml::Controls::TextChangedEventArgs^ e);
 		void AutoStartSelector_SelectionChanged(Platform::Object^ sender, Windows::UI::Xaml::Controls::SelectionChangedEventArgs^ e);
 		void FramePacing_SelectionChanged(Platform::Object^ sender, Windows::UI::Xaml::Controls::SelectionChangedEventArgs^ e);
+		void AVSyncWindowSelector_SelectionChanged(Platform::Object^ sender, Windows::UI::Xaml::Controls::SelectionChangedEventArgs^ e);
 		void GlobalSettingsOption_Click(Platform::Object^ sender, Windows::UI::Xaml::RoutedEventArgs^ e);
 		void BitrateInput_KeyDown(Platform::Object^ sender, Windows::UI::Xaml::Input::KeyRoutedEventArgs^ e);
 		void OnLoaded(Platform::Object^ sender, Windows::UI::Xaml::RoutedEventArgs^ e);
@@ -26,6 +26,10 @@ ImGuiPlots::ImGuiPlots() :
         Plot(kPlotDescs[PLOT_QUEUED_FRAMES]),
 
         Plot(kPlotDescs[PLOT_BANDWIDTH]),
+        Plot(kPlotDescs[PLOT_GLASS_TO_GLASS]),
+        Plot(kPlotDescs[PLOT_AUDIO_QUEUE]),
+        Plot(kPlotDescs[PLOT_AUDIO_DECODE]),
+        Plot(kPlotDescs[PLOT_AUDIO_UNDERRUNS]),
         Plot(kPlotDescs[PLOT_ETC]),
     }},
     m_isEnabled(true)
@@ -10,6 +10,10 @@ enum PlotType {
 	PLOT_DROPPED_PACER,
 	PLOT_QUEUED_FRAMES,
 	PLOT_BANDWIDTH,
+	PLOT_GLASS_TO_GLASS,
+	PLOT_AUDIO_QUEUE,
+	PLOT_AUDIO_DECODE,
+	PLOT_AUDIO_UNDERRUNS,
 
 	PLOT_ETC,
 	PlotCount
@@ -39,6 +43,10 @@ inline constexpr std::array<PlotDesc, PlotCount> kPlotDescs = {{
     {"Dropped frames (pacing)",        PLOT_LABEL_TOTAL_INT,     "", -1.0f, 3.0f, NULL, NULL},
 	{"Frames queued",                  PLOT_LABEL_MIN_MAX_AVG_INT, "", -1.0f, 6.0f, NULL, NULL},
     {"Video stream",                   PLOT_LABEL_MIN_MAX_AVG, "Mbps", -0.1f, 200.0f, NULL, NULL},
+    {"Glass-to-glass (est.)",          PLOT_LABEL_MIN_MAX_AVG, "ms", -0.1f, 100.0f, NULL, 99.0f},
+    {"Audio queued",                   PLOT_LABEL_MIN_MAX_AVG, "ms", -0.1f, 125.0f, NULL, 124.0f},
+    {"Audio decode",                   PLOT_LABEL_MIN_MAX_AVG, "us", -1.0f, 500.0f, NULL, 499.0f},
+    {"Audio underruns",                PLOT_LABEL_TOTAL_INT,     "", -1.0f, 3.0f, NULL, NULL},
 	{"Etc...",                         PLOT_LABEL_MIN_MAX_AVG, "ms", -0.1f, 50.0f, NULL, 49.0f},
 }};
 
@@ -1,46 +1,50 @@
 #include "pch.h"
 #include "BandwidthTracker.h"
+#include <algorithm>
 
 using namespace std::chrono;
 
 BandwidthTracker::BandwidthTracker(uint32_t windowSeconds, uint32_t bucketIntervalMs)
   : windowSeconds(seconds(windowSeconds)),
-    bucketIntervalMs(bucketIntervalMs)
+    bucketIntervalMs(bucketIntervalMs > 0 ? bucketIntervalMs : 250)
 {
-    if (bucketIntervalMs <= 0) {
-        bucketIntervalMs = 250;
-    }
-    bucketCount = (windowSeconds * 1000) / bucketIntervalMs;
-    buckets.resize(bucketCount);
+    bucketCount = std::max<uint32_t>(1, (windowSeconds * 1000) / this->bucketIntervalMs);
+    buckets.reset(new Bucket[bucketCount]());
 }
 
 // Add bytes recorded at the current time.
 void BandwidthTracker::AddBytes(size_t bytes) {
-    std::lock_guard<std::mutex> lock(mtx);
-    auto now = steady_clock::now();
-    updateBucket(bytes, now);
+    int64_t interval = currentInterval(steady_clock::now());
+    Bucket &bucket = buckets[interval % bucketCount];
+    uint64_t tag = (uint64_t)interval << (64 - TAG_BITS);
+    uint64_t current = bucket.load(std::memory_order_relaxed);
+    uint64_t updated;
+    do {
+        // A bucket still holding an older interval starts over
+        if ((current & ~BYTES_MASK) == tag) {
+            updated = current + bytes;
+        }
+        else {
+            updated = tag | (bytes & BYTES_MASK);
+        }
+    } while (!bucket.compare_exchange_weak(current, updated, std::memory_order_relaxed));
 }
 
 // We don't want to average the entire window used for peak,
 // so average only the newest 25% of complete buckets
 double BandwidthTracker::GetAverageMbps() {
-    std::lock_guard<std::mutex> lock(mtx);
     auto now = steady_clock::now();
-    auto ms = duration_cast<milliseconds>(now.time_since_epoch());
-    int currentIndex = (ms.count() / bucketIntervalMs) % bucketCount;
+    int64_t current = currentInterval(now);
     int maxBuckets = bucketCount / 4;
     size_t totalBytes = 0;
     steady_clock::time_point oldestBucket = now;
 
-    // Sum bytes from 25% most recent buckets as long as they are completed
-    for (int i = 0; i < maxBuckets; i++) {
-        int idx = (currentIndex - i + bucketCount) % bucketCount;
-        const Bucket &bucket = buckets[idx];
-        if (isValid(bucket, now) && (now - bucket.start >= milliseconds(bucketIntervalMs))) {
-            totalBytes += bucket.bytes;
-            if (bucket.start < oldestBucket) {
-                oldestBucket = bucket.start;
-            }
+    // Sum bytes from 25% most recent buckets, skipping the current one which is still in progress
+    for (int i = 1; i < maxBuckets; i++) {
+        size_t bytes;
+        if (bytesForInterval(current - i, bytes)) {
+            totalBytes += bytes;
+            oldestBucket = intervalStart(current - i);
         }
     }
 
@@ -53,12 +57,13 @@ double BandwidthTracker::GetAverageMbps() {
 }
 
 double BandwidthTracker::GetPeakMbps() {
-    std::lock_guard<std::mutex> lock(mtx);
     auto now = steady_clock::now();
+    int64_t current = currentInterval(now);
     double peak = 0.0;
-    for (const auto& bucket : buckets) {
-        if (isValid(bucket, now)) {
-            double throughput = getBucketMbps(bucket);
+    for (uint32_t i = 0; i < bucketCount; i++) {
+        size_t bytes;
+        if (bytesForInterval(current - i, bytes) && now - intervalStart(current - i) <= windowSeconds) {
+            double throughput = getBucketMbps(bytes);
             if (throughput > peak) {
                 peak = throughput;
             }
@@ -73,33 +78,27 @@ unsigned int BandwidthTracker::GetWindowSeconds() {
 
 /// private methods
 
-inline double BandwidthTracker::getBucketMbps(const Bucket &bucket) const {
-    return bucket.bytes * 8.0 / 1000000.0 / (bucketIntervalMs / 1000.0);
+inline double BandwidthTracker::getBucketMbps(size_t bytes) const {
+    return bytes * 8.0 / 1000000.0 / (bucketIntervalMs / 1000.0);
 }
 
-// Check if a bucket's data is still valid (within the window)
-inline bool BandwidthTracker::isValid(const Bucket &bucket, steady_clock::time_point now) const {
-    return (now - bucket.start) <= windowSeconds;
+inline int64_t BandwidthTracker::currentInterval(steady_clock::time_point now) const {
+    return duration_cast<milliseconds>(now.time_since_epoch()).count() / bucketIntervalMs;
 }
 
-void BandwidthTracker::updateBucket(size_t bytes, steady_clock::time_point now) {
-    auto ms          = duration_cast<milliseconds>(now.time_since_epoch()).count();
-    int bucketIndex  = (ms / bucketIntervalMs) % bucketCount;
-    auto aligned_ms  = ms - (ms % bucketIntervalMs);
-    auto bucketStart = steady_clock::time_point(milliseconds(aligned_ms));
-
-    Bucket &bucket = buckets[bucketIndex];
-
-    if (now - bucket.start > windowSeconds) {
-        bucket.bytes = 0;
-        bucket.start = bucketStart;
-    }
+inline steady_clock::time_point BandwidthTracker::intervalStart(int64_t interval) const {
+    return steady_clock::time_point(milliseconds(interval * bucketIntervalMs));
+}
 
-    if (bucket.start != bucketStart) {
-        bucket.bytes = bytes;
-        bucket.start = bucketStart;
+// The bytes recorded during interval, if its bucket hasn't been reused for a newer one or left over from an older one
+bool BandwidthTracker::bytesForInterval(int64_t interval, size_t &bytes) const {
+    if (interval < 0) {
+        return false;
     }
-    else {
-        bucket.bytes += bytes;
+    uint64_t value = buckets[interval % bucketCount].load(std::memory_order_relaxed);
+    if ((value & ~BYTES_MASK) != ((uint64_t)interval << (64 - TAG_BITS))) {
+        return false;
     }
+    bytes = (size_t)(value & BYTES_MASK);
+    return true;
 }
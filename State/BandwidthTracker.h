@@ -2,8 +2,8 @@
 
 #include <chrono>
 #include <cstdint>
-#include <mutex>
-#include <vector>
+#include <atomic>
+#include <memory>
 
 /**
  * @brief The BandwidthTracker class tracks network bandwidth usage over a sliding time window (default 10s).
@@ -17,8 +17,8 @@
  *
  * GetPeakMbps() returns the peak bandwidth seen during any one bucket interval across the full time window.
  *
- * All public methods are thread safe. A typical use case is calling AddBytes() in a data processing thread while
- * calling GetAverageMbps() from a UI thread.
+ * All public methods are thread safe and lock-free. A typical use case is calling AddBytes() in a data processing
+ * thread while calling GetAverageMbps() from a UI thread, neither ever waits for the other.
  *
  * Example usage:
  * @code
@@ -47,7 +47,7 @@ public:
 	 * @brief Record bytes that were received or sent.
 	 *
 	 * This method updates the corresponding bucket for the current time interval with the new data.
-	 * It is thread-safe. Bytes are associated with the bucket for "now" and it is not possible to
+	 * It is thread-safe and lock-free. Bytes are associated with the bucket for "now" and it is not possible to
 	 * submit data for old buckets. This function should be called as needed at the time the bytes
 	 * were received. Callers should not maintain their own byte totals.
 	 *
@@ -86,22 +86,24 @@ public:
 
 private:
 	/**
-	 * @brief A structure representing a single time bucket.
+	 * @brief A single time bucket, packed into one atomic word so it can be updated without a lock.
 	 *
-	 * Each bucket holds the start time of the interval and the total number of bytes recorded during that interval.
+	 * The high TAG_BITS hold the low bits of the bucket's interval number (steady_clock time / bucketIntervalMs)
+	 * and the rest the number of bytes recorded during that interval. The first AddBytes() of a new interval
+	 * swaps in the new tag and byte count in one compare-exchange.
 	 */
-	struct Bucket {
-		std::chrono::steady_clock::time_point start{}; ///< The start time of the bucket's interval.
-		size_t bytes = 0;                              ///< The number of bytes recorded in this bucket.
-	};
+	typedef std::atomic<std::uint64_t> Bucket;
 
-	const std::chrono::seconds windowSeconds;          ///< T he duration of the tracking window.
+	static constexpr int TAG_BITS = 24;
+	static constexpr std::uint64_t BYTES_MASK = (1ULL << (64 - TAG_BITS)) - 1;
+
+	const std::chrono::seconds windowSeconds;          ///< The duration of the tracking window.
 	const int bucketIntervalMs;                        ///< The duration of each bucket (in milliseconds).
 	std::uint32_t bucketCount;                         ///< The total number of buckets covering the window.
-	std::vector<Bucket> buckets;                       ///< Fixed-size circular buffer of buckets.
-	std::mutex mtx;                                    ///< Mutex to ensure thread-safe access.
+	std::unique_ptr<Bucket[]> buckets;                 ///< Fixed-size circular buffer of buckets.
 
-	bool isValid(const Bucket &bucket, std::chrono::steady_clock::time_point now) const;
-	void updateBucket(size_t bytes, std::chrono::steady_clock::time_point now);
-	double getBucketMbps(const Bucket &bucket) const;
+	std::int64_t currentInterval(std::chrono::steady_clock::time_point now) const;
+	bool bytesForInterval(std::int64_t interval, size_t &bytes) const;
+	std::chrono::steady_clock::time_point intervalStart(std::int64_t interval) const;
+	double getBucketMbps(size_t bytes) const;
 };
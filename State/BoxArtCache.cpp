@@ -0,0 +1,133 @@
+#include "pch.h"
+#include "BoxArtCache.h"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include "Utils.hpp"
+
+extern "C" {
+#include <libgamestream/errors.h>
+}
+
+using namespace moonlight_xbox_dx;
+
+BoxArtCache &BoxArtCache::instance() {
+	static BoxArtCache inst;
+	return inst;
+}
+
+concurrency::task<void> BoxArtCache::Fetch(const SERVER_DATA &server, const std::vector<MoonlightApp ^> &apps) {
+	auto jobs = std::make_shared<std::vector<Job>>();
+	const std::string host = server.uniqueId != nullptr ? server.uniqueId : server.serverInfo.address;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_loaded) {
+			loadIndex();
+			m_loaded = true;
+		}
+
+		for (auto a : apps) {
+			Job job;
+			job.app = a;
+			job.appId = a->Id;
+			job.key = host + "_" + std::to_string(a->Id);
+			job.path = m_folder + Utils::NarrowToWideString(job.key) + L".png";
+
+			WIN32_FILE_ATTRIBUTE_DATA attributes;
+			const long long fileSize = GetFileAttributesEx(job.path.c_str(), GetFileExInfoStandard, &attributes)
+			                               ? (((long long)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow)
+			                               : -1;
+			const BoxArtIndex::Lookup found = m_index.lookup(job.key, fileSize);
+			if (found.cached) {
+				// Setting the same path again would make the tile reload its image
+				auto imagePath = ref new Platform::String(job.path.c_str());
+				if (a->ImagePath != imagePath) a->ImagePath = imagePath;
+				if (found.etag.empty()) continue; // nothing to revalidate with
+				job.etag = found.etag;
+			}
+
+			if (!m_inFlight.insert(job.key).second) continue; // an earlier Fetch is already on it
+			jobs->push_back(job);
+		}
+	}
+
+	if (jobs->empty()) {
+		return concurrency::task_from_result();
+	}
+
+	// Keep our own copy of the address, serverData can be rewritten by a status probe meanwhile
+	auto address = std::make_shared<std::string>(server.serverInfo.address);
+	const unsigned short httpsPort = server.httpsPort;
+
+	auto next = std::make_shared<std::atomic<size_t>>(0);
+	const size_t workerCount = std::min(jobs->size(), (size_t)MAX_CONCURRENT_FETCHES);
+	std::vector<concurrency::task<void>> workers;
+	for (size_t w = 0; w < workerCount; w++) {
+		workers.push_back(concurrency::create_task([this, jobs, next, address, httpsPort]() {
+			SERVER_DATA target = {};
+			target.serverInfo.address = address->c_str();
+			target.httpsPort = httpsPort;
+
+			size_t i;
+			while ((i = next->fetch_add(1)) < jobs->size()) {
+				Job &job = (*jobs)[i];
+				APP_ASSET asset = {};
+				strncpy_s(asset.etag, job.etag.c_str(), _TRUNCATE);
+
+				std::string path = Utils::WideToNarrowString(job.path);
+				int status = gs_appasset(&target, path.c_str(), job.appId, &asset);
+
+				bool updated = false;
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					m_inFlight.erase(job.key);
+					if (status == GS_OK && !asset.notModified) {
+						m_index.record(job.key, asset.size, asset.etag);
+						updated = true;
+					}
+				}
+
+				if (status != GS_OK) {
+					Utils::Logf("BoxArtCache: fetching box art for app %d failed: %s\n", job.appId, asset.error);
+				} else if (updated) {
+					job.app->ImagePath = ref new Platform::String(job.path.c_str());
+				}
+			}
+		}));
+	}
+
+	return concurrency::when_all(workers.begin(), workers.end()).then([this]() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		saveIndex();
+	});
+}
+
+// Both index helpers expect m_mutex to be held
+
+void BoxArtCache::loadIndex() {
+	Platform::String ^ folderString = Windows::Storage::ApplicationData::Current->LocalFolder->Path;
+	m_folder = std::wstring(folderString->Data()) + L"\\images\\";
+	CreateDirectory(m_folder.c_str(), NULL);
+
+	std::ifstream file(m_folder + L"index.txt");
+	m_index.read(file);
+}
+
+void BoxArtCache::saveIndex() {
+	const std::wstring indexPath = m_folder + L"index.txt";
+	const std::wstring tempPath = indexPath + L".tmp";
+
+	{
+		std::ofstream file(tempPath, std::ios::trunc);
+		if (!m_index.write(file)) {
+			Utils::Log("BoxArtCache: failed to write the cache index\n");
+			return;
+		}
+	}
+
+	if (!MoveFileEx(tempPath.c_str(), indexPath.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+		Utils::Log("BoxArtCache: failed to replace the cache index\n");
+	}
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <mutex>
+#include <ppltasks.h>
+#include <set>
+#include <string>
+#include <vector>
+#include "State\BoxArtIndex.h"
+#include "State\MoonlightApp.h"
+
+extern "C" {
+#include <libgamestream/client.h>
+}
+
+namespace moonlight_xbox_dx {
+
+// Downloads and caches box art for the app grid.
+//
+// Images are stored as images\<host uniqueid>_<appId>.png next to an index recording the size and
+// ETag of every file. An app whose cached image matches the index is shown straight away. It is only
+// revalidated with a conditional request when the host gave us an ETag. Missing images are
+// fetched by up to MAX_CONCURRENT_FETCHES workers over the pooled libgamestream connections.
+class BoxArtCache {
+  public:
+	// Singleton
+	static BoxArtCache &instance();
+
+	// Points each app at its cached image and fetches missing or stale ones in the background.
+	// ImagePath is updated as each download completes.
+	concurrency::task<void> Fetch(const SERVER_DATA &server, const std::vector<MoonlightApp ^> &apps);
+
+	static constexpr int MAX_CONCURRENT_FETCHES = 4;
+
+  private:
+	BoxArtCache() = default;
+	BoxArtCache(const BoxArtCache &) = delete;
+	BoxArtCache &operator=(const BoxArtCache &) = delete;
+
+	struct Job {
+		MoonlightApp ^ app;
+		int appId;
+		std::string key;
+		std::wstring path;
+		std::string etag; // empty when the image has to be downloaded
+	};
+
+	void loadIndex();
+	void saveIndex();
+
+	std::mutex m_mutex;
+	bool m_loaded = false;
+	std::wstring m_folder;
+	BoxArtIndex m_index;
+	std::set<std::string> m_inFlight;
+};
+
+} // namespace moonlight_xbox_dx
@@ -0,0 +1,40 @@
+#include "pch.h"
+#include "BoxArtIndex.h"
+#include <cstdlib>
+#include <sstream>
+
+using namespace moonlight_xbox_dx;
+
+BoxArtIndex::Lookup BoxArtIndex::lookup(const std::string &key, long long fileSize) const {
+	auto it = m_entries.find(key);
+	if (it == m_entries.end() || fileSize < 0 || fileSize != it->second.size) {
+		return Lookup{false, std::string()}; // anything we didn't record gets downloaded again
+	}
+	return Lookup{true, it->second.etag};
+}
+
+void BoxArtIndex::record(const std::string &key, long long size, const std::string &etag) {
+	m_entries[key] = Entry{size, etag};
+}
+
+void BoxArtIndex::read(std::istream &in) {
+	std::string line;
+	while (std::getline(in, line)) {
+		std::istringstream fields(line);
+		std::string key, size, etag;
+		if (!std::getline(fields, key, '\t') || !std::getline(fields, size, '\t')) continue;
+		std::getline(fields, etag);
+
+		Entry entry;
+		entry.size = std::strtoll(size.c_str(), nullptr, 10);
+		entry.etag = etag;
+		m_entries[key] = entry;
+	}
+}
+
+bool BoxArtIndex::write(std::ostream &out) const {
+	for (auto &entry : m_entries) {
+		out << entry.first << '\t' << entry.second.size << '\t' << entry.second.etag << '\n';
+	}
+	return out.good();
+}
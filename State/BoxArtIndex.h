@@ -0,0 +1,39 @@
+#pragma once
+
+#include <istream>
+#include <map>
+#include <ostream>
+#include <string>
+
+namespace moonlight_xbox_dx {
+
+// The index BoxArtCache keeps next to the cached images, the size and ETag of every image it
+// downloaded. A file is only trusted if it is the one that was recorded. Not thread safe,
+// BoxArtCache holds its lock around every call.
+class BoxArtIndex {
+  public:
+	struct Lookup {
+		bool cached;      // the file on disk is the recorded one and can be shown straight away
+		std::string etag; // revalidate the cached file with this, empty if there's nothing to send
+	};
+
+	// fileSize is -1 when there's no file at the image's path
+	Lookup lookup(const std::string &key, long long fileSize) const;
+	void record(const std::string &key, long long size, const std::string &etag);
+
+	// One entry per line: key, size and ETag separated by tabs
+	void read(std::istream &in);
+	bool write(std::ostream &out) const;
+
+	size_t size() const { return m_entries.size(); }
+
+  private:
+	struct Entry {
+		long long size = 0;
+		std::string etag;
+	};
+
+	std::map<std::string, Entry> m_entries; // keyed by <host uniqueid>_<appId>
+};
+
+} // namespace moonlight_xbox_dx
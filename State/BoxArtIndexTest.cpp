@@ -0,0 +1,246 @@
+// Index and revalidation suite for the box art cache, built on the host rather than into the app
+//
+// BoxArtIndex must only trust a file of the recorded size, hand out the recorded ETag to
+// revalidate it with, and read back what it wrote while skipping lines it can't make sense of.
+// Then images are fetched from a stub host over HTTPS with gs_appasset(), making the same
+// decisions BoxArtCache::Fetch() makes: a first fetch downloads, a cached image is revalidated
+// with If-None-Match and a 304 leaves the file and index alone, new art replaces it, a failed or
+// empty response never replaces it, a file that no longer matches the index is downloaded
+// again unconditionally, and an image the host gave no ETag for isn't requested again.
+//
+// Built through Tools/CMakeLists.txt.
+
+#include "pch.h"
+#include "BoxArtIndex.h"
+#include "HostStubServer.h"
+
+extern "C" {
+#include "client.h"
+#include "errors.h"
+#include "http.h"
+#include "mkcert.h"
+}
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace moonlight_xbox_dx;
+
+static int g_failures = 0;
+
+#define CHECK(cond, ...)                                     \
+	do {                                                     \
+		if (!(cond)) {                                       \
+			fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+			fprintf(stderr, __VA_ARGS__);                    \
+			fprintf(stderr, "\n");                           \
+			g_failures++;                                    \
+		}                                                    \
+	} while (0)
+
+static void testIndex() {
+	BoxArtIndex index;
+	CHECK(!index.lookup("host_1", 1000).cached, "an empty index trusted a file");
+
+	index.record("host_1", 1000, "\"v1\"");
+	index.record("host_2", 5, "");
+	index.record("host_3", 42, "W/\"weak etag\"");
+
+	BoxArtIndex::Lookup found = index.lookup("host_1", 1000);
+	CHECK(found.cached && found.etag == "\"v1\"", "recorded image not trusted, or the wrong ETag");
+	CHECK(!index.lookup("host_1", 999).cached, "a file of another size was trusted");
+	CHECK(!index.lookup("host_1", -1).cached, "a missing file was trusted");
+	CHECK(index.lookup("host_1", 999).etag.empty(), "a file that doesn't match the index is revalidated");
+	found = index.lookup("host_2", 5);
+	CHECK(found.cached && found.etag.empty(), "an image without an ETag isn't cached, or has one");
+
+	index.record("host_1", 2000, "\"v2\"");
+	found = index.lookup("host_1", 2000);
+	CHECK(found.cached && found.etag == "\"v2\"" && !index.lookup("host_1", 1000).cached,
+	      "recording an image again didn't replace its entry");
+
+	std::ostringstream written;
+	CHECK(index.write(written), "write() failed");
+
+	// Lines a crash or an older version could have left behind
+	std::istringstream in(written.str() + "truncated\n" + "\n" + "host_4\t77\n");
+	BoxArtIndex reread;
+	reread.read(in);
+	CHECK(reread.size() == 4, "read back %zu entries, expected 4", reread.size());
+	for (const char *key : {"host_1", "host_2", "host_3"}) {
+		const long long size = !strcmp(key, "host_1") ? 2000 : !strcmp(key, "host_2") ? 5 : 42;
+		const BoxArtIndex::Lookup a = index.lookup(key, size), b = reread.lookup(key, size);
+		CHECK(a.cached == b.cached && a.etag == b.etag, "%s changed on the way through the file", key);
+	}
+	found = reread.lookup("host_4", 77);
+	CHECK(found.cached && found.etag.empty(), "an entry without the ETag field wasn't read");
+
+	std::ostringstream again;
+	reread.write(again);
+	CHECK(again.str() == written.str() + "host_4\t77\t\n", "writing the index again gave\n%s", again.str().c_str());
+}
+
+// The host's side of /appasset
+struct ArtHost {
+	std::string body = std::string(4000, 'a');
+	std::string etag = "\"v1\"";
+	int status = 200;
+	std::string lastIfNoneMatch;
+	int assetRequests = 0;
+
+	HostStubServer::Response handle(const HostStubServer::Request &request) {
+		HostStubServer::Response response;
+		lastIfNoneMatch = request.ifNoneMatch;
+		assetRequests++;
+		if (status != 200) {
+			response.status = status;
+			response.body = "<html>error</html>";
+		} else if (!etag.empty() && request.ifNoneMatch == etag) {
+			response.status = 304;
+		} else {
+			response.body = body;
+			response.etag = etag;
+		}
+		return response;
+	}
+};
+
+static long long fileSize(const std::string &path) {
+	struct stat st;
+	return stat(path.c_str(), &st) == 0 ? st.st_size : -1;
+}
+
+static std::string readFile(const std::string &path) {
+	std::ifstream file(path, std::ios::binary);
+	std::ostringstream data;
+	data << file.rdbuf();
+	return data.str();
+}
+
+enum FetchResult { SKIPPED, DOWNLOADED, NOT_MODIFIED, FAILED };
+
+// BoxArtCache::Fetch() for one app
+static FetchResult fetch(BoxArtIndex &index, SERVER_DATA &server, const std::string &key, const std::string &path,
+                         int appId) {
+	const BoxArtIndex::Lookup found = index.lookup(key, fileSize(path));
+	if (found.cached && found.etag.empty()) {
+		return SKIPPED;
+	}
+
+	APP_ASSET asset = {};
+	snprintf(asset.etag, sizeof(asset.etag), "%s", found.etag.c_str());
+	if (gs_appasset(&server, path.c_str(), appId, &asset) != GS_OK) {
+		return FAILED;
+	}
+	if (asset.notModified) {
+		return NOT_MODIFIED;
+	}
+	index.record(key, asset.size, asset.etag);
+	return DOWNLOADED;
+}
+
+static void testRevalidation(const std::string &directory, const std::string &certFile, const std::string &keyFile) {
+	ArtHost art;
+	HostStubServer host([&](const HostStubServer::Request &request) { return art.handle(request); });
+	if (!host.startHttps(certFile.c_str(), keyFile.c_str())) {
+		CHECK(false, "the stub host can't serve HTTPS");
+		return;
+	}
+
+	char address[] = "127.0.0.1";
+	SERVER_DATA server = {};
+	server.serverInfo.address = address;
+	server.httpsPort = host.httpsPort();
+
+	BoxArtIndex index;
+	const std::string key = "0123456789ABCDEF_42";
+	const std::string path = directory + key + ".png";
+
+	CHECK(fetch(index, server, key, path, 42) == DOWNLOADED, "first fetch didn't download");
+	CHECK(art.lastIfNoneMatch.empty(), "first fetch was conditional");
+	CHECK(readFile(path) == art.body, "downloaded image isn't what the host sent");
+	CHECK(index.lookup(key, (long long)art.body.size()).etag == art.etag, "the index didn't record the ETag");
+
+	// Nothing changed on the host
+	for (int i = 0; i < 3; i++) {
+		CHECK(fetch(index, server, key, path, 42) == NOT_MODIFIED, "revalidating an unchanged image didn't get a 304");
+		CHECK(art.lastIfNoneMatch == art.etag, "revalidation sent If-None-Match \"%s\"", art.lastIfNoneMatch.c_str());
+	}
+	CHECK(readFile(path) == art.body, "a 304 touched the cached image");
+	CHECK(fileSize(path + ".tmp") < 0, "a 304 left the download's temporary file behind");
+
+	// New art on the host
+	art.body = std::string(6000, 'b');
+	art.etag = "\"v2\"";
+	CHECK(fetch(index, server, key, path, 42) == DOWNLOADED, "changed art wasn't downloaded");
+	CHECK(readFile(path) == art.body, "changed art didn't replace the cached image");
+	CHECK(index.lookup(key, 6000).cached && index.lookup(key, 6000).etag == "\"v2\"", "the index kept the old entry");
+
+	// Errors and empty answers never replace what's cached
+	const std::string cachedArt = art.body;
+	art.status = 404;
+	CHECK(fetch(index, server, key, path, 42) == FAILED, "a 404 was accepted as box art");
+	art.status = 200;
+	art.body.clear();
+	art.etag = "\"v3\"";
+	CHECK(fetch(index, server, key, path, 42) == FAILED, "an empty image was accepted");
+	CHECK(readFile(path) == cachedArt, "a failed fetch replaced the cached image");
+	CHECK(index.lookup(key, (long long)cachedArt.size()).etag == "\"v2\"", "a failed fetch changed the index");
+	CHECK(fileSize(path + ".tmp") < 0, "a failed fetch left its temporary file behind");
+
+	// The file on disk isn't the one in the index, so it can't be revalidated
+	art.body = std::string(3000, 'c');
+	{
+		std::ofstream damaged(path, std::ios::binary | std::ios::trunc);
+		damaged << "not the image";
+	}
+	CHECK(fetch(index, server, key, path, 42) == DOWNLOADED, "an image that doesn't match the index wasn't downloaded");
+	CHECK(art.lastIfNoneMatch.empty(), "an image that doesn't match the index was revalidated");
+	CHECK(readFile(path) == art.body, "the damaged image wasn't replaced");
+
+	// A host that sends no ETag is never asked again once the image is cached
+	art.etag.clear();
+	CHECK(fetch(index, server, key, path, 42) == DOWNLOADED, "the conditional fetch didn't download the new art");
+	const int requests = art.assetRequests;
+	CHECK(fetch(index, server, key, path, 42) == SKIPPED, "an image without an ETag was fetched again");
+	CHECK(art.assetRequests == requests, "an image without an ETag cost a request");
+
+	printf("revalidation: %d requests over %d connections\n", host.requests(), host.connections());
+	unlink(path.c_str());
+}
+
+int main(int argc, char **argv) {
+	curl_global_init(CURL_GLOBAL_ALL);
+
+	char directory[] = "/tmp/box-art-test-XXXXXX";
+	if (!mkdtemp(directory)) {
+		perror("mkdtemp");
+		return 1;
+	}
+	const std::string dir = std::string(directory) + "/";
+	const std::string certFile = dir + CERTIFICATE_FILE_NAME;
+	const std::string keyFile = dir + KEY_FILE_NAME;
+	const std::string p12File = dir + "client.p12";
+
+	// The host and the client share one certificate, neither side checks the other's
+	CERT_KEY_PAIR cert = mkcert_generate();
+	mkcert_save(certFile.c_str(), p12File.c_str(), keyFile.c_str(), cert);
+	mkcert_free(cert);
+	http_init(dir.c_str(), 0);
+
+	testIndex();
+	testRevalidation(dir, certFile, keyFile);
+
+	for (const std::string &file : {certFile, keyFile, p12File}) {
+		unlink(file.c_str());
+	}
+	rmdir(directory);
+	curl_global_cleanup();
+
+	printf("%d failures\n", g_failures);
+	return g_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,66 @@
+#include "pch.h"
+#include "ConnectionPrewarmer.h"
+#include "Utils.hpp"
+
+using namespace moonlight_xbox_dx;
+
+ConnectionPrewarmer &ConnectionPrewarmer::instance() {
+	static ConnectionPrewarmer inst;
+	return inst;
+}
+
+void ConnectionPrewarmer::Prewarm(Platform::String ^ hostname) {
+	if (hostname == nullptr) return;
+
+	uint64_t generation;
+	concurrency::cancellation_token token = concurrency::cancellation_token::none();
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		generation = m_slot.begin(hostname->Data());
+		if (generation == 0) return;
+
+		m_cancel.cancel();
+		m_cancel = concurrency::cancellation_token_source();
+		token = m_cancel.get_token();
+	}
+
+	concurrency::create_task([this, hostname, generation, token]() {
+		auto client = std::make_unique<MoonlightClient>();
+		std::string host = Utils::PlatformStringToStdString(hostname);
+		int status = client->Connect(host.c_str(), CONNECT_TIMEOUT_MS);
+
+		std::vector<MoonlightApp ^> apps;
+		if (status == 0 && client->IsPaired() && !token.is_canceled()) {
+			apps = client->GetApplications(false);
+		}
+
+		// Dropped if focus moved on, nobody wants this anymore
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_slot.finish(generation, status == 0, std::move(client), std::move(apps));
+	}, token);
+}
+
+void ConnectionPrewarmer::Cancel() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_cancel.cancel();
+	m_cancel = concurrency::cancellation_token_source();
+	m_slot.cancel();
+}
+
+bool ConnectionPrewarmer::ClaimServerData(Platform::String ^ hostname, MoonlightClient &client) {
+	if (hostname == nullptr) return false;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::unique_ptr<MoonlightClient> prewarmed = m_slot.claimClient(hostname->Data());
+	if (prewarmed == nullptr) return false;
+
+	client.TakeServerData(*prewarmed);
+	return true;
+}
+
+bool ConnectionPrewarmer::ClaimApps(Platform::String ^ hostname, std::vector<MoonlightApp ^> &apps) {
+	if (hostname == nullptr) return false;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_slot.claimApps(hostname->Data(), apps);
+}
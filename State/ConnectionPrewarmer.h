@@ -0,0 +1,45 @@
+#pragma once
+
+#include <mutex>
+#include <ppltasks.h>
+#include <vector>
+#include "State\MoonlightClient.h"
+#include "State\PrewarmSlot.h"
+
+namespace moonlight_xbox_dx {
+
+// Speculatively connects to the host whose tile has focus, so launching it doesn't start from cold.
+//
+// A prewarm fetches serverinfo, which opens and authenticates the HTTPS connection that stays
+// in the libgamestream pool. For a paired host it also fetches the app list. StartStreaming and
+// UpdateApps claim the results if they are younger than MAX_AGE_MS, and fall back to fetching them
+// themselves otherwise. Only one host is warmed at a time. Prewarming another host or calling
+// Cancel() abandons the previous one: requests already on the wire finish within
+// CONNECT_TIMEOUT_MS, but their results are dropped and the later stages are skipped.
+class ConnectionPrewarmer {
+  public:
+	// Singleton
+	static ConnectionPrewarmer &instance();
+
+	void Prewarm(Platform::String ^ hostname);
+	void Cancel();
+
+	// Hands the prewarmed serverinfo for hostname over to client. Returns false if there is none
+	// or it is too old, in which case the caller connects as usual.
+	bool ClaimServerData(Platform::String ^ hostname, MoonlightClient &client);
+	bool ClaimApps(Platform::String ^ hostname, std::vector<MoonlightApp ^> &apps);
+
+	static constexpr int MAX_AGE_MS = 10000;
+	static constexpr long CONNECT_TIMEOUT_MS = 3000;
+
+  private:
+	ConnectionPrewarmer() = default;
+	ConnectionPrewarmer(const ConnectionPrewarmer &) = delete;
+	ConnectionPrewarmer &operator=(const ConnectionPrewarmer &) = delete;
+
+	std::mutex m_mutex;
+	concurrency::cancellation_token_source m_cancel;
+	PrewarmSlot<MoonlightClient, MoonlightApp ^> m_slot{MAX_AGE_MS};
+};
+
+} // namespace moonlight_xbox_dx
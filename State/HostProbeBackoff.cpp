@@ -0,0 +1,42 @@
+#include "pch.h"
+#include "HostProbeBackoff.h"
+#include <algorithm>
+
+using namespace moonlight_xbox_dx;
+
+bool HostProbeBackoff::begin(const std::wstring &host, bool force) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	ProbeState &state = m_states[host];
+
+	if (state.inFlight) {
+		return false; // still waiting on the previous probe
+	}
+	if (!force && state.failures > 0 && QpcNow() < state.nextProbeQpc) {
+		return false;
+	}
+
+	state.inFlight = true;
+	return true;
+}
+
+void HostProbeBackoff::end(const std::wstring &host, bool connected) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	ProbeState &state = m_states[host];
+	state.inFlight = false;
+
+	if (connected) {
+		state.failures = 0;
+		return;
+	}
+
+	state.failures++;
+	state.nextProbeQpc = QpcNow() + MsToQpc((double)delayMs(state.failures));
+}
+
+int64_t HostProbeBackoff::delayMs(int failures) {
+	if (failures <= 0) {
+		return 0;
+	}
+	const int shift = std::min(failures - 1, 8);
+	return std::min((int64_t)BACKOFF_BASE_MS << shift, (int64_t)BACKOFF_MAX_MS);
+}
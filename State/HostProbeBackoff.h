@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace moonlight_xbox_dx {
+
+// Decides which saved hosts HostProbeScheduler probes in a round.
+//
+// A host is never probed twice at once. A host that doesn't answer is skipped until its deadline,
+// BACKOFF_BASE_MS after the first failure and doubling with every further one up to
+// BACKOFF_MAX_MS, unless the round is forced. One answer clears the backoff. Time is QpcNow(), so
+// the host tools can run it on a virtual clock.
+class HostProbeBackoff {
+  public:
+	// Returns true if host is due, and marks it in flight until end()
+	bool begin(const std::wstring &host, bool force);
+	void end(const std::wstring &host, bool connected);
+
+	// How long a failed host is skipped for after its nth failure in a row
+	static int64_t delayMs(int failures);
+
+	static constexpr int BACKOFF_BASE_MS = 5000;
+	static constexpr int BACKOFF_MAX_MS = 60000;
+
+  private:
+	struct ProbeState {
+		int failures = 0;
+		int64_t nextProbeQpc = 0;
+		bool inFlight = false;
+	};
+
+	std::mutex m_mutex;
+	std::map<std::wstring, ProbeState> m_states;
+};
+
+} // namespace moonlight_xbox_dx
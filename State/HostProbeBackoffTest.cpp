@@ -0,0 +1,186 @@
+// Deadline and backoff suite for HostProbeBackoff, built on the host rather than into the app
+//
+// Runs on a virtual clock. A host that fails must be skipped until exactly its deadline, 5s after
+// the first failure and doubling up to 60s, and probed again from then on. A forced round must
+// probe it anyway, one answer must clear the backoff, a host in flight must never be handed out
+// twice, and every host must keep its own state. A scripted run of probe rounds checks which hosts
+// are probed when, against the delays worked out by hand.
+//
+// Built through Tools/CMakeLists.txt.
+
+#include "pch.h"
+#include "HostProbeBackoff.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace moonlight_xbox_dx;
+
+static int g_failures = 0;
+
+#define CHECK(cond, ...)                                     \
+	do {                                                     \
+		if (!(cond)) {                                       \
+			fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+			fprintf(stderr, __VA_ARGS__);                    \
+			fprintf(stderr, "\n");                           \
+			g_failures++;                                    \
+		}                                                    \
+	} while (0)
+
+// HostProbeScheduler::PROBE_TIMEOUT_MS, how long a probe of an offline host can take
+static const double PROBE_TIMEOUT_MS = 3000;
+
+static int64_t g_nowQpc = 0;
+
+static int64_t virtualQpcNow() {
+	return g_nowQpc;
+}
+
+static void advanceMs(double ms) {
+	g_nowQpc += MsToQpc(ms);
+}
+
+static void testDelays() {
+	const int64_t expected[] = {0, 5000, 10000, 20000, 40000, 60000, 60000, 60000, 60000, 60000, 60000};
+	for (int failures = 0; failures < (int)(sizeof(expected) / sizeof(expected[0])); failures++) {
+		CHECK(HostProbeBackoff::delayMs(failures) == expected[failures], "delay after %d failures is %lld ms, expected %lld",
+		      failures, (long long)HostProbeBackoff::delayMs(failures), (long long)expected[failures]);
+	}
+	// The shift is capped, so a host that has been off for days doesn't overflow it
+	CHECK(HostProbeBackoff::delayMs(1000000) == HostProbeBackoff::BACKOFF_MAX_MS, "delay after a million failures is %lld",
+	      (long long)HostProbeBackoff::delayMs(1000000));
+}
+
+// Each failure pushes the deadline out, the host is due again exactly on it
+static void testDeadlines() {
+	HostProbeBackoff backoff;
+	const std::wstring host = L"10.0.0.2";
+
+	for (int failures = 1; failures <= 7; failures++) {
+		CHECK(backoff.begin(host, false), "host not due after %d failures", failures - 1);
+		backoff.end(host, false);
+
+		const int64_t delayMs = HostProbeBackoff::delayMs(failures);
+		advanceMs((double)delayMs - 1);
+		CHECK(!backoff.begin(host, false), "host probed 1 ms before its deadline, %lld ms after failure %d",
+		      (long long)delayMs, failures);
+		advanceMs(1);
+	}
+
+	// The deadline is counted from when the probe finished, a slow probe doesn't eat into it
+	CHECK(backoff.begin(host, false), "host not due after its last deadline");
+	advanceMs(PROBE_TIMEOUT_MS);
+	backoff.end(host, false);
+	advanceMs(HostProbeBackoff::BACKOFF_MAX_MS - 1);
+	CHECK(!backoff.begin(host, false), "backoff counted from the start of a slow probe");
+	advanceMs(1);
+	CHECK(backoff.begin(host, false), "host not due once the backoff ran out");
+	backoff.end(host, true);
+}
+
+static void testForceAndRecovery() {
+	HostProbeBackoff backoff;
+	const std::wstring host = L"gaming-pc.local";
+
+	for (int i = 0; i < 3; i++) {
+		CHECK(backoff.begin(host, true), "forced probe refused");
+		backoff.end(host, false);
+	}
+	// Forcing doesn't clear the backoff, the failures still count
+	advanceMs(HostProbeBackoff::delayMs(3) - 1);
+	CHECK(!backoff.begin(host, false), "forced probes reset the backoff");
+	CHECK(backoff.begin(host, true), "forced probe refused while backing off");
+
+	// One answer and the host is due on every round again
+	backoff.end(host, true);
+	for (int i = 0; i < 5; i++) {
+		CHECK(backoff.begin(host, false), "host that answered is backed off, round %d", i);
+		backoff.end(host, true);
+	}
+
+	// And a later failure starts from the base delay again
+	CHECK(backoff.begin(host, false), "host not due");
+	backoff.end(host, false);
+	advanceMs(HostProbeBackoff::BACKOFF_BASE_MS);
+	CHECK(backoff.begin(host, false), "backoff after recovering didn't start over from %d ms",
+	      HostProbeBackoff::BACKOFF_BASE_MS);
+	backoff.end(host, true);
+}
+
+static void testInFlight() {
+	HostProbeBackoff backoff;
+	const std::wstring host = L"10.0.0.3";
+
+	CHECK(backoff.begin(host, false), "idle host not due");
+	CHECK(!backoff.begin(host, false), "host handed out twice");
+	CHECK(!backoff.begin(host, true), "host handed out twice by a forced round");
+	advanceMs(HostProbeBackoff::BACKOFF_MAX_MS * 2.0);
+	CHECK(!backoff.begin(host, false), "host handed out twice once the probe ran long");
+	backoff.end(host, true);
+	CHECK(backoff.begin(host, false), "host not due once its probe finished");
+	backoff.end(host, true);
+}
+
+// ProbeAll() rounds every 2s, as the host list refreshes, with two hosts offline for a while
+static void testRounds() {
+	struct Host {
+		std::wstring name;
+		int64_t onlineAfterMs; // -1 never
+		std::vector<int64_t> probedAtMs;
+	};
+	std::vector<Host> hosts = {
+		{L"always-on", 0, {}},
+		{L"back-after-30s", 30000, {}},
+		{L"offline", -1, {}},
+	};
+
+	HostProbeBackoff backoff;
+	const int64_t startQpc = g_nowQpc;
+	for (int64_t t = 0; t <= 150000; t += 2000) {
+		g_nowQpc = startQpc + MsToQpc((double)t);
+		for (Host &h : hosts) {
+			if (backoff.begin(h.name, false)) {
+				h.probedAtMs.push_back(t);
+				backoff.end(h.name, h.onlineAfterMs >= 0 && t >= h.onlineAfterMs);
+			}
+		}
+	}
+
+	// Worked out by hand: a failed host is next probed on the first round at or past its deadline
+	const std::vector<int64_t> expected[] = {
+		{},
+		{0, 6000, 16000, 36000, 38000},
+		{0, 6000, 16000, 36000, 76000, 136000},
+	};
+	CHECK(hosts[0].probedAtMs.size() == 76, "always-on host probed %zu times, expected every round",
+	      hosts[0].probedAtMs.size());
+	for (size_t i = 1; i < hosts.size(); i++) {
+		std::vector<int64_t> probed = hosts[i].probedAtMs;
+		if (i == 1) {
+			probed.resize(std::min(probed.size(), expected[i].size()));
+		}
+		CHECK(probed == expected[i], "%ls probed at the wrong times", hosts[i].name.c_str());
+		printf("%-16ls probed at", hosts[i].name.c_str());
+		for (size_t p = 0; p < std::min(hosts[i].probedAtMs.size(), (size_t)8); p++) {
+			printf(" %llds", (long long)hosts[i].probedAtMs[p] / 1000);
+		}
+		printf("%s\n", hosts[i].probedAtMs.size() > 8 ? " ..." : "");
+	}
+	CHECK(hosts[1].probedAtMs.size() == 5 + (150000 - 38000) / 2000,
+	      "host that came back is probed %zu times, expected every round from 38s", hosts[1].probedAtMs.size());
+}
+
+int main(int argc, char **argv) {
+	g_HostQpcNow = virtualQpcNow;
+
+	testDelays();
+	testDeadlines();
+	testForceAndRecovery();
+	testInFlight();
+	testRounds();
+
+	printf("%d failures\n", g_failures);
+	return g_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,52 @@
+#include "pch.h"
+#include "HostProbeScheduler.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "Utils.hpp"
+
+using namespace moonlight_xbox_dx;
+
+HostProbeScheduler &HostProbeScheduler::instance() {
+	static HostProbeScheduler inst;
+	return inst;
+}
+
+concurrency::task<void> HostProbeScheduler::ProbeAll(Windows::Foundation::Collections::IVector<MoonlightHost ^> ^ hosts, bool showLoading, bool force) {
+	// Take a snapshot, SavedHosts may change while we're probing
+	auto due = std::make_shared<std::vector<MoonlightHost ^>>();
+	for (auto host : hosts) {
+		if (m_backoff.begin(host->LastHostname->Data(), force)) {
+			due->push_back(host);
+		}
+	}
+
+	if (due->empty()) {
+		return concurrency::task_from_result();
+	}
+
+	// Each worker takes the next host until there are none left
+	auto next = std::make_shared<std::atomic<size_t>>(0);
+	const size_t workerCount = std::min(due->size(), (size_t)MAX_CONCURRENT_PROBES);
+	std::vector<concurrency::task<void>> workers;
+	for (size_t w = 0; w < workerCount; w++) {
+		workers.push_back(concurrency::create_task([this, due, next, showLoading]() {
+			size_t i;
+			while ((i = next->fetch_add(1)) < due->size()) {
+				MoonlightHost ^ host = (*due)[i];
+				bool connected = false;
+				try {
+					host->ProbeHostInfo(showLoading, PROBE_TIMEOUT_MS);
+					connected = host->Connected;
+				}
+				catch (...) {
+					Utils::Log("HostProbeScheduler: probe threw an exception\n");
+				}
+				m_backoff.end(host->LastHostname->Data(), connected);
+			}
+		}));
+	}
+
+	return concurrency::when_all(workers.begin(), workers.end());
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <ppltasks.h>
+#include "State\HostProbeBackoff.h"
+#include "State\MoonlightHost.h"
+
+namespace moonlight_xbox_dx {
+
+// Refreshes the status of saved hosts in parallel.
+//
+// At most MAX_CONCURRENT_PROBES hosts are probed at once, and each status request gives up after
+// PROBE_TIMEOUT_MS, so an offline host can't hold up the others. Every MoonlightHost updates its
+// own bound properties, so results reach the UI as each probe finishes rather than at the end.
+// Hosts that don't answer are skipped by later rounds with an exponential backoff, unless forced,
+// see HostProbeBackoff.
+class HostProbeScheduler {
+  public:
+	// Singleton
+	static HostProbeScheduler &instance();
+
+	// Probes every host that is due. The task completes once all of them have finished.
+	// force ignores the backoff, e.g. when the user opens the host list.
+	concurrency::task<void> ProbeAll(Windows::Foundation::Collections::IVector<MoonlightHost ^> ^ hosts, bool showLoading, bool force);
+
+	static constexpr int MAX_CONCURRENT_PROBES = 4;
+	static constexpr long PROBE_TIMEOUT_MS = 3000;
+
+  private:
+	HostProbeScheduler() = default;
+	HostProbeScheduler(const HostProbeScheduler &) = delete;
+	HostProbeScheduler &operator=(const HostProbeScheduler &) = delete;
+
+	HostProbeBackoff m_backoff; // keyed by LastHostname
+};
+
+} // namespace moonlight_xbox_dx
@@ -1,19 +1,11 @@
 #include "pch.h"
-#include <mdns.h>
+#include "MDNSHandler.h"
+#include <algorithm>
 #include <Utils.hpp>
 
 using namespace moonlight_xbox_dx;
 using namespace Windows::Networking::Connectivity;
 
-static char addrbuffer[64];
-static char entrybuffer[256];
-static char namebuffer[256];
-static char sendbuffer[1024];
-static int  mdns_buffer[4096];
-static int sockets[8] = { 0,0,0,0,0,0,0,0 };
-static mdns_record_txt_t txtbuffer[128];
-static std::map<std::string, std::string> hostnames;
-static std::map<std::string, uint16_t> ports;
 
 static mdns_string_t
 ipv4_address_to_string(char* buffer, size_t capacity, const struct sockaddr_in* addr,
@@ -67,66 +59,270 @@ ip_address_to_string(char* buffer, size_t capacity, const struct sockaddr* addr,
 }
 
 
-// Callback handling parsing answers to queries sent
-static int
-query_callback(int sock, const struct sockaddr* from, size_t addrlen, mdns_entry_type_t entry,
-	uint16_t query_id, uint16_t rtype, uint16_t rclass, uint32_t ttl, const void* data,
-	size_t size, size_t name_offset, size_t name_length, size_t record_offset,
-	size_t record_length, void* user_data) {
+static const char *SERVICE_NAME = "_nvstream._tcp.local";
+
+// Whether the record at nameOffset is named "<instance>._nvstream._tcp.local."
+static bool isServiceInstance(const void *data, size_t size, size_t nameOffset) {
+	char name[256];
+	mdns_string_t str = mdns_string_extract(data, size, &nameOffset, name, sizeof(name));
+	size_t length = str.length;
+	if (length > 0 && str.str[length - 1] == '.') length--;
+	size_t serviceLength = strlen(SERVICE_NAME);
+	return length > serviceLength && str.str[length - serviceLength - 1] == '.' &&
+	       _strnicmp(str.str + length - serviceLength, SERVICE_NAME, serviceLength) == 0;
+}
+
+MDNSHandler &MDNSHandler::instance() {
+	static MDNSHandler inst;
+	return inst;
+}
+
+void MDNSHandler::Start() {
+	std::lock_guard<std::mutex> lock(m_lifecycleMutex);
+	if (m_running.load()) {
+		m_restartBackoff.store(true);
+		wake();
+		return;
+	}
+
+	static std::once_flag wsaInit;
+	std::call_once(wsaInit, []() {
+		WSADATA wsaData;
+		WSAStartup(MAKEWORD(2, 2), &wsaData);
+	});
+
+	openSockets();
+	m_hosts.clear();
+	m_queryIntervalMs = FIRST_QUERY_INTERVAL_MS;
+	m_nextQuery = Clock::now();
+	m_running.store(true);
+	m_thread = std::thread([this]() { run(); });
+}
+
+void MDNSHandler::Stop() {
+	std::lock_guard<std::mutex> lock(m_lifecycleMutex);
+	if (!m_running.exchange(false)) return;
+	wake();
+	if (m_thread.joinable()) m_thread.join();
+	closeSockets();
+}
+
+void MDNSHandler::openSockets() {
+	m_socketCount = 0;
+	m_maxQueryIntervalMs = MAX_QUERY_INTERVAL_MS;
+	for (auto h : NetworkInformation::GetHostNames()) {
+		if (h->IPInformation == nullptr || h->Type != Windows::Networking::HostNameType::Ipv4) continue;
+		if (m_socketCount == MAX_SOCKETS) {
+			Utils::Log("MDNSHandler: too many interfaces, ignoring the rest\n");
+			break;
+		}
+		std::string address = Utils::PlatformStringToStdString(h->ToString());
+		sockaddr_in addr = {};
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(MDNS_PORT);
+		inet_pton(AF_INET, address.c_str(), &addr.sin_addr.s_addr);
+		// Joins the mDNS group on this interface. Bound to the mDNS port, mdns_query_send asks for
+		// multicast answers and we also hear announcements and goodbyes.
+		int sock = mdns_socket_open_ipv4(&addr);
+		if (sock < 0) {
+			// Something holds the port exclusively. Unicast answers still work, but announcements and
+			// goodbyes won't reach us, so keep querying at least once a minute.
+			Utils::Logf("MDNSHandler: can't bind the mDNS port on %s, using unicast answers\n", address.c_str());
+			addr.sin_port = 0;
+			sock = mdns_socket_open_ipv4(&addr);
+			if (sock >= 0) m_maxQueryIntervalMs = MAX_UNICAST_QUERY_INTERVAL_MS;
+		}
+		if (sock >= 0) m_sockets[m_socketCount++] = sock;
+	}
+	openWakeSocket();
+}
+
+void MDNSHandler::closeSockets() {
+	for (int i = 0; i < m_socketCount; i++) {
+		mdns_socket_close(m_sockets[i]);
+	}
+	m_socketCount = 0;
+	if (m_wakeSocket >= 0) {
+		closesocket((SOCKET)m_wakeSocket);
+		m_wakeSocket = -1;
+	}
+}
+
+void MDNSHandler::openWakeSocket() {
+	SOCKET sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (sock == INVALID_SOCKET) {
+		Utils::Log("MDNSHandler: can't open the wakeup socket, polling for Stop() instead\n");
+		return;
+	}
+	sockaddr_in addr = {};
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	int addrlen = sizeof(addr);
+	u_long nonBlocking = 1;
+	if (bind(sock, (sockaddr *)&addr, sizeof(addr)) != 0 || getsockname(sock, (sockaddr *)&addr, &addrlen) != 0 ||
+	    connect(sock, (sockaddr *)&addr, addrlen) != 0 || ioctlsocket(sock, FIONBIO, &nonBlocking) != 0) {
+		Utils::Log("MDNSHandler: can't open the wakeup socket, polling for Stop() instead\n");
+		closesocket(sock);
+		return;
+	}
+	m_wakeSocket = (int)sock;
+}
+
+void MDNSHandler::wake() {
+	if (m_wakeSocket < 0) return;
+	char byte = 0;
+	send((SOCKET)m_wakeSocket, &byte, sizeof(byte), 0);
+}
+
+void MDNSHandler::drainWakeSocket() {
+	char byte;
+	while (recv((SOCKET)m_wakeSocket, &byte, sizeof(byte), 0) > 0) {
+	}
+}
+
+void MDNSHandler::run() {
+	while (m_running.load()) {
+		auto now = Clock::now();
+		if (m_restartBackoff.exchange(false)) {
+			m_queryIntervalMs = FIRST_QUERY_INTERVAL_MS;
+			m_nextQuery = now;
+		}
+
+		bool query = now >= m_nextQuery;
+		if (query) {
+			m_nextQuery = now + std::chrono::milliseconds(m_queryIntervalMs);
+			m_queryIntervalMs = std::min(m_queryIntervalMs * 2, m_maxQueryIntervalMs);
+		}
+
+		// Ask again before a host's records run out, so a host that is still there isn't dropped
+		for (auto &entry : m_hosts) {
+			CachedHost &host = entry.second;
+			if (host.complete() && !host.refreshQueried && now >= host.refreshAt) {
+				host.refreshQueried = true;
+				query = true;
+			}
+		}
+		if (query) sendQueries();
+
+		expireHosts(now);
+
+		// Sleep until a response arrives, Start() or Stop() wakes us up, or the next deadline
+		auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(nextWakeup(now) - now).count();
+		wait = std::max<long long>(0, wait);
+		if (m_wakeSocket < 0) wait = std::min<long long>(wait, STOP_CHECK_INTERVAL_MS);
+
+		fd_set readable;
+		FD_ZERO(&readable);
+		int maxSocket = 0;
+		for (int i = 0; i < m_socketCount; i++) {
+			FD_SET(m_sockets[i], &readable);
+			maxSocket = std::max(maxSocket, m_sockets[i]);
+		}
+		if (m_wakeSocket >= 0) {
+			FD_SET(m_wakeSocket, &readable);
+			maxSocket = std::max(maxSocket, m_wakeSocket);
+		} else if (m_socketCount == 0) {
+			Sleep((DWORD)wait);
+			continue;
+		}
+
+		timeval timeout;
+		timeout.tv_sec = (long)(wait / 1000);
+		timeout.tv_usec = (long)((wait % 1000) * 1000);
+		int ready = select(maxSocket + 1, &readable, NULL, NULL, &timeout);
+		if (ready <= 0) continue;
+
+		if (m_wakeSocket >= 0 && FD_ISSET(m_wakeSocket, &readable)) drainWakeSocket();
+
+		for (int i = 0; i < m_socketCount; i++) {
+			if (FD_ISSET(m_sockets[i], &readable)) receive(m_sockets[i]);
+		}
+	}
+}
+
+void MDNSHandler::sendQueries() {
+	for (int i = 0; i < m_socketCount; i++) {
+		mdns_query_send(m_sockets[i], MDNS_RECORDTYPE_PTR, SERVICE_NAME, strlen(SERVICE_NAME), m_packetBuffer, sizeof(m_packetBuffer), 0);
+	}
+}
+
+void MDNSHandler::receive(int sock) {
+	mdns_query_recv(sock, m_packetBuffer, sizeof(m_packetBuffer), queryCallback, this, 0);
+}
+
+int MDNSHandler::queryCallback(int sock, const struct sockaddr *from, size_t addrlen, mdns_entry_type_t entry,
+                               uint16_t query_id, uint16_t rtype, uint16_t rclass, uint32_t ttl, const void *data,
+                               size_t size, size_t name_offset, size_t name_length, size_t record_offset,
+                               size_t record_length, void *user_data) {
 	(void)sizeof(sock);
+	(void)sizeof(entry);
 	(void)sizeof(query_id);
+	(void)sizeof(rclass);
 	(void)sizeof(name_length);
-	(void)sizeof(user_data);
-	mdns_string_t fromaddrstr = ip_address_to_string(addrbuffer, sizeof(addrbuffer), from, addrlen);
-	const char* entrytype = (entry == MDNS_ENTRYTYPE_ANSWER) ? "answer" : ((entry == MDNS_ENTRYTYPE_AUTHORITY) ? "authority" : "additional");
-	mdns_string_t entrystr = mdns_string_extract(data, size, &name_offset, entrybuffer, sizeof(entrybuffer));
-	auto key = std::string(fromaddrstr.str);
+	MDNSHandler *self = (MDNSHandler *)user_data;
+	mdns_string_t fromaddrstr = ip_address_to_string(self->m_addressBuffer, sizeof(self->m_addressBuffer), from, addrlen);
+	self->onRecord(std::string(fromaddrstr.str, fromaddrstr.length), rtype, ttl, data, size, name_offset, record_offset, record_length);
+	return 0;
+}
+
+void MDNSHandler::onRecord(const std::string &responder, uint16_t rtype, uint32_t ttl, const void *data, size_t size,
+                           size_t nameOffset, size_t recordOffset, size_t recordLength) {
+	if (rtype != MDNS_RECORDTYPE_SRV && rtype != MDNS_RECORDTYPE_A) return;
+
+	// On the mDNS port we see every service announced on the network, only take ports from GameStream
+	// hosts. An A record can't be matched by name, it only counts once the same responder sends an SRV.
+	if (rtype == MDNS_RECORDTYPE_SRV && !isServiceInstance(data, size, nameOffset)) return;
+
+	// A TTL of zero is a goodbye, the record expires right away
+	auto now = Clock::now();
+	auto expiry = now + std::chrono::seconds(ttl);
+	CachedHost &host = m_hosts[responder];
+
 	if (rtype == MDNS_RECORDTYPE_SRV) {
-		mdns_record_srv_t srv = mdns_record_parse_srv(data, size, record_offset, record_length,
-			namebuffer, sizeof(namebuffer));
-		ports.emplace(key, srv.port);
-	}
-	else if (rtype == MDNS_RECORDTYPE_A) {
+		mdns_record_srv_t srv = mdns_record_parse_srv(data, size, recordOffset, recordLength, m_nameBuffer, sizeof(m_nameBuffer));
+		host.port = srv.port;
+		host.portExpiry = expiry;
+	} else {
 		struct sockaddr_in addr;
-		mdns_record_parse_a(data, size, record_offset, record_length, &addr);
-		mdns_string_t addrstr =
-			ipv4_address_to_string(namebuffer, sizeof(namebuffer), &addr, sizeof(addr));
-		hostnames.emplace(key,std::string(addrstr.str));
-		
+		mdns_record_parse_a(data, size, recordOffset, recordLength, &addr);
+		mdns_string_t addrstr = ipv4_address_to_string(m_nameBuffer, sizeof(m_nameBuffer), &addr, sizeof(addr));
+		host.address = std::string(addrstr.str, addrstr.length);
+		host.addressExpiry = expiry;
 	}
-	if (ports.count(key) && hostnames.count(key)) {
-		auto hostname = hostnames[key];
-		auto hostnamePlusPort = Utils::StringFromStdString(hostname) + ":" + ports[key];
-		GetApplicationState()->AddHost(hostnamePlusPort);
-		hostnames.erase(key);
-		ports.erase(key);
+
+	if (!host.complete() || host.expiry() <= now) return;
+
+	host.refreshAt = now + (host.expiry() - now) * 4 / 5;
+	host.refreshQueried = false;
+	if (!host.announced) {
+		host.announced = true;
+		if (OnHostFound) OnHostFound(host.address + ":" + std::to_string(host.port));
 	}
-	return 0;
 }
 
+MDNSHandler::Clock::time_point MDNSHandler::CachedHost::expiry() const {
+	if (port == 0) return addressExpiry;
+	if (address.empty()) return portExpiry;
+	return std::min(addressExpiry, portExpiry);
+}
 
-void init_mdns() {
-	WSADATA wsaData;
-	WSAStartup(MAKEWORD(2, 2), &wsaData);
-	int k = 0;
-	for (auto h : NetworkInformation::GetHostNames()) {
-		if (h->IPInformation == nullptr || h->Type != Windows::Networking::HostNameType::Ipv4)continue;
-		auto ip = h->ToString();
-		sockaddr_in addr;
-		addr.sin_family = AF_INET;
-		addr.sin_port = 0;
-		inet_pton(AF_INET, Utils::PlatformStringToStdString(ip).c_str(), &addr.sin_addr.s_addr);
-		sockets[k] = mdns_socket_open_ipv4(&addr);
-		auto str = "_nvstream._tcp.local";
-		mdns_query_send(sockets[k], MDNS_RECORDTYPE_PTR, str, strlen(str), &mdns_buffer, 4096, 0);
-		k++;
+void MDNSHandler::expireHosts(Clock::time_point now) {
+	for (auto it = m_hosts.begin(); it != m_hosts.end();) {
+		if (it->second.expiry() > now) {
+			++it;
+			continue;
+		}
+		if (it->second.announced && OnHostLost) OnHostLost(it->second.address + ":" + std::to_string(it->second.port));
+		it = m_hosts.erase(it);
 	}
 }
 
-int query_mdns() {
-	for (int i = 0; i < 8; i++) {
-		if (sockets[i] == 0) break;
-		mdns_query_recv(sockets[i], &mdns_buffer, 4096, query_callback, NULL, 0);
+MDNSHandler::Clock::time_point MDNSHandler::nextWakeup(Clock::time_point now) const {
+	auto next = m_nextQuery;
+	for (auto &entry : m_hosts) {
+		const CachedHost &host = entry.second;
+		next = std::min(next, host.expiry());
+		if (host.complete() && !host.refreshQueried) next = std::min(next, host.refreshAt);
 	}
-	return 0;
-}
\ No newline at end of file
+	return std::max(next, now);
+}
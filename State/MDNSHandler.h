@@ -1,5 +1,108 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <mdns.h>
 
-void init_mdns();
-int query_mdns();
\ No newline at end of file
+namespace moonlight_xbox_dx {
+
+// Discovers GameStream hosts (_nvstream._tcp.local) over mDNS.
+//
+// A dedicated thread waits on the sockets of every interface at once and handles responses as
+// soon as they arrive. The sockets are bound to the mDNS port and join the mDNS group, so they
+// also see hosts announcing themselves and saying goodbye, and queries ask for multicast answers.
+// Queries are repeated with the RFC 6762 continuous querying backoff (one second, doubling up to
+// an hour), and again once a known host reaches 80% of its TTL. If the mDNS port can't be shared,
+// an interface falls back to an ephemeral port that only gets unicast answers, and the backoff
+// stops at a minute instead. A host is reported through OnHostFound as soon as both its address
+// and port are known, and through OnHostLost when its records expire or it says goodbye.
+// Callbacks run on the discovery thread.
+class MDNSHandler {
+  public:
+	// Singleton
+	static MDNSHandler &instance();
+
+	// Opens a socket per IPv4 interface and starts the discovery thread. Calling it while
+	// already running restarts the query backoff, so a query goes out right away.
+	void Start();
+	void Stop();
+
+	// Receive "address:port", as ApplicationState::AddHost expects. Set them before Start.
+	std::function<void(const std::string &host)> OnHostFound;
+	std::function<void(const std::string &host)> OnHostLost;
+
+	static constexpr int MAX_SOCKETS = 8;
+	static constexpr int FIRST_QUERY_INTERVAL_MS = 1000;
+	static constexpr int MAX_QUERY_INTERVAL_MS = 60 * 60 * 1000;
+	static constexpr int MAX_UNICAST_QUERY_INTERVAL_MS = 60 * 1000;
+	// Only used if the wakeup socket couldn't be opened
+	static constexpr int STOP_CHECK_INTERVAL_MS = 250;
+
+  private:
+	using Clock = std::chrono::steady_clock;
+
+	MDNSHandler() = default;
+	MDNSHandler(const MDNSHandler &) = delete;
+	MDNSHandler &operator=(const MDNSHandler &) = delete;
+
+	struct CachedHost {
+		std::string address;
+		uint16_t port = 0;
+		Clock::time_point addressExpiry;
+		Clock::time_point portExpiry;
+		Clock::time_point refreshAt;
+		bool refreshQueried = false;
+		bool announced = false;
+
+		bool complete() const {
+			return port != 0 && !address.empty();
+		}
+		Clock::time_point expiry() const;
+	};
+
+	static int queryCallback(int sock, const struct sockaddr *from, size_t addrlen, mdns_entry_type_t entry,
+	                         uint16_t query_id, uint16_t rtype, uint16_t rclass, uint32_t ttl, const void *data,
+	                         size_t size, size_t name_offset, size_t name_length, size_t record_offset,
+	                         size_t record_length, void *user_data);
+
+	void openSockets();
+	void closeSockets();
+	void openWakeSocket();
+	void wake();
+	void drainWakeSocket();
+	void run();
+	void sendQueries();
+	void receive(int sock);
+	void onRecord(const std::string &responder, uint16_t rtype, uint32_t ttl, const void *data, size_t size,
+	              size_t nameOffset, size_t recordOffset, size_t recordLength);
+	void expireHosts(Clock::time_point now);
+	Clock::time_point nextWakeup(Clock::time_point now) const;
+
+	std::mutex m_lifecycleMutex;
+	std::thread m_thread;
+	std::atomic<bool> m_running{false};
+	std::atomic<bool> m_restartBackoff{false};
+
+	// Loopback socket connected to itself. Start() and Stop() write to it so select() returns
+	// right away instead of at the next query or expiry.
+	int m_wakeSocket = -1;
+
+	// Everything below is only touched by the discovery thread while it runs
+	int m_sockets[MAX_SOCKETS] = {};
+	int m_socketCount = 0;
+	int m_maxQueryIntervalMs = MAX_QUERY_INTERVAL_MS;
+	Clock::time_point m_nextQuery;
+	int m_queryIntervalMs = FIRST_QUERY_INTERVAL_MS;
+	std::map<std::string, CachedHost> m_hosts; // keyed by the address the response came from
+
+	char m_addressBuffer[64];
+	char m_nameBuffer[256];
+	int m_packetBuffer[4096];
+};
+
+} // namespace moonlight_xbox_dx
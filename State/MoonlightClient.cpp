@@ -13,6 +13,11 @@ extern "C" {
 #include <cmath>
 #include <gamingdeviceinformation.h>
 #include "Streaming\FFMpegDecoder.h"
+#include "State\BoxArtCache.h"
+#include "State\ConnectionPrewarmer.h"
+#include "Streaming\AVSyncMonitor.h"
+#include "Streaming\LaunchTimeline.h"
+#include "Streaming\PacingTrace.h"
 
 using namespace moonlight_xbox_dx;
 using namespace Windows::Gaming::Input;
@@ -24,6 +29,7 @@ std::atomic<bool> g_connectionTerminated{false};
 void log_message(const char* fmt, ...);
 void connection_started();
 void connection_status_update(int status);
+void stage_starting(int stage);
 void connection_status_completed(int status);
 void connection_terminated(int status);
 void connection_set_hdr(bool value);
@@ -196,16 +202,41 @@ MoonlightClient::~MoonlightClient() {
 }
 
 void MoonlightClient::StopApp() {
+	// A prewarmed serverinfo would still name the game we're closing
+	ConnectionPrewarmer::instance().Cancel();
 	gs_quit_app(&serverData);
 }
+
+// LocalFolder\pacing-<date>-<time>.mlpt
+static std::string pacingTracePath() {
+	Platform::String ^ folderString = Windows::Storage::ApplicationData::Current->LocalFolder->Path;
+	char folder[2048];
+	wcstombs_s(NULL, folder, folderString->Data(), 2047);
+
+	time_t now = time(nullptr);
+	struct tm local;
+	localtime_s(&local, &now);
+
+	char path[2200];
+	snprintf(path, sizeof(path), "%s\\pacing-%04d%02d%02d-%02d%02d%02d.mlpt", folder,
+	         local.tm_year + 1900, local.tm_mon + 1, local.tm_mday, local.tm_hour, local.tm_min, local.tm_sec);
+	return path;
+}
+
 int MoonlightClient::StartStreaming(std::shared_ptr<DX::DeviceResources> res, StreamConfiguration^ sConfig) {
 	g_connectionTerminated.store(false, std::memory_order_release);
+	LaunchTimeline::instance().begin();
 
 	//Thanks to https://stackoverflow.com/questions/11746146/how-to-convert-platformstring-to-char
 	std::wstring fooW(sConfig->hostname->Begin());
 	std::string fooA(fooW.begin(), fooW.end());
 	const char *charStr = fooA.c_str();
-	this->Connect(charStr);
+	if (ConnectionPrewarmer::instance().ClaimServerData(sConfig->hostname, *this)) {
+		LaunchTimeline::instance().markPrewarmed();
+	} else {
+		this->Connect(charStr);
+	}
+	LaunchTimeline::instance().mark(LAUNCH_SERVERINFO);
 	STREAM_CONFIGURATION config;
 	LiInitializeStreamConfiguration(&config);
 	config.width = sConfig->width;
@@ -292,6 +323,7 @@ int MoonlightClient::StartStreaming(std::shared_ptr<DX::DeviceResources> res, St
 		Utils::Log(gs_error);
 		return a;
 	}
+	LaunchTimeline::instance().mark(LAUNCH_APP_STARTED);
 	// Sleep(10000);
 	connectedInstance = this;
 	CONNECTION_LISTENER_CALLBACKS callbacks;
@@ -300,17 +332,29 @@ int MoonlightClient::StartStreaming(std::shared_ptr<DX::DeviceResources> res, St
 	callbacks.connectionStarted = connection_started;
 	callbacks.connectionStatusUpdate = connection_status_update;
 	callbacks.connectionTerminated = connection_terminated;
-	callbacks.stageStarting = connection_status_update;
+	callbacks.stageStarting = stage_starting;
 	callbacks.stageFailed = stage_failed;
 	callbacks.stageComplete = connection_status_completed;
 	callbacks.setHdrMode = connection_set_hdr;
 	callbacks.rumble = connection_rumble;
 	// callbacks.rumbleTriggers = connection_trigger_rumble;
 
-	FFMpegDecoder::instance().CompleteInitialization(res, &config, sConfig->framePacing == "Immediate");
+	if (sConfig->recordPacingTrace) {
+		PacingTrace::instance().requestRecording(pacingTracePath());
+	}
+
+	FramePacingMode framePacing = FRAME_PACING_DISPLAY_LOCKED;
+	if (sConfig->framePacing == "Immediate") {
+		framePacing = FRAME_PACING_IMMEDIATE;
+	} else if (sConfig->framePacing == "Adaptive") {
+		framePacing = FRAME_PACING_ADAPTIVE;
+	}
+	FFMpegDecoder::instance().CompleteInitialization(res, &config, framePacing);
+	AVSyncMonitor::instance().init(sConfig->avSyncWindow);
 	DECODER_RENDERER_CALLBACKS rCallbacks = FFMpegDecoder::getDecoder();
 
 	AUDIO_RENDERER_CALLBACKS aCallbacks = AudioPlayer::getDecoder();
+	AudioPlayer::getInstance()->upmix = sConfig->upmixAudio;
 	int k = LiStartConnection(&serverData.serverInfo, &config, &callbacks, &rCallbacks, &aCallbacks, NULL, 0, NULL, 0);
 	sprintf(message, "LiStartConnection %d\n", k);
 	Utils::Log(message);
@@ -333,6 +377,7 @@ void connection_started() {
 	char message[2048];
 	sprintf(message, "Connection Started\n");
 	Utils::Log(message);
+	LaunchTimeline::instance().mark(LAUNCH_CONNECTION_STARTED);
 	if (connectedInstance->OnCompleted != nullptr) {
 		connectedInstance->OnCompleted();
 	}
@@ -344,10 +389,16 @@ void connection_status_update(int status) {
 	Utils::Log(message);
 }
 
+void stage_starting(int stage) {
+	LaunchTimeline::instance().stageStarted(stage);
+	connection_status_update(stage);
+}
+
 void connection_status_completed(int status) {
 	char message[4096];
 	sprintf(message, "Stage %d completed\n", status);
 	Utils::Log(message);
+	LaunchTimeline::instance().stageCompleted(status);
 	if (connectedInstance->OnStatusUpdate != nullptr) {
 		connectedInstance->OnStatusUpdate(status);
 	}
@@ -375,6 +426,7 @@ void stage_failed(int stage, int err) {
 	LiStringifyPortFlags(portFlags, ", ", failingPorts, sizeof(failingPorts));
 	sprintf(message, "%s failed with error %d.\n Check Firewall and Connections to port: %s\n", LiGetStageName(stage), err, failingPorts);
 	Utils::Log(message);
+	LaunchTimeline::instance().abort(stage, err);
 	if (connectedInstance->OnFailed != nullptr) {
 		connectedInstance->OnFailed(stage, err, message);
 	}
@@ -405,7 +457,7 @@ void connection_trigger_rumble(unsigned short controllerNumber, unsigned short l
 	gp->Vibration = v;
 }
 
-int MoonlightClient::Connect(const char *hostname) {
+int MoonlightClient::Connect(const char *hostname, long timeoutMs) {
 	this->hostname = (char *)malloc(2048 * sizeof(char));
 	strcpy_s(this->hostname, 2048, hostname);
 	if (strchr(this->hostname, ':') != 0) {
@@ -421,10 +473,32 @@ int MoonlightClient::Connect(const char *hostname) {
 	wcstombs_s(NULL, folder, folderString->Data(), 2047);
 
 	int status = 0;
-	status = gs_init(&serverData, this->hostname, port, folder, 3, true);
+	status = gs_init(&serverData, this->hostname, port, folder, 3, true, timeoutMs);
+	m_serverInfoLoaded = status == 0;
 	return status;
 }
 
+// Takes over the serverinfo of a client that connected to the same host moments ago
+void MoonlightClient::TakeServerData(MoonlightClient &from) {
+	serverData = from.serverData;
+	port = from.port;
+	m_serverInfoLoaded = from.m_serverInfoLoaded;
+	// serverData.serverInfo.address points at the hostname buffer, so that moves along with it
+	std::swap(hostname, from.hostname);
+}
+
+// RefreshStatus needs the ports and pairing state from a successful Connect
+bool MoonlightClient::CanRefreshStatus() {
+	return m_serverInfoLoaded;
+}
+
+// Polls pairing and the running game with a single request, see gs_status
+int MoonlightClient::RefreshStatus(bool *changed) {
+	*changed = false;
+	if (!m_serverInfoLoaded) return GS_WRONG_STATE;
+	return gs_status(&serverData, changed);
+}
+
 bool MoonlightClient::IsConnectionTerminated() {
 	return g_connectionTerminated.load(std::memory_order_acquire);
 }
@@ -481,10 +555,11 @@ std::vector<MoonlightApp ^> MoonlightClient::GetApplications(bool fetchAssets) {
 		tempValues.push_back(a);
 		list = list->next;
 	}
-	std::sort(begin(tempValues), end(tempValues), [](struct app &lhs, struct app &rhs) {
-		if (lhs.Name->Data()[0] == '_' && rhs.Name->Data()[0] != '_') return true;
-		if (rhs.Name->Data()[0] == '_' && lhs.Name->Data()[0] != '_') return false;
-		return lhs.Name < rhs.Name;
+	std::sort(begin(tempValues), end(tempValues), [](const struct app &lhs, const struct app &rhs) {
+		const wchar_t *l = lhs.Name->Data(), *r = rhs.Name->Data();
+		if (l[0] == '_' && r[0] != '_') return true;
+		if (r[0] == '_' && l[0] != '_') return false;
+		return wcscmp(l, r) < 0;
 	});
 	for (auto s : tempValues) {
 		MoonlightApp ^ a = ref new MoonlightApp();
@@ -492,28 +567,17 @@ std::vector<MoonlightApp ^> MoonlightClient::GetApplications(bool fetchAssets) {
 		a->Name = s.Name;
 		values.push_back(a);
 	}
-	Platform::String ^ folderString = Windows::Storage::ApplicationData::Current->LocalFolder->Path;
-	folderString = folderString->Concat(folderString, "\\images\\");
-	char folder[2048];
-	wcstombs_s(NULL, folder, folderString->Data(), 2047);
-	CreateDirectory(folderString->Data(), NULL);
 	if (fetchAssets) {
-		Concurrency::create_task([folder, folderString, values, this]() {
-			for (auto a : values) {
-				auto imgPath = folderString->Concat(folderString, a->Id + ".png");
-				// https://stackoverflow.com/a/6218957
-				DWORD dwAttrib = GetFileAttributes(imgPath->Data());
-				if (dwAttrib == INVALID_FILE_ATTRIBUTES) {
-					gs_appasset(&serverData, folder, a->Id);
-				}
-				a->ImagePath = imgPath;
-			}
-		});
+		FetchBoxArt(values);
 	}
 
 	return values;
 }
 
+void MoonlightClient::FetchBoxArt(const std::vector<MoonlightApp ^> &apps) {
+	BoxArtCache::instance().Fetch(serverData, apps);
+}
+
 static bool hasGamepadReadingChanged(GamepadReading a, GamepadReading b) {
 	if (a.Buttons != b.Buttons) {
 		return true;
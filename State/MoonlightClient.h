@@ -20,7 +20,10 @@ class MoonlightClient {
 	~MoonlightClient();
 	bool SetDisplayHDR(bool enabled, const SS_HDR_METADATA &sunshineHdrMetadata);
 	int StartStreaming(std::shared_ptr<DX::DeviceResources> res, StreamConfiguration ^ config);
-	int Connect(const char *hostname);
+	int Connect(const char *hostname, long timeoutMs = 0);
+	bool CanRefreshStatus();
+	void TakeServerData(MoonlightClient &from);
+	int RefreshStatus(bool *changed);
 	bool IsConnectionTerminated();
 	void SetConnectionTerminated();
 	bool IsHDR();
@@ -29,6 +32,7 @@ class MoonlightClient {
 	int Pair();
 	char *GeneratePIN();
 	std::vector<MoonlightApp ^> GetApplications(bool fetchAssets = true);
+	void FetchBoxArt(const std::vector<MoonlightApp ^> &apps);
 	void SendGamepadReading(short controllerNumber, Windows::Gaming::Input::GamepadReading reading);
 	void SendMousePosition(float x, float y);
 	void SendMousePressed(int button);
@@ -58,6 +62,7 @@ class MoonlightClient {
 	char *connectionPin = NULL;
 	char *hostname = NULL;
 	int port = 0;
+	bool m_serverInfoLoaded = false;
 	bool useSoftwareEncoder = false;
 	int activeGamepadMask = 0;
 	bool m_isHDR;
@@ -1,6 +1,8 @@
 #include "pch.h"
 #include "MoonlightHost.h"
 #include "State\MoonlightClient.h"
+#include "State\ConnectionPrewarmer.h"
+#include "Utils\KeyedDiff.h"
 
 namespace moonlight_xbox_dx {
 	MoonlightHost::MoonlightHost(Platform::String ^host) {
@@ -15,8 +17,12 @@ namespace moonlight_xbox_dx {
 	}
 
 	void MoonlightHost::UpdateHostInfo(bool showLoading) {
+		ProbeHostInfo(showLoading, 0);
+	}
+
+	void MoonlightHost::ProbeHostInfo(bool showLoading, long timeoutMs) {
 		if (showLoading) this->Loading = true;
-		bool status = this->Connect() == 0;
+		bool status = this->ConnectWithTimeout(timeoutMs) == 0;
 		this->Connected = status;
 		if (status) {
 			this->Paired = client->IsPaired();
@@ -31,7 +37,31 @@ namespace moonlight_xbox_dx {
 		if (showLoading) this->Loading = false;
 	}
 
+	// Cheap alternative to UpdateHostInfo for polling. Only properties that changed are set,
+	// so bound controls aren't notified every few seconds. Returns whether the host answered.
+	bool MoonlightHost::RefreshStatus() {
+		if (client == nullptr || !client->CanRefreshStatus()) {
+			// Haven't reached the host yet, do the full connection
+			UpdateHostInfo(false);
+			return this->connected;
+		}
+
+		bool changed = false;
+		bool status = client->RefreshStatus(&changed) == 0;
+		if (status != this->connected) this->Connected = status;
+		if (status && changed) {
+			if (client->IsPaired() != this->paired) this->Paired = client->IsPaired();
+			if (client->GetRunningAppID() != this->currentlyRunningAppId) this->CurrentlyRunningAppId = client->GetRunningAppID();
+		}
+		return status;
+	}
+
 	int MoonlightHost::Connect()
+	{
+		return ConnectWithTimeout(0);
+	}
+
+	int MoonlightHost::ConnectWithTimeout(long timeoutMs)
 	{
 		if (client == nullptr) {
 			client = new MoonlightClient();
@@ -39,23 +69,52 @@ namespace moonlight_xbox_dx {
 		Platform::String^ ipAddress = this->lastHostname;
 		char ipAddressStr[2048];
 		wcstombs_s(NULL, ipAddressStr, ipAddress->Data(), 2047);
-		return client->Connect(ipAddressStr);
+		return client->Connect(ipAddressStr, timeoutMs);
 	}
 
 	void MoonlightHost::UpdateApps() {
-	    auto apps = client->GetApplications();
+	    std::vector<MoonlightApp^> apps;
+	    if (!ConnectionPrewarmer::instance().ClaimApps(lastHostname, apps)) {
+	        apps = client->GetApplications(false);
+	    }
 	    Windows::ApplicationModel::Core::CoreApplication::MainView->CoreWindow->Dispatcher->RunAsync(Windows::UI::Core::CoreDispatcherPriority::High, ref new Windows::UI::Core::DispatchedHandler([this, apps]() {
-			Apps->Clear();
-			for (auto a : apps) {
-				if (a->Id == CurrentlyRunningAppId) a->CurrentlyRunning = true;
-				Apps->Append(a);
+			// Edit Apps in place so only changed tiles are rebuilt and the grid keeps its scroll position
+			std::vector<MoonlightApp^> current;
+			std::vector<int> currentIds, newIds;
+			for (auto a : Apps) {
+				current.push_back(a);
+				currentIds.push_back(a->Id);
+			}
+			for (auto a : apps) newIds.push_back(a->Id);
+			auto diff = KeyedDiff(currentIds, newIds);
+
+			// Apps we already show keep their object, and with it their box art
+			std::vector<MoonlightApp^> result(apps);
+			for (auto &r : diff.retained) {
+				auto existing = current[r.first];
+				if (existing->Name != apps[r.second]->Name) existing->Name = apps[r.second]->Name;
+				result[r.second] = existing;
 			}
+			for (auto &op : diff.ops) {
+				if (op.type == KeyedDiffOp::Type::Remove) Apps->RemoveAt((unsigned int)op.index);
+				else Apps->InsertAt((unsigned int)op.index, result[op.toIndex]);
+			}
+			for (auto a : result) {
+				bool running = a->Id == CurrentlyRunningAppId;
+				if (a->CurrentlyRunning != running) a->CurrentlyRunning = running;
+			}
+
+			// Box art goes to the objects that are actually shown
+			MoonlightClient *c = client;
+			Concurrency::create_task([c, result]() {
+				c->FetchBoxArt(result);
+			});
 		}));
     }
 
 	void MoonlightHost::UpdateAppRunningStates() {
 		try {
-			UpdateHostInfo(false);
+			RefreshStatus();
 		} catch (...) { }
 
 		int runningId = this->CurrentlyRunningAppId;
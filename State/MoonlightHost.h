@@ -18,6 +18,7 @@ namespace moonlight_xbox_dx {
         bool loading = true;
         bool wolPolling = false;
         bool playAudioOnPC = false;
+        bool upmixAudio = false;
         MoonlightClient* client;
         int currentlyRunningAppId;
         int bitrate = 20000;
@@ -27,10 +28,12 @@ namespace moonlight_xbox_dx {
         Platform::String^ videoCodec = "H.265";
         Platform::String^ audioConfig = "Stereo";
         Platform::String^ framePacing = "";
+        int avSyncWindow = 0;
         bool enableHDR = false;
         bool enableSOPS = false;
         bool enableStats = false;
         bool enableGraphs = true;
+        bool recordPacingTrace = false;
         Windows::Foundation::Collections::IVector<MoonlightApp^>^ apps;
     public:
         //Thanks to https://phsucharee.wordpress.com/2013/06/19/data-binding-and-ccx-inotifypropertychanged/
@@ -39,10 +42,16 @@ namespace moonlight_xbox_dx {
         MoonlightHost(Platform::String ^host);
 
         void UpdateHostInfo(bool showLoading);
+        bool RefreshStatus();
         int Connect();
         void Unpair();
         void UpdateApps();
     void UpdateAppRunningStates();
+    internal:
+        // timeoutMs limits how long each status request may take, 0 for no limit
+        void ProbeHostInfo(bool showLoading, long timeoutMs);
+        int ConnectWithTimeout(long timeoutMs);
+    public:
         property Platform::String^ InstanceId
         {
             Platform::String^ get() { return this->instanceId; }
@@ -230,6 +239,17 @@ namespace moonlight_xbox_dx {
             }
         }
 
+        // Largest A/V offset in ms we let stand before delaying audio, 0 to only measure it
+        property int AVSyncWindow
+        {
+            int get() { return this->avSyncWindow; }
+            void set(int value) {
+                if (avSyncWindow == value)return;
+                this->avSyncWindow = value;
+                OnPropertyChanged("AVSyncWindow");
+            }
+        }
+
         property Windows::Foundation::Collections::IVector<MoonlightApp^>^ Apps {
             Windows::Foundation::Collections::IVector<MoonlightApp^>^ get() {
                 if (this->apps == nullptr)
@@ -249,6 +269,15 @@ namespace moonlight_xbox_dx {
             }
         }
 
+        property bool UpmixAudio
+        {
+            bool get() { return this->upmixAudio; }
+            void set(bool value) {
+                this->upmixAudio = value;
+                OnPropertyChanged("UpmixAudio");
+            }
+        }
+
         property bool EnableHDR
         {
             bool get() { return this->enableHDR; }
@@ -284,5 +313,14 @@ namespace moonlight_xbox_dx {
                 OnPropertyChanged("EnableGraphs");
             }
         }
+
+        property bool RecordPacingTrace
+        {
+            bool get() { return this->recordPacingTrace; }
+            void set(bool value) {
+                this->recordPacingTrace = value;
+                OnPropertyChanged("RecordPacingTrace");
+            }
+        }
     };
 }
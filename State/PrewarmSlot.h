@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace moonlight_xbox_dx {
+
+// What ConnectionPrewarmer holds for the one host it warms: which prewarm is current, and the
+// client and app list it left behind until they are claimed or go stale.
+//
+// begin() starts a new prewarm unless hostname is already warm or on the way, and returns its
+// generation. finish() only keeps the results of the current generation, so a prewarm that was
+// superseded or cancelled on the wire can't overwrite a newer one. A claim hands each result out
+// once, and only while it is younger than maxAgeMs. Time is QpcNow(), so the host tools can run
+// it on a virtual clock. Not synchronized, ConnectionPrewarmer holds its mutex around every call.
+template <typename Client, typename App> class PrewarmSlot {
+  public:
+	explicit PrewarmSlot(int maxAgeMs) : m_maxAgeMs(maxAgeMs) {
+	}
+
+	// 0 if hostname is already warm or being warmed
+	uint64_t begin(const std::wstring &hostname) {
+		if (m_active && m_hostname == hostname && (m_pending || isFresh(hostname))) {
+			return 0;
+		}
+		reset();
+		m_active = true;
+		m_hostname = hostname;
+		m_pending = true;
+		return ++m_generation;
+	}
+
+	// Returns false if the results were dropped, because a newer prewarm started or it was cancelled
+	bool finish(uint64_t generation, bool connected, std::unique_ptr<Client> client, std::vector<App> apps) {
+		if (generation != m_generation) {
+			return false;
+		}
+		if (!connected) {
+			reset();
+			return true;
+		}
+		m_pending = false;
+		m_readyQpc = QpcNow();
+		m_client = std::move(client);
+		m_apps = std::move(apps);
+		m_hasApps = !m_apps.empty();
+		return true;
+	}
+
+	void cancel() {
+		m_generation++;
+		reset();
+	}
+
+	// null if there is nothing fresh for hostname
+	std::unique_ptr<Client> claimClient(const std::wstring &hostname) {
+		if (m_client == nullptr || !isFresh(hostname)) {
+			return nullptr;
+		}
+		return std::move(m_client);
+	}
+
+	bool claimApps(const std::wstring &hostname, std::vector<App> &apps) {
+		if (!m_hasApps || !isFresh(hostname)) {
+			return false;
+		}
+		apps = std::move(m_apps);
+		m_apps.clear();
+		m_hasApps = false;
+		return true;
+	}
+
+	bool isFresh(const std::wstring &hostname) const {
+		if (!m_active || m_pending || m_hostname != hostname) {
+			return false;
+		}
+		return QpcNow() - m_readyQpc < MsToQpc(m_maxAgeMs);
+	}
+
+  private:
+	void reset() {
+		m_active = false;
+		m_hostname.clear();
+		m_pending = false;
+		m_client.reset();
+		m_apps.clear();
+		m_hasApps = false;
+	}
+
+	const int m_maxAgeMs;
+	uint64_t m_generation = 0;
+
+	bool m_active = false; // m_hostname is being warmed or holds results
+	std::wstring m_hostname;
+	bool m_pending = false;
+	int64_t m_readyQpc = 0;
+	std::unique_ptr<Client> m_client; // null once claimed
+	std::vector<App> m_apps;
+	bool m_hasApps = false;
+};
+
+} // namespace moonlight_xbox_dx
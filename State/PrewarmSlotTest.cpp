@@ -0,0 +1,177 @@
+// Claim and expiry suite for the slot ConnectionPrewarmer keeps its results in, built on the host
+// rather than into the app
+//
+// Runs on a virtual clock. A prewarmed client and app list must be handed out once each, to the
+// host they were fetched for, and only until exactly MAX_AGE_MS after the prewarm finished.
+// Prewarming the same host again must be a no-op while a prewarm is on the way or fresh, and
+// start over once it went stale. A prewarm that was superseded by another host or cancelled
+// while on the wire must have its results dropped, and a failed one must leave nothing behind.
+//
+// Built through Tools/CMakeLists.txt.
+
+#include "pch.h"
+#include "PrewarmSlot.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace moonlight_xbox_dx;
+
+static int g_failures = 0;
+
+#define CHECK(cond, ...)                                     \
+	do {                                                     \
+		if (!(cond)) {                                       \
+			fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+			fprintf(stderr, __VA_ARGS__);                    \
+			fprintf(stderr, "\n");                           \
+			g_failures++;                                    \
+		}                                                    \
+	} while (0)
+
+// ConnectionPrewarmer::MAX_AGE_MS
+static const int MAX_AGE_MS = 10000;
+// ConnectionPrewarmer::CONNECT_TIMEOUT_MS, how long a prewarm of an offline host can take
+static const double CONNECT_TIMEOUT_MS = 3000;
+
+static int64_t g_nowQpc = 0;
+
+static int64_t virtualQpcNow() {
+	return g_nowQpc;
+}
+
+static void advanceMs(double ms) {
+	g_nowQpc += MsToQpc(ms);
+}
+
+// Stand-ins for MoonlightClient and MoonlightApp^
+struct Client {
+	std::wstring host;
+};
+using Slot = PrewarmSlot<Client, int>;
+
+static std::unique_ptr<Client> connected(const std::wstring &host) {
+	return std::unique_ptr<Client>(new Client{host});
+}
+
+static void testClaim() {
+	Slot slot(MAX_AGE_MS);
+	const std::wstring host = L"10.0.0.2";
+
+	const uint64_t generation = slot.begin(host);
+	CHECK(generation != 0, "prewarming an idle slot didn't start");
+	CHECK(slot.claimClient(host) == nullptr, "a client was claimed while the prewarm was on the way");
+	CHECK(slot.begin(host) == 0, "the same host was prewarmed twice at once");
+
+	CHECK(slot.finish(generation, true, connected(host), {1, 2, 3}), "the current prewarm's results were dropped");
+	CHECK(slot.begin(host) == 0, "a freshly warmed host was prewarmed again");
+
+	std::vector<int> apps;
+	CHECK(!slot.claimApps(L"10.0.0.9", apps), "another host claimed the apps");
+	CHECK(slot.claimClient(L"10.0.0.9") == nullptr, "another host claimed the client");
+
+	std::unique_ptr<Client> client = slot.claimClient(host);
+	CHECK(client != nullptr && client->host == host, "the prewarmed client wasn't handed out");
+	CHECK(slot.claimClient(host) == nullptr, "the client was handed out twice");
+
+	// Claiming the client leaves the apps for UpdateApps
+	CHECK(slot.claimApps(host, apps) && apps == std::vector<int>({1, 2, 3}), "the prewarmed apps weren't handed out");
+	apps.clear();
+	CHECK(!slot.claimApps(host, apps) && apps.empty(), "the apps were handed out twice");
+}
+
+static void testExpiry() {
+	Slot slot(MAX_AGE_MS);
+	const std::wstring host = L"gaming-pc.local";
+
+	const uint64_t generation = slot.begin(host);
+	// How long the prewarm took doesn't count, the age starts when it finished
+	advanceMs(CONNECT_TIMEOUT_MS);
+	slot.finish(generation, true, connected(host), {7});
+
+	advanceMs(MAX_AGE_MS - 1);
+	CHECK(slot.isFresh(host), "results went stale before MAX_AGE_MS");
+	std::vector<int> apps;
+	CHECK(slot.claimApps(host, apps), "apps 1 ms short of MAX_AGE_MS weren't handed out");
+
+	advanceMs(1);
+	CHECK(!slot.isFresh(host), "results still fresh at MAX_AGE_MS");
+	CHECK(slot.claimClient(host) == nullptr, "a client MAX_AGE_MS old was handed out");
+
+	// Stale results don't keep the host from being warmed again
+	const uint64_t again = slot.begin(host);
+	CHECK(again != 0 && again != generation, "a stale host wasn't prewarmed again");
+	slot.finish(again, true, connected(host), {});
+	CHECK(slot.claimClient(host) != nullptr, "the client of the second prewarm wasn't handed out");
+	CHECK(!slot.claimApps(host, apps), "an empty app list was handed out");
+}
+
+static void testSuperseded() {
+	Slot slot(MAX_AGE_MS);
+	const std::wstring first = L"10.0.0.2", second = L"10.0.0.3";
+
+	// Focus moves to another tile while the first prewarm is still on the wire
+	const uint64_t a = slot.begin(first);
+	const uint64_t b = slot.begin(second);
+	CHECK(a != 0 && b != 0 && a != b, "moving focus didn't start a new prewarm");
+	CHECK(!slot.finish(a, true, connected(first), {1}), "the abandoned prewarm's results were kept");
+	CHECK(slot.claimClient(first) == nullptr, "the abandoned host's client was handed out");
+	CHECK(slot.finish(b, true, connected(second), {2}), "the current prewarm's results were dropped");
+	std::unique_ptr<Client> client = slot.claimClient(second);
+	CHECK(client != nullptr && client->host == second, "the current host's client wasn't handed out");
+
+	// Moving focus away also drops results that already arrived
+	const uint64_t c = slot.begin(first);
+	slot.finish(c, true, connected(first), {3});
+	slot.begin(second);
+	std::vector<int> apps;
+	CHECK(slot.claimClient(first) == nullptr && !slot.claimApps(first, apps), "moving focus kept the old results");
+
+	// Coming back to a host while its old prewarm is still on the wire starts a new one
+	const uint64_t d = slot.begin(first);
+	const uint64_t e = slot.begin(second);
+	const uint64_t f = slot.begin(first);
+	CHECK(f != d, "returning to a host reused its abandoned prewarm");
+	CHECK(!slot.finish(d, true, connected(first), {4}) && !slot.finish(e, true, connected(second), {5}),
+	      "an abandoned prewarm's results were kept");
+	CHECK(slot.finish(f, true, connected(first), {6}) && slot.claimApps(first, apps) && apps == std::vector<int>({6}),
+	      "the current prewarm's apps weren't handed out");
+}
+
+static void testCancelAndFailure() {
+	Slot slot(MAX_AGE_MS);
+	const std::wstring host = L"10.0.0.4";
+
+	// Cancelled on the wire, by launching something or leaving the page
+	const uint64_t generation = slot.begin(host);
+	slot.cancel();
+	CHECK(!slot.finish(generation, true, connected(host), {1}), "a cancelled prewarm's results were kept");
+	CHECK(slot.claimClient(host) == nullptr, "a cancelled prewarm's client was handed out");
+
+	// Cancelled after it finished
+	const uint64_t finished = slot.begin(host);
+	CHECK(finished != 0, "a cancelled host couldn't be prewarmed again");
+	slot.finish(finished, true, connected(host), {1});
+	slot.cancel();
+	std::vector<int> apps;
+	CHECK(slot.claimClient(host) == nullptr && !slot.claimApps(host, apps), "cancelling kept the results");
+
+	// A host that didn't answer leaves nothing behind, and can be tried again right away
+	const uint64_t failed = slot.begin(host);
+	CHECK(slot.finish(failed, false, nullptr, {}), "the current prewarm's failure was dropped");
+	CHECK(!slot.isFresh(host) && slot.claimClient(host) == nullptr, "a failed prewarm left results behind");
+	CHECK(slot.begin(host) != 0, "a host that failed to prewarm can't be tried again");
+}
+
+int main(int argc, char **argv) {
+	g_HostQpcNow = virtualQpcNow;
+
+	testClaim();
+	testExpiry();
+	testSuperseded();
+	testCancelAndFailure();
+
+	printf("%d failures\n", g_failures);
+	return g_failures == 0 ? 0 : 1;
+}
@@ -1,20 +1,15 @@
 #include "pch.h"
 #include "Stats.h"
 #include "Utils.hpp"
+#include "../Common/StepTimer.h"
 #include "../Plot/ImGuiPlots.h"
+#include "../Streaming/AVSyncMonitor.h"
+#include "../Streaming/AudioJitterBuffer.h"
 #include "../Streaming/FFMpegDecoder.h"
+#include "../Streaming/LaunchTimeline.h"
 
 using namespace moonlight_xbox_dx;
 
-Stats::Stats() :
-	m_avgQueueSize(0.0),
-	m_avgMbpsSmoothed(0.0)
-{
-	ZeroMemory(&m_ActiveWndVideoStats, sizeof(VIDEO_STATS));
-	ZeroMemory(&m_LastWndVideoStats, sizeof(VIDEO_STATS));
-	ZeroMemory(&m_GlobalVideoStats, sizeof(VIDEO_STATS));
-}
-
 // Called every frame, if true is returned, the stats text is refreshed
 bool Stats::ShouldUpdateDisplay(DX::StepTimer const& timer, bool isVisible, char* output, size_t length)
 {
@@ -28,7 +23,9 @@ bool Stats::ShouldUpdateDisplay(DX::StepTimer const& timer, bool isVisible, char
 
 	// Process stats once per second
 	if (timer.GetTotalSeconds() - m_ActiveWndVideoStats.measurementStartTimestamp >= 1.0) {
-		std::lock_guard<std::mutex> lock(m_mutex);
+		// Pull everything the producer threads submitted during this window
+		collectWindow(m_ActiveWndVideoStats);
+		AudioStats::instance().collect(m_audioWindow);
 
 		if (isVisible) {
 			// Display using data from the last 2 window periods
@@ -52,111 +49,83 @@ bool Stats::ShouldUpdateDisplay(DX::StepTimer const& timer, bool isVisible, char
 	return shouldUpdate;
 }
 
-/// Hooks for stat producers, where possible these are combined into one call
+/// private methods
 
-// 1. The size in bytes of one video frame, we use this to also increment frame counters.
-// 2. Time in milliseconds from first packet of a frame until fully reassembled frame is ready for decoding
-//    Includes time spent in FEC reassembly
-// 3. Host processing latency (encode time)
-// 4. network packet loss (caller reports frame sequence number holes)
-void Stats::SubmitVideoBytesAndReassemblyTime(uint32_t length, PDECODE_UNIT decodeUnit, uint32_t droppedFrames)
-{
-	std::lock_guard<std::mutex> lock(m_mutex);
-	m_ActiveWndVideoStats.receivedFrames++;
-	m_ActiveWndVideoStats.totalFrames++;
-
-	// bandwidth
-	m_bwTracker.AddBytes(length);
-
-	// reassembly time
-	uint32_t reassemblyUs = (uint32_t)(decodeUnit->enqueueTimeUs - decodeUnit->receiveTimeUs);
-	m_ActiveWndVideoStats.totalReassemblyTimeUs += reassemblyUs;
-
-	// Host processing latency
-	uint16_t frameHPL = decodeUnit->frameHostProcessingLatency;
-	if (frameHPL != 0) {
-		if (m_ActiveWndVideoStats.minHostProcessingLatency != 0) {
-			m_ActiveWndVideoStats.minHostProcessingLatency = std::min(m_ActiveWndVideoStats.minHostProcessingLatency, frameHPL);
-		} else {
-			m_ActiveWndVideoStats.minHostProcessingLatency = frameHPL;
-		}
-		m_ActiveWndVideoStats.framesWithHostProcessingLatency += 1;
-		m_ActiveWndVideoStats.maxHostProcessingLatency = std::max(m_ActiveWndVideoStats.maxHostProcessingLatency, frameHPL);
-		m_ActiveWndVideoStats.totalHostProcessingLatency += frameHPL;
-	}
+// Fills the window with everything submitted since the last call (ShouldUpdateDisplay only)
+void Stats::collectWindow(VIDEO_STATS& window) {
+	uint64_t totals[STAT_COUNT] = {};
+	uint16_t minHPL = 0, maxHPL = 0;
+	LatencyHistogram* histograms[HIST_COUNT] = {
+		&window.reassemblyTimeHist,
+		&window.decodeTimeHist,
+		&window.pacerTimeHist,
+		&window.renderTimeHist,
+		&window.presentTimeHist,
+		&window.endToEndTimeHist,
+	};
+
+	// Every slot is summed, claimed or not, since a released slot still holds what its last thread submitted
+	for (int i = 0; i <= MAX_STATS_THREADS; i++) {
+		StatsSlot& slot = (i < MAX_STATS_THREADS) ? m_slots[i] : m_sharedSlot;
+		for (int c = 0; c < STAT_COUNT; c++) {
+			totals[c] += slot.counters[c].load(std::memory_order_relaxed);
+		}
 
-	// Network packet loss
-	if (droppedFrames > 0) {
-		m_ActiveWndVideoStats.networkDroppedFrames += droppedFrames;
-		m_ActiveWndVideoStats.totalFrames += droppedFrames;
+		uint16_t slotMin = slot.minHostProcessingLatency.exchange(0, std::memory_order_relaxed);
+		if (slotMin != 0 && (minHPL == 0 || slotMin < minHPL)) {
+			minHPL = slotMin;
+		}
+		maxHPL = std::max(maxHPL, slot.maxHostProcessingLatency.exchange(0, std::memory_order_relaxed));
+
+		// Histograms are drained rather than diffed, skip empty buckets so we don't
+		// write to cache lines the producers are using
+		for (int h = 0; h < HIST_COUNT; h++) {
+			const uint64_t maxValue = slot.histogramMax[h].exchange(0, std::memory_order_relaxed);
+			for (int b = 0; b < LatencyHistogram::BUCKET_COUNT; b++) {
+				if (slot.histograms[h][b].load(std::memory_order_relaxed) != 0) {
+					histograms[h]->addToBucket(b, slot.histograms[h][b].exchange(0, std::memory_order_relaxed), maxValue);
+				}
+			}
+		}
 	}
-	ImGuiPlots::instance().observeFloat(PLOT_DROPPED_NETWORK, (float)droppedFrames);
 
-	// Host frametime graph, uses raw 90kHz units to avoid rounding errors
-	static uint32_t lastHostPts = 0;
-	if (lastHostPts != 0) {
-		const uint32_t delta90k = (uint32_t)(decodeUnit->rtpTimestamp - lastHostPts); // wrap-safe
-		ImGuiPlots::instance().observeFloat(PLOT_HOST_FRAMETIME, (float)(delta90k / 90.0f));
+	uint64_t delta[STAT_COUNT];
+	for (int c = 0; c < STAT_COUNT; c++) {
+		delta[c] = totals[c] - m_lastTotals[c];
+		m_lastTotals[c] = totals[c];
 	}
-	lastHostPts = (uint32_t)decodeUnit->rtpTimestamp;
-}
-
-// Time in milliseconds we spent decoding one frame, it is added up to later be divided by decodedFrames
-void Stats::SubmitDecodeMs(double decodeMs) {
-	std::lock_guard<std::mutex> lock(m_mutex);
-	m_ActiveWndVideoStats.totalDecodeTime += decodeMs;
-	m_ActiveWndVideoStats.decodedFrames++;
-}
-
-void Stats::SubmitDroppedFrame(int count) {
-	std::lock_guard<std::mutex> lock(m_mutex);
-	m_ActiveWndVideoStats.pacerDroppedFrames += count;
-}
-
-void Stats::SubmitAvgQueueSize(float avgQueueSize) {
-	std::lock_guard<std::mutex> lock(m_mutex);
-	m_avgQueueSize = avgQueueSize;
-}
-
-// Time in microseconds we spent in the frame pacer, and time for rendering the frame.
-// Also increments the rendered frame count.
-void Stats::SubmitPacerTime(int64_t pacerTimeQpc) {
-	std::lock_guard<std::mutex> lock(m_mutex);
-	int64_t pacerTimeUs = QpcToUs(pacerTimeQpc);
-	m_ActiveWndVideoStats.totalPacerTimeUs += pacerTimeUs;
-}
-
-// Present to display latency (how close to hitting vblank we are)
-void Stats::SubmitPresentPacing(double presentDisplayMs) {
-	std::lock_guard<std::mutex> lock(m_mutex);
-	m_ActiveWndVideoStats.totalPresentDisplayMs += presentDisplayMs;
-}
-
-// High-level render loop timings
-void Stats::SubmitRenderStats(int64_t preWaitTimeUs, int64_t renderTimeUs, int64_t presentTimeUs, bool hitDeadline) {
-	std::lock_guard<std::mutex> lock(m_mutex);
-	m_ActiveWndVideoStats.totalRenderTimeUs += renderTimeUs;
-	m_ActiveWndVideoStats.renderedFrames++;
-
-	if (hitDeadline) {
-		m_ActiveWndVideoStats.hitDeadlines++;
-	} else {
-		m_ActiveWndVideoStats.missedDeadlines++;
 
-#if defined(_DEBUG)
-		Utils::Logf("missed deadline: preWait + render: %.2f + %.2f = %.2f ms\n",
-			(double)preWaitTimeUs / 1000.0, (double)renderTimeUs / 1000.0,
-			(double)(preWaitTimeUs + renderTimeUs) / 1000.0);
-#endif
+	window.receivedFrames = (uint32_t)delta[STAT_RECEIVED_FRAMES];
+	window.totalFrames = (uint32_t)delta[STAT_TOTAL_FRAMES];
+	window.networkDroppedFrames = (uint32_t)delta[STAT_NETWORK_DROPPED_FRAMES];
+	window.pacerDroppedFrames = (uint32_t)delta[STAT_PACER_DROPPED_FRAMES];
+	window.decodedFrames = (uint32_t)delta[STAT_DECODED_FRAMES];
+	window.renderedFrames = (uint32_t)delta[STAT_RENDERED_FRAMES];
+	window.hitDeadlines = (uint32_t)delta[STAT_HIT_DEADLINES];
+	window.missedDeadlines = (uint32_t)delta[STAT_MISSED_DEADLINES];
+	window.minHostProcessingLatency = minHPL;
+	window.maxHostProcessingLatency = maxHPL;
+	window.totalHostProcessingLatency = (uint32_t)delta[STAT_HOST_PROCESSING_LATENCY];
+	window.framesWithHostProcessingLatency = (uint32_t)delta[STAT_FRAMES_WITH_HOST_PROCESSING_LATENCY];
+	window.totalReassemblyTimeUs = (uint32_t)delta[STAT_REASSEMBLY_TIME_US];
+	window.totalDecodeTime = (double)delta[STAT_DECODE_TIME_NS] / 1000000.0;
+	window.totalPacerTimeUs = delta[STAT_PACER_TIME_US];
+	window.totalPreWaitTimeUs = delta[STAT_PREWAIT_TIME_US];
+	window.totalRenderTimeUs = delta[STAT_RENDER_TIME_US];
+	window.totalPresentTimeUs = delta[STAT_PRESENT_TIME_US];
+	window.totalPresentDisplayMs = (double)delta[STAT_PRESENT_DISPLAY_NS] / 1000000.0;
+	window.framesWithEndToEndLatency = (uint32_t)delta[STAT_END_TO_END_FRAMES];
+	window.totalEndToEndHostUs = delta[STAT_END_TO_END_HOST_US];
+	window.totalEndToEndNetworkUs = delta[STAT_END_TO_END_NETWORK_US];
+	window.totalEndToEndClientUs = delta[STAT_END_TO_END_CLIENT_US];
+
+	// The network part of the glass-to-glass estimate for the next window
+	uint32_t rtt, rttVariance;
+	if (LiGetEstimatedRttInfo(&rtt, &rttVariance)) {
+		m_oneWayNetworkUs.store(rtt * 1000 / 2, std::memory_order_relaxed);
 	}
-
-	// Only shown in debug builds
-	m_ActiveWndVideoStats.totalPreWaitTimeUs += preWaitTimeUs;
-	m_ActiveWndVideoStats.totalPresentTimeUs += presentTimeUs;
 }
 
-/// private methods
-
 void Stats::addVideoStats(DX::StepTimer const& timer, VIDEO_STATS& src, VIDEO_STATS& dst) {
 	dst.receivedFrames += src.receivedFrames;
 	dst.decodedFrames += src.decodedFrames;
@@ -173,6 +142,17 @@ void Stats::addVideoStats(DX::StepTimer const& timer, VIDEO_STATS& src, VIDEO_ST
 	dst.totalPreWaitTimeUs += src.totalPreWaitTimeUs;
 	dst.totalPresentTimeUs += src.totalPresentTimeUs;
 	dst.totalPresentDisplayMs += src.totalPresentDisplayMs;
+	dst.framesWithEndToEndLatency += src.framesWithEndToEndLatency;
+	dst.totalEndToEndHostUs += src.totalEndToEndHostUs;
+	dst.totalEndToEndNetworkUs += src.totalEndToEndNetworkUs;
+	dst.totalEndToEndClientUs += src.totalEndToEndClientUs;
+
+	dst.reassemblyTimeHist.merge(src.reassemblyTimeHist);
+	dst.decodeTimeHist.merge(src.decodeTimeHist);
+	dst.pacerTimeHist.merge(src.pacerTimeHist);
+	dst.renderTimeHist.merge(src.renderTimeHist);
+	dst.presentTimeHist.merge(src.presentTimeHist);
+	dst.endToEndTimeHist.merge(src.endToEndTimeHist);
 
 	if (dst.minHostProcessingLatency == 0) {
 		dst.minHostProcessingLatency = src.minHostProcessingLatency;
@@ -354,6 +334,7 @@ void Stats::formatVideoStats(DX::StepTimer const& timer, VIDEO_STATS& stats, cha
 
 	if (stats.renderedFrames != 0) {
 		char rttString[32];
+		char queueString[32];
 
 		if (stats.lastRtt != 0) {
 			snprintf(rttString, sizeof(rttString), "%u ms (variance: %u ms)", stats.lastRtt, stats.lastRttVariance);
@@ -362,20 +343,29 @@ void Stats::formatVideoStats(DX::StepTimer const& timer, VIDEO_STATS& stats, cha
 			snprintf(rttString, sizeof(rttString), "N/A");
 		}
 
+		const float avgQueueSize = m_avgQueueSize.load(std::memory_order_relaxed);
+		const int jitterBufferTarget = m_jitterBufferTarget.load(std::memory_order_relaxed);
+		if (jitterBufferTarget >= 0) {
+			snprintf(queueString, sizeof(queueString), "%.1f (target %d)", avgQueueSize, jitterBufferTarget);
+		}
+		else {
+			snprintf(queueString, sizeof(queueString), "%.1f", avgQueueSize);
+		}
+
 		ret = snprintf(&output[offset],
 					   length - offset,
 					   "Frames dropped by your network connection: %.2f%%\n"
 					   "Frames dropped due to network jitter: %.2f%%\n"
 					   "Average network latency: %s\n"
 					   "Average reassembly/decoding time: %.2f/%.2f ms\n"
-					   "Average frames in queue: %.1f\n"
+					   "Average frames in queue: %s\n"
 					   "Average frame queue/render/present: %.2f/%.2f/%.2f ms\n",
 					   stats.totalFrames ? (double)stats.networkDroppedFrames / stats.totalFrames * 100 : 0.0f,
 					   stats.totalFrames ? (double)stats.pacerDroppedFrames / stats.totalFrames * 100 : 0.0f,
 					   rttString,
 					   stats.decodedFrames ? (double)stats.totalReassemblyTimeUs / 1000.0 / stats.decodedFrames : 0.0f,
 					   stats.decodedFrames ? (double)stats.totalDecodeTime / stats.decodedFrames : 0.0f,
-					   m_avgQueueSize,
+					   queueString,
 					   stats.renderedFrames ? (double)stats.totalPacerTimeUs / 1000.0 / stats.renderedFrames : 0.0f,
 					   stats.renderedFrames ? (double)stats.totalRenderTimeUs / 1000.0 / stats.renderedFrames : 0.0f,
 					   stats.renderedFrames ? (double)stats.totalPresentTimeUs / 1000.0 / stats.renderedFrames : 0.0f);
@@ -385,6 +375,132 @@ void Stats::formatVideoStats(DX::StepTimer const& timer, VIDEO_STATS& stats, cha
 		}
 
 		offset += ret;
+
+		if (stats.framesWithEndToEndLatency > 0) {
+			const double frames = stats.framesWithEndToEndLatency;
+			const double hostMs = (double)stats.totalEndToEndHostUs / 1000.0 / frames;
+			const double networkMs = (double)stats.totalEndToEndNetworkUs / 1000.0 / frames;
+			const double clientMs = (double)stats.totalEndToEndClientUs / 1000.0 / frames;
+			ret = snprintf(&output[offset],
+						   length - offset,
+						   "Est. glass-to-glass: %.1f ms (host/net/client %.1f/%.1f/%.1f)\n",
+						   hostMs + networkMs + clientMs,
+						   hostMs,
+						   networkMs,
+						   clientMs);
+		}
+		else {
+			ret = snprintf(&output[offset],
+						   length - offset,
+						   "Est. glass-to-glass: - ms (host/net/client -/-/-)\n");
+		}
+		if (ret < 0 || (size_t)ret >= (length - offset)) {
+			Utils::Log("Error: stringifyVideoStats length overflow\n");
+			return;
+		}
+
+		offset += ret;
+
+		const AudioJitterBuffer& audio = AudioJitterBuffer::instance();
+		ret = snprintf(&output[offset],
+					   length - offset,
+					   "Audio latency: %.1f ms (target %.1f), under/overruns %llu/%llu, lost %llu\n",
+					   audio.latencyMs(),
+					   audio.targetMs(),
+					   audio.underruns(),
+					   audio.overruns(),
+					   audio.lostPackets());
+		if (ret < 0 || (size_t)ret >= (length - offset)) {
+			Utils::Log("Error: stringifyVideoStats length overflow\n");
+			return;
+		}
+
+		offset += ret;
+
+		// Only the last window, a single late callback is what people hear as a crackle
+		ret = snprintf(&output[offset],
+					   length - offset,
+					   "Audio decode %.0f/%.0f us, callback jitter %.2f/%.1f ms, min queue %.1f ms\n",
+					   m_audioWindow.decodeAvgUs,
+					   m_audioWindow.decodeMaxUs,
+					   m_audioWindow.callbackJitterMs,
+					   m_audioWindow.callbackMaxLateMs,
+					   std::max(m_audioWindow.minQueuedMs, 0.0));
+		if (ret < 0 || (size_t)ret >= (length - offset)) {
+			Utils::Log("Error: stringifyVideoStats length overflow\n");
+			return;
+		}
+
+		offset += ret;
+
+		const AVSyncMonitor& sync = AVSyncMonitor::instance();
+		if (sync.hasOffset()) {
+			ret = snprintf(&output[offset],
+						   length - offset,
+						   "A/V offset: %+.1f ms (audio %s), audio held back %.0f ms\n",
+						   sync.offsetMs(),
+						   sync.offsetMs() >= 0.0 ? "late" : "early",
+						   sync.correctionMs());
+		}
+		else {
+			ret = snprintf(&output[offset],
+						   length - offset,
+						   "A/V offset: - ms\n");
+		}
+		if (ret < 0 || (size_t)ret >= (length - offset)) {
+			Utils::Log("Error: stringifyVideoStats length overflow\n");
+			return;
+		}
+
+		offset += ret;
+
+		// Averages hide the spikes that show up as stutter, so also show the distribution
+		const struct {
+			const char* name;
+			const LatencyHistogram& hist;
+		} latencies[] = {
+			{"Reassembly", stats.reassemblyTimeHist},
+			{"Decode", stats.decodeTimeHist},
+			{"Queue", stats.pacerTimeHist},
+			{"Render", stats.renderTimeHist},
+			{"Present", stats.presentTimeHist},
+			{"End-to-end", stats.endToEndTimeHist},
+		};
+
+		ret = snprintf(&output[offset],
+					   length - offset,
+					   "Latency p50/p95/p99/max:\n");
+		if (ret < 0 || (size_t)ret >= (length - offset)) {
+			Utils::Log("Error: stringifyVideoStats length overflow\n");
+			return;
+		}
+
+		offset += ret;
+
+		for (const auto& latency : latencies) {
+			ret = snprintf(&output[offset],
+						   length - offset,
+						   "  %-10s %.2f/%.2f/%.2f/%.2f ms\n",
+						   latency.name,
+						   (double)latency.hist.percentile(50.0) / 1000.0,
+						   (double)latency.hist.percentile(95.0) / 1000.0,
+						   (double)latency.hist.percentile(99.0) / 1000.0,
+						   (double)latency.hist.max() / 1000.0);
+			if (ret < 0 || (size_t)ret >= (length - offset)) {
+				Utils::Log("Error: stringifyVideoStats length overflow\n");
+				return;
+			}
+
+			offset += ret;
+		}
+
+		ret = LaunchTimeline::instance().format(&output[offset], length - offset);
+		if (ret < 0) {
+			Utils::Log("Error: stringifyVideoStats length overflow\n");
+			return;
+		}
+
+		offset += ret;
 	}
 
 #if defined(_DEBUG)
@@ -1,12 +1,13 @@
 #pragma once
 
 #include "pch.h"
-#include <mutex>
+#include <atomic>
 #include <string>
-#include "../Common/StepTimer.h"
 #include "../Utils/FloatBuffer.h"
+#include "../Utils/LatencyHistogram.h"
 
 #include "BandwidthTracker.h"
+#include "../Streaming/AudioStats.h"
 
 extern "C" {
 	#include "Limelight.h"
@@ -39,6 +40,10 @@ typedef struct _VIDEO_STATS {
 	uint64_t totalRenderTimeUs;
 	uint64_t totalPresentTimeUs;
 	double totalPresentDisplayMs;
+	uint32_t framesWithEndToEndLatency;
+	uint64_t totalEndToEndHostUs;
+	uint64_t totalEndToEndNetworkUs;
+	uint64_t totalEndToEndClientUs;
 	uint32_t lastRtt;
 	uint32_t lastRttVariance;
 	double totalFps;
@@ -46,8 +51,23 @@ typedef struct _VIDEO_STATS {
 	double decodedFps;
 	double renderedFps;
 	double measurementStartTimestamp;
+
+	// Per-frame distributions in microseconds, the totals above only give us averages
+	LatencyHistogram reassemblyTimeHist;
+	LatencyHistogram decodeTimeHist;
+	LatencyHistogram pacerTimeHist;
+	LatencyHistogram renderTimeHist;
+	LatencyHistogram presentTimeHist;
+	LatencyHistogram endToEndTimeHist;
 } VIDEO_STATS, *PVIDEO_STATS;
 
+struct MLFrameTimeline;
+
+namespace DX
+{
+	class StepTimer;
+}
+
 namespace moonlight_xbox_dx
 {
 	class Stats
@@ -61,22 +81,91 @@ namespace moonlight_xbox_dx
 		void SubmitDecodeMs(double decodeMs);
 		void SubmitDroppedFrame(int count);
 		void SubmitAvgQueueSize(float avgQueueSize);
+		void SubmitJitterBufferTarget(int targetDepth);
 		void SubmitPacerTime(int64_t pacerTimeQpc);
 		void SubmitPresentPacing(double presentDisplayMs);
 		void SubmitRenderStats(int64_t preWaitTimeUs, int64_t renderTimeUs, int64_t presentTimeUs, bool hitDeadline);
+		void SubmitFrameTimeline(const MLFrameTimeline& timeline);
+
+		// Hands the submitting threads' slots back once a stream's threads are gone
+		void ReleaseThreadSlots();
+		int ThreadSlotsClaimed() const; // threads that submitted since the last release
 
 	private:
+		// Counters accumulated by the Submit* methods. They only ever grow, each window is
+		// the difference between two snapshots.
+		enum StatCounter {
+			STAT_RECEIVED_FRAMES,
+			STAT_TOTAL_FRAMES,
+			STAT_NETWORK_DROPPED_FRAMES,
+			STAT_PACER_DROPPED_FRAMES,
+			STAT_DECODED_FRAMES,
+			STAT_RENDERED_FRAMES,
+			STAT_HIT_DEADLINES,
+			STAT_MISSED_DEADLINES,
+			STAT_HOST_PROCESSING_LATENCY,
+			STAT_FRAMES_WITH_HOST_PROCESSING_LATENCY,
+			STAT_REASSEMBLY_TIME_US,
+			STAT_DECODE_TIME_NS,
+			STAT_PACER_TIME_US,
+			STAT_PREWAIT_TIME_US,
+			STAT_RENDER_TIME_US,
+			STAT_PRESENT_TIME_US,
+			STAT_PRESENT_DISPLAY_NS,
+			STAT_END_TO_END_FRAMES,
+			STAT_END_TO_END_HOST_US,
+			STAT_END_TO_END_NETWORK_US,
+			STAT_END_TO_END_CLIENT_US,
+			STAT_COUNT
+		};
+
+		// Per-frame timings that are also kept as histograms
+		enum StatHistogram {
+			HIST_REASSEMBLY_TIME_US,
+			HIST_DECODE_TIME_US,
+			HIST_PACER_TIME_US,
+			HIST_RENDER_TIME_US,
+			HIST_PRESENT_TIME_US,
+			HIST_END_TO_END_US,
+			HIST_COUNT
+		};
+
+		// One per submitting thread, on its own cache line so the decoder and render threads
+		// never contend with each other or with ShouldUpdateDisplay.
+		struct alignas(64) StatsSlot {
+			std::atomic<bool>     claimed;                  // by a thread, until ReleaseThreadSlots()
+			std::atomic<uint64_t> counters[STAT_COUNT];
+			std::atomic<uint16_t> minHostProcessingLatency; // reset every window, 0 = none
+			std::atomic<uint16_t> maxHostProcessingLatency; // reset every window
+			std::atomic<uint32_t> histograms[HIST_COUNT][LatencyHistogram::BUCKET_COUNT]; // reset every window
+			std::atomic<uint64_t> histogramMax[HIST_COUNT];                               // reset every window
+		};
+
+		static constexpr int MAX_STATS_THREADS = 4;
+
+		StatsSlot* threadSlot();
+		static void bump(StatsSlot* slot, StatCounter counter, uint64_t value);
+		static void recordLatency(StatsSlot* slot, StatHistogram histogram, int64_t valueUs);
+		void collectWindow(VIDEO_STATS& window);
+
 		void addVideoStats(DX::StepTimer const& timer, VIDEO_STATS& src, VIDEO_STATS& dst);
 		void formatVideoStats(DX::StepTimer const& timer, VIDEO_STATS& stats, char* output, size_t length);
 
-		std::mutex                           m_mutex;
+		std::atomic<uint32_t>                m_slotEpoch;        // changes on every release, invalidating threadSlot()'s cache
+		StatsSlot                            m_slots[MAX_STATS_THREADS];
+		StatsSlot                            m_sharedSlot;       // used by any threads beyond MAX_STATS_THREADS
+		std::atomic<int>                     m_slotsUsed;        // threads that claimed a slot since the last release
+		uint64_t                             m_lastTotals[STAT_COUNT]; // ShouldUpdateDisplay only
 
 		// Moonlight stats overlay
 		VIDEO_STATS                          m_ActiveWndVideoStats;
 		VIDEO_STATS                          m_LastWndVideoStats;
 		VIDEO_STATS                          m_GlobalVideoStats;
 		BandwidthTracker                     m_bwTracker;
-		float                                m_avgQueueSize;
+		std::atomic<float>                   m_avgQueueSize;
+		std::atomic<int>                     m_jitterBufferTarget; // -1 unless using adaptive frame pacing
+		std::atomic<uint32_t>                m_oneWayNetworkUs;    // half the RTT, refreshed every window
+		AudioStatsWindow                     m_audioWindow;        // refreshed every window
 		double                               m_avgMbpsSmoothed;
 	};
 }
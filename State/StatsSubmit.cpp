@@ -0,0 +1,241 @@
+#include "pch.h"
+#include "Stats.h"
+#include "Utils.hpp"
+#include "../Plot/ImGuiPlots.h"
+#include "../Streaming/FramePool.h"
+
+// The producer side of Stats, the Submit* hooks and the per-thread slots they write to. Kept apart
+// from the overlay code so it builds on its own, see Tools/StatsBench.
+
+using namespace moonlight_xbox_dx;
+
+// Unique across Stats instances, so a thread's cached slot is never mistaken for one in another instance
+static std::atomic<uint32_t> s_nextSlotEpoch{1};
+
+Stats::Stats() :
+	m_slotEpoch(s_nextSlotEpoch.fetch_add(1)),
+	m_slotsUsed(0),
+	m_avgQueueSize(0.0),
+	m_jitterBufferTarget(-1),
+	m_oneWayNetworkUs(0),
+	m_audioWindow(),
+	m_avgMbpsSmoothed(0.0)
+{
+	ZeroMemory(&m_ActiveWndVideoStats, sizeof(VIDEO_STATS));
+	ZeroMemory(&m_LastWndVideoStats, sizeof(VIDEO_STATS));
+	ZeroMemory(&m_GlobalVideoStats, sizeof(VIDEO_STATS));
+	ZeroMemory(m_lastTotals, sizeof(m_lastTotals));
+
+	auto resetSlot = [](StatsSlot& slot) {
+		slot.claimed.store(false, std::memory_order_relaxed);
+		for (auto& counter : slot.counters) {
+			counter.store(0, std::memory_order_relaxed);
+		}
+		slot.minHostProcessingLatency.store(0, std::memory_order_relaxed);
+		slot.maxHostProcessingLatency.store(0, std::memory_order_relaxed);
+		for (int h = 0; h < HIST_COUNT; h++) {
+			for (auto& bucket : slot.histograms[h]) {
+				bucket.store(0, std::memory_order_relaxed);
+			}
+			slot.histogramMax[h].store(0, std::memory_order_relaxed);
+		}
+	};
+	for (auto& slot : m_slots) {
+		resetSlot(slot);
+	}
+	resetSlot(m_sharedSlot);
+}
+
+/// Hooks for stat producers, where possible these are combined into one call
+/// These are called from the decoder and render threads several times per frame and never take a lock.
+
+// 1. The size in bytes of one video frame, we use this to also increment frame counters.
+// 2. Time in milliseconds from first packet of a frame until fully reassembled frame is ready for decoding
+//    Includes time spent in FEC reassembly
+// 3. Host processing latency (encode time)
+// 4. network packet loss (caller reports frame sequence number holes)
+void Stats::SubmitVideoBytesAndReassemblyTime(uint32_t length, PDECODE_UNIT decodeUnit, uint32_t droppedFrames)
+{
+	StatsSlot* slot = threadSlot();
+	bump(slot, STAT_RECEIVED_FRAMES, 1);
+	bump(slot, STAT_TOTAL_FRAMES, 1);
+
+	// bandwidth
+	m_bwTracker.AddBytes(length);
+
+	// reassembly time
+	uint32_t reassemblyUs = (uint32_t)(decodeUnit->enqueueTimeUs - decodeUnit->receiveTimeUs);
+	bump(slot, STAT_REASSEMBLY_TIME_US, reassemblyUs);
+	recordLatency(slot, HIST_REASSEMBLY_TIME_US, reassemblyUs);
+
+	// Host processing latency
+	uint16_t frameHPL = decodeUnit->frameHostProcessingLatency;
+	if (frameHPL != 0) {
+		// ShouldUpdateDisplay resets min/max each window, so these need a CAS
+		uint16_t minHPL = slot->minHostProcessingLatency.load(std::memory_order_relaxed);
+		while ((minHPL == 0 || frameHPL < minHPL) &&
+		       !slot->minHostProcessingLatency.compare_exchange_weak(minHPL, frameHPL, std::memory_order_relaxed)) {
+		}
+		uint16_t maxHPL = slot->maxHostProcessingLatency.load(std::memory_order_relaxed);
+		while (frameHPL > maxHPL &&
+		       !slot->maxHostProcessingLatency.compare_exchange_weak(maxHPL, frameHPL, std::memory_order_relaxed)) {
+		}
+		bump(slot, STAT_FRAMES_WITH_HOST_PROCESSING_LATENCY, 1);
+		bump(slot, STAT_HOST_PROCESSING_LATENCY, frameHPL);
+	}
+
+	// Network packet loss
+	if (droppedFrames > 0) {
+		bump(slot, STAT_NETWORK_DROPPED_FRAMES, droppedFrames);
+		bump(slot, STAT_TOTAL_FRAMES, droppedFrames);
+	}
+	ImGuiPlots::instance().observeFloat(PLOT_DROPPED_NETWORK, (float)droppedFrames);
+
+	// Host frametime graph, uses raw 90kHz units to avoid rounding errors
+	static uint32_t lastHostPts = 0;
+	if (lastHostPts != 0) {
+		const uint32_t delta90k = (uint32_t)(decodeUnit->rtpTimestamp - lastHostPts); // wrap-safe
+		ImGuiPlots::instance().observeFloat(PLOT_HOST_FRAMETIME, (float)(delta90k / 90.0f));
+	}
+	lastHostPts = (uint32_t)decodeUnit->rtpTimestamp;
+}
+
+// Time in milliseconds we spent decoding one frame, it is added up to later be divided by decodedFrames
+void Stats::SubmitDecodeMs(double decodeMs) {
+	StatsSlot* slot = threadSlot();
+	bump(slot, STAT_DECODE_TIME_NS, (uint64_t)(decodeMs * 1000000.0));
+	recordLatency(slot, HIST_DECODE_TIME_US, (int64_t)(decodeMs * 1000.0));
+	bump(slot, STAT_DECODED_FRAMES, 1);
+}
+
+void Stats::SubmitDroppedFrame(int count) {
+	bump(threadSlot(), STAT_PACER_DROPPED_FRAMES, count);
+}
+
+void Stats::SubmitAvgQueueSize(float avgQueueSize) {
+	m_avgQueueSize.store(avgQueueSize, std::memory_order_relaxed);
+}
+
+// Current target depth of the adaptive frame pacing jitter buffer
+void Stats::SubmitJitterBufferTarget(int targetDepth) {
+	m_jitterBufferTarget.store(targetDepth, std::memory_order_relaxed);
+}
+
+// Time in microseconds we spent in the frame pacer, and time for rendering the frame.
+// Also increments the rendered frame count.
+void Stats::SubmitPacerTime(int64_t pacerTimeQpc) {
+	int64_t pacerTimeUs = QpcToUs(pacerTimeQpc);
+	StatsSlot* slot = threadSlot();
+	bump(slot, STAT_PACER_TIME_US, pacerTimeUs);
+	recordLatency(slot, HIST_PACER_TIME_US, pacerTimeUs);
+}
+
+// Present to display latency (how close to hitting vblank we are)
+void Stats::SubmitPresentPacing(double presentDisplayMs) {
+	bump(threadSlot(), STAT_PRESENT_DISPLAY_NS, (uint64_t)(presentDisplayMs * 1000000.0));
+}
+
+// High-level render loop timings
+void Stats::SubmitRenderStats(int64_t preWaitTimeUs, int64_t renderTimeUs, int64_t presentTimeUs, bool hitDeadline) {
+	StatsSlot* slot = threadSlot();
+	bump(slot, STAT_RENDER_TIME_US, renderTimeUs);
+	bump(slot, STAT_RENDERED_FRAMES, 1);
+	recordLatency(slot, HIST_RENDER_TIME_US, renderTimeUs);
+	recordLatency(slot, HIST_PRESENT_TIME_US, presentTimeUs);
+
+	if (hitDeadline) {
+		bump(slot, STAT_HIT_DEADLINES, 1);
+	} else {
+		bump(slot, STAT_MISSED_DEADLINES, 1);
+
+#if defined(_DEBUG)
+		Utils::Logf("missed deadline: preWait + render: %.2f + %.2f = %.2f ms\n",
+			(double)preWaitTimeUs / 1000.0, (double)renderTimeUs / 1000.0,
+			(double)(preWaitTimeUs + renderTimeUs) / 1000.0);
+#endif
+	}
+
+	// Only shown in debug builds
+	bump(slot, STAT_PREWAIT_TIME_US, preWaitTimeUs);
+	bump(slot, STAT_PRESENT_TIME_US, presentTimeUs);
+}
+
+// Estimated glass-to-glass latency of one frame, called by Pacer the first time the frame is presented.
+// We can't see the host's capture or the display's scanout, so this is the sum of:
+// host processing latency (as reported by the host) + half the RTT + first packet received until Present()
+void Stats::SubmitFrameTimeline(const MLFrameTimeline& timeline) {
+	if (timeline.receiveQpc == 0 || timeline.presentQpc <= timeline.receiveQpc) {
+		return;
+	}
+
+	const int64_t hostUs = (int64_t)timeline.hostProcessingLatency * 100;
+	const int64_t networkUs = m_oneWayNetworkUs.load(std::memory_order_relaxed);
+	const int64_t clientUs = QpcToUs(timeline.presentQpc - timeline.receiveQpc);
+	const int64_t totalUs = hostUs + networkUs + clientUs;
+
+	StatsSlot* slot = threadSlot();
+	bump(slot, STAT_END_TO_END_FRAMES, 1);
+	bump(slot, STAT_END_TO_END_HOST_US, hostUs);
+	bump(slot, STAT_END_TO_END_NETWORK_US, networkUs);
+	bump(slot, STAT_END_TO_END_CLIENT_US, clientUs);
+	recordLatency(slot, HIST_END_TO_END_US, totalUs);
+
+	ImGuiPlots::instance().observeFloat(PLOT_GLASS_TO_GLASS, (float)(totalUs / 1000.0));
+}
+
+// Called once the stream's decoder and render threads are done, so that the threads of the next
+// stream get slots of their own rather than all sharing m_sharedSlot. The counters stay where they
+// are, so windows collected across a release still add up. A thread that is still submitting
+// claims a slot again on its next call, and if two threads briefly end up in the same slot
+// their updates are still atomic.
+void Stats::ReleaseThreadSlots() {
+	for (auto& slot : m_slots) {
+		slot.claimed.store(false, std::memory_order_release);
+	}
+	m_slotsUsed.store(0, std::memory_order_relaxed);
+	m_slotEpoch.store(s_nextSlotEpoch.fetch_add(1), std::memory_order_release);
+}
+
+int Stats::ThreadSlotsClaimed() const {
+	return m_slotsUsed.load(std::memory_order_relaxed);
+}
+
+/// private methods
+
+// Each submitting thread claims a free slot the first time it submits to this Stats instance, and
+// again after ReleaseThreadSlots(). Threads beyond MAX_STATS_THREADS share m_sharedSlot, which is
+// still correct because every update is an atomic RMW, just not contention free.
+Stats::StatsSlot* Stats::threadSlot() {
+	thread_local uint32_t tlsEpoch = 0;
+	thread_local StatsSlot* tlsSlot = nullptr;
+
+	const uint32_t epoch = m_slotEpoch.load(std::memory_order_acquire);
+	if (tlsEpoch != epoch) {
+		m_slotsUsed.fetch_add(1, std::memory_order_relaxed);
+		tlsSlot = &m_sharedSlot;
+		for (auto& slot : m_slots) {
+			bool claimed = false;
+			if (slot.claimed.compare_exchange_strong(claimed, true, std::memory_order_acq_rel)) {
+				tlsSlot = &slot;
+				break;
+			}
+		}
+		tlsEpoch = epoch;
+	}
+	return tlsSlot;
+}
+
+inline void Stats::bump(StatsSlot* slot, StatCounter counter, uint64_t value) {
+	slot->counters[counter].fetch_add(value, std::memory_order_relaxed);
+}
+
+// Same idea as bump(), but counts the value into its histogram bucket
+void Stats::recordLatency(StatsSlot* slot, StatHistogram histogram, int64_t valueUs) {
+	const uint64_t value = valueUs > 0 ? (uint64_t)valueUs : 0;
+	slot->histograms[histogram][LatencyHistogram::bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+
+	uint64_t maxValue = slot->histogramMax[histogram].load(std::memory_order_relaxed);
+	while (value > maxValue &&
+	       !slot->histogramMax[histogram].compare_exchange_weak(maxValue, value, std::memory_order_relaxed)) {
+	}
+}
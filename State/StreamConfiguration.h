@@ -14,12 +14,15 @@ namespace moonlight_xbox_dx
 		property Platform::String^ audioConfig;
 		property Platform::String^ videoCodec;
 		property Platform::String^ framePacing;
+		property int avSyncWindow;
 		property bool enableHDR;
 		property bool playAudioOnPC;
+		property bool upmixAudio;
 		property bool enableVsync;
 		property bool enableSOPS;
 		property bool enableStats;
 		property bool enableGraphs;
+		property bool recordPacingTrace;
 	};
 
 	moonlight_xbox_dx::StreamConfiguration^ GetStreamConfig();
@@ -0,0 +1,108 @@
+#include "pch.h"
+#include "AVSyncMonitor.h"
+#include "AudioJitterBuffer.h"
+
+#include <algorithm>
+
+AVSyncMonitor &AVSyncMonitor::instance() {
+	static AVSyncMonitor inst;
+	return inst;
+}
+
+// Called by StartStreaming, before the audio and video streams start
+void AVSyncMonitor::init(double windowMs) {
+	m_audioPathEwmaMs = 0.0;
+	m_haveAudioPath = false;
+	m_videoPathEwmaMs = 0.0;
+	m_haveVideoPath = false;
+	m_lastCorrectionQpc = 0;
+
+	m_audioValid.store(false, std::memory_order_relaxed);
+	m_offsetValid.store(false, std::memory_order_relaxed);
+	m_offsetMs.store(0.0, std::memory_order_relaxed);
+	m_correctionMs.store(0.0, std::memory_order_relaxed);
+	m_windowMs.store(windowMs > 0.0 ? windowMs : 0.0, std::memory_order_relaxed);
+	AudioJitterBuffer::instance().setSyncDelayMs(0.0);
+}
+
+// Audio receive thread only
+void AVSyncMonitor::observeAudio(int64_t arrivalQpc, int64_t playoutQpc, double packetMs) {
+	const double pathMs = QpcToMs(playoutQpc - arrivalQpc) + packetMs;
+	if (!m_haveAudioPath) {
+		m_audioPathEwmaMs = pathMs;
+		m_haveAudioPath = true;
+	} else {
+		m_audioPathEwmaMs += EWMA_ALPHA * (pathMs - m_audioPathEwmaMs);
+	}
+	m_audioPathMs.store(m_audioPathEwmaMs, std::memory_order_relaxed);
+	m_audioValid.store(true, std::memory_order_release);
+}
+
+// Render thread only
+void AVSyncMonitor::observeVideo(int64_t receiveQpc, int64_t presentQpc, double hostLatencyMs) {
+	if (receiveQpc == 0 || presentQpc <= receiveQpc) {
+		return;
+	}
+
+	const double pathMs = QpcToMs(presentQpc - receiveQpc) + hostLatencyMs;
+	if (!m_haveVideoPath) {
+		m_videoPathEwmaMs = pathMs;
+		m_haveVideoPath = true;
+	} else {
+		m_videoPathEwmaMs += EWMA_ALPHA * (pathMs - m_videoPathEwmaMs);
+	}
+
+	if (!m_audioValid.load(std::memory_order_acquire)) {
+		return; // no audio yet, or the stream has none
+	}
+
+	const double offset = m_audioPathMs.load(std::memory_order_relaxed) - m_videoPathEwmaMs;
+	m_offsetMs.store(offset, std::memory_order_relaxed);
+	m_offsetValid.store(true, std::memory_order_release);
+
+	correct(offset, presentQpc);
+}
+
+// Moves the audio delay one step at a time, the jitter buffer needs a while to reach a new
+// target and the smoothed offset a while longer to show it
+void AVSyncMonitor::correct(double offsetMs, int64_t nowQpc) {
+	const double window = m_windowMs.load(std::memory_order_relaxed);
+	if (window <= 0.0) {
+		return;
+	}
+	if (m_lastCorrectionQpc != 0 && QpcToMs(nowQpc - m_lastCorrectionQpc) < CORRECTION_INTERVAL_MS) {
+		return;
+	}
+
+	const double current = m_correctionMs.load(std::memory_order_relaxed);
+	double next = current;
+	if (offsetMs < -window) {
+		next = std::min(current + CORRECTION_STEP_MS, MAX_CORRECTION_MS);
+	} else if (offsetMs > window) {
+		next = std::max(current - CORRECTION_STEP_MS, 0.0);
+	}
+
+	m_lastCorrectionQpc = nowQpc;
+	if (next != current) {
+		FQLog("AVSyncMonitor: offset %.1fms outside +/-%.0fms, audio delay %.0fms -> %.0fms\n",
+		      offsetMs, window, current, next);
+		m_correctionMs.store(next, std::memory_order_relaxed);
+		AudioJitterBuffer::instance().setSyncDelayMs(next);
+	}
+}
+
+bool AVSyncMonitor::hasOffset() const {
+	return m_offsetValid.load(std::memory_order_acquire);
+}
+
+double AVSyncMonitor::offsetMs() const {
+	return m_offsetMs.load(std::memory_order_relaxed);
+}
+
+double AVSyncMonitor::correctionMs() const {
+	return m_correctionMs.load(std::memory_order_relaxed);
+}
+
+double AVSyncMonitor::windowMs() const {
+	return m_windowMs.load(std::memory_order_relaxed);
+}
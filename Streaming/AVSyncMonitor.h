@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Measures the lip-sync offset between audio and video and optionally keeps it inside a window.
+//
+// Both streams are timed on the client's QPC clock from the moment their data arrives:
+//   audio: arrival -> playout, from the ring fill and device buffer when the packet is queued,
+//          plus the packet duration the host spent capturing it
+//   video: first packet received -> first Present, plus the host processing latency it reports
+// Network delay is assumed to be the same for both, so the difference of the two smoothed paths
+// is how far audio lags the picture. Positive means audio is late.
+//
+// When a window is set and audio runs early by more than that, the audio jitter buffer is asked
+// to hold CORRECTION_STEP_MS more every CORRECTION_INTERVAL_MS, and gives it back when audio
+// turns late. Audio that is late with no extra delay left to remove is only reported, video is
+// never held back for it.
+//
+// Timestamps are passed in, so the class runs on a virtual clock as well as on QPC.
+
+class AVSyncMonitor {
+  public:
+	// Singleton
+	static AVSyncMonitor &instance();
+
+	// Call before each stream. windowMs <= 0 only measures.
+	void init(double windowMs);
+
+	// Audio receive thread, for each packet queued for playback
+	void observeAudio(int64_t arrivalQpc, int64_t playoutQpc, double packetMs);
+
+	// Render thread, for each frame the first time it is presented
+	void observeVideo(int64_t receiveQpc, int64_t presentQpc, double hostLatencyMs);
+
+	// Any thread
+	bool hasOffset() const;
+	double offsetMs() const;     // smoothed, positive when audio lags video
+	double correctionMs() const; // extra delay currently requested from the audio jitter buffer
+	double windowMs() const;
+
+	static constexpr double EWMA_ALPHA = 1.0 / 64.0;
+	static constexpr double CORRECTION_STEP_MS = 5.0;
+	static constexpr double MAX_CORRECTION_MS = 100.0;
+	static constexpr double CORRECTION_INTERVAL_MS = 2000.0;
+
+  private:
+	AVSyncMonitor() = default;
+	AVSyncMonitor(const AVSyncMonitor &) = delete;
+	AVSyncMonitor &operator=(const AVSyncMonitor &) = delete;
+
+	void correct(double offsetMs, int64_t nowQpc);
+
+	// Audio thread owned
+	double m_audioPathEwmaMs = 0.0;
+	bool m_haveAudioPath = false;
+
+	// Render thread owned
+	double m_videoPathEwmaMs = 0.0;
+	bool m_haveVideoPath = false;
+	int64_t m_lastCorrectionQpc = 0;
+
+	// Published values
+	std::atomic<double> m_audioPathMs{0.0};
+	std::atomic<bool> m_audioValid{false};
+	std::atomic<double> m_offsetMs{0.0};
+	std::atomic<bool> m_offsetValid{false};
+	std::atomic<double> m_correctionMs{0.0};
+	std::atomic<double> m_windowMs{0.0};
+};
@@ -0,0 +1,210 @@
+// Correction suite for AVSyncMonitor, built on the host rather than into the app
+//
+// Audio packets every 5ms and video frames at 60fps are fed in on a virtual clock with paths the
+// test controls. With audio early by more than the window, the delay requested from the audio
+// jitter buffer must grow by exactly CORRECTION_STEP_MS per CORRECTION_INTERVAL_MS and stop at
+// MAX_CORRECTION_MS, and the jitter buffer's target must carry it. When the extra delay shows up
+// in the audio path, the correction must stop as soon as the offset is back inside the window and
+// then hold. Once audio turns late it must be given back a step at a time, never below zero, and
+// audio that is late with nothing left to give back is only reported. Without a window nothing
+// is corrected at all.
+//
+// Built through Tools/CMakeLists.txt.
+
+#include "pch.h"
+#include "AVSyncMonitor.h"
+#include "AudioJitterBuffer.h"
+
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+static int g_failures = 0;
+
+#define CHECK(cond, ...)                                     \
+	do {                                                     \
+		if (!(cond)) {                                       \
+			fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+			fprintf(stderr, __VA_ARGS__);                    \
+			fprintf(stderr, "\n");                           \
+			g_failures++;                                    \
+		}                                                    \
+	} while (0)
+
+static const double PACKET_MS = 5.0;
+static const double FRAME_MS = 1000.0 / 60.0;
+static const double WINDOW_MS = 20.0;
+
+// Jitter buffer target on a clean network with a 10ms device period and 5ms packets
+static const double CLEAN_TARGET_MS = 15.0;
+
+struct Change {
+	double atMs;
+	double correctionMs;
+};
+
+// Feeds both streams from where the last run stopped until toMs. audioPathMs gets the current correction, so the extra
+// delay can show up in the audio path the way the jitter buffer would add it.
+class Streams {
+  public:
+	std::function<double(double correctionMs)> audioPathMs;
+	std::function<double()> videoPathMs;
+	std::vector<Change> changes;
+
+	void run(double toMs) {
+		AVSyncMonitor &sync = AVSyncMonitor::instance();
+		while (m_nowMs < toMs) {
+			const double correction = sync.correctionMs();
+			if (m_nextAudioMs <= m_nextVideoMs) {
+				const int64_t arrival = MsToQpc(m_nextAudioMs);
+				sync.observeAudio(arrival, arrival + MsToQpc(audioPathMs(correction) - PACKET_MS), PACKET_MS);
+				m_nowMs = m_nextAudioMs;
+				m_nextAudioMs += PACKET_MS;
+			} else {
+				const int64_t present = MsToQpc(m_nextVideoMs);
+				sync.observeVideo(present - MsToQpc(videoPathMs()), present, 0.0);
+				m_nowMs = m_nextVideoMs;
+				m_nextVideoMs += FRAME_MS;
+			}
+			if (sync.correctionMs() != correction) {
+				changes.push_back({m_nowMs, sync.correctionMs()});
+			}
+		}
+	}
+
+	double nowMs() const {
+		return m_nowMs;
+	}
+
+  private:
+	// Video starts a little later, so there is audio to compare it with
+	double m_nowMs = 0.0;
+	double m_nextAudioMs = 0.0;
+	double m_nextVideoMs = 1.0;
+};
+
+// What the jitter buffer targets with the correction added
+static double jitterTargetMs() {
+	AudioJitterBuffer &jitter = AudioJitterBuffer::instance();
+	jitter.init(48000, 240, 480, 2);
+	return jitter.targetMs();
+}
+
+// Consecutive changes must be single steps in one direction, CORRECTION_INTERVAL_MS apart
+static void checkSteps(const std::vector<Change> &changes, double direction, const char *what) {
+	double previous = changes.empty() ? 0.0 : changes[0].correctionMs - direction * AVSyncMonitor::CORRECTION_STEP_MS;
+	for (size_t i = 0; i < changes.size(); i++) {
+		CHECK(std::fabs(changes[i].correctionMs - previous - direction * AVSyncMonitor::CORRECTION_STEP_MS) < 1e-9,
+		      "%s: step %zu went from %.1fms to %.1fms", what, i, previous, changes[i].correctionMs);
+		if (i > 0) {
+			const double interval = changes[i].atMs - changes[i - 1].atMs;
+			// Steps are only taken on frames, so they can land up to a frame late
+			CHECK(interval > AVSyncMonitor::CORRECTION_INTERVAL_MS - 1e-6 &&
+			          interval < AVSyncMonitor::CORRECTION_INTERVAL_MS + FRAME_MS,
+			      "%s: step %zu came %.1fms after the previous one", what, i, interval);
+		}
+		previous = changes[i].correctionMs;
+	}
+}
+
+// Audio far ahead and nothing it does catches up: steps all the way to the clamp
+static void testStepAndClamp() {
+	AVSyncMonitor &sync = AVSyncMonitor::instance();
+	sync.init(WINDOW_MS);
+
+	Streams streams;
+	streams.audioPathMs = [](double) { return 30.0; };
+	streams.videoPathMs = [] { return 250.0; };
+	streams.run(60000);
+
+	CHECK(sync.hasOffset() && std::fabs(sync.offsetMs() + 220.0) < 0.5, "offset is %.1fms, expected -220ms",
+	      sync.offsetMs());
+	const size_t steps = (size_t)(AVSyncMonitor::MAX_CORRECTION_MS / AVSyncMonitor::CORRECTION_STEP_MS);
+	CHECK(streams.changes.size() == steps, "%zu steps to the clamp, expected %zu", streams.changes.size(), steps);
+	checkSteps(streams.changes, 1.0, "audio early");
+	if (!streams.changes.empty()) {
+		const Change &last = streams.changes.back();
+		printf("audio early by 220ms: %zu steps, clamped at %.0fms after %.1fs\n", streams.changes.size(),
+		       last.correctionMs, last.atMs / 1000);
+		CHECK(last.correctionMs == AVSyncMonitor::MAX_CORRECTION_MS, "stopped at %.1fms", last.correctionMs);
+		CHECK(last.atMs < (steps - 1) * AVSyncMonitor::CORRECTION_INTERVAL_MS + FRAME_MS + 1.0,
+		      "reached the clamp after %.1fs", last.atMs / 1000);
+	}
+	CHECK(sync.correctionMs() == AVSyncMonitor::MAX_CORRECTION_MS, "correction went past the clamp to %.1fms",
+	      sync.correctionMs());
+	CHECK(std::fabs(jitterTargetMs() - (CLEAN_TARGET_MS + AVSyncMonitor::MAX_CORRECTION_MS)) < 0.1,
+	      "the jitter buffer targets %.1fms with %.0fms of correction", jitterTargetMs(), sync.correctionMs());
+}
+
+// The extra delay reaches the audio path, so the correction stops once it is in the window, then
+// video speeds up and the delay is given back
+static void testSettleAndGiveBack() {
+	AVSyncMonitor &sync = AVSyncMonitor::instance();
+	sync.init(WINDOW_MS);
+
+	double videoMs = 97.5;
+	Streams streams;
+	streams.audioPathMs = [](double correction) { return 30.0 + correction; };
+	streams.videoPathMs = [&] { return videoMs; };
+
+	// Offset -67.5ms, so 50ms of delay brings it inside the window. Offsets right on its edge
+	// would leave the outcome to the last bit of the smoothing.
+	streams.run(30000);
+	printf("audio early by 67.5ms: settled at %.0fms, offset %.1fms\n", sync.correctionMs(), sync.offsetMs());
+	CHECK(sync.correctionMs() == 50.0, "settled at %.1fms, expected 50ms", sync.correctionMs());
+	CHECK(std::fabs(sync.offsetMs()) <= WINDOW_MS + 0.5, "offset %.1fms is outside the window", sync.offsetMs());
+	checkSteps(streams.changes, 1.0, "settling");
+	CHECK(std::fabs(jitterTargetMs() - (CLEAN_TARGET_MS + 50.0)) < 0.1, "the jitter buffer targets %.1fms",
+	      jitterTargetMs());
+
+	// Settled, nothing moves
+	streams.changes.clear();
+	streams.run(streams.nowMs() + 20000);
+	CHECK(streams.changes.empty(), "a settled correction moved %zu times", streams.changes.size());
+
+	// Video gets 70ms faster, audio is now late by 52.5ms and the delay has to go
+	videoMs = 27.5;
+	streams.run(streams.nowMs() + 30000);
+	printf("audio late by 52.5ms: gave back to %.0fms in %zu steps, offset %.1fms\n", sync.correctionMs(),
+	       streams.changes.size(), sync.offsetMs());
+	CHECK(sync.correctionMs() == 15.0, "gave back to %.1fms, expected 15ms", sync.correctionMs());
+	CHECK(std::fabs(sync.offsetMs()) <= WINDOW_MS + 0.5, "offset %.1fms is outside the window", sync.offsetMs());
+	checkSteps(streams.changes, -1.0, "giving back");
+
+	// Audio late whatever it does: the rest goes, and it never goes negative
+	videoMs = 5.0;
+	streams.changes.clear();
+	streams.run(streams.nowMs() + 30000);
+	CHECK(sync.correctionMs() == 0.0, "%.1fms of correction left with audio late", sync.correctionMs());
+	CHECK(streams.changes.size() == 3, "%zu steps to give back 15ms", streams.changes.size());
+	CHECK(sync.offsetMs() > WINDOW_MS, "late audio reported at %.1fms", sync.offsetMs());
+	CHECK(std::fabs(jitterTargetMs() - CLEAN_TARGET_MS) < 0.1, "the jitter buffer still holds %.1fms extra",
+	      jitterTargetMs() - CLEAN_TARGET_MS);
+}
+
+static void testMeasureOnly() {
+	AVSyncMonitor &sync = AVSyncMonitor::instance();
+	sync.init(0.0);
+
+	Streams streams;
+	streams.audioPathMs = [](double correction) { return 30.0 + correction; };
+	streams.videoPathMs = [] { return 250.0; };
+	streams.run(20000);
+	CHECK(sync.hasOffset() && sync.offsetMs() < -200.0, "offset not measured without a window");
+	CHECK(streams.changes.empty() && sync.correctionMs() == 0.0, "corrected without a window");
+
+	// A frame without a receive time says nothing about the path
+	const double offset = sync.offsetMs();
+	sync.observeVideo(0, MsToQpc(streams.nowMs() + 1.0), 0.0);
+	CHECK(sync.offsetMs() == offset, "a frame without a receive time moved the offset");
+}
+
+int main(int argc, char **argv) {
+	testStepAndClamp();
+	testSettleAndGiveBack();
+	testMeasureOnly();
+
+	printf("%d failures\n", g_failures);
+	return g_failures == 0 ? 0 : 1;
+}
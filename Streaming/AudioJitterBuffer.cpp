@@ -0,0 +1,164 @@
+#include "pch.h"
+#include "AudioJitterBuffer.h"
+
+#include <algorithm>
+#include <cmath>
+
+AudioJitterBuffer &AudioJitterBuffer::instance() {
+	static AudioJitterBuffer inst;
+	return inst;
+}
+
+void AudioJitterBuffer::init(int sampleRate, int samplesPerFrame, int devicePeriodFrames, int devicePeriods) {
+	m_sampleRate = sampleRate > 0 ? sampleRate : 48000;
+	m_samplesPerFrame = samplesPerFrame > 0 ? samplesPerFrame : m_sampleRate / 200;
+	m_devicePeriodFrames = std::max(devicePeriodFrames, 0);
+	m_packetMs = m_samplesPerFrame * 1000.0 / m_sampleRate;
+	m_deviceLatencyMs = (double)m_devicePeriodFrames * std::max(devicePeriods, 1) * 1000.0 / m_sampleRate;
+	m_lastArrivalQpc = 0;
+	m_haveLast = false;
+	m_jitterEwmaMs = 0.0;
+	m_peakJitterMs = 0.0;
+	m_fillEwma = 0.0;
+	m_haveFill = false;
+
+	m_underruns.store(0, std::memory_order_relaxed);
+	m_overruns.store(0, std::memory_order_relaxed);
+	m_lostPackets.store(0, std::memory_order_relaxed);
+	m_plcFrames.store(0, std::memory_order_relaxed);
+	m_silentFrames.store(0, std::memory_order_relaxed);
+	m_latencyMs.store(m_deviceLatencyMs, std::memory_order_relaxed);
+	m_publishedJitterMs.store(0.0, std::memory_order_relaxed);
+	m_targetFrames.store(0, std::memory_order_relaxed);
+
+	updateTarget();
+}
+
+// Receive thread only
+AudioJitterBuffer::Correction AudioJitterBuffer::observePacket(int64_t arrivalQpc, uint32_t queuedFrames, int packetCount) {
+	if (m_haveLast) {
+		const double expectedMs = std::max(packetCount, 1) * m_packetMs;
+		const double actualMs = QpcToMs(arrivalQpc - m_lastArrivalQpc);
+
+		// Ignore discontinuities such as the host pausing audio while nothing plays
+		if (actualMs >= 0.0 && actualMs < 500.0) {
+			const double deviationMs = std::fabs(actualMs - expectedMs);
+			m_jitterEwmaMs += (deviationMs - m_jitterEwmaMs) / 16.0;
+
+			// decay the peak so the buffer shrinks again once the jitter is gone
+			const double decay = std::pow(0.5, actualMs / JITTER_HALF_LIFE_MS);
+			m_peakJitterMs = std::max(deviationMs, m_peakJitterMs * decay);
+
+			updateTarget();
+		}
+	}
+	m_lastArrivalQpc = arrivalQpc;
+	m_haveLast = true;
+
+	// The device callback drains the ring a period at a time, so only the average fill means anything
+	if (!m_haveFill) {
+		m_fillEwma = queuedFrames;
+		m_haveFill = true;
+	} else {
+		m_fillEwma += FILL_EWMA_ALPHA * ((double)queuedFrames - m_fillEwma);
+	}
+	m_latencyMs.store(m_fillEwma * 1000.0 / m_sampleRate + m_deviceLatencyMs, std::memory_order_relaxed);
+
+	const double target = m_targetFrames.load(std::memory_order_relaxed);
+	const double excess = m_fillEwma - target;
+	// At least 1ms, wider while the fill swings with network jitter so we don't chase noise
+	const double deadband = std::max(1.0, m_jitterEwmaMs) * m_sampleRate / 1000.0;
+
+	// A burst after a stall left far more queued than we want, catch up a packet at a time
+	if (excess > 2.0 * m_samplesPerFrame && queuedFrames > target + 2.0 * m_samplesPerFrame + m_devicePeriodFrames) {
+		m_fillEwma -= m_samplesPerFrame;
+		return CORRECTION_DROP_PACKET;
+	}
+
+	// Steady state and clock drift, a sample per packet is well under what anyone can hear
+	if (excess > deadband) {
+		return CORRECTION_DROP_SAMPLE;
+	} else if (excess < -deadband) {
+		return CORRECTION_INSERT_SAMPLE;
+	}
+	return CORRECTION_NONE;
+}
+
+void AudioJitterBuffer::updateTarget() {
+	// Enough for the device to pull a full period while the next packet is still in flight,
+	// plus whatever the network has been adding recently
+	const double periodMs = m_devicePeriodFrames * 1000.0 / m_sampleRate;
+	const double needMs = std::max(m_peakJitterMs, 2.0 * m_jitterEwmaMs);
+	const double targetMs = std::min(periodMs + m_packetMs + needMs, MAX_TARGET_MS) +
+	                        m_syncDelayMs.load(std::memory_order_relaxed);
+	const uint32_t target = (uint32_t)std::ceil(targetMs * m_sampleRate / 1000.0);
+
+	const uint32_t previous = m_targetFrames.exchange(target, std::memory_order_relaxed);
+	if (std::abs((int)target - (int)previous) >= m_samplesPerFrame) {
+		FQLog("AudioJitterBuffer: target %.1fms -> %.1fms (jitter %.2fms, peak %.2fms)\n",
+		      previous * 1000.0 / m_sampleRate, targetMs, m_jitterEwmaMs, m_peakJitterMs);
+	}
+	m_publishedJitterMs.store(m_jitterEwmaMs, std::memory_order_relaxed);
+}
+
+uint32_t AudioJitterBuffer::targetFrames() const {
+	return m_targetFrames.load(std::memory_order_relaxed);
+}
+
+void AudioJitterBuffer::setSyncDelayMs(double delayMs) {
+	m_syncDelayMs.store(std::max(delayMs, 0.0), std::memory_order_relaxed);
+}
+
+double AudioJitterBuffer::packetMs() const {
+	return m_packetMs;
+}
+
+double AudioJitterBuffer::deviceLatencyMs() const {
+	return m_deviceLatencyMs;
+}
+
+void AudioJitterBuffer::countUnderrun(uint32_t plcFrames, uint32_t silentFrames) {
+	m_underruns.fetch_add(1, std::memory_order_relaxed);
+	m_plcFrames.fetch_add(plcFrames, std::memory_order_relaxed);
+	m_silentFrames.fetch_add(silentFrames, std::memory_order_relaxed);
+}
+
+void AudioJitterBuffer::countOverrun() {
+	m_overruns.fetch_add(1, std::memory_order_relaxed);
+}
+
+void AudioJitterBuffer::countLostPacket() {
+	m_lostPackets.fetch_add(1, std::memory_order_relaxed);
+}
+
+double AudioJitterBuffer::latencyMs() const {
+	return m_latencyMs.load(std::memory_order_relaxed);
+}
+
+double AudioJitterBuffer::targetMs() const {
+	return targetFrames() * 1000.0 / m_sampleRate;
+}
+
+double AudioJitterBuffer::jitterMs() const {
+	return m_publishedJitterMs.load(std::memory_order_relaxed);
+}
+
+uint64_t AudioJitterBuffer::underruns() const {
+	return m_underruns.load(std::memory_order_relaxed);
+}
+
+uint64_t AudioJitterBuffer::overruns() const {
+	return m_overruns.load(std::memory_order_relaxed);
+}
+
+uint64_t AudioJitterBuffer::lostPackets() const {
+	return m_lostPackets.load(std::memory_order_relaxed);
+}
+
+uint64_t AudioJitterBuffer::plcFrames() const {
+	return m_plcFrames.load(std::memory_order_relaxed);
+}
+
+uint64_t AudioJitterBuffer::silentFrames() const {
+	return m_silentFrames.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// This class keeps the audio ring at a fill level that rides out network jitter without adding
+// more latency than needed.
+//
+// It measures how irregularly Opus packets arrive compared to the audio they carry and derives
+// a target fill from it: one device period plus one packet, plus the recent worst jitter. Each
+// packet is then told how to correct the smoothed fill towards that target. A sample is dropped
+// or inserted per packet for small errors, which also absorbs the clock drift between host and
+// audio device. A whole packet is dropped when a burst left far too much queued. Underruns are
+// concealed by the player, and the late audio that follows raises the fill again by itself.
+//
+// The observe and correction methods are called by the audio receive thread, the counters may be
+// bumped from the device callback and everything public is readable from any thread.
+
+class AudioJitterBuffer {
+  public:
+	// Singleton
+	static AudioJitterBuffer &instance();
+
+	// Call before each stream, once the device period is known
+	void init(int sampleRate, int samplesPerFrame, int devicePeriodFrames, int devicePeriods);
+
+	enum Correction {
+		CORRECTION_NONE,
+		CORRECTION_DROP_SAMPLE,   // remove one sample frame from this packet
+		CORRECTION_INSERT_SAMPLE, // add one sample frame to this packet
+		CORRECTION_DROP_PACKET,   // discard this packet entirely
+	};
+
+	// Receive thread, called for each received packet with its arrival time, the frames queued in
+	// the ring before it is written and how many packets it follows, counting lost ones. Returns
+	// how to adjust the packet.
+	Correction observePacket(int64_t arrivalQpc, uint32_t queuedFrames, int packetCount = 1);
+
+	// Frames the ring must hold before playback starts
+	uint32_t targetFrames() const;
+
+	// Extra delay on top of what the jitter needs, set by AVSyncMonitor to hold audio back
+	void setSyncDelayMs(double delayMs);
+
+	double packetMs() const;
+	double deviceLatencyMs() const;
+
+	// Counters, any thread
+	void countUnderrun(uint32_t plcFrames, uint32_t silentFrames);
+	void countOverrun();
+	void countLostPacket();
+
+	double latencyMs() const;    // smoothed ring fill plus the device buffer
+	double targetMs() const;
+	double jitterMs() const;
+	uint64_t underruns() const;
+	uint64_t overruns() const;
+	uint64_t lostPackets() const;
+	uint64_t plcFrames() const;    // underrun frames filled by Opus packet loss concealment
+	uint64_t silentFrames() const; // underrun frames filled with silence
+
+	static constexpr double MAX_TARGET_MS = 120.0;
+	static constexpr double JITTER_HALF_LIFE_MS = 5000.0;
+	static constexpr double FILL_EWMA_ALPHA = 1.0 / 32.0;
+
+  private:
+	AudioJitterBuffer() = default;
+	AudioJitterBuffer(const AudioJitterBuffer &) = delete;
+	AudioJitterBuffer &operator=(const AudioJitterBuffer &) = delete;
+
+	void updateTarget();
+
+	// Receive-thread owned state
+	int m_sampleRate = 48000;
+	int m_samplesPerFrame = 240;
+	int m_devicePeriodFrames = 480;
+	double m_packetMs = 5.0;
+	double m_deviceLatencyMs = 0.0;
+	int64_t m_lastArrivalQpc = 0;
+	bool m_haveLast = false;
+	double m_jitterEwmaMs = 0.0; // RFC 3550 style smoothed jitter
+	double m_peakJitterMs = 0.0; // recent worst case, decays with JITTER_HALF_LIFE_MS
+	double m_fillEwma = 0.0;     // frames
+	bool m_haveFill = false;
+
+	// Published values
+	std::atomic<uint32_t> m_targetFrames{0};
+	std::atomic<double> m_syncDelayMs{0.0};
+	std::atomic<double> m_latencyMs{0.0};
+	std::atomic<double> m_publishedJitterMs{0.0};
+	std::atomic<uint64_t> m_underruns{0};
+	std::atomic<uint64_t> m_overruns{0};
+	std::atomic<uint64_t> m_lostPackets{0};
+	std::atomic<uint64_t> m_plcFrames{0};
+	std::atomic<uint64_t> m_silentFrames{0};
+};
@@ -0,0 +1,320 @@
+// Simulated jitter suite for AudioJitterBuffer, built on the host rather than into the app
+//
+// A host sends a 5ms Opus packet every 5ms over a simulated network, and a device with a 10ms
+// period drains the ring the way AudioPlayer::FillOutput() does, waiting for targetFrames()
+// before it starts and after 200ms without data. Every packet is written with the correction
+// observePacket() asked for. On a clean network the target must be one period plus one packet,
+// and the fill must hold it even with the device clock drifting. Jitter must raise the target to
+// cover it, and the fill must follow without underruns. Once the jitter is gone the peak must
+// halve every JITTER_HALF_LIFE_MS, and the target and fill come back down with it. A host that
+// stalls and then sends everything it held at once must be caught up with CORRECTION_DROP_PACKET,
+// a packet at a time, back to near the target without underrunning, and never on a clean network.
+//
+// Built through Tools/CMakeLists.txt.
+
+#include "pch.h"
+#include "AudioJitterBuffer.h"
+
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <random>
+
+static int g_failures = 0;
+
+#define CHECK(cond, ...)                                     \
+	do {                                                     \
+		if (!(cond)) {                                       \
+			fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+			fprintf(stderr, __VA_ARGS__);                    \
+			fprintf(stderr, "\n");                           \
+			g_failures++;                                    \
+		}                                                    \
+	} while (0)
+
+static const int SAMPLE_RATE = 48000;
+static const int PACKET_FRAMES = 240; // 5ms
+static const int PERIOD_FRAMES = 480; // 10ms
+static const int PERIODS = 2;
+static const double PACKET_MS = 5.0;
+static const double PERIOD_MS = 10.0;
+
+// AudioPlayer::MAX_CONCEAL_MS
+static const double MAX_CONCEAL_MS = 200.0;
+
+static double framesToMs(double frames) {
+	return frames * 1000.0 / SAMPLE_RATE;
+}
+
+// Network delay of the packet sent at sendMs
+using Network = std::function<double(double sendMs)>;
+
+// The receive thread and the device callback of AudioPlayer, on one virtual clock
+class Simulation {
+  public:
+	explicit Simulation(double deviceSpeed = 1.0) : m_jitter(AudioJitterBuffer::instance()), m_deviceSpeed(deviceSpeed) {
+		m_jitter.init(SAMPLE_RATE, PACKET_FRAMES, PERIOD_FRAMES, PERIODS);
+	}
+
+	// Runs until untilMs, packets arrive in order
+	void run(double untilMs, const Network &network) {
+		for (;;) {
+			if (!m_havePacket) {
+				m_arrivalMs = std::max(m_arrivalMs, m_sendMs + network(m_sendMs));
+				m_havePacket = true;
+			}
+			const double callbackMs = m_callbacks * PERIOD_MS / m_deviceSpeed;
+			const double nextMs = std::min(m_arrivalMs, callbackMs);
+			if (nextMs >= untilMs) {
+				break;
+			}
+			if (m_arrivalMs <= callbackMs) {
+				receive();
+			} else {
+				callback();
+			}
+		}
+		m_nowMs = untilMs;
+	}
+
+	// Counters since the last reset()
+	void reset() {
+		for (int &count : corrections) {
+			count = 0;
+		}
+		underrunFrames = 0;
+		callbacks = 0;
+		maxQueued = 0;
+		m_errorMsSum = 0.0;
+		m_errorSamples = 0;
+	}
+
+	double nowMs() const {
+		return m_nowMs;
+	}
+
+	uint32_t queued() const {
+		return m_queued;
+	}
+
+	// Smoothed fill, what the jitter buffer steers
+	double fillMs() const {
+		return m_jitter.latencyMs() - m_jitter.deviceLatencyMs();
+	}
+
+	double meanErrorMs() const {
+		return m_errorSamples ? m_errorMsSum / m_errorSamples : 0.0;
+	}
+
+	int corrections[4] = {};
+	uint64_t underrunFrames = 0;
+	int callbacks = 0;
+	uint32_t maxQueued = 0;
+
+  private:
+	void receive() {
+		m_nowMs = m_arrivalMs;
+		const AudioJitterBuffer::Correction correction = m_jitter.observePacket(MsToQpc(m_arrivalMs), m_queued);
+		corrections[correction]++;
+		switch (correction) {
+		case AudioJitterBuffer::CORRECTION_DROP_PACKET:
+			m_jitter.countOverrun();
+			break;
+		case AudioJitterBuffer::CORRECTION_DROP_SAMPLE:
+			m_queued += PACKET_FRAMES - 1;
+			break;
+		case AudioJitterBuffer::CORRECTION_INSERT_SAMPLE:
+			m_queued += PACKET_FRAMES + 1;
+			break;
+		default:
+			m_queued += PACKET_FRAMES;
+			break;
+		}
+		maxQueued = std::max(maxQueued, m_queued);
+		m_errorMsSum += std::fabs(fillMs() - m_jitter.targetMs());
+		m_errorSamples++;
+
+		m_sendMs += PACKET_MS;
+		m_havePacket = false;
+	}
+
+	void callback() {
+		m_nowMs = m_callbacks * PERIOD_MS / m_deviceSpeed;
+		m_callbacks++;
+		if (!m_primed) {
+			if (m_queued < m_jitter.targetFrames()) {
+				return;
+			}
+			m_primed = true;
+			m_concealedRun = 0;
+		}
+		callbacks++;
+
+		const uint32_t played = std::min(m_queued, (uint32_t)PERIOD_FRAMES);
+		m_queued -= played;
+		if (played == PERIOD_FRAMES) {
+			m_concealedRun = 0;
+			return;
+		}
+		const uint32_t shortfall = PERIOD_FRAMES - played;
+		m_jitter.countUnderrun(0, shortfall);
+		underrunFrames += shortfall;
+		m_concealedRun += shortfall;
+		if (framesToMs(m_concealedRun) >= MAX_CONCEAL_MS) {
+			m_primed = false;
+		}
+	}
+
+	AudioJitterBuffer &m_jitter;
+	const double m_deviceSpeed; // device clock against the host's, >1 drains faster
+
+	double m_nowMs = 0.0;
+	double m_sendMs = 0.0;
+	double m_arrivalMs = 0.0;
+	bool m_havePacket = false;
+	int64_t m_callbacks = 1;
+	uint32_t m_queued = 0;
+	bool m_primed = false;
+	uint32_t m_concealedRun = 0;
+
+	double m_errorMsSum = 0.0;
+	uint64_t m_errorSamples = 0;
+};
+
+static const Network CLEAN = [](double) { return 20.0; };
+
+static Network uniformJitter(std::mt19937 &rng, double maxMs) {
+	return [&rng, maxMs](double) { return 20.0 + std::uniform_real_distribution<double>(0.0, maxMs)(rng); };
+}
+
+static void testClean() {
+	for (double speed : {1.0, 1.002, 0.998}) {
+		Simulation sim(speed);
+		sim.run(2000, CLEAN);
+		const AudioJitterBuffer &jitter = AudioJitterBuffer::instance();
+		CHECK(std::fabs(jitter.targetMs() - (PERIOD_MS + PACKET_MS)) < 0.1, "clean target is %.2fms, expected %.0fms",
+		      jitter.targetMs(), PERIOD_MS + PACKET_MS);
+
+		sim.reset();
+		sim.run(sim.nowMs() + 30000, CLEAN);
+		printf("clean, device at %.3fx: target %.1fms, fill %.1fms off by %.2fms on average, %d/%d/%d corrections\n",
+		       speed, jitter.targetMs(), sim.fillMs(), sim.meanErrorMs(), sim.corrections[1], sim.corrections[2],
+		       sim.corrections[3]);
+		CHECK(std::fabs(jitter.targetMs() - (PERIOD_MS + PACKET_MS)) < 0.1, "clean target drifted to %.2fms",
+		      jitter.targetMs());
+		// The fill is sampled as packets arrive, and with drift that slides along the device's drain
+		// sawtooth, so it is only held to within half a packet
+		CHECK(sim.meanErrorMs() < (speed == 1.0 ? 1.0 : PACKET_MS / 2),
+		      "device at %.3fx: fill off its target by %.2fms on average", speed, sim.meanErrorMs());
+		CHECK(sim.underrunFrames == 0, "device at %.3fx: %llu frames underran on a clean network", speed,
+		      (unsigned long long)sim.underrunFrames);
+		CHECK(sim.corrections[AudioJitterBuffer::CORRECTION_DROP_PACKET] == 0, "device at %.3fx: packets dropped",
+		      speed);
+		// 0.2% of 48kHz is 96 frames a second, one per packet can keep up with it
+		if (speed > 1.0) {
+			CHECK(sim.corrections[AudioJitterBuffer::CORRECTION_INSERT_SAMPLE] > 0, "a fast device wasn't fed");
+		} else if (speed < 1.0) {
+			CHECK(sim.corrections[AudioJitterBuffer::CORRECTION_DROP_SAMPLE] > 0, "a slow device wasn't drained");
+		}
+	}
+}
+
+static void testJitterAndDecay(std::mt19937 &rng) {
+	const double maxJitterMs = 12.0;
+	Simulation sim;
+	AudioJitterBuffer &jitter = AudioJitterBuffer::instance();
+	sim.run(10000, uniformJitter(rng, maxJitterMs));
+
+	sim.reset();
+	sim.run(sim.nowMs() + 20000, uniformJitter(rng, maxJitterMs));
+	const double jitteryTarget = jitter.targetMs();
+	printf("%.0fms jitter: target %.1fms, jitter %.2fms, fill off by %.2fms on average, %llu frames underran\n",
+	       maxJitterMs, jitteryTarget, jitter.jitterMs(), sim.meanErrorMs(), (unsigned long long)sim.underrunFrames);
+	// Back to back arrivals can be up to maxJitterMs further apart than they were sent
+	CHECK(jitteryTarget > PERIOD_MS + PACKET_MS + 0.75 * maxJitterMs &&
+	          jitteryTarget <= PERIOD_MS + PACKET_MS + maxJitterMs + 0.1,
+	      "target %.2fms for %.0fms of jitter", jitteryTarget, maxJitterMs);
+	CHECK(sim.meanErrorMs() < 3.0, "fill off its target by %.2fms on average", sim.meanErrorMs());
+	CHECK(sim.underrunFrames < (uint64_t)sim.callbacks * PERIOD_FRAMES / 1000,
+	      "%llu frames underran with the target at %.1fms", (unsigned long long)sim.underrunFrames, jitteryTarget);
+	CHECK(sim.corrections[AudioJitterBuffer::CORRECTION_DROP_PACKET] == 0, "packets dropped for plain jitter");
+
+	// The jitter stops, the peak halves every JITTER_HALF_LIFE_MS
+	const double extraMs = jitteryTarget - (PERIOD_MS + PACKET_MS);
+	for (int halfLives = 1; halfLives <= 4; halfLives++) {
+		sim.run(sim.nowMs() + AudioJitterBuffer::JITTER_HALF_LIFE_MS, CLEAN);
+		const double expected = extraMs / (1 << halfLives);
+		const double actual = jitter.targetMs() - (PERIOD_MS + PACKET_MS);
+		printf("  %4.0fs clean: target %.2fms, %.2fms over the clean target\n",
+		       halfLives * AudioJitterBuffer::JITTER_HALF_LIFE_MS / 1000, jitter.targetMs(), actual);
+		// The peak was set by one packet within the last half life, so it is only this close
+		CHECK(actual < expected * 1.1 + 0.1 && actual > expected * 0.5 - 0.1,
+		      "%.2fms over the clean target after %d half lives, expected about %.2fms", actual, halfLives, expected);
+	}
+	sim.reset();
+	sim.run(sim.nowMs() + 20000, CLEAN);
+	CHECK(jitter.targetMs() < PERIOD_MS + PACKET_MS + 0.5, "target only came down to %.2fms", jitter.targetMs());
+	CHECK(std::fabs(sim.fillMs() - jitter.targetMs()) < 1.5, "fill stayed at %.2fms with the target at %.2fms",
+	      sim.fillMs(), jitter.targetMs());
+	CHECK(sim.underrunFrames == 0, "%llu frames underran while the buffer shrank",
+	      (unsigned long long)sim.underrunFrames);
+	CHECK(sim.corrections[AudioJitterBuffer::CORRECTION_DROP_PACKET] == 0, "packets dropped while the buffer shrank");
+}
+
+static void testCatchUp() {
+	Simulation sim;
+	AudioJitterBuffer &jitter = AudioJitterBuffer::instance();
+	sim.run(5000, CLEAN);
+
+	// The host stalls for 600ms, then sends everything it captured meanwhile at once
+	const double stallStartMs = sim.nowMs(), stallMs = 600.0;
+	const Network stall = [&](double sendMs) {
+		return sendMs >= stallStartMs && sendMs < stallStartMs + stallMs ? stallStartMs + stallMs + 20.0 - sendMs : 20.0;
+	};
+	sim.reset();
+	sim.run(stallStartMs + stallMs + 21.0, stall);
+	const uint32_t burst = sim.maxQueued;
+	const int dropsInBurst = sim.corrections[AudioJitterBuffer::CORRECTION_DROP_PACKET];
+
+	sim.reset();
+	double caughtUpMs = -1.0;
+	const double limit = jitter.targetFrames() + 2.0 * PACKET_FRAMES + PERIOD_FRAMES;
+	while (sim.nowMs() < stallStartMs + stallMs + 5000) {
+		sim.run(sim.nowMs() + PACKET_MS, stall);
+		if (caughtUpMs < 0 && sim.queued() <= limit) {
+			caughtUpMs = sim.nowMs() - (stallStartMs + stallMs);
+		}
+	}
+	const int drops = dropsInBurst + sim.corrections[AudioJitterBuffer::CORRECTION_DROP_PACKET];
+	printf("%.0fms stall: queue peaked at %.0fms, %d packets dropped, caught up after %.0fms, target %.1fms\n", stallMs,
+	       framesToMs(burst), drops, caughtUpMs, jitter.targetMs());
+
+	CHECK(burst > limit, "the burst only queued %.0fms", framesToMs(burst));
+	CHECK(drops > 0, "a %.0fms burst wasn't caught up by dropping packets", framesToMs(burst));
+	// Only what was over the target is dropped
+	const int held = (int)(stallMs / PACKET_MS);
+	CHECK(drops * PACKET_FRAMES <= held * PACKET_FRAMES - (int)jitter.targetFrames(),
+	      "%d of the %d packets the host held were dropped", drops, held);
+	CHECK(caughtUpMs >= 0 && caughtUpMs < 2000, "the fill took %.0fms to come back near the target", caughtUpMs);
+	CHECK(sim.underrunFrames == 0, "catching up underran by %llu frames", (unsigned long long)sim.underrunFrames);
+	CHECK(jitter.overruns() == (uint64_t)drops, "%llu overruns counted for %d dropped packets",
+	      (unsigned long long)jitter.overruns(), drops);
+
+	// And once caught up, it stays put
+	sim.reset();
+	sim.run(sim.nowMs() + 10000, CLEAN);
+	CHECK(sim.corrections[AudioJitterBuffer::CORRECTION_DROP_PACKET] == 0, "packets still dropped after catching up");
+	CHECK(std::fabs(sim.fillMs() - jitter.targetMs()) < 1.5, "fill settled at %.2fms with the target at %.2fms",
+	      sim.fillMs(), jitter.targetMs());
+}
+
+int main(int argc, char **argv) {
+	std::mt19937 rng(1);
+
+	testClean();
+	testJitterAndDecay(rng);
+	testCatchUp();
+
+	printf("%d failures\n", g_failures);
+	return g_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,200 @@
+#include "pch.h"
+#include "AudioMixer.h"
+
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE__)
+#define AUDIO_MIXER_SSE
+#include <xmmintrin.h>
+#elif defined(_M_ARM) || defined(_M_ARM64) || defined(__ARM_NEON)
+#define AUDIO_MIXER_NEON
+#include <arm_neon.h>
+#endif
+
+static const float MINUS_3DB = 0.70710678f;
+static const float MINUS_6DB = 0.5f;
+
+// Moonlight decodes surround in this order, stereo and 5.1 are its first 2 and 6 channels
+static const MixChannel kStreamLayout[AudioMixer::MAX_CHANNELS] = {
+	MIX_FRONT_LEFT, MIX_FRONT_RIGHT, MIX_FRONT_CENTER, MIX_LFE,
+	MIX_BACK_LEFT, MIX_BACK_RIGHT, MIX_SIDE_LEFT, MIX_SIDE_RIGHT,
+};
+
+bool AudioMixer::init(int inChannels, const MixChannel *outLayout, int outChannels, bool upmix) {
+	if ((inChannels != 2 && inChannels != 6 && inChannels != 8) || outChannels < 1 || outChannels > MAX_CHANNELS) {
+		return false;
+	}
+	if (outLayout == NULL) {
+		outLayout = kStreamLayout;
+		outChannels = inChannels;
+	}
+	m_inChannels = inChannels;
+	m_outChannels = outChannels;
+
+	bool src[MIX_OTHER] = {}, dst[MIX_OTHER] = {};
+	for (int i = 0; i < inChannels; i++) {
+		src[kStreamLayout[i]] = true;
+	}
+	for (int o = 0; o < outChannels; o++) {
+		if (outLayout[o] != MIX_OTHER) {
+			dst[outLayout[o]] = true;
+		}
+	}
+	const bool srcBack = src[MIX_BACK_LEFT], srcSide = src[MIX_SIDE_LEFT];
+	const bool dstBack = dst[MIX_BACK_LEFT], dstSide = dst[MIX_SIDE_LEFT];
+
+	// Route each input channel through the downmix stages, then pick out the device's channels
+	for (int i = 0; i < inChannels; i++) {
+		float v[MIX_OTHER] = {};
+		v[kStreamLayout[i]] = 1.0f;
+
+		// 7.1 -> 5.1, or surrounds that are on the other pair of speakers
+		if ((srcBack && !dstBack) || (srcSide && !dstSide)) {
+			const float gain = (srcBack && srcSide) ? MINUS_3DB : 1.0f;
+			const int left = (dstSide && !dstBack) ? MIX_SIDE_LEFT : MIX_BACK_LEFT;
+			const float l = v[MIX_BACK_LEFT] + v[MIX_SIDE_LEFT];
+			const float r = v[MIX_BACK_RIGHT] + v[MIX_SIDE_RIGHT];
+			v[MIX_BACK_LEFT] = v[MIX_BACK_RIGHT] = v[MIX_SIDE_LEFT] = v[MIX_SIDE_RIGHT] = 0.0f;
+			v[left] = gain * l;
+			v[left + 1] = gain * r;
+		}
+
+		// 5.1 -> stereo
+		if (!dst[MIX_FRONT_CENTER] && v[MIX_FRONT_CENTER] != 0.0f) {
+			v[MIX_FRONT_LEFT] += MINUS_3DB * v[MIX_FRONT_CENTER];
+			v[MIX_FRONT_RIGHT] += MINUS_3DB * v[MIX_FRONT_CENTER];
+			v[MIX_FRONT_CENTER] = 0.0f;
+		}
+		if (!dstBack && !dstSide) {
+			v[MIX_FRONT_LEFT] += MINUS_3DB * v[MIX_BACK_LEFT];
+			v[MIX_FRONT_RIGHT] += MINUS_3DB * v[MIX_BACK_RIGHT];
+			v[MIX_BACK_LEFT] = v[MIX_BACK_RIGHT] = 0.0f;
+		}
+
+		// stereo -> mono
+		if (!dst[MIX_FRONT_LEFT] && !dst[MIX_FRONT_RIGHT]) {
+			v[MIX_FRONT_CENTER] += MINUS_3DB * (v[MIX_FRONT_LEFT] + v[MIX_FRONT_RIGHT]);
+			v[MIX_FRONT_LEFT] = v[MIX_FRONT_RIGHT] = 0.0f;
+		}
+
+		// Fill speakers the stream has nothing for, the LFE stays empty as it would need a low-pass
+		if (upmix) {
+			const int kind = kStreamLayout[i];
+			if ((kind == MIX_FRONT_LEFT || kind == MIX_FRONT_RIGHT) && !src[MIX_FRONT_CENTER] && dst[MIX_FRONT_CENTER]) {
+				v[MIX_FRONT_CENTER] += MINUS_6DB;
+			}
+			if ((kind == MIX_FRONT_LEFT || kind == MIX_FRONT_RIGHT) && !srcBack && !srcSide) {
+				const int side = kind - MIX_FRONT_LEFT;
+				if (dstBack) v[MIX_BACK_LEFT + side] += MINUS_3DB;
+				if (dstSide) v[MIX_SIDE_LEFT + side] += MINUS_3DB;
+			}
+			// 5.1 on 7.1 speakers, spread the surround pair over both
+			if ((kind == MIX_BACK_LEFT || kind == MIX_BACK_RIGHT) && !srcSide && dstBack && dstSide) {
+				const int side = kind - MIX_BACK_LEFT;
+				v[MIX_BACK_LEFT + side] = MINUS_3DB;
+				v[MIX_SIDE_LEFT + side] = MINUS_3DB;
+			}
+		}
+
+		for (int o = 0; o < outChannels; o++) {
+			m_matrix[o][i] = outLayout[o] != MIX_OTHER ? v[outLayout[o]] : 0.0f;
+		}
+	}
+	for (int o = 0; o < MAX_CHANNELS; o++) {
+		for (int i = 0; i < MAX_CHANNELS; i++) {
+			if (o >= outChannels || i >= inChannels) {
+				m_matrix[o][i] = 0.0f;
+			}
+		}
+	}
+
+	// Scale each downmixed speaker so full scale on every channel it takes still can't clip
+	for (int o = 0; o < outChannels; o++) {
+		float sum = 0.0f;
+		for (int i = 0; i < inChannels; i++) {
+			sum += std::fabs(m_matrix[o][i]);
+		}
+		if (sum > 1.0f) {
+			for (int i = 0; i < inChannels; i++) {
+				m_matrix[o][i] /= sum;
+			}
+		}
+	}
+
+	m_passthrough = inChannels == outChannels;
+	for (int o = 0; o < MAX_CHANNELS; o++) {
+		for (int i = 0; i < MAX_CHANNELS; i++) {
+			m_columns[i][o] = m_matrix[o][i];
+			if (o < outChannels && i < inChannels && m_matrix[o][i] != (o == i ? 1.0f : 0.0f)) {
+				m_passthrough = false;
+			}
+		}
+	}
+	return true;
+}
+
+void AudioMixer::processScalar(const float *in, float *out, uint32_t frameCount) const {
+	for (uint32_t f = 0; f < frameCount; f++) {
+		for (int o = 0; o < m_outChannels; o++) {
+			float acc = 0.0f;
+			for (int i = 0; i < m_inChannels; i++) {
+				acc += m_matrix[o][i] * in[i];
+			}
+			out[o] = acc;
+		}
+		in += m_inChannels;
+		out += m_outChannels;
+	}
+}
+
+// Each frame is a sum of matrix columns weighted by the input samples, with all 8 outputs in two
+// vectors. Only the device's channels are stored so frames can be written back to back, which is
+// why 2, 4, 6 and 8 channels each get their own store.
+void AudioMixer::process(const float *in, float *out, uint32_t frameCount) const {
+	// Odd layouts such as mono or 3.0 are rare enough to not need their own stores
+	if (m_outChannels % 2 != 0) {
+		processScalar(in, out, frameCount);
+		return;
+	}
+
+#if defined(AUDIO_MIXER_SSE)
+	for (uint32_t f = 0; f < frameCount; f++) {
+		__m128 lo = _mm_setzero_ps();
+		__m128 hi = _mm_setzero_ps();
+		for (int i = 0; i < m_inChannels; i++) {
+			const __m128 sample = _mm_set1_ps(in[i]);
+			lo = _mm_add_ps(lo, _mm_mul_ps(sample, _mm_load_ps(&m_columns[i][0])));
+			hi = _mm_add_ps(hi, _mm_mul_ps(sample, _mm_load_ps(&m_columns[i][4])));
+		}
+
+		switch (m_outChannels) {
+		case 8: _mm_storeu_ps(out, lo); _mm_storeu_ps(out + 4, hi); break;
+		case 6: _mm_storeu_ps(out, lo); _mm_storel_pi((__m64 *)(out + 4), hi); break;
+		case 4: _mm_storeu_ps(out, lo); break;
+		default: _mm_storel_pi((__m64 *)out, lo); break;
+		}
+		in += m_inChannels;
+		out += m_outChannels;
+	}
+#elif defined(AUDIO_MIXER_NEON)
+	for (uint32_t f = 0; f < frameCount; f++) {
+		float32x4_t lo = vdupq_n_f32(0.0f);
+		float32x4_t hi = vdupq_n_f32(0.0f);
+		for (int i = 0; i < m_inChannels; i++) {
+			lo = vmlaq_n_f32(lo, vld1q_f32(&m_columns[i][0]), in[i]);
+			hi = vmlaq_n_f32(hi, vld1q_f32(&m_columns[i][4]), in[i]);
+		}
+
+		switch (m_outChannels) {
+		case 8: vst1q_f32(out, lo); vst1q_f32(out + 4, hi); break;
+		case 6: vst1q_f32(out, lo); vst1_f32(out + 4, vget_low_f32(hi)); break;
+		case 4: vst1q_f32(out, lo); break;
+		default: vst1_f32(out, vget_low_f32(lo)); break;
+		}
+		in += m_inChannels;
+		out += m_outChannels;
+	}
+#else
+	processScalar(in, out, frameCount);
+#endif
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+
+// Maps the channels Opus decodes to the channels the audio device plays.
+//
+// The host sends stereo, 5.1 or 7.1 in Moonlight's order (FL FR FC LFE BL BR SL SR), while the
+// device plays whatever layout the console is set to. Rather than leave that to the backend, the
+// player opens the device in its native layout and runs every packet through this matrix:
+//   7.1 -> 5.1  the side and back pair fold into the one surround pair the device has, -3 dB each
+//   5.1 -> 2.0  ITU-R BS.775, center and surrounds at -3 dB into the fronts, LFE dropped
+//   upmix       optional, stereo feeds a phantom center at -6 dB and the surrounds at -3 dB
+// Stages run in that order, so 7.1 reaches stereo through 5.1. Each speaker that takes a downmix
+// is then scaled so it can't clip with every channel it takes at full scale. Layouts that come
+// out as an identity are reported, so the player can skip the mix entirely.
+//
+// process() uses SSE on x86/x64 and NEON on ARM, processScalar() is the reference they must match.
+// Streaming/AudioMixerTest.cpp checks that on the host, along with the throughput of each path.
+
+enum MixChannel {
+	MIX_FRONT_LEFT = 0,
+	MIX_FRONT_RIGHT,
+	MIX_FRONT_CENTER,
+	MIX_LFE,
+	MIX_BACK_LEFT,
+	MIX_BACK_RIGHT,
+	MIX_SIDE_LEFT,
+	MIX_SIDE_RIGHT,
+	MIX_OTHER, // present on the device but never fed
+};
+
+class AudioMixer {
+  public:
+	static constexpr int MAX_CHANNELS = 8;
+
+	// inChannels is the stream's count, in Moonlight's order. outLayout lists the device's
+	// channels in the order it expects them, NULL for the stream's own layout which passes
+	// through. Returns false for layouts it can't handle.
+	bool init(int inChannels, const MixChannel *outLayout, int outChannels, bool upmix);
+
+	bool isPassthrough() const { return m_passthrough; }
+	int inChannels() const { return m_inChannels; }
+	int outChannels() const { return m_outChannels; }
+	float gain(int out, int in) const { return m_matrix[out][in]; }
+
+	// Interleaved frames, in and out must not overlap
+	void process(const float *in, float *out, uint32_t frameCount) const;
+	void processScalar(const float *in, float *out, uint32_t frameCount) const;
+
+  private:
+	int m_inChannels = 0;
+	int m_outChannels = 0;
+	bool m_passthrough = false;
+	float m_matrix[MAX_CHANNELS][MAX_CHANNELS] = {};
+
+	// The matrix by input channel, each padded to a full vector of outputs
+	alignas(16) float m_columns[MAX_CHANNELS][MAX_CHANNELS] = {};
+};
@@ -0,0 +1,215 @@
+// Parity and throughput suite for AudioMixer, built on the host rather than into the app
+//
+// For every stream layout, device layout and upmix setting this checks that process() matches
+// processScalar() bit for bit, never writes past the frames it was given, passes matching layouts
+// through and can't clip, then times both paths on a second of 48 kHz audio. process() is the SSE
+// path on x86/x64 and the NEON path on ARM, so build it on both.
+//
+//   g++ -std=c++17 -O2 -ffp-contract=off -ITools/HostCompat Streaming/AudioMixer*.cpp -o mixer-test
+//
+// or through Tools/CMakeLists.txt. -ffp-contract=off keeps the compiler from fusing the scalar
+// reference's multiply-adds, which the SIMD paths don't do either.
+
+#include "pch.h"
+#include "AudioMixer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE__)
+static const char *SIMD_PATH = "SSE";
+#elif defined(_M_ARM) || defined(_M_ARM64) || defined(__ARM_NEON)
+static const char *SIMD_PATH = "NEON";
+#else
+static const char *SIMD_PATH = "scalar only";
+#endif
+
+struct DeviceLayout {
+	const char *name;
+	int channels;
+	MixChannel layout[AudioMixer::MAX_CHANNELS];
+};
+
+static const DeviceLayout kDeviceLayouts[] = {
+	{"mono", 1, {MIX_FRONT_CENTER}},
+	{"stereo", 2, {MIX_FRONT_LEFT, MIX_FRONT_RIGHT}},
+	{"3.0", 3, {MIX_FRONT_LEFT, MIX_FRONT_RIGHT, MIX_FRONT_CENTER}},
+	{"quad", 4, {MIX_FRONT_LEFT, MIX_FRONT_RIGHT, MIX_BACK_LEFT, MIX_BACK_RIGHT}},
+	{"quad side", 4, {MIX_FRONT_LEFT, MIX_FRONT_RIGHT, MIX_SIDE_LEFT, MIX_SIDE_RIGHT}},
+	{"5.1", 6, {MIX_FRONT_LEFT, MIX_FRONT_RIGHT, MIX_FRONT_CENTER, MIX_LFE, MIX_BACK_LEFT, MIX_BACK_RIGHT}},
+	{"5.1 side", 6, {MIX_FRONT_LEFT, MIX_FRONT_RIGHT, MIX_FRONT_CENTER, MIX_LFE, MIX_SIDE_LEFT, MIX_SIDE_RIGHT}},
+	{"7.1", 8,
+	 {MIX_FRONT_LEFT, MIX_FRONT_RIGHT, MIX_FRONT_CENTER, MIX_LFE, MIX_BACK_LEFT, MIX_BACK_RIGHT, MIX_SIDE_LEFT,
+	  MIX_SIDE_RIGHT}},
+	{"7.1 reordered", 8,
+	 {MIX_FRONT_LEFT, MIX_FRONT_RIGHT, MIX_FRONT_CENTER, MIX_LFE, MIX_SIDE_LEFT, MIX_SIDE_RIGHT, MIX_BACK_LEFT,
+	  MIX_BACK_RIGHT}},
+	{"stereo + aux", 4, {MIX_FRONT_LEFT, MIX_FRONT_RIGHT, MIX_OTHER, MIX_OTHER}},
+};
+
+static const int kStreamChannels[] = {2, 6, 8};
+
+// Odd on purpose, so the last frames don't line up with anything
+static const uint32_t PARITY_FRAMES = 1021;
+static const float CANARY = 1234.5f;
+
+static int g_failures = 0;
+
+static void fail(const char *what, int inChannels, const DeviceLayout &device, bool upmix) {
+	fprintf(stderr, "FAIL %d ch -> %s%s: %s\n", inChannels, device.name, upmix ? " (upmix)" : "", what);
+	g_failures++;
+}
+
+static void checkLayout(int inChannels, const DeviceLayout &device, bool upmix, std::mt19937 &rng) {
+	AudioMixer mixer;
+	if (!mixer.init(inChannels, device.layout, device.channels, upmix)) {
+		fail("init refused the layout", inChannels, device, upmix);
+		return;
+	}
+
+	std::uniform_real_distribution<float> sample(-1.0f, 1.0f);
+	std::vector<float> in(PARITY_FRAMES * inChannels);
+	for (float &s : in) {
+		s = sample(rng);
+	}
+
+	// One frame of slack after each output catches a store that is wider than the device layout
+	const size_t outSamples = PARITY_FRAMES * device.channels;
+	std::vector<float> simd(outSamples + AudioMixer::MAX_CHANNELS, CANARY);
+	std::vector<float> scalar(outSamples + AudioMixer::MAX_CHANNELS, CANARY);
+	mixer.process(in.data(), simd.data(), PARITY_FRAMES);
+	mixer.processScalar(in.data(), scalar.data(), PARITY_FRAMES);
+
+	if (memcmp(simd.data(), scalar.data(), outSamples * sizeof(float)) != 0) {
+		fail("process() doesn't match processScalar()", inChannels, device, upmix);
+	}
+	for (size_t i = outSamples; i < simd.size(); i++) {
+		if (simd[i] != CANARY || scalar[i] != CANARY) {
+			fail("wrote past the last frame", inChannels, device, upmix);
+			break;
+		}
+	}
+
+	// Whatever the signs of the inputs, no speaker can go over full scale
+	for (int o = 0; o < device.channels; o++) {
+		float sum = 0.0f;
+		for (int i = 0; i < inChannels; i++) {
+			sum += std::fabs(mixer.gain(o, i));
+		}
+		if (sum > 1.0f + 1e-6f) {
+			fail("a speaker can clip", inChannels, device, upmix);
+			break;
+		}
+	}
+
+	// The stream's own layout needs no mix, and whatever is reported as a passthrough must really be one
+	bool same = inChannels == device.channels;
+	for (int c = 0; same && c < device.channels; c++) {
+		const MixChannel streamOrder[] = {MIX_FRONT_LEFT, MIX_FRONT_RIGHT, MIX_FRONT_CENTER, MIX_LFE,
+		                                  MIX_BACK_LEFT,  MIX_BACK_RIGHT,  MIX_SIDE_LEFT,    MIX_SIDE_RIGHT};
+		same = device.layout[c] == streamOrder[c];
+	}
+	if (same && !upmix && !mixer.isPassthrough()) {
+		fail("matching layout isn't a passthrough", inChannels, device, upmix);
+	}
+	if (mixer.isPassthrough() && memcmp(scalar.data(), in.data(), outSamples * sizeof(float)) != 0) {
+		fail("passthrough changes the samples", inChannels, device, upmix);
+	}
+}
+
+// A few gains the header promises, so a change to the matrix shows up as more than a parity pass
+static void checkKnownGains() {
+	const DeviceLayout &stereo = kDeviceLayouts[1];
+	AudioMixer mixer;
+	mixer.init(6, stereo.layout, stereo.channels, false);
+	// FL, FC at -3 dB, BL at -3 dB, normalised by their sum
+	const float norm = 1.0f + 2.0f * 0.70710678f;
+	if (std::fabs(mixer.gain(0, MIX_FRONT_LEFT) - 1.0f / norm) > 1e-6f ||
+	    std::fabs(mixer.gain(0, MIX_FRONT_CENTER) - 0.70710678f / norm) > 1e-6f ||
+	    mixer.gain(0, MIX_LFE) != 0.0f || mixer.gain(0, MIX_FRONT_RIGHT) != 0.0f) {
+		fail("5.1 -> stereo isn't ITU-R BS.775", 6, stereo, false);
+	}
+
+	const DeviceLayout &surround = kDeviceLayouts[5];
+	mixer.init(2, surround.layout, surround.channels, true);
+	if (mixer.gain(MIX_LFE, 0) != 0.0f || mixer.gain(MIX_FRONT_CENTER, 0) == 0.0f ||
+	    mixer.gain(MIX_BACK_LEFT, 0) == 0.0f || mixer.gain(MIX_BACK_LEFT, 1) != 0.0f) {
+		fail("stereo upmix doesn't feed the center and surrounds", 2, surround, true);
+	}
+}
+
+static double msPerSecondOfAudio(const AudioMixer &mixer, bool simd, const std::vector<float> &in,
+                                 std::vector<float> &out, uint32_t frames) {
+	using Clock = std::chrono::steady_clock;
+	const int rounds = 20;
+	double best = 1e9;
+	for (int r = 0; r < rounds; r++) {
+		const auto start = Clock::now();
+		if (simd) {
+			mixer.process(in.data(), out.data(), frames);
+		} else {
+			mixer.processScalar(in.data(), out.data(), frames);
+		}
+		best = std::min(best, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+	}
+	return best;
+}
+
+static void benchmark(std::mt19937 &rng) {
+	const uint32_t frames = 48000;
+	std::uniform_real_distribution<float> sample(-1.0f, 1.0f);
+	std::vector<float> in(frames * AudioMixer::MAX_CHANNELS);
+	std::vector<float> out(frames * AudioMixer::MAX_CHANNELS);
+	for (float &s : in) {
+		s = sample(rng);
+	}
+
+	printf("\nms to mix one second of 48 kHz audio, best of 20\n");
+	printf("  %-22s %8s %8s\n", "", SIMD_PATH, "scalar");
+	const struct {
+		int inChannels;
+		const DeviceLayout *device;
+		bool upmix;
+	} cases[] = {
+		{8, &kDeviceLayouts[5], false},
+		{8, &kDeviceLayouts[1], false},
+		{6, &kDeviceLayouts[1], false},
+		{2, &kDeviceLayouts[7], true},
+	};
+	for (const auto &c : cases) {
+		AudioMixer mixer;
+		mixer.init(c.inChannels, c.device->layout, c.device->channels, c.upmix);
+		char label[64];
+		snprintf(label, sizeof(label), "%d ch -> %s%s", c.inChannels, c.device->name, c.upmix ? " upmix" : "");
+		printf("  %-22s %8.3f %8.3f\n", label, msPerSecondOfAudio(mixer, true, in, out, frames),
+		       msPerSecondOfAudio(mixer, false, in, out, frames));
+	}
+}
+
+int main(int argc, char **argv) {
+	const bool bench = !(argc > 1 && !strcmp(argv[1], "--no-bench"));
+	std::mt19937 rng(1);
+
+	int layouts = 0;
+	for (int inChannels : kStreamChannels) {
+		for (const DeviceLayout &device : kDeviceLayouts) {
+			for (bool upmix : {false, true}) {
+				checkLayout(inChannels, device, upmix, rng);
+				layouts++;
+			}
+		}
+	}
+	checkKnownGains();
+
+	printf("%s path: %d layouts checked against the scalar reference, %d failures\n", SIMD_PATH, layouts,
+	       g_failures);
+	if (bench) {
+		benchmark(rng);
+	}
+	return g_failures == 0 ? 0 : 1;
+}
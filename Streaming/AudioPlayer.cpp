@@ -2,7 +2,11 @@
 #include <opus/opus_multistream.h>
 #include <State\MoonlightClient.h>
 #include <Streaming\AudioPlayer.h>
+#include <Streaming\AudioJitterBuffer.h>
+#include <Streaming\AudioStats.h>
+#include <Streaming\AVSyncMonitor.h>
 #include <Utils.hpp>
+#include <algorithm>
 #if defined(_DEBUG)
 #define MA_DEBUG_OUTPUT
 #endif
@@ -17,9 +21,23 @@ static void AudioPlayer_LogCallback(void* pUserData, ma_uint32 level, const char
 }
 
 namespace moonlight_xbox_dx {
+	static MixChannel ToMixChannel(ma_channel channel) {
+		switch (channel) {
+		case MA_CHANNEL_FRONT_LEFT: return MIX_FRONT_LEFT;
+		case MA_CHANNEL_FRONT_RIGHT: return MIX_FRONT_RIGHT;
+		case MA_CHANNEL_MONO:
+		case MA_CHANNEL_FRONT_CENTER: return MIX_FRONT_CENTER;
+		case MA_CHANNEL_LFE: return MIX_LFE;
+		case MA_CHANNEL_BACK_LEFT: return MIX_BACK_LEFT;
+		case MA_CHANNEL_BACK_RIGHT: return MIX_BACK_RIGHT;
+		case MA_CHANNEL_SIDE_LEFT: return MIX_SIDE_LEFT;
+		case MA_CHANNEL_SIDE_RIGHT: return MIX_SIDE_RIGHT;
+		default: return MIX_OTHER;
+		}
+	}
+
 	//Helpers
 	AudioPlayer* instance;
-	ma_pcm_rb rb;
 	ma_device device;
 	ma_context context;
 	ma_log log;
@@ -61,21 +79,89 @@ namespace moonlight_xbox_dx {
 
 	void requireAudioData(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount)
 	{
-		void* buffer;
-		ma_uint32 len = frameCount;
-		ma_result res = ma_pcm_rb_acquire_read(&rb, &len, &buffer);
-		if (res != MA_SUCCESS) {
-			Utils::Log("Failed to read audio data\n");
+		instance->FillOutput((float*)pOutput, frameCount);
+	}
+
+	// Called by the device callback. miniaudio hands us a silenced buffer, anything we can't
+	// play from the ring is concealed so the device never repeats stale samples.
+	void AudioPlayer::FillOutput(float* output, uint32_t frameCount) {
+		AudioJitterBuffer& jitterBuffer = AudioJitterBuffer::instance();
+		AudioStats& audioStats = AudioStats::instance();
+		audioStats.observeCallback(QpcNow(), frameCount);
+
+		// Start (or restart after a long outage) only once the jitter buffer is full enough
+		const uint32_t queuedFrames = ring.availableRead();
+		if (!primed) {
+			if (queuedFrames < jitterBuffer.targetFrames()) {
+				return;
+			}
+			primed = true;
+			concealedRun = 0;
+			concealLen = 0;
+		}
+		audioStats.observeFill(queuedFrames);
+
+		// The rest of a concealed packet comes first, Opus decoded everything in the ring after it
+		uint32_t filled = TakeConcealed(output, frameCount);
+		filled += ring.readFrames(output + filled * channelCount, frameCount - filled);
+		if (filled == frameCount) {
+			concealedRun = 0;
 			return;
 		}
+
+		const uint32_t shortfall = frameCount - filled;
+		const uint32_t plcFrames = Conceal(output + filled * channelCount, shortfall);
+		jitterBuffer.countUnderrun(plcFrames, shortfall - plcFrames);
+
+		// The host stopped sending, go quiet and buffer up again instead of concealing forever
+		concealedRun += shortfall;
+		if (concealedRun >= (uint32_t)(sampleRate / 1000 * MAX_CONCEAL_MS)) {
+			Utils::Logf("Audio: no data for %dms, rebuffering\n", MAX_CONCEAL_MS);
+			primed = false;
+		}
+	}
+
+	// Device callback only, plays what's left of the last concealed packet
+	uint32_t AudioPlayer::TakeConcealed(float* output, uint32_t frameCount) {
+		const uint32_t len = std::min(concealLen, frameCount);
 		if (len > 0) {
-			memcpy(pOutput, buffer, len * ma_pcm_rb_get_bpf(&rb));
-			res = ma_pcm_rb_commit_read(&rb, len);
-			if (res != MA_SUCCESS && res != MA_AT_END) {
-				Utils::Log("Failed to read audio data to shared buffer\n");
-				return;
+			memcpy(output, concealBuffer.data() + concealPos * channelCount, len * channelCount * sizeof(float));
+			concealPos += len;
+			concealLen -= len;
+		}
+		return len;
+	}
+
+	// Device callback only. Opus packet loss concealment continues the audio smoothly, but the
+	// receive thread may be decoding at that moment, in which case we fall back to silence.
+	// Returns how many frames came from PLC, the remainder is silence.
+	uint32_t AudioPlayer::Conceal(float* output, uint32_t frameCount) {
+		std::unique_lock<std::mutex> lock(decoderMutex, std::try_to_lock);
+		if (!lock.owns_lock() || decoder == NULL) {
+			memset(output, 0, frameCount * channelCount * sizeof(float));
+			return 0;
+		}
+
+		float* plc = mixer.isPassthrough() ? concealBuffer.data() : plcBuffer.data();
+		uint32_t concealed = 0;
+		while (concealed < frameCount) {
+			int decodeLen = opus_multistream_decode_float(decoder, NULL, 0, plc, this->samplePerFrame, 0);
+			if (decodeLen <= 0) {
+				memset(output, 0, (frameCount - concealed) * channelCount * sizeof(float));
+				break;
 			}
+			if (plc != concealBuffer.data()) {
+				mixer.process(plc, concealBuffer.data(), (uint32_t)decodeLen);
+			}
+
+			// Keep whatever we don't need now, the next callback plays it before newer audio
+			concealPos = 0;
+			concealLen = (uint32_t)decodeLen;
+			uint32_t len = TakeConcealed(output, frameCount - concealed);
+			output += len * channelCount;
+			concealed += len;
 		}
+		return concealed;
 	}
 
 	int AudioPlayer::Init(int audioConfiguration, const POPUS_MULTISTREAM_CONFIGURATION opusConfig, void* mnlContext, int arFlags) {
@@ -84,14 +170,9 @@ namespace moonlight_xbox_dx {
 		if (rc != 0) {
 			return rc;
 		}
-		ma_device_config deviceConfig;
-		deviceConfig = ma_device_config_init(ma_device_type_playback);
-		deviceConfig.playback.format = ma_format_f32;
-		deviceConfig.playback.channels = opusConfig->channelCount;
-		deviceConfig.sampleRate = opusConfig->sampleRate;
 		this->samplePerFrame = opusConfig->samplesPerFrame;
-		this->channelCount = opusConfig->channelCount;
-		deviceConfig.dataCallback = requireAudioData;
+		this->streamChannels = opusConfig->channelCount;
+		this->sampleRate = opusConfig->sampleRate;
 
 		// Specify a custom log object in the config so any logs that are posted from ma_context_init() are captured.
 		ma_log_init(NULL, &log);
@@ -104,57 +185,188 @@ namespace moonlight_xbox_dx {
 			return -3;
 		}
 
-		if (ma_device_init(&context, &deviceConfig, &device) != MA_SUCCESS) {
-			Utils::Log("Failed to open playback device.\n");
-			return -3;
+		// Play in the device's own layout and do the channel mapping ourselves. Layouts the mixer
+		// doesn't know are left to miniaudio, as are devices that can't be opened that way.
+		bool mixed = OpenDevice(0);
+		if (mixed) {
+			MixChannel layout[AudioMixer::MAX_CHANNELS];
+			for (ma_uint32 c = 0; c < device.playback.channels && c < AudioMixer::MAX_CHANNELS; c++) {
+				layout[c] = ToMixChannel(device.playback.channelMap[c]);
+			}
+			if (!mixer.init(streamChannels, layout, (int)device.playback.channels, upmix)) {
+				Utils::Logf("Audio: no mix from %d to %u channels, leaving it to the device\n", streamChannels, device.playback.channels);
+				ma_device_uninit(&device);
+				mixed = false;
+			}
+		}
+		if (!mixed) {
+			if (!OpenDevice(streamChannels)) {
+				Utils::Log("Failed to open playback device.\n");
+				return -3;
+			}
+			mixer.init(streamChannels, NULL, streamChannels, false);
 		}
+		this->channelCount = (int)device.playback.channels;
+		Utils::Logf("Audio: %d channel stream on %d channel device, %s\n", streamChannels, channelCount,
+		            mixer.isPassthrough() ? "played as is" : (upmix ? "mixed with upmix" : "mixed"));
+
+		this->decodeBuffer.assign((this->samplePerFrame + 1) * this->streamChannels, 0.0f);
+		this->mixBuffer.assign((this->samplePerFrame + 1) * this->channelCount, 0.0f);
+		this->plcBuffer.assign(this->samplePerFrame * this->streamChannels, 0.0f);
+		this->concealBuffer.assign(this->samplePerFrame * this->channelCount, 0.0f);
 
-		ma_result r = ma_pcm_rb_init(ma_format_f32, opusConfig->channelCount, opusConfig->samplesPerFrame * 10, NULL, NULL, &rb);
-		if (r != MA_SUCCESS) {
+		int r = 0;
+		if (!ring.init(channelCount, opusConfig->sampleRate / 1000 * RING_BUFFER_MS)) {
 			Utils::Log("Failed to create shared buffer\n");
+			r = -3;
 		}
+
+		AudioJitterBuffer::instance().init(opusConfig->sampleRate, opusConfig->samplesPerFrame,
+		                                   device.playback.internalPeriodSizeInFrames, device.playback.internalPeriods);
+		AudioStats::instance().init(opusConfig->sampleRate);
 		return r;
 	}
 
+	// channels = 0 opens the device in its native channel count and layout
+	bool AudioPlayer::OpenDevice(int channels) {
+		ma_device_config deviceConfig = ma_device_config_init(ma_device_type_playback);
+		deviceConfig.playback.format = ma_format_f32;
+		deviceConfig.playback.channels = channels;
+		deviceConfig.sampleRate = this->sampleRate;
+		deviceConfig.dataCallback = requireAudioData;
+		return ma_device_init(&context, &deviceConfig, &device) == MA_SUCCESS;
+	}
+
 	void AudioPlayer::Cleanup() {
-		Utils::Log("Audio Cleanup\n");
-		if (decoder != NULL) opus_multistream_decoder_destroy(decoder);
-		ma_pcm_rb_uninit(&rb);
+		Utils::Logf("Audio Cleanup, packets decoded in place: %llu, through the scratch buffer: %llu\n",
+		            inPlacePackets, copiedPackets);
+		{
+			std::lock_guard<std::mutex> lock(decoderMutex);
+			if (decoder != NULL) opus_multistream_decoder_destroy(decoder);
+			decoder = NULL;
+		}
+		ring.uninit();
 		ma_device_uninit(&device);
 		ma_log_uninit(&log);
 		ma_context_uninit(&context);
 	}
 
+	// Called by the audio receive thread. moonlight-common-c passes NULL for a lost packet, which
+	// makes Opus conceal it.
 	int AudioPlayer::SubmitDU(char* sampleData, int sampleLength) {
-		void* buffer;
-		ma_uint32 bufferLen = (ma_uint32)this->samplePerFrame;
-		ma_result r = ma_pcm_rb_acquire_write(&rb, &bufferLen, &buffer);
-		if (r != MA_SUCCESS) {
-			Utils::Log("Failed to acquire shared buffer\n");
-			return -1;
-		}
-		if (bufferLen < (ma_uint32)this->samplePerFrame || buffer == nullptr) {
-			Utils::Logf("Audio buffer overflow (%d > %d)\n", bufferLen, this->samplePerFrame);
-			return -1;
-		}
+		const int64_t arrivalQpc = QpcNow();
+		AudioJitterBuffer& jitterBuffer = AudioJitterBuffer::instance();
 
-		int decodeLen = opus_multistream_decode_float(decoder, (unsigned char*)sampleData,
-													  sampleLength, (float *)buffer, this->samplePerFrame, 0);
+		// Decode straight into the ring when the space after its write pointer can take the packet
+		// plus an inserted sample frame. Near the end of the ring, decode into decodeBuffer and copy
+		// it across the wrap instead.
+		float* region = ring.acquireWrite((uint32_t)this->samplePerFrame + 1);
+		float* samples = (region != NULL && mixer.isPassthrough()) ? region : decodeBuffer.data();
+
+		int decodeLen;
+		int64_t decodeQpc;
+		{
+			std::lock_guard<std::mutex> lock(decoderMutex);
+			const int64_t decodeStartQpc = QpcNow();
+			decodeLen = opus_multistream_decode_float(decoder, (unsigned char*)sampleData,
+			                                          sampleLength, samples, this->samplePerFrame, 0);
+			decodeQpc = QpcNow() - decodeStartQpc;
+		}
 		if (decodeLen < 0) {
 			Utils::Logf("opus_multistream_decode_float failed: %d\n", decodeLen);
 			return -1;
 		}
-		if (decodeLen > 0) {
-			r = ma_pcm_rb_commit_write(&rb, (ma_uint32)decodeLen);
-			if (r != MA_SUCCESS && r != MA_AT_END) {
-				Utils::Log("Failed to write to shared buffer\n");
-				return -1;
+
+		const uint32_t queuedFrames = ring.availableRead();
+		AudioStats::instance().observeDecode(decodeQpc, queuedFrames);
+
+		if (sampleData == NULL) {
+			jitterBuffer.countLostPacket();
+			lostPackets++;
+			return CommitFrames(samples, (uint32_t)decodeLen, region) ? 0 : -1;
+		}
+
+		AudioJitterBuffer::Correction correction = jitterBuffer.observePacket(arrivalQpc, queuedFrames, 1 + lostPackets);
+		lostPackets = 0;
+
+		// Sample corrections happen mid-packet, blending with the neighbouring samples
+		const int mid = decodeLen / 2;
+		switch (correction) {
+		case AudioJitterBuffer::CORRECTION_DROP_PACKET:
+			jitterBuffer.countOverrun();
+			return 0;
+
+		case AudioJitterBuffer::CORRECTION_DROP_SAMPLE:
+			if (decodeLen >= 2) {
+				for (int c = 0; c < streamChannels; c++) {
+					samples[(mid - 1) * streamChannels + c] = 0.5f * (samples[(mid - 1) * streamChannels + c] + samples[mid * streamChannels + c]);
+				}
+				memmove(samples + mid * streamChannels, samples + (mid + 1) * streamChannels, (decodeLen - mid - 1) * streamChannels * sizeof(float));
+				decodeLen--;
 			}
+			break;
+
+		case AudioJitterBuffer::CORRECTION_INSERT_SAMPLE:
+			if (decodeLen >= 2) {
+				memmove(samples + (mid + 1) * streamChannels, samples + mid * streamChannels, (decodeLen - mid) * streamChannels * sizeof(float));
+				for (int c = 0; c < streamChannels; c++) {
+					samples[mid * streamChannels + c] = 0.5f * (samples[(mid - 1) * streamChannels + c] + samples[(mid + 1) * streamChannels + c]);
+				}
+				decodeLen++;
+			}
+			break;
+
+		default:
+			break;
+		}
+
+		if (!CommitFrames(samples, (uint32_t)decodeLen, region)) {
+			return -1;
 		}
+
+		// The packet starts playing once everything queued ahead of it and the device buffer have played
+		const double playoutMs = queuedFrames * 1000.0 / sampleRate + jitterBuffer.deviceLatencyMs();
+		AVSyncMonitor::instance().observeAudio(arrivalQpc, arrivalQpc + MsToQpc(playoutMs), jitterBuffer.packetMs());
 		return 0;
 	}
 
+	// Receive thread only, publishes a decoded packet to the device callback. region is the ring's
+	// contiguous write space when it can take the whole packet, and may already hold it.
+	bool AudioPlayer::CommitFrames(const float* samples, uint32_t frameCount, float* region) {
+		if (region == NULL) {
+			copiedPackets++;
+			if (!mixer.isPassthrough()) {
+				mixer.process(samples, mixBuffer.data(), frameCount);
+				samples = mixBuffer.data();
+			}
+			return WriteFrames(samples, frameCount);
+		}
+
+		inPlacePackets++;
+		if (samples != region) {
+			mixer.process(samples, region, frameCount);
+		}
+		return ring.commitWrite(frameCount);
+	}
+
+	// Receive thread only, a packet that doesn't fit in the ring is dropped whole
+	bool AudioPlayer::WriteFrames(const float* samples, uint32_t frameCount) {
+		const uint32_t space = ring.availableWrite();
+		if (space < frameCount) {
+			Utils::Logf("Audio buffer overflow (%u > %u)\n", frameCount, space);
+			AudioJitterBuffer::instance().countOverrun();
+			return false;
+		}
+		return ring.writeFrames(samples, frameCount);
+	}
+
 	void AudioPlayer::Start() {
+		primed = false;
+		concealedRun = 0;
+		concealLen = 0;
+		lostPackets = 0;
+		inPlacePackets = 0;
+		copiedPackets = 0;
 		if (ma_device_start(&device) != MA_SUCCESS) {
 			Utils::Log("Failed to start playback device.\n");
 			ma_device_uninit(&device);
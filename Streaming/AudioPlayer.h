@@ -1,5 +1,9 @@
 #pragma once
 #include "pch.h"
+#include <mutex>
+#include <vector>
+#include "AudioMixer.h"
+#include "AudioRing.h"
 extern "C" {
 #include <Limelight.h>
 #include <opus/opus_multistream.h>
@@ -19,10 +23,41 @@ namespace moonlight_xbox_dx
 		static AudioPlayer* getInstance();
 		static AUDIO_RENDERER_CALLBACKS getDecoder();
 		bool setup = false;
-		int channelCount;
+		bool upmix = false;     // spread stereo over surround speakers, set before the stream starts
+		int channelCount;       // played by the device, what the ring holds
+		int streamChannels;     // decoded by Opus
+
+		// Called by the device callback
+		void FillOutput(float* output, uint32_t frameCount);
+
+		static constexpr int RING_BUFFER_MS = 250;
+		static constexpr int MAX_CONCEAL_MS = 200; // after this long without data, wait for the buffer to refill
 	private:
-		OpusMSDecoder* decoder;
+		uint32_t TakeConcealed(float* output, uint32_t frameCount);
+		uint32_t Conceal(float* output, uint32_t frameCount);
+		bool OpenDevice(int channels);
+		bool CommitFrames(const float* samples, uint32_t frameCount, float* region);
+		bool WriteFrames(const float* samples, uint32_t frameCount);
+
+		OpusMSDecoder* decoder = NULL;
 		int sampleRate;
 		int samplePerFrame;
+
+		AudioMixer mixer;                 // stream channels to device channels
+		AudioRing ring;                   // device channels, from the receive thread to the device callback
+		std::mutex decoderMutex;          // the device callback decodes PLC when the ring runs dry
+		std::vector<float> decodeBuffer;  // one packet plus a sample frame inserted for drift correction
+		std::vector<float> mixBuffer;     // decodeBuffer mixed for the device, when the ring wraps
+		std::vector<float> plcBuffer;     // PLC output before mixing
+		std::vector<float> concealBuffer;
+		int lostPackets = 0;              // since the last received packet
+		uint64_t inPlacePackets = 0;      // decoded or mixed straight into the ring
+		uint64_t copiedPackets = 0;       // went through a scratch buffer because the ring wrapped
+
+		// Device callback only
+		bool primed = false;              // the ring reached its target fill since playback (re)started
+		uint32_t concealedRun = 0;        // consecutive frames concealed
+		uint32_t concealPos = 0;          // PLC output in concealBuffer not played yet
+		uint32_t concealLen = 0;
 	};
 }
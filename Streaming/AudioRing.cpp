@@ -0,0 +1,101 @@
+#include "pch.h"
+#include "AudioRing.h"
+#include <Utils.hpp>
+
+#include <cstring>
+
+using namespace moonlight_xbox_dx;
+
+bool AudioRing::init(int channels, uint32_t capacityFrames) {
+	m_channels = channels;
+	m_initialized = ma_pcm_rb_init(ma_format_f32, channels, capacityFrames, NULL, NULL, &m_rb) == MA_SUCCESS;
+	return m_initialized;
+}
+
+void AudioRing::uninit() {
+	if (m_initialized) {
+		ma_pcm_rb_uninit(&m_rb);
+		m_initialized = false;
+	}
+}
+
+uint32_t AudioRing::availableRead() {
+	return m_initialized ? ma_pcm_rb_available_read(&m_rb) : 0;
+}
+
+uint32_t AudioRing::availableWrite() {
+	return m_initialized ? ma_pcm_rb_available_write(&m_rb) : 0;
+}
+
+uint32_t AudioRing::readFrames(float *output, uint32_t frameCount) {
+	if (!m_initialized) {
+		return 0;
+	}
+	uint32_t filled = 0;
+	while (filled < frameCount) {
+		void *buffer;
+		ma_uint32 len = frameCount - filled;
+		ma_result res = ma_pcm_rb_acquire_read(&m_rb, &len, &buffer);
+		if (res != MA_SUCCESS) {
+			Utils::Log("Failed to read audio data\n");
+			break;
+		}
+		if (len == 0) {
+			break;
+		}
+		memcpy(output + filled * m_channels, buffer, len * m_channels * sizeof(float));
+		res = ma_pcm_rb_commit_read(&m_rb, len);
+		if (res != MA_SUCCESS && res != MA_AT_END) {
+			Utils::Log("Failed to read audio data to shared buffer\n");
+			break;
+		}
+		filled += len;
+	}
+	return filled;
+}
+
+bool AudioRing::writeFrames(const float *samples, uint32_t frameCount) {
+	if (availableWrite() < frameCount) {
+		return false;
+	}
+
+	while (frameCount > 0) {
+		void *buffer;
+		ma_uint32 len = frameCount;
+		ma_result r = ma_pcm_rb_acquire_write(&m_rb, &len, &buffer);
+		if (r != MA_SUCCESS || len == 0) {
+			Utils::Log("Failed to acquire shared buffer\n");
+			return false;
+		}
+		memcpy(buffer, samples, len * m_channels * sizeof(float));
+		r = ma_pcm_rb_commit_write(&m_rb, len);
+		if (r != MA_SUCCESS && r != MA_AT_END) {
+			Utils::Log("Failed to write to shared buffer\n");
+			return false;
+		}
+		samples += len * m_channels;
+		frameCount -= len;
+	}
+	return true;
+}
+
+float *AudioRing::acquireWrite(uint32_t frameCount) {
+	if (!m_initialized) {
+		return NULL;
+	}
+	void *region = NULL;
+	ma_uint32 contiguous = frameCount;
+	if (ma_pcm_rb_acquire_write(&m_rb, &contiguous, &region) != MA_SUCCESS || region == NULL || contiguous < frameCount) {
+		return NULL;
+	}
+	return (float *)region;
+}
+
+bool AudioRing::commitWrite(uint32_t frameCount) {
+	ma_result r = ma_pcm_rb_commit_write(&m_rb, frameCount);
+	if (r != MA_SUCCESS && r != MA_AT_END) {
+		Utils::Log("Failed to write to shared buffer\n");
+		return false;
+	}
+	return true;
+}
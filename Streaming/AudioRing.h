@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include "third_party/miniaudio.h"
+
+// Decoded audio on its way from the receive thread to the device callback, as interleaved
+// float frames in a miniaudio ring buffer.
+//
+// The ring only hands out contiguous regions, so readFrames() and writeFrames() take two of them
+// when they cross its end. The receive thread can also decode straight into the ring with
+// acquireWrite() and commitWrite() when the space after the write pointer is large enough.
+// One writer and one reader, no locks.
+class AudioRing {
+  public:
+	bool init(int channels, uint32_t capacityFrames);
+	void uninit();
+
+	int channels() const { return m_channels; }
+	uint32_t availableRead();
+	uint32_t availableWrite();
+
+	// Reader only. Returns how many frames were read, less than frameCount if the ring ran dry.
+	uint32_t readFrames(float *output, uint32_t frameCount);
+
+	// Writer only. Writes all of the frames, or none if they don't fit.
+	bool writeFrames(const float *samples, uint32_t frameCount);
+
+	// Writer only. The contiguous space after the write pointer if it holds frameCount frames,
+	// NULL otherwise. Publish what was written there with commitWrite().
+	float *acquireWrite(uint32_t frameCount);
+	bool commitWrite(uint32_t frameCount);
+
+  private:
+	ma_pcm_rb m_rb;
+	int m_channels = 0;
+	bool m_initialized = false;
+};
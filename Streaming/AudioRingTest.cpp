@@ -0,0 +1,204 @@
+// Wraparound continuity suite for AudioRing, built on the host rather than into the app
+//
+// A writer pushes a counting sequence through the ring in chunks of random size, some decoded in
+// place through acquireWrite() and commitWrite() and some copied with writeFrames(), while a
+// reader pulls it back out with readFrames() in chunks of unrelated random size. Every sample
+// read must be the next one of the sequence exactly, so a read or write split wrongly across the
+// end of the ring shows up as a gap, a repeat or shifted channels. Each ring runs once with both
+// sides interleaved on one thread, where every result can be predicted, and once with the writer
+// and reader on their own threads like the receive thread and the device callback.
+//
+//   g++ -std=c++17 -O2 -ITools/HostCompat Streaming/AudioRing*.cpp Tools/HostCompat/HostUtils.cpp -o ring-test -lpthread -lm
+//
+// or through Tools/CMakeLists.txt.
+
+#define MINIAUDIO_IMPLEMENTATION
+#include "pch.h"
+#include "AudioRing.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+
+// Integers up to 2^24 are exact in a float, the sequence repeats after that
+static float sequenceSample(uint64_t n) {
+	return (float)(n & 0xFFFFFF);
+}
+
+static const float CANARY = -1.0f;
+
+static int g_failures = 0;
+
+static void fail(int channels, uint32_t capacity, const char *mode, const char *what) {
+	fprintf(stderr, "FAIL %d ch, %u frame ring, %s: %s\n", channels, capacity, mode, what);
+	g_failures++;
+}
+
+// Checks frames against the sequence starting at *next and moves it on
+static bool checkSequence(const float *frames, uint32_t frameCount, int channels, uint64_t *next) {
+	for (uint32_t i = 0; i < frameCount * channels; i++) {
+		if (frames[i] != sequenceSample((*next)++)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// The writer's side of both tests, one packet of frameCount frames
+static bool writePacket(AudioRing &ring, std::vector<float> &scratch, bool inPlace, uint32_t frameCount,
+                        uint64_t *next) {
+	const int channels = ring.channels();
+	float *region = inPlace ? ring.acquireWrite(frameCount) : NULL;
+	float *samples = region != NULL ? region : scratch.data();
+	uint64_t n = *next;
+	for (uint32_t i = 0; i < frameCount * channels; i++) {
+		samples[i] = sequenceSample(n++);
+	}
+	if (region != NULL ? !ring.commitWrite(frameCount) : !ring.writeFrames(samples, frameCount)) {
+		return false;
+	}
+	*next = n;
+	return true;
+}
+
+static void runInterleaved(int channels, uint32_t capacity, uint32_t maxChunk, uint64_t totalFrames) {
+	const char *mode = "interleaved";
+	AudioRing ring;
+	if (!ring.init(channels, capacity)) {
+		fail(channels, capacity, mode, "init failed");
+		return;
+	}
+
+	std::mt19937 rng(channels * 7919 + capacity);
+	std::uniform_int_distribution<uint32_t> chunk(1, maxChunk);
+	std::vector<float> scratch(maxChunk * channels);
+	std::vector<float> output((maxChunk + 1) * channels);
+	uint64_t written = 0, read = 0;
+	uint64_t nextWrite = 0, nextRead = 0;
+	uint64_t splitWrites = 0, splitReads = 0;
+
+	while (read < totalFrames) {
+		if (rng() % 2 == 0) {
+			const uint32_t frames = chunk(rng);
+			const bool inPlace = rng() % 2 == 0;
+			const uint32_t space = ring.availableWrite();
+			const uint32_t queued = ring.availableRead();
+			const bool crosses = (written % capacity) + frames > capacity;
+			const bool ok = writePacket(ring, scratch, inPlace, frames, &nextWrite);
+
+			// A packet that can't go in place is copied instead, so either way it goes in whenever it fits
+			if (ok != (frames <= space)) {
+				fail(channels, capacity, mode, "the ring didn't take exactly the packets that fit");
+				return;
+			}
+			if (!ok && ring.availableRead() != queued) {
+				fail(channels, capacity, mode, "a refused packet was partly written");
+				return;
+			}
+			if (ok) {
+				written += frames;
+				splitWrites += crosses;
+			}
+		} else {
+			const uint32_t frames = chunk(rng);
+			const uint32_t queued = ring.availableRead();
+			std::fill(output.begin(), output.end(), CANARY);
+			const uint32_t got = ring.readFrames(output.data(), frames);
+			if (got != std::min(frames, queued)) {
+				fail(channels, capacity, mode, "readFrames() returned less than was queued");
+				return;
+			}
+			if (!checkSequence(output.data(), got, channels, &nextRead)) {
+				fail(channels, capacity, mode, "samples out of sequence");
+				return;
+			}
+			if (output[got * channels] != CANARY) {
+				fail(channels, capacity, mode, "readFrames() wrote past the frames it returned");
+				return;
+			}
+			splitReads += (read % capacity) + got > capacity;
+			read += got;
+		}
+	}
+
+	if (splitWrites == 0 || splitReads == 0) {
+		fail(channels, capacity, mode, "never crossed the end of the ring");
+	}
+	ring.uninit();
+	printf("  %d ch, %5u frame ring, %-11s %9llu frames, %6llu writes and %6llu reads across the end\n", channels,
+	       capacity, mode, (unsigned long long)read, (unsigned long long)splitWrites,
+	       (unsigned long long)splitReads);
+}
+
+static void runThreaded(int channels, uint32_t capacity, uint32_t maxChunk, uint64_t totalFrames) {
+	const char *mode = "threaded";
+	AudioRing ring;
+	if (!ring.init(channels, capacity)) {
+		fail(channels, capacity, mode, "init failed");
+		return;
+	}
+
+	std::atomic<bool> writerFailed{false};
+	std::thread writer([&]() {
+		std::mt19937 rng(channels * 104729 + capacity);
+		std::uniform_int_distribution<uint32_t> chunk(1, maxChunk);
+		std::vector<float> scratch(maxChunk * channels);
+		uint64_t next = 0, written = 0;
+		while (written < totalFrames && !writerFailed.load()) {
+			const uint32_t frames = chunk(rng);
+			const bool inPlace = rng() % 2 == 0;
+			while (ring.availableWrite() < frames) {
+				std::this_thread::yield();
+			}
+			// Only this thread writes, so the space can't shrink before the packet goes in
+			if (!writePacket(ring, scratch, inPlace, frames, &next)) {
+				writerFailed.store(true);
+			}
+			written += frames;
+		}
+	});
+
+	std::mt19937 rng(channels * 15485863 + capacity);
+	std::uniform_int_distribution<uint32_t> chunk(1, maxChunk);
+	std::vector<float> output(maxChunk * channels);
+	uint64_t next = 0, read = 0;
+	bool inSequence = true;
+	while (read < totalFrames && !writerFailed.load()) {
+		const uint32_t got = ring.readFrames(output.data(), chunk(rng));
+		if (got == 0) {
+			std::this_thread::yield();
+			continue;
+		}
+		if (inSequence && !checkSequence(output.data(), got, channels, &next)) {
+			inSequence = false;
+			writerFailed.store(true); // stops the writer, it may be waiting for space
+		}
+		read += got;
+	}
+	writer.join();
+
+	if (!inSequence) {
+		fail(channels, capacity, mode, "samples out of sequence");
+	} else if (writerFailed.load()) {
+		fail(channels, capacity, mode, "a packet that fit was refused");
+	}
+	ring.uninit();
+	printf("  %d ch, %5u frame ring, %-11s %9llu frames\n", channels, capacity, mode, (unsigned long long)read);
+}
+
+int main() {
+	// 250 ms at 48 kHz like the player, and a small odd ring that wraps every few packets
+	const uint32_t capacities[] = {12000, 97};
+	for (int channels : {1, 2, 6, 8}) {
+		for (uint32_t capacity : capacities) {
+			const uint32_t maxChunk = capacity == 12000 ? 961 : 61;
+			runInterleaved(channels, capacity, maxChunk, (uint64_t)capacity * 200);
+			runThreaded(channels, capacity, maxChunk, (uint64_t)capacity * 200);
+		}
+	}
+	printf("%d failures\n", g_failures);
+	return g_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,95 @@
+#include "pch.h"
+#include "AudioStats.h"
+#include "AudioJitterBuffer.h"
+#include "../Plot/ImGuiPlots.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+AudioStats &AudioStats::instance() {
+	static AudioStats inst;
+	return inst;
+}
+
+// Called by AudioPlayer::Init. The counters only ever grow, each window is the difference
+// between two snapshots, so only the per-stream state is reset here.
+void AudioStats::init(int sampleRate) {
+	m_sampleRate = sampleRate > 0 ? sampleRate : 48000;
+	m_lastUnderruns = 0;
+	m_lastCallbackQpc = 0;
+	m_decodeMaxUs.store(0, std::memory_order_relaxed);
+	m_callbackMaxLateUs.store(0, std::memory_order_relaxed);
+	m_minQueuedFrames.store(UINT32_MAX, std::memory_order_relaxed);
+}
+
+// Receive thread only
+void AudioStats::observeDecode(int64_t decodeQpc, uint32_t queuedFrames) {
+	const uint64_t decodeUs = (uint64_t)std::max<int64_t>(QpcToUs(decodeQpc), 0);
+	m_packets.fetch_add(1, std::memory_order_relaxed);
+	m_decodeTotalUs.fetch_add(decodeUs, std::memory_order_relaxed);
+	raise(m_decodeMaxUs, decodeUs);
+
+	// Underruns happen in the callback, which can't take the plot lock, so they are plotted here
+	const uint64_t underruns = AudioJitterBuffer::instance().underruns();
+	const uint64_t newUnderruns = underruns >= m_lastUnderruns ? underruns - m_lastUnderruns : underruns;
+	m_lastUnderruns = underruns;
+
+	ImGuiPlots &plots = ImGuiPlots::instance();
+	plots.observeFloat(PLOT_AUDIO_QUEUE, (float)(queuedFrames * 1000.0 / m_sampleRate));
+	plots.observeFloat(PLOT_AUDIO_DECODE, (float)decodeUs);
+	plots.observeFloat(PLOT_AUDIO_UNDERRUNS, (float)newUnderruns);
+}
+
+// Device callback only
+void AudioStats::observeCallback(int64_t nowQpc, uint32_t frameCount) {
+	const int64_t lastQpc = m_lastCallbackQpc;
+	m_lastCallbackQpc = nowQpc;
+	if (lastQpc == 0 || nowQpc <= lastQpc) {
+		return;
+	}
+
+	// The device asks for what it played since the last callback, so that's how long it should have been
+	const int64_t periodUs = QpcToUs(nowQpc - lastQpc);
+	const int64_t expectedUs = (int64_t)frameCount * 1000000 / m_sampleRate;
+	m_callbacks.fetch_add(1, std::memory_order_relaxed);
+	m_callbackDeviationUs.fetch_add((uint64_t)std::llabs(periodUs - expectedUs), std::memory_order_relaxed);
+	if (periodUs > expectedUs) {
+		raise(m_callbackMaxLateUs, (uint64_t)(periodUs - expectedUs));
+	}
+}
+
+// Device callback only, while playing
+void AudioStats::observeFill(uint32_t queuedFrames) {
+	uint32_t current = m_minQueuedFrames.load(std::memory_order_relaxed);
+	while (queuedFrames < current && !m_minQueuedFrames.compare_exchange_weak(current, queuedFrames, std::memory_order_relaxed)) {
+	}
+}
+
+// Single writer, but collect() resets it concurrently
+void AudioStats::raise(std::atomic<uint64_t> &slot, uint64_t value) {
+	uint64_t current = slot.load(std::memory_order_relaxed);
+	while (value > current && !slot.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+	}
+}
+
+void AudioStats::collect(AudioStatsWindow &window) {
+	const uint64_t packets = m_packets.load(std::memory_order_relaxed);
+	const uint64_t decodeTotalUs = m_decodeTotalUs.load(std::memory_order_relaxed);
+	const uint64_t callbacks = m_callbacks.load(std::memory_order_relaxed);
+	const uint64_t callbackDeviationUs = m_callbackDeviationUs.load(std::memory_order_relaxed);
+
+	window.packets = (uint32_t)(packets - m_lastPackets);
+	window.decodeAvgUs = window.packets ? (double)(decodeTotalUs - m_lastDecodeTotalUs) / window.packets : 0.0;
+	window.decodeMaxUs = (double)m_decodeMaxUs.exchange(0, std::memory_order_relaxed);
+	window.callbacks = (uint32_t)(callbacks - m_lastCallbacks);
+	window.callbackJitterMs = window.callbacks ? (double)(callbackDeviationUs - m_lastCallbackDeviationUs) / window.callbacks / 1000.0 : 0.0;
+	window.callbackMaxLateMs = (double)m_callbackMaxLateUs.exchange(0, std::memory_order_relaxed) / 1000.0;
+
+	const uint32_t minQueued = m_minQueuedFrames.exchange(UINT32_MAX, std::memory_order_relaxed);
+	window.minQueuedMs = minQueued != UINT32_MAX ? minQueued * 1000.0 / m_sampleRate : -1.0;
+
+	m_lastPackets = packets;
+	m_lastDecodeTotalUs = decodeTotalUs;
+	m_lastCallbacks = callbacks;
+	m_lastCallbackDeviationUs = callbackDeviationUs;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Health counters for the audio path, so "crackling" reports come with something to look at.
+//
+// The receive thread reports how long each Opus packet took to decode and how much audio was
+// queued in the ring when it arrived. The device callback reports when it runs and the ring fill
+// it finds, which shows how regular the audio device pulls data and how close the ring came to
+// running dry. Underruns and overruns are counted by AudioJitterBuffer.
+//
+// The callback must not block, so everything it touches is a relaxed atomic with a single writer.
+// The receive thread also feeds the audio plots, and Stats collects a window once a second.
+
+struct AudioStatsWindow {
+	uint32_t packets;          // decoded, including concealed losses
+	double decodeAvgUs;
+	double decodeMaxUs;
+	uint32_t callbacks;
+	double callbackJitterMs;   // average deviation from the audio each callback asked for
+	double callbackMaxLateMs;  // worst callback that came later than expected
+	double minQueuedMs;        // lowest ring fill a callback found, -1 if none while playing
+};
+
+class AudioStats {
+  public:
+	// Singleton
+	static AudioStats &instance();
+
+	// Call before each stream
+	void init(int sampleRate);
+
+	// Receive thread, for each decoded packet with the frames queued in the ring before it is written
+	void observeDecode(int64_t decodeQpc, uint32_t queuedFrames);
+
+	// Device callback, lock-free
+	void observeCallback(int64_t nowQpc, uint32_t frameCount);
+	void observeFill(uint32_t queuedFrames);
+
+	// Stats thread, returns the window since the previous call
+	void collect(AudioStatsWindow &window);
+
+  private:
+	AudioStats() = default;
+	AudioStats(const AudioStats &) = delete;
+	AudioStats &operator=(const AudioStats &) = delete;
+
+	static void raise(std::atomic<uint64_t> &slot, uint64_t value);
+
+	int m_sampleRate = 48000;
+
+	// Receive thread owned
+	uint64_t m_lastUnderruns = 0;
+
+	// Device callback owned
+	int64_t m_lastCallbackQpc = 0;
+
+	// Published counters, reset by collect() where noted
+	std::atomic<uint64_t> m_packets{0};
+	std::atomic<uint64_t> m_decodeTotalUs{0};
+	std::atomic<uint64_t> m_decodeMaxUs{0};        // reset
+	std::atomic<uint64_t> m_callbacks{0};
+	std::atomic<uint64_t> m_callbackDeviationUs{0};
+	std::atomic<uint64_t> m_callbackMaxLateUs{0};  // reset
+	std::atomic<uint32_t> m_minQueuedFrames{UINT32_MAX}; // reset
+
+	// Stats thread owned
+	uint64_t m_lastPackets = 0;
+	uint64_t m_lastDecodeTotalUs = 0;
+	uint64_t m_lastCallbacks = 0;
+	uint64_t m_lastCallbackDeviationUs = 0;
+};
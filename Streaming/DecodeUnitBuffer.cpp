@@ -0,0 +1,51 @@
+#include "pch.h"
+#include "DecodeUnitBuffer.h"
+
+#include <cstdlib>
+#include <cstring>
+
+DecodeUnitBuffer::~DecodeUnitBuffer() {
+	release();
+}
+
+bool DecodeUnitBuffer::reserve(int length) {
+	const int required = length + AV_INPUT_BUFFER_PADDING_SIZE;
+	if (m_capacity >= required) {
+		return true;
+	}
+
+	FQLog("DecodeUnitBuffer grew from %d -> %d\n", m_capacity, required);
+
+	uint8_t *grown = (uint8_t *)realloc(m_data, required);
+	if (grown == nullptr) {
+		return false;
+	}
+	m_data = grown;
+	m_capacity = required;
+	return true;
+}
+
+void DecodeUnitBuffer::release() {
+	free(m_data);
+	m_data = nullptr;
+	m_capacity = 0;
+	m_size = 0;
+}
+
+bool DecodeUnitBuffer::gather(const DECODE_UNIT *decodeUnit) {
+	if (!reserve(decodeUnit->fullLength)) {
+		return false;
+	}
+
+	int length = 0;
+	for (PLENTRY entry = decodeUnit->bufferList; entry != nullptr; entry = entry->next) {
+		memcpy(m_data + length, entry->data, entry->length);
+		length += entry->length;
+	}
+	memset(m_data + length, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+
+	m_size = length;
+	m_gatheredUnits++;
+	m_gatheredBytes += length;
+	return true;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+
+extern "C" {
+#include <Limelight.h>
+#include <libavcodec/avcodec.h>
+}
+
+// The buffer FFMpegDecoder hands to ffmpeg. Decode units arrive as a list of entries in buffers
+// owned by moonlight-common-c, which are not padded, so every unit is gathered here and followed
+// by the AV_INPUT_BUFFER_PADDING_SIZE zeroed bytes ffmpeg's bitstream readers may run into.
+// The buffer only grows, so after the first large IDR frame gathering doesn't allocate.
+class DecodeUnitBuffer {
+  public:
+	~DecodeUnitBuffer();
+
+	// Makes room for a unit of length bytes plus padding
+	bool reserve(int length);
+	void release();
+
+	// Copies the unit's entries and zeroes the padding. Returns false if the buffer couldn't grow.
+	bool gather(const DECODE_UNIT *decodeUnit);
+
+	uint8_t *data() const { return m_data; }
+	int size() const { return m_size; }
+
+	uint64_t gatheredUnits() const { return m_gatheredUnits; }
+	uint64_t gatheredBytes() const { return m_gatheredBytes; }
+	void resetCounters() {
+		m_gatheredUnits = 0;
+		m_gatheredBytes = 0;
+	}
+
+  private:
+	uint8_t *m_data = nullptr;
+	int m_capacity = 0;
+	int m_size = 0;
+	uint64_t m_gatheredUnits = 0;
+	uint64_t m_gatheredBytes = 0;
+};
@@ -0,0 +1,157 @@
+// clang-format off
+#include "pch.h"
+// clang-format on
+#include "DevicePacerTiming.h"
+#include "../Plot/ImGuiPlots.h"
+#include "AVSyncMonitor.h"
+#include "FramePool.h"
+#include "Utils.hpp"
+
+using namespace moonlight_xbox_dx;
+
+// How close to a deadline QpcEvent stops blocking and spins instead
+static constexpr int64_t WAIT_SPIN_US = 1000;
+
+// Timed waits on Windows only have ~1ms granularity, so the wait stops WAIT_SPIN_US short of the
+// deadline and the remainder is spun out, polling the event, the same way SleepUntilQpc() does it.
+class QpcEvent : public IPacerEvent {
+  public:
+	QpcEvent() {
+		// auto-reset, there is only ever one waiter
+		m_Event = CreateEventEx(nullptr, nullptr, 0, EVENT_ALL_ACCESS);
+	}
+
+	~QpcEvent() {
+		if (m_Event) {
+			CloseHandle(m_Event);
+		}
+	}
+
+	void set() override {
+		SetEvent(m_Event);
+	}
+
+	bool waitUntil(int64_t deadlineQpc) override {
+		if (!deadlineQpc) {
+			return WaitForSingleObjectEx(m_Event, INFINITE, FALSE) == WAIT_OBJECT_0;
+		}
+
+		const int64_t spinQpc = UsToQpc(WAIT_SPIN_US);
+		for (;;) {
+			const int64_t remaining = deadlineQpc - QpcNow();
+			if (remaining <= 0) {
+				return WaitForSingleObjectEx(m_Event, 0, FALSE) == WAIT_OBJECT_0;
+			}
+
+			DWORD timeoutMs = 0;
+			if (remaining > spinQpc) {
+				timeoutMs = static_cast<DWORD>(((remaining - spinQpc) * 1000) / QpcFreq());
+			}
+			if (WaitForSingleObjectEx(m_Event, timeoutMs, FALSE) == WAIT_OBJECT_0) {
+				return true;
+			}
+			if (timeoutMs == 0) {
+				YieldProcessor();
+			}
+		}
+	}
+
+  private:
+	HANDLE m_Event = nullptr;
+};
+
+int64_t QpcClock::now() {
+	return QpcNow();
+}
+
+void QpcClock::sleepUntil(int64_t targetQpc) {
+	SleepUntilQpc(targetQpc);
+}
+
+std::unique_ptr<IPacerEvent> QpcClock::createEvent() {
+	return std::make_unique<QpcEvent>();
+}
+
+DxgiVsyncSource::DxgiVsyncSource(const std::shared_ptr<DX::DeviceResources> &res)
+    : m_DeviceResources(res) {
+}
+
+DxgiVsyncSource::~DxgiVsyncSource() {
+	stop();
+}
+
+void DxgiVsyncSource::start(std::function<void()> onVBlank) {
+	if (m_Thread.joinable()) {
+		return;
+	}
+	m_Stopping.store(false, std::memory_order_release);
+	m_Thread = std::thread(&DxgiVsyncSource::vsyncThread, this, std::move(onVBlank));
+}
+
+void DxgiVsyncSource::stop() {
+	m_Stopping.store(true, std::memory_order_release);
+	if (m_Thread.joinable()) {
+		m_Thread.join();
+	}
+}
+
+void DxgiVsyncSource::vsyncThread(std::function<void()> onVBlank) {
+	if (!SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_ABOVE_NORMAL)) {
+		Utils::Logf("Failed to set vsyncHardware priority: %d\n", GetLastError());
+	}
+
+	Utils::Logf("vsyncHardware stats thread started, qpcFreq=%lld ticksPerMs=%lld\n",
+	            QpcFreq(), MsToQpc(1.0));
+
+	while (!m_Stopping.load(std::memory_order_acquire)) {
+		// All this thread does is wake up every vsync and let Pacer record the precise vsync QPC
+		// the system tracks. This data is several frames out of date but it's enough to
+		// very precisely time present calls and to determine the vsync interval.
+		m_DeviceResources->GetDXGIOutput()->WaitForVBlank();
+		onVBlank();
+	}
+
+	Utils::Logf("vsyncHardware stats thread stopped\n");
+}
+
+bool DxgiVsyncSource::lastVBlank(VsyncSample *sample) {
+	DXGI_FRAME_STATISTICS stats;
+	if (m_DeviceResources->GetSwapChain()->GetFrameStatistics(&stats) != S_OK) {
+		return false;
+	}
+	sample->refreshCount = stats.SyncRefreshCount;
+	sample->qpc = stats.SyncQPCTime.QuadPart;
+	return true;
+}
+
+StreamPacerStats::StreamPacerStats(const std::shared_ptr<DX::DeviceResources> &res)
+    : m_Stats(res->GetStats()) {
+}
+
+void StreamPacerStats::frameQueued(int droppedFrames, int queueDepth) {
+	if (droppedFrames) {
+		m_Stats->SubmitDroppedFrame(1);
+	}
+
+	ImGuiPlots::instance().observeFloat(PLOT_DROPPED_PACER, (float)droppedFrames);
+	float avgQueueSize = ImGuiPlots::instance().observeFloatReturnAvg(PLOT_QUEUED_FRAMES, (float)queueDepth);
+	m_Stats->SubmitAvgQueueSize(avgQueueSize);
+}
+
+void StreamPacerStats::jitterBufferTarget(int targetDepth) {
+	m_Stats->SubmitJitterBufferTarget(targetDepth);
+}
+
+void StreamPacerStats::frameSkipped() {
+	ImGuiPlots::instance().observeFloat(PLOT_DROPPED_PACER, 1.0);
+}
+
+void StreamPacerStats::frameRendered(int64_t queuedQpc) {
+	m_Stats->SubmitPacerTime(queuedQpc);
+}
+
+void StreamPacerStats::framePresented(const MLFrameTimeline &timeline) {
+	m_Stats->SubmitFrameTimeline(timeline);
+	AVSyncMonitor::instance().observeVideo(timeline.receiveQpc, timeline.presentQpc,
+	                                       timeline.hostProcessingLatency / 10.0);
+}
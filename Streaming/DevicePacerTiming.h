@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include "../Common/DeviceResources.h"
+#include "PacerTiming.h"
+
+// The PacerTiming.h implementations used when streaming: QPC time, DXGI vblanks and
+// reports that go to Stats and the overlay plots.
+
+class QpcClock : public IPacerClock {
+  public:
+	int64_t now() override;
+	void sleepUntil(int64_t targetQpc) override;
+	std::unique_ptr<IPacerEvent> createEvent() override;
+};
+
+class DxgiVsyncSource : public IVsyncSource {
+  public:
+	explicit DxgiVsyncSource(const std::shared_ptr<DX::DeviceResources> &res);
+	~DxgiVsyncSource();
+
+	void start(std::function<void()> onVBlank) override;
+	void stop() override;
+	bool lastVBlank(VsyncSample *sample) override;
+
+  private:
+	void vsyncThread(std::function<void()> onVBlank);
+
+	std::shared_ptr<DX::DeviceResources> m_DeviceResources;
+	std::thread m_Thread;
+	std::atomic<bool> m_Stopping{false};
+};
+
+class StreamPacerStats : public IPacerStats {
+  public:
+	explicit StreamPacerStats(const std::shared_ptr<DX::DeviceResources> &res);
+
+	void frameQueued(int droppedFrames, int queueDepth) override;
+	void jitterBufferTarget(int targetDepth) override;
+	void frameSkipped() override;
+	void frameRendered(int64_t queuedQpc) override;
+	void framePresented(const MLFrameTimeline &timeline) override;
+
+  private:
+	std::shared_ptr<moonlight_xbox_dx::Stats> m_Stats;
+};
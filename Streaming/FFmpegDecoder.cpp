@@ -2,6 +2,11 @@
 #include "FFMpegDecoder.h"
 #include "../Plot/ImGuiPlots.h"
 #include "StatsRenderer.h"
+#include "DevicePacerTiming.h"
+#include "FramePool.h"
+#include "FrameQueue.h"
+#include "PacingTrace.h"
+#include "LaunchTimeline.h"
 
 #include <Common\DirectXHelper.h>
 #include <d3d11_1.h>
@@ -22,22 +27,6 @@ using namespace moonlight_xbox_dx;
 
 #define INITIAL_DECODER_BUFFER_SIZE (256 * 1024)
 
-static bool ensure_buf_size(unsigned char **buf, int *buf_size, int required_size)
-{
-	if (*buf_size >= required_size)
-		return true;
-
-	FQLog("ensure_buf_size grew from %d -> %d\n", *buf_size, required_size);
-
-	*buf_size = required_size;
-	*buf = (unsigned char *)realloc(*buf, *buf_size);
-	if (!*buf) {
-		return false;
-	}
-
-	return true;
-}
-
 namespace moonlight_xbox_dx {
 	FFMpegDecoder &FFMpegDecoder::instance() {
 		static FFMpegDecoder inst;
@@ -52,8 +41,7 @@ namespace moonlight_xbox_dx {
 		decoder_ctx(nullptr),
 		device_ctx(nullptr),
 		d3d11va_device_ctx(nullptr),
-		ffmpeg_buffer(nullptr),
-		ffmpeg_buffer_size(0),
+		m_Packet(nullptr),
 		m_deviceResources(nullptr),
 		m_LastFrameNumber(0) {
 	}
@@ -85,10 +73,14 @@ namespace moonlight_xbox_dx {
 		Utils::Logf(shouldPrefixThisMessage ? "[ffmpeg] %s" : "%s", lineBuffer);
 	}
 
-    void FFMpegDecoder::CompleteInitialization(const std::shared_ptr<DX::DeviceResources>& res, STREAM_CONFIGURATION *config, bool framePacingImmediate) {
+    void FFMpegDecoder::CompleteInitialization(const std::shared_ptr<DX::DeviceResources>& res, STREAM_CONFIGURATION *config, FramePacingMode framePacingMode) {
 		this->m_deviceResources = res;
 		this->fps = config->fps;
-		Pacer::instance().init(res, config->fps, res->GetRefreshRate(), framePacingImmediate);
+		PacerSources sources;
+		sources.clock = std::make_shared<QpcClock>();
+		sources.vsync = std::make_shared<DxgiVsyncSource>(res);
+		sources.stats = std::make_shared<StreamPacerStats>(res);
+		Pacer::instance().init(sources, config->fps, res->GetRefreshRate(), framePacingMode);
 	}
 
 	int FFMpegDecoder::Init(int videoFormat, int width, int height, int redrawRate, void* context, int drFlags) {
@@ -98,8 +90,7 @@ namespace moonlight_xbox_dx {
 		this->fps = 60; // correctly set in CompleteInitialization
 
 		this->m_LastFrameNumber = 0;
-		this->ffmpeg_buffer_size = 0;
-
+		this->m_Buffer.resetCounters();
 
 #if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(58,10,100)
 		avcodec_register_all();
@@ -167,64 +158,73 @@ namespace moonlight_xbox_dx {
     		Utils::Log("Warning: decoder did not select AV_PIX_FMT_D3D11\n");
 		}
 
-		if (!ensure_buf_size(&ffmpeg_buffer, &ffmpeg_buffer_size, INITIAL_DECODER_BUFFER_SIZE + AV_INPUT_BUFFER_PADDING_SIZE)) {
-			Utils::Log("Couldn't allocate initial ffmpeg_buffer\n");
+		if (!m_Buffer.reserve(INITIAL_DECODER_BUFFER_SIZE)) {
+			Utils::Log("Couldn't allocate initial decode unit buffer\n");
+			Cleanup();
+			return -1;
+		}
+
+		m_Packet = av_packet_alloc();
+		if (m_Packet == NULL) {
+			Utils::Log("Couldn't allocate AVPacket\n");
 			Cleanup();
 			return -1;
 		}
 
+		// Frames can be in FrameQueue, held by Pacer as the current frame, held by the render
+		// thread while it catches up, or being received by the decoder.
+		FramePool::instance().init(FrameQueue::instance().maxCapacity() + 3);
+
+		LaunchTimeline::instance().mark(LAUNCH_DECODER_READY);
 		return 0;
 	}
 
 	void FFMpegDecoder::Cleanup() {
 		avcodec_free_context(&decoder_ctx);
-		if (ffmpeg_buffer != NULL) {
-			free(ffmpeg_buffer);
-			ffmpeg_buffer = NULL;
-			ffmpeg_buffer_size = 0;
-		}
+		av_packet_free(&m_Packet);
+		m_Buffer.release();
 		m_LastFrameNumber = 0;
 
 		Pacer::instance().deinit();
+		FramePool::instance().deinit();
 
-		Utils::Log("FFMpegDecoder::Cleanup\n");
-	}
-
-    static inline int frame_attach_userdata(AVFrame *frame, int64_t decodeEndQpc) {
-	    if (!frame) return AVERROR(EINVAL);
-
-	    if (frame->opaque_ref) {
-		    av_buffer_unref(&frame->opaque_ref);
-	    }
-
-	    AVBufferRef *buf = av_buffer_allocz(sizeof(MLFrameData));
-	    if (!buf) return AVERROR(ENOMEM);
-
-	    MLFrameData *data = (MLFrameData *)buf->data;
-	    data->decodeEndQpc = decodeEndQpc;
-	    frame->opaque_ref = buf;
+		// The decoder and pacer threads are done submitting, the next stream's threads get their own slots
+		if (m_deviceResources && m_deviceResources->GetStats()) {
+			m_deviceResources->GetStats()->ReleaseThreadSlots();
+		}
 
-	    return 0;
-    }
+		Utils::Logf("FFMpegDecoder::Cleanup gathered %llu decode units (%llu bytes)\n",
+		            m_Buffer.gatheredUnits(), m_Buffer.gatheredBytes());
+	}
 
     // Called by the VideoDec thread
 	int FFMpegDecoder::SubmitDecodeUnit(PDECODE_UNIT decodeUnit) {
 		LARGE_INTEGER decodeStart, decodeEnd;
-		PLENTRY entry = decodeUnit->bufferList;
 		int length = 0;
 		QueryPerformanceCounter(&decodeStart);
-
-		if (!ensure_buf_size(&ffmpeg_buffer, &ffmpeg_buffer_size, decodeUnit->fullLength + AV_INPUT_BUFFER_PADDING_SIZE)) {
-			Utils::Logf("Couldn't realloc ffmpeg_buffer\n");
+		LaunchTimeline::instance().mark(LAUNCH_FIRST_DECODE_UNIT);
+
+		// receiveTimeUs is on moonlight-common-c's clock, rebase it onto QPC
+		MLFrameTimeline timeline = {};
+		timeline.receiveQpc = decodeStart.QuadPart - UsToQpc((int64_t)(LiGetMicroseconds() - decodeUnit->receiveTimeUs));
+		timeline.decodeStartQpc = decodeStart.QuadPart;
+		timeline.hostProcessingLatency = decodeUnit->frameHostProcessingLatency;
+		PTrace(PTRACE_DU_ARRIVAL, decodeUnit->frameNumber, decodeUnit->fullLength, timeline.receiveQpc);
+		PTrace(PTRACE_DECODE_START, decodeUnit->frameNumber, 0, decodeStart.QuadPart);
+
+		// Decode unit buffers aren't padded, so every unit is copied into one that is. See
+		// DecodeUnitBuffer, and Tools/DecodeUnitBench for what that costs per frame.
+		if (!m_Buffer.gather(decodeUnit)) {
+			Utils::Logf("Couldn't grow the decode unit buffer\n");
 			return DR_NEED_IDR;
 		}
 
-	    while (entry != NULL) {
-		    memcpy(ffmpeg_buffer + length, entry->data, entry->length);
-		    length += entry->length;
-		    entry = entry->next;
-	    }
-		memset(ffmpeg_buffer + length, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+		m_Packet->data = m_Buffer.data();
+		length = m_Buffer.size();
+
+		m_Packet->size = length;
+		m_Packet->pts = (int64_t)decodeUnit->rtpTimestamp;
+		m_Packet->dts = m_Packet->pts;
 
 		// Detect breaks in the frame sequence indicating dropped packets
 		uint32_t droppedFramesNetwork = 0;
@@ -236,17 +236,11 @@ namespace moonlight_xbox_dx {
 
 		// track stats for a variety of things we can track at the same time
 		m_deviceResources->GetStats()->SubmitVideoBytesAndReassemblyTime(length, decodeUnit, droppedFramesNetwork);
+		Pacer::instance().observeNetworkLoss(droppedFramesNetwork);
 
 		// ffmpeg_decode
-		AVPacket *pkt = av_packet_alloc();
-		pkt->data = ffmpeg_buffer;
-		pkt->size = length;
-		pkt->pts = (int64_t)decodeUnit->rtpTimestamp;
-		pkt->dts = pkt->pts;
-
-		int err = avcodec_send_packet(decoder_ctx, pkt);
-		av_packet_unref(pkt);
-		av_packet_free(&pkt);
+		int err = avcodec_send_packet(decoder_ctx, m_Packet);
+		av_packet_unref(m_Packet);
 		if (err < 0) {
 			char ffmpegError[1024];
 			av_strerror(err, ffmpegError, 1024);
@@ -255,23 +249,25 @@ namespace moonlight_xbox_dx {
 		}
 
 		while (err >= 0) {
-			AVFrame* frame = av_frame_alloc();
+			AVFrame* frame = FramePool::instance().acquire();
 			err = avcodec_receive_frame(decoder_ctx, frame);
 			if (err == AVERROR(EAGAIN) || err == AVERROR_EOF) {
-				av_frame_free(&frame);
+				FramePool::instance().release(&frame);
 				break;
 			}
 			else if (err < 0) {
 				char ffmpegError[1024];
 				av_strerror(err, ffmpegError, sizeof(ffmpegError));
 				Utils::Logf("avcodec_receive_frame failed: %s\n", ffmpegError);
-				av_frame_free(&frame);
+				FramePool::instance().release(&frame);
 				return DR_NEED_IDR;
 			}
 
 			// Capture a frame timestamp to measuring pacing delay
 			QueryPerformanceCounter(&decodeEnd);
-			frame_attach_userdata(frame, decodeEnd.QuadPart);
+			FramePool::instance().attachUserData(frame, decodeEnd.QuadPart, timeline);
+			PTrace(PTRACE_DECODE_END, frame->pts, decodeUnit->frameNumber, decodeEnd.QuadPart);
+			LaunchTimeline::instance().mark(LAUNCH_FIRST_FRAME_DECODED);
 
 			FQLog("✓ Frame decoded [pts: %.3fms] [in#: %d] [out#: %d] [lost: %d] decode time %.3fms\n",
 				frame->pts / 90.0,
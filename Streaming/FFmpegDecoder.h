@@ -4,6 +4,8 @@
 #include <mutex>
 #include <queue>
 #include "../Common/StepTimer.h"
+#include "DecodeUnitBuffer.h"
+#include "FramePool.h"
 #include "Pacer.h"
 #include "Utils.hpp"
 #include "VideoRenderer.h"
@@ -17,12 +19,6 @@ extern "C" {
 
 #define MAX_BUFFER 1024 * 1024
 
-typedef struct MLFrameData {
-	int64_t decodeEndQpc;     // when we finished decoding
-	int64_t presentTargetQpc; // timestamp when frame should be presented (slightly earlier than vsync)
-	int64_t presentVsyncQpc;  // hard vsync deadline
-} MLFrameData;
-
 namespace moonlight_xbox_dx {
 
 class FFMpegDecoder {
@@ -30,7 +26,7 @@ class FFMpegDecoder {
 	// Singleton accessor
 	static FFMpegDecoder &instance();
 
-	void CompleteInitialization(const std::shared_ptr<DX::DeviceResources> &res, STREAM_CONFIGURATION *config, bool framePacingImmediate);
+	void CompleteInitialization(const std::shared_ptr<DX::DeviceResources> &res, STREAM_CONFIGURATION *config, FramePacingMode framePacingMode);
 	int Init(int videoFormat, int width, int height, int redrawRate, void *context, int drFlags);
 	void Cleanup();
 	int SubmitDecodeUnit(PDECODE_UNIT decodeUnit);
@@ -69,8 +65,8 @@ class FFMpegDecoder {
 	AVCodecContext *decoder_ctx;
 	AVHWDeviceContext *device_ctx;
 	AVD3D11VADeviceContext *d3d11va_device_ctx;
-	unsigned char *ffmpeg_buffer;
-	int ffmpeg_buffer_size;
+	DecodeUnitBuffer m_Buffer;
+	AVPacket *m_Packet; // reused for every decode unit
 	std::shared_ptr<DX::DeviceResources> m_deviceResources;
 	int m_LastFrameNumber;
 };
@@ -0,0 +1,120 @@
+// clang-format off
+#include "pch.h"
+// clang-format on
+#include "FramePool.h"
+#include <algorithm>
+#include "Utils.hpp"
+
+using namespace moonlight_xbox_dx;
+
+FramePool &FramePool::instance() {
+	static FramePool inst;
+	return inst;
+}
+
+FramePool::FramePool() {
+	for (auto &slot : m_Slots) {
+		slot.store(nullptr, std::memory_order_relaxed);
+	}
+}
+
+AVBufferRef *FramePool::allocUserData(void *opaque, size_t size) {
+	auto *self = static_cast<FramePool *>(opaque);
+	self->m_UserDataAllocations.fetch_add(1, std::memory_order_relaxed);
+	return av_buffer_alloc(size);
+}
+
+void FramePool::init(int capacity) {
+	m_FrameAllocations.store(0, std::memory_order_relaxed);
+	m_UserDataAllocations.store(0, std::memory_order_relaxed);
+	m_Reuses.store(0, std::memory_order_relaxed);
+
+	if (!m_UserDataPool) {
+		m_UserDataPool = av_buffer_pool_init2(sizeof(MLFrameData), this, &FramePool::allocUserData, nullptr);
+	}
+
+	m_Capacity.store(std::clamp(capacity, 1, MAX_CAPACITY), std::memory_order_release);
+	m_Active.store(true, std::memory_order_release);
+
+	Utils::Logf("FramePool init: capacity %d\n", m_Capacity.load());
+}
+
+void FramePool::deinit() {
+	m_Active.store(false, std::memory_order_release);
+
+	for (auto &slot : m_Slots) {
+		AVFrame *frame = slot.exchange(nullptr, std::memory_order_acq_rel);
+		if (frame) {
+			av_frame_free(&frame);
+		}
+	}
+
+	// Buffers still attached to live frames keep the pool alive until they are released
+	av_buffer_pool_uninit(&m_UserDataPool);
+
+	Utils::Logf("FramePool deinit: %llu frame allocations, %llu userdata allocations, %llu reuses\n",
+	            frameAllocations(), userDataAllocations(), reuses());
+}
+
+// called by decoder thread
+AVFrame *FramePool::acquire() {
+	const int capacity = m_Capacity.load(std::memory_order_acquire);
+	for (int i = 0; i < capacity; ++i) {
+		if (m_Slots[i].load(std::memory_order_relaxed) == nullptr) {
+			continue;
+		}
+		AVFrame *frame = m_Slots[i].exchange(nullptr, std::memory_order_acquire);
+		if (frame) {
+			m_Reuses.fetch_add(1, std::memory_order_relaxed);
+			return frame;
+		}
+	}
+
+	m_FrameAllocations.fetch_add(1, std::memory_order_relaxed);
+	return av_frame_alloc();
+}
+
+// called by decoder thread
+int FramePool::attachUserData(AVFrame *frame, int64_t decodeEndQpc, const MLFrameTimeline &timeline) {
+	if (!frame) return AVERROR(EINVAL);
+
+	if (frame->opaque_ref) {
+		av_buffer_unref(&frame->opaque_ref);
+	}
+
+	AVBufferRef *buf = m_UserDataPool ? av_buffer_pool_get(m_UserDataPool) : av_buffer_alloc(sizeof(MLFrameData));
+	if (!buf) return AVERROR(ENOMEM);
+
+	// pooled buffers come back with the previous frame's data in them
+	MLFrameData *data = (MLFrameData *)buf->data;
+	*data = MLFrameData{};
+	data->decodeEndQpc = decodeEndQpc;
+	data->timeline = timeline;
+	frame->opaque_ref = buf;
+
+	return 0;
+}
+
+// called by any thread
+void FramePool::release(AVFrame **frame) {
+	if (!frame || !*frame) {
+		return;
+	}
+
+	// returns the decoder surface and the MLFrameData buffer to their pools
+	av_frame_unref(*frame);
+
+	if (m_Active.load(std::memory_order_acquire)) {
+		const int capacity = m_Capacity.load(std::memory_order_acquire);
+		for (int i = 0; i < capacity; ++i) {
+			AVFrame *expected = nullptr;
+			if (m_Slots[i].compare_exchange_strong(expected, *frame, std::memory_order_release, std::memory_order_relaxed)) {
+				*frame = nullptr;
+				return;
+			}
+		}
+	}
+
+	// pool is full or shut down
+	av_frame_free(frame);
+}
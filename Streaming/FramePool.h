@@ -0,0 +1,83 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/buffer.h>
+}
+
+// Where a frame was at each stage of the client pipeline, used to estimate glass-to-glass latency
+typedef struct MLFrameTimeline {
+	int64_t receiveQpc;             // first packet of the frame arrived
+	int64_t decodeStartQpc;         // frame was handed to ffmpeg
+	int64_t renderStartQpc;         // Pacer took the frame from FrameQueue
+	int64_t presentQpc;             // first Present() of the frame, 0 until then
+	uint16_t hostProcessingLatency; // encode time reported by the host in 1/10 ms, 0 if unknown
+} MLFrameTimeline;
+
+typedef struct MLFrameData {
+	int64_t decodeEndQpc;     // when we finished decoding
+	int64_t presentTargetQpc; // timestamp when frame should be presented (slightly earlier than vsync)
+	int64_t presentVsyncQpc;  // hard vsync deadline
+	MLFrameTimeline timeline;
+} MLFrameData;
+
+// Recycles AVFrames and their MLFrameData between the decoder and render threads, so that
+// once the stream is running no heap allocations are made per frame.
+//
+// The decoder thread acquires frames, any thread may release them. Pooled frames are kept
+// in a small array of atomic slots, so neither side ever takes a lock.
+
+class FramePool {
+  public:
+	// Singleton
+	static FramePool &instance();
+
+	static constexpr int MAX_CAPACITY = 16;
+
+	// Call once per stream. capacity is the number of frames that can be alive at once,
+	// i.e. FrameQueue::maxCapacity() plus the frames held by the decoder and Pacer.
+	// It is clamped to MAX_CAPACITY, frames beyond that are allocated and freed as needed.
+	void init(int capacity);
+	void deinit();
+
+	// Returns an empty frame, ready to be passed to avcodec_receive_frame()
+	AVFrame *acquire();
+
+	// Attaches a fresh MLFrameData to frame->opaque_ref. Must be called after avcodec_receive_frame()
+	// because ffmpeg unrefs the frame (and its opaque_ref) before writing to it.
+	int attachUserData(AVFrame *frame, int64_t decodeEndQpc, const MLFrameTimeline &timeline);
+
+	// Drops the frame's references and keeps the empty frame for reuse. Sets *frame to nullptr.
+	void release(AVFrame **frame);
+
+	// Counters, lock-free
+	uint64_t frameAllocations() const {
+		return m_FrameAllocations.load(std::memory_order_relaxed);
+	}
+	uint64_t userDataAllocations() const {
+		return m_UserDataAllocations.load(std::memory_order_relaxed);
+	}
+	uint64_t reuses() const {
+		return m_Reuses.load(std::memory_order_relaxed);
+	}
+
+  private:
+	FramePool();
+	FramePool(const FramePool &) = delete;
+	FramePool &operator=(const FramePool &) = delete;
+
+	static AVBufferRef *allocUserData(void *opaque, size_t size);
+
+	std::array<std::atomic<AVFrame *>, MAX_CAPACITY> m_Slots;
+	std::atomic<int> m_Capacity{0};
+	std::atomic<bool> m_Active{false};
+	AVBufferPool *m_UserDataPool = nullptr;
+
+	std::atomic<uint64_t> m_FrameAllocations{0};
+	std::atomic<uint64_t> m_UserDataAllocations{0};
+	std::atomic<uint64_t> m_Reuses{0};
+};
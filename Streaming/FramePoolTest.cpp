@@ -0,0 +1,238 @@
+// Steady-state allocation suite for FramePool, built on the host rather than into the app
+//
+// Frames go around the decoder -> FrameQueue -> Pacer loop the way the app moves them, with a
+// varying number alive at once. After a warm-up, neither FramePool's own counters nor the
+// allocations counted by the host ffmpeg shim may move. Then more frames are held than the pool
+// has slots, so acquire() finds it empty: each frame past MAX_CAPACITY must cost exactly one
+// allocation, the surplus must be freed when it comes back rather than kept, and the loop must be
+// allocation free again afterwards. The same loop also runs with release() on a second thread.
+//
+// Built through Tools/CMakeLists.txt.
+
+#include "pch.h"
+#include "FramePool.h"
+
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+static int g_failures = 0;
+
+#define CHECK(cond, ...)                                     \
+	do {                                                     \
+		if (!(cond)) {                                       \
+			fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+			fprintf(stderr, __VA_ARGS__);                    \
+			fprintf(stderr, "\n");                           \
+			g_failures++;                                    \
+		}                                                    \
+	} while (0)
+
+struct AllocationCounts {
+	uint64_t poolFrames;
+	uint64_t poolUserData;
+	uint64_t heapFrames;
+	uint64_t heapBuffers;
+
+	static AllocationCounts now() {
+		FramePool &pool = FramePool::instance();
+		return AllocationCounts{pool.frameAllocations(), pool.userDataAllocations(), g_HostAvFrameAllocs.load(),
+		                        g_HostAvBufferAllocs.load()};
+	}
+
+	bool operator==(const AllocationCounts &o) const {
+		return poolFrames == o.poolFrames && poolUserData == o.poolUserData && heapFrames == o.heapFrames &&
+		       heapBuffers == o.heapBuffers;
+	}
+};
+
+static void printCounts(const char *label, const AllocationCounts &c) {
+	printf("  %-28s frames %llu, userdata %llu (heap: %llu frames, %llu buffers)\n", label,
+	       (unsigned long long)c.poolFrames, (unsigned long long)c.poolUserData, (unsigned long long)c.heapFrames,
+	       (unsigned long long)c.heapBuffers);
+}
+
+// What the decoder does with a frame once avcodec_receive_frame() filled it
+static AVFrame *decodeOne(int64_t pts) {
+	FramePool &pool = FramePool::instance();
+	AVFrame *frame = pool.acquire();
+	frame->pts = pts;
+	MLFrameTimeline timeline = {};
+	timeline.decodeStartQpc = pts;
+	if (pool.attachUserData(frame, pts + 1, timeline) != 0) {
+		return frame;
+	}
+	CHECK(((MLFrameData *)frame->opaque_ref->data)->decodeEndQpc == pts + 1, "userdata wasn't filled in");
+	return frame;
+}
+
+// Has count frames alive at once, so the pool holds that many afterwards
+static void fill(int count) {
+	std::vector<AVFrame *> frames;
+	for (int i = 0; i < count; i++) {
+		frames.push_back(decodeOne(i));
+	}
+	for (AVFrame *&frame : frames) {
+		FramePool::instance().release(&frame);
+	}
+}
+
+// Keeps between 1 and maxAlive frames alive, in decode order
+static void runLoop(int frames, int maxAlive, std::mt19937 &rng) {
+	std::deque<AVFrame *> alive;
+	std::uniform_int_distribution<int> target(1, maxAlive);
+	int64_t pts = 0;
+	for (int f = 0; f < frames; f++) {
+		const int want = target(rng);
+		while ((int)alive.size() < want) {
+			alive.push_back(decodeOne(pts++));
+		}
+		while ((int)alive.size() > want - 1 && !alive.empty()) {
+			AVFrame *frame = alive.front();
+			alive.pop_front();
+			FramePool::instance().release(&frame);
+			CHECK(frame == nullptr, "release() didn't clear the pointer");
+		}
+	}
+	for (AVFrame *frame : alive) {
+		FramePool::instance().release(&frame);
+	}
+}
+
+static void testSteadyState(std::mt19937 &rng) {
+	const int capacity = 8;
+	FramePool::instance().init(capacity);
+
+	fill(capacity);
+	runLoop(1000, capacity, rng);
+	const AllocationCounts warm = AllocationCounts::now();
+	runLoop(100000, capacity, rng);
+	const AllocationCounts after = AllocationCounts::now();
+
+	printf("steady state, up to %d frames alive\n", capacity);
+	printCounts("after warm-up", warm);
+	printCounts("after 100000 more frames", after);
+	CHECK(warm == after, "allocations grew in steady state");
+	CHECK(warm.poolFrames <= (uint64_t)capacity, "warm-up allocated %llu frames for %d slots",
+	      (unsigned long long)warm.poolFrames, capacity);
+
+	FramePool::instance().deinit();
+}
+
+static void testExhausted(std::mt19937 &rng) {
+	const int slots = FramePool::MAX_CAPACITY;
+	const int held = slots + 4;
+	FramePool::instance().init(slots + 100);
+
+	fill(slots);
+	runLoop(1000, slots, rng);
+	const int64_t framesLiveWarm = g_HostAvFramesLive.load();
+	const AllocationCounts warm = AllocationCounts::now();
+
+	// Every slot empty, so the last few acquires have nothing to reuse
+	std::vector<AVFrame *> frames;
+	for (int i = 0; i < held; i++) {
+		frames.push_back(decodeOne(i));
+	}
+	const AllocationCounts exhausted = AllocationCounts::now();
+	const uint64_t extraFrames = exhausted.poolFrames - warm.poolFrames;
+	const uint64_t extraHeapFrames = exhausted.heapFrames - warm.heapFrames;
+
+	for (AVFrame *&frame : frames) {
+		FramePool::instance().release(&frame);
+	}
+	const int64_t framesLiveAfter = g_HostAvFramesLive.load();
+
+	fill(held);
+	const AllocationCounts regrown = AllocationCounts::now();
+	runLoop(100000, slots, rng);
+	const AllocationCounts after = AllocationCounts::now();
+
+	printf("all %d slots in use, %d frames held\n", slots, held);
+	printCounts("after warm-up", warm);
+	printCounts("while held", exhausted);
+	printCounts("holding them again", regrown);
+	printCounts("after 100000 more frames", after);
+	CHECK(extraFrames == (uint64_t)(held - slots), "acquire() allocated %llu frames past the pool, expected %d",
+	      (unsigned long long)extraFrames, held - slots);
+	CHECK(extraHeapFrames == extraFrames, "FramePool counted %llu frame allocations, the heap saw %llu",
+	      (unsigned long long)extraFrames, (unsigned long long)extraHeapFrames);
+	CHECK(framesLiveAfter == framesLiveWarm, "%lld frames alive after the surplus came back, expected %lld",
+	      (long long)framesLiveAfter, (long long)framesLiveWarm);
+	CHECK(after.poolUserData == regrown.poolUserData && after.heapBuffers == regrown.heapBuffers,
+	      "userdata allocations grew once the pool had seen %d frames at once", held);
+	CHECK(after.heapFrames - regrown.heapFrames == 0, "frames were allocated with no more than %d alive", slots);
+
+	FramePool::instance().deinit();
+}
+
+// The decoder acquires, the render thread releases
+static void testThreaded() {
+	const int capacity = 8;
+	const int frames = 200000;
+	FramePool::instance().init(capacity);
+	fill(capacity);
+	const AllocationCounts warm = AllocationCounts::now();
+
+	std::mutex lock;
+	std::condition_variable cv;
+	std::deque<AVFrame *> queue;
+	bool done = false;
+
+	auto renderThread = std::thread([&]() {
+		for (;;) {
+			std::unique_lock<std::mutex> l(lock);
+			cv.wait(l, [&] { return !queue.empty() || done; });
+			if (queue.empty()) {
+				return;
+			}
+			AVFrame *frame = queue.front();
+			queue.pop_front();
+			cv.notify_all();
+			l.unlock();
+			FramePool::instance().release(&frame);
+		}
+	});
+
+	for (int f = 0; f < frames; f++) {
+		AVFrame *frame = decodeOne(f);
+		std::unique_lock<std::mutex> l(lock);
+		// With one frame being decoded and one being released, no more than capacity are alive
+		cv.wait(l, [&] { return (int)queue.size() < capacity - 2; });
+		queue.push_back(frame);
+		cv.notify_all();
+	}
+	{
+		std::lock_guard<std::mutex> l(lock);
+		done = true;
+	}
+	cv.notify_all();
+	renderThread.join();
+	const AllocationCounts after = AllocationCounts::now();
+
+	printf("release() on the render thread\n");
+	printCounts("after warm-up", warm);
+	printCounts("after 200000 frames", after);
+	CHECK(warm == after, "allocations grew with release() on another thread");
+
+	FramePool::instance().deinit();
+}
+
+int main(int argc, char **argv) {
+	std::mt19937 rng(1);
+
+	testSteadyState(rng);
+	testExhausted(rng);
+	testThreaded();
+
+	CHECK(g_HostAvFramesLive.load() == 0, "%lld frames leaked after deinit", (long long)g_HostAvFramesLive.load());
+	CHECK(g_HostAvBuffersLive.load() == 0, "%lld buffers leaked after deinit", (long long)g_HostAvBuffersLive.load());
+
+	printf("%d failures\n", g_failures);
+	return g_failures == 0 ? 0 : 1;
+}
@@ -2,10 +2,10 @@
 #include "pch.h"
 // clang-format on
 #include "FrameQueue.h"
+#include "FramePool.h"
+#include "PacingTrace.h"
 #include "Utils.hpp"
 #include <cassert>
-#include <chrono>
-#include <thread>
 
 using namespace moonlight_xbox_dx;
 
@@ -19,25 +19,33 @@ FrameQueue &FrameQueue::instance() {
 }
 
 FrameQueue::FrameQueue()
-    : _capacity(0),
-      _head(0),
-      _tail(0),
-      _count(0),
-      _droppedLast(false),
+    : _droppedLast(false),
       _maxCapacity(5), // should not exceed swapchain BufferCount
       _highWaterMark(3),
       _paused(true) {    // caller will call start()
 
-	_capacity = _maxCapacity;
-	_buffer.assign(_capacity, nullptr);
-	_head = _tail = _count = 0;
+	static_assert((RING_SIZE & RING_MASK) == 0, "RING_SIZE must be a power of two");
+	assert(_maxCapacity + 1 < (int)RING_SIZE);
+
+	for (auto &slot : _buffer) {
+		slot.store(nullptr, std::memory_order_relaxed);
+	}
+}
+
+FrameQueue::~FrameQueue() {
+}
+
+void FrameQueue::setClock(std::shared_ptr<IPacerClock> clock) {
+	assert(paused());
+	_clock = std::move(clock);
+	_enqueueEvent = _clock->createEvent();
 }
 
 void FrameQueue::setPaused(bool p) {
 	_paused.store(p, std::memory_order_release);
-	if (p) {
+	if (p && _enqueueEvent) {
 		// Wake any waiters so they can exit
-		_cv.notify_all();
+		_enqueueEvent->set();
 	}
 }
 
@@ -53,101 +61,88 @@ void FrameQueue::stop() {
 }
 
 std::size_t FrameQueue::count() const {
-	std::lock_guard<std::mutex> lock(_mutex);
-	return static_cast<std::size_t>(_count);
+	int c = _count.value.load(std::memory_order_acquire);
+	return static_cast<std::size_t>(c > 0 ? c : 0);
 }
 
 bool FrameQueue::isEmpty() const {
 	return count() == 0;
 }
 
+// Called from stop() on the decoder thread, safe to race with the consumer
 void FrameQueue::clear() {
-	std::lock_guard<std::mutex> lock(_mutex);
 	// free all AVFrame in the queue
-	while (_count > 0) {
-		AVFrame *frame = popFrame();
-		dropFrame(frame);
+	while (AVFrame *frame = popFrame()) {
+		dropFrame(frame, PTRACE_DROP_FLUSH);
 	}
-	_head = _tail = _count = 0;
-	std::fill(_buffer.begin(), _buffer.end(), nullptr);
 }
 
 void FrameQueue::setHighWaterMark(int hwm) {
-	std::lock_guard<std::mutex> lock(_mutex);
-	_highWaterMark = hwm;
+	_highWaterMark.store(hwm, std::memory_order_release);
 }
 
 int FrameQueue::highWaterMark() const {
-	std::lock_guard<std::mutex> lock(_mutex);
-	return _highWaterMark;
+	return _highWaterMark.load(std::memory_order_acquire);
 }
 
-// Push into buffer at _tail (requires _mutex held)
+// Push into buffer at _tail (producer thread only)
 void FrameQueue::pushFrame(AVFrame *frame) {
-	_buffer[_tail] = frame;
-	_tail = (_tail + 1) % _capacity;
-	_count++;
+	const uint32_t tail = _tail.value.load(std::memory_order_relaxed);
+	_buffer[tail & RING_MASK].store(frame, std::memory_order_relaxed);
+	_tail.value.store(tail + 1, std::memory_order_release);
+	_lastPushQpc.store(_clock->now(), std::memory_order_relaxed);
+
+	// seq_cst pairs with the consumer setting _consumerWaiting before re-checking the count
+	int count = _count.value.fetch_add(1) + 1;
+
+	PTrace(PTRACE_ENQUEUE, frame->pts, count);
 
 	// Wake waiting consumer
-	_cv.notify_one();
+	if (_consumerWaiting.load()) {
+		_enqueueEvent->set();
+	}
 
 	FQLog("[-> %s pts: %.3fms] enqueue frame, queue size %d/%d\n",
 		isFrameIDR(frame) ? "IDR" : "P",
-		frame->pts / 90.0, _count, _highWaterMark);
+		frame->pts / 90.0, count, highWaterMark());
 }
 
-// Pop oldest frame from _head (requires _mutex held)
+// Pop oldest frame from _head. The render thread pops to display a frame and the
+// decoder thread pops to drop the oldest frame, so _head is claimed with a CAS.
 AVFrame* FrameQueue::popFrame() {
-	if (_count == 0) {
-		return nullptr;
-	}
+	uint32_t head = _head.value.load(std::memory_order_acquire);
+	do {
+		if (head == _tail.value.load(std::memory_order_acquire)) {
+			return nullptr;
+		}
+	} while (!_head.value.compare_exchange_weak(head, head + 1, std::memory_order_acq_rel, std::memory_order_acquire));
 
-	AVFrame *frame = _buffer[_head];
-	_buffer[_head] = nullptr;
-	_head = (_head + 1) % _capacity;
-	_count--;
+	AVFrame *frame = _buffer[head & RING_MASK].exchange(nullptr, std::memory_order_acquire);
+	_count.value.fetch_sub(1, std::memory_order_acq_rel);
 	return frame;
 }
 
-// Peek next frame (requires _mutex held)
-AVFrame* FrameQueue::peekFrame() {
-	if (_count == 0) {
-		return nullptr;
-	}
-	return _buffer[_head];
-}
-
-void FrameQueue::enumerateFrames(const std::function<void(AVFrame *frame, std::size_t idx, bool &stop)> &func) const {
-	std::lock_guard<std::mutex> lock(_mutex);
-	bool stop = false;
-	for (int i = 0; i < _count; ++i) {
-		int idx = (_head + i) % _capacity;
-		AVFrame *f = _buffer[idx];
-		func(f, static_cast<std::size_t>(i), stop);
-		if (stop) {
-			break;
-		}
-	}
-}
-
-void FrameQueue::dropFrame(AVFrame *frame) {
+void FrameQueue::dropFrame(AVFrame *frame, uint32_t reason) {
 	if (frame) {
 		FQLog("! dropped frame [pts: %.3fms]\n", frame->pts / 90.0);
-		av_frame_free(&frame);
+		PTrace(PTRACE_DROP, frame->pts, reason);
+		FramePool::instance().release(&frame);
 	}
 }
 
+// producer thread only
 int FrameQueue::unsafeEnqueue(AVFrame *frame, int frameDropTarget) {
 	int dropCount = 0;
+	const int count = static_cast<int>(this->count());
 
 	// Always accept IDR frames, allow exceeding HWM
-	if (isFrameIDR(frame) || _count < frameDropTarget) {
+	if (isFrameIDR(frame) || count < frameDropTarget) {
 		// in the unlikely event of a full queue, blindly drop the oldest
 		// we don't care if it's an IDR because we just got a new one
-		if (_count == _capacity) {
+		if (count >= _maxCapacity) {
 			AVFrame *oldest = popFrame();
 			if (oldest) {
-				dropFrame(oldest);
+				dropFrame(oldest, PTRACE_DROP_FULL);
 				dropCount = 1;
 			}
 		}
@@ -156,14 +151,14 @@ int FrameQueue::unsafeEnqueue(AVFrame *frame, int frameDropTarget) {
 	} else {
 		if (!_droppedLast) {
 			// alternate between: dropping newest...
-			dropFrame(frame);
+			dropFrame(frame, PTRACE_DROP_NEWEST);
 			dropCount = 1;
 			_droppedLast = true;
 		} else {
 			// and: dropping oldest & enqueue new
 			AVFrame *oldest = popFrame();
 			if (oldest) {
-				dropFrame(oldest);
+				dropFrame(oldest, PTRACE_DROP_OLDEST);
 				dropCount = 1;
 			}
 			pushFrame(frame);
@@ -175,45 +170,58 @@ int FrameQueue::unsafeEnqueue(AVFrame *frame, int frameDropTarget) {
 
 // Enqueue with simple alternate-drop logic
 int FrameQueue::enqueue(AVFrame *frame) {
-	std::lock_guard<std::mutex> lock(_mutex);
-	return unsafeEnqueue(frame, _highWaterMark);
+	return unsafeEnqueue(frame, highWaterMark());
+}
+
+// Blocks the consumer until the queue holds num frames, the queue is paused, or deadlineQpc
+// passes (0 waits forever). Returns true if the frames are available.
+//
+// pushFrame() signals the event so we wake up as soon as a frame lands.
+bool FrameQueue::waitForCount(int num, int64_t deadlineQpc) {
+	for (;;) {
+		if (paused()) {
+			return false;
+		}
+		if (static_cast<int>(count()) >= num) {
+			return true;
+		}
+		if (deadlineQpc && deadlineQpc <= _clock->now()) {
+			return false;
+		}
+
+		// Announce ourselves before the final check so a concurrent pushFrame() can't be missed
+		_consumerWaiting.store(true);
+		if (!paused() && _count.value.load() < num) {
+			if (_enqueueEvent->waitUntil(deadlineQpc)) {
+				FQLog("waitForCount woke %.3fms after enqueue\n", QpcToMs(_clock->now() - _lastPushQpc.load(std::memory_order_relaxed)));
+			}
+		}
+		_consumerWaiting.store(false, std::memory_order_relaxed);
+	}
 }
 
 // Allows the render loop to wait if the queue is empty
 // Optional param: wait until the queue contains N items
 // Optional timeout in milliseconds
 void FrameQueue::waitForEnqueue(int num) {
-	std::unique_lock<std::mutex> lock(_mutex);
-	while (!_paused.load(std::memory_order_acquire) && _count < num) {
-		// This waits forever until a frame arrives
-		_cv.wait(lock);
-	}
+	// This waits forever until a frame arrives
+	waitForCount(num, 0);
 }
 
 void FrameQueue::waitForEnqueue(int num, double timeoutMs) {
-	std::unique_lock<std::mutex> lock(_mutex);
-	if (_paused.load(std::memory_order_acquire)) {
+	if (paused()) {
 		return;
 	}
 
-	auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(
-	                                                       static_cast<long long>(timeoutMs * 1000.0));
-
-	while (_count < num && !_paused.load(std::memory_order_acquire)) {
-		if (_cv.wait_until(lock, deadline) == std::cv_status::timeout) {
-			break;
-		}
-	}
+	waitForCount(num, _clock->now() + MsToQpc(timeoutMs));
 }
 
 AVFrame* FrameQueue::dequeue() {
-	std::lock_guard<std::mutex> lock(_mutex);
-	AVFrame *frame = nullptr;
-
-	if (_count > 0) {
-		frame = popFrame();
+	AVFrame *frame = popFrame();
+	if (frame) {
+		PTrace(PTRACE_DEQUEUE, frame->pts, (uint32_t)count());
 		FQLog("[<- pts: %.3fms] dequeue frame, queue size %d/%d\n",
-			frame->pts / 90.0, _count, _highWaterMark);
+			frame->pts / 90.0, (int)count(), highWaterMark());
 	}
 	return frame;
 }
@@ -223,23 +231,18 @@ AVFrame* FrameQueue::dequeueWithTimeout(double timeoutSeconds) {
 		return nullptr;
 	}
 
-	const int64_t startQpc = QpcNow();
+	const int64_t startQpc = _clock->now();
 	const int64_t deadlineQpc = startQpc + MsToQpc(timeoutSeconds * 1000.0);
 
-	int round = 0;
-
 	// Always attempt to dequeue at least once
-	do {
-        if (round > 0) {
-            std::this_thread::sleep_for(std::chrono::microseconds(100)); // 0.1 ms
-        }
-        AVFrame *frame = dequeue();
-        if (frame) {
-            return frame;
-        }
-        round++;
-    } while (QpcNow() < deadlineQpc);
-
-	FQLog("dequeueWithTimeout timed out after %.3fms\n", QpcToMs(QpcNow() - startQpc));
-	return nullptr;
+	AVFrame *frame = dequeue();
+	while (!frame && waitForCount(1, deadlineQpc)) {
+		// the producer may have dropped the frame we woke up for, so try again
+		frame = dequeue();
+	}
+
+	if (!frame) {
+		FQLog("dequeueWithTimeout timed out after %.3fms\n", QpcToMs(_clock->now() - startQpc));
+	}
+	return frame;
 }
@@ -1,22 +1,29 @@
 #pragma once
 
+#include <array>
 #include <atomic>
-#include <condition_variable>
 #include <cstddef>
 #include <cstdint>
-#include <functional>
 #include <memory>
-#include <mutex>
 #include <string>
 #include <vector>
 
 #include "../Utils/FloatBuffer.h"
+#include "PacerTiming.h"
 #include "Utils.hpp"
 
 extern "C" {
 #include <libavcodec/avcodec.h>
 }
 
+// Single-producer/single-consumer frame queue between the decoder thread (producer) and the
+// render thread (consumer).
+//
+// The ring is lock-free: the producer owns _tail, and _head is advanced with a CAS so that the
+// producer can also pop the oldest frame when its drop policy calls for it. The render thread
+// never takes a lock to check count(), and waits for new frames on an event instead of a condvar.
+// Time and the event come from the IPacerClock Pacer hands over in setClock().
+
 class FrameQueue {
   public:
 	// Singleton
@@ -38,11 +45,14 @@ class FrameQueue {
 	void waitForEnqueue(int num = 1);
 	void waitForEnqueue(int num = 1, double timeoutMs = 1000.0 / 60);
 
+	// Call while stopped, before start()
+	void setClock(std::shared_ptr<IPacerClock> clock);
 	void start();
 	void stop();
 
   private:
   	FrameQueue();
+	~FrameQueue();
 	FrameQueue(const FrameQueue &) = delete;
 	FrameQueue &operator=(const FrameQueue &) = delete;
 
@@ -51,30 +61,44 @@ class FrameQueue {
 		return _paused.load(std::memory_order_acquire);
 	}
 
-	// Internal helpers (must be called with _mutex held)
-	int unsafeEnqueue(AVFrame *frame, int frameDropTarget);
-	void pushFrame(AVFrame *frame);
-	AVFrame* popFrame();
-	AVFrame* peekFrame();
-	void dropFrame(AVFrame *frame);
+	// Internal helpers
+	int unsafeEnqueue(AVFrame *frame, int frameDropTarget); // producer thread only
+	void pushFrame(AVFrame *frame);                         // producer thread only
+	AVFrame* popFrame();                                    // either thread
+	void dropFrame(AVFrame *frame, uint32_t reason);
+	bool waitForCount(int num, int64_t deadlineQpc);
+
+	// Ring size must be a power of two and larger than _maxCapacity + 1, so that the producer
+	// can never write into a slot that a pop has claimed but not yet emptied.
+	static constexpr uint32_t RING_SIZE = 8;
+	static constexpr uint32_t RING_MASK = RING_SIZE - 1;
+
+	struct alignas(64) PaddedIndex {
+		std::atomic<uint32_t> value{0};
+	};
 
-	void enumerateFrames(
-	    const std::function<void(AVFrame *frame, std::size_t idx, bool &stop)> &func) const;
+	struct alignas(64) PaddedCount {
+		std::atomic<int> value{0};
+	};
 
 	// Members
 
-	mutable std::mutex _mutex;
-	std::condition_variable _cv;
+	std::array<std::atomic<AVFrame*>, RING_SIZE> _buffer;
+	PaddedIndex _head;   // next frame to pop
+	PaddedIndex _tail;   // next slot to push, written by the producer only
+	PaddedCount _count;  // may briefly lag _tail - _head while a pop is in progress
 
-	std::vector<AVFrame*> _buffer;
-	int _capacity;
-	int _head;
-	int _tail;
-	int _count;
-	bool _droppedLast;
+	bool _droppedLast;   // producer thread only
 
 	const int _maxCapacity;
-	int _highWaterMark;
+	std::atomic<int> _highWaterMark;
 
 	std::atomic<bool> _paused;
+
+	std::shared_ptr<IPacerClock> _clock;
+
+	// Signalled by pushFrame() when the consumer is blocked in waitForCount()
+	std::unique_ptr<IPacerEvent> _enqueueEvent;
+	std::atomic<bool> _consumerWaiting{false};
+	std::atomic<int64_t> _lastPushQpc{0};
 };
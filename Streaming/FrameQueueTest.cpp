@@ -0,0 +1,251 @@
+// SPSC stress suite for FrameQueue, built on the host rather than into the app
+//
+// The drop policy is checked first, with the decoder's enqueue() and the render loop's dequeue()
+// interleaved at random on one thread against a model of the policy, so every drop and every
+// dequeued frame can be predicted exactly: IDR frames are always accepted, frames over the high
+// water mark alternate between dropping the newest and the oldest, and a full queue drops its
+// oldest frame.
+//
+// Then the decoder and render threads run for real, flat out, with the consumer blocking in
+// dequeueWithTimeout(). Every frame must come out in order with no repeats, every frame must be
+// either dequeued or reported dropped by enqueue(), the queue must never hold more than
+// maxCapacity() frames, and no frame may be leaked. The enqueue to dequeue latency is reported,
+// and a lost wakeup shows up in it as a frame waiting for the dequeue timeout.
+//
+// usage: frame-queue-test [--frames 2000000] [--max-p99-ms 0]
+//
+// Built through Tools/CMakeLists.txt.
+
+#include "pch.h"
+#include "FramePool.h"
+#include "FrameQueue.h"
+#include "HostPacerClock.h"
+#include "../Utils/LatencyHistogram.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <random>
+#include <thread>
+
+static int g_failures = 0;
+
+#define CHECK(cond, ...)                                     \
+	do {                                                     \
+		if (!(cond)) {                                       \
+			fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+			fprintf(stderr, __VA_ARGS__);                    \
+			fprintf(stderr, "\n");                           \
+			g_failures++;                                    \
+		}                                                    \
+	} while (0)
+
+// How long the render thread waits for a frame before it goes round its loop again
+static const double DEQUEUE_TIMEOUT_S = 0.1;
+
+static AVFrame *makeFrame(int64_t seq, bool idr) {
+	AVFrame *frame = FramePool::instance().acquire();
+	frame->pts = seq;
+	frame->pict_type = idr ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_P;
+	MLFrameTimeline timeline = {};
+	FramePool::instance().attachUserData(frame, QpcNow(), timeline);
+	return frame;
+}
+
+// unsafeEnqueue() as a plain deque
+struct PolicyModel {
+	struct Entry {
+		int64_t seq;
+		bool idr;
+	};
+	std::deque<Entry> queue;
+	bool droppedLast = false;
+
+	// Returns the sequence number of the dropped frame, -1 if none
+	int64_t enqueue(Entry e, int highWaterMark, int maxCapacity) {
+		int64_t dropped = -1;
+		if (e.idr || (int)queue.size() < highWaterMark) {
+			if ((int)queue.size() >= maxCapacity) {
+				dropped = queue.front().seq;
+				queue.pop_front();
+			}
+			queue.push_back(e);
+			droppedLast = false;
+		} else if (!droppedLast) {
+			dropped = e.seq;
+			droppedLast = true;
+		} else {
+			if (!queue.empty()) {
+				dropped = queue.front().seq;
+				queue.pop_front();
+			}
+			queue.push_back(e);
+			droppedLast = false;
+		}
+		return dropped;
+	}
+};
+
+static void testPolicy(std::mt19937 &rng) {
+	FrameQueue &queue = FrameQueue::instance();
+	queue.start();
+
+	PolicyModel model;
+	std::uniform_int_distribution<int> op(0, 99);
+	std::uniform_int_distribution<int> hwm(1, queue.maxCapacity());
+	int highWaterMark = 3;
+	queue.setHighWaterMark(highWaterMark);
+
+	// The queue remembers whether it dropped last across streams, an enqueue into an empty queue resets it
+	model.enqueue({0, false}, highWaterMark, queue.maxCapacity());
+	queue.enqueue(makeFrame(0, false));
+
+	uint64_t enqueues = 0, dequeues = 0, drops = 0, idrs = 0;
+	for (int64_t seq = 1; seq < 200000;) {
+		const int r = op(rng);
+		if (r < 55) {
+			const bool idr = op(rng) < 5;
+			const int64_t expectDropped = model.enqueue({seq, idr}, highWaterMark, queue.maxCapacity());
+			const int dropCount = queue.enqueue(makeFrame(seq, idr));
+			CHECK(dropCount == (expectDropped >= 0 ? 1 : 0), "frame %lld: enqueue() dropped %d, the policy drops %d",
+			      (long long)seq, dropCount, expectDropped >= 0 ? 1 : 0);
+			CHECK(expectDropped != seq || !idr, "the model dropped an incoming IDR frame");
+			drops += dropCount;
+			idrs += idr;
+			enqueues++;
+			seq++;
+		} else if (r < 95) {
+			AVFrame *frame = queue.dequeue();
+			if (model.queue.empty()) {
+				CHECK(frame == nullptr, "dequeued pts %lld from a queue that should be empty",
+				      frame ? (long long)frame->pts : 0LL);
+			} else {
+				const PolicyModel::Entry expect = model.queue.front();
+				model.queue.pop_front();
+				CHECK(frame != nullptr && frame->pts == expect.seq, "dequeued pts %lld, expected %lld",
+				      frame ? (long long)frame->pts : -1LL, (long long)expect.seq);
+				CHECK(frame == nullptr || (frame->pict_type == AV_PICTURE_TYPE_I) == expect.idr,
+				      "frame %lld came out with the wrong picture type", (long long)expect.seq);
+				dequeues++;
+			}
+			FramePool::instance().release(&frame);
+		} else {
+			highWaterMark = hwm(rng);
+			queue.setHighWaterMark(highWaterMark);
+		}
+		CHECK(queue.count() == model.queue.size(), "count() is %zu, expected %zu", queue.count(), model.queue.size());
+		if (g_failures > 20) {
+			break;
+		}
+	}
+
+	queue.stop();
+	printf("drop policy: %llu enqueues (%llu IDR), %llu dequeues, %llu drops, all as predicted\n",
+	       (unsigned long long)enqueues, (unsigned long long)idrs, (unsigned long long)dequeues,
+	       (unsigned long long)drops);
+}
+
+static void testThreads(int frames, double maxP99Ms) {
+	FrameQueue &queue = FrameQueue::instance();
+	queue.setHighWaterMark(3);
+	queue.start();
+
+	std::atomic<bool> producerDone{false};
+	uint64_t dropped = 0;
+	uint64_t dequeued = 0;
+	uint64_t outOfOrder = 0;
+	uint64_t overCapacity = 0;
+	LatencyHistogram latencyUs;
+	latencyUs.reset();
+
+	std::thread renderThread([&]() {
+		int64_t last = -1;
+		for (;;) {
+			AVFrame *frame = queue.dequeueWithTimeout(DEQUEUE_TIMEOUT_S);
+			if (!frame) {
+				if (producerDone.load() && queue.isEmpty()) {
+					return;
+				}
+				continue;
+			}
+			const MLFrameData *data = (const MLFrameData *)frame->opaque_ref->data;
+			latencyUs.record((uint64_t)QpcToUs(QpcNow() - data->decodeEndQpc));
+			if (frame->pts <= last) {
+				outOfOrder++;
+			}
+			last = frame->pts;
+			if (queue.count() > (size_t)queue.maxCapacity()) {
+				overCapacity++;
+			}
+			dequeued++;
+			FramePool::instance().release(&frame);
+		}
+	});
+
+	// The decoder runs flat out, handing the CPU over every few frames so the render thread
+	// sees the queue at every depth
+	std::mt19937 rng(2);
+	std::uniform_int_distribution<int> burst(1, 8);
+	int untilYield = burst(rng);
+	for (int seq = 0; seq < frames; seq++) {
+		dropped += queue.enqueue(makeFrame(seq, seq % 120 == 0));
+		if (--untilYield == 0) {
+			std::this_thread::yield();
+			untilYield = burst(rng);
+		}
+	}
+	producerDone.store(true);
+	renderThread.join();
+	queue.stop();
+
+	const double p50 = latencyUs.percentile(50) / 1000.0;
+	const double p99 = latencyUs.percentile(99) / 1000.0;
+	printf("two threads: %d frames, %llu dequeued, %llu dropped\n", frames, (unsigned long long)dequeued,
+	       (unsigned long long)dropped);
+	printf("  enqueue -> dequeue: p50 %.3f ms, p99 %.3f ms, max %.3f ms\n", p50, p99, latencyUs.max() / 1000.0);
+
+	CHECK(dequeued + dropped == (uint64_t)frames, "%llu dequeued + %llu dropped != %d enqueued",
+	      (unsigned long long)dequeued, (unsigned long long)dropped, frames);
+	CHECK(outOfOrder == 0, "%llu frames came out of order", (unsigned long long)outOfOrder);
+	CHECK(overCapacity == 0, "the queue held more than %d frames %llu times", queue.maxCapacity(),
+	      (unsigned long long)overCapacity);
+	CHECK(maxP99Ms <= 0 || p99 <= maxP99Ms, "p99 enqueue -> dequeue latency %.3f ms is over %.3f ms", p99, maxP99Ms);
+}
+
+static void usage() {
+	fprintf(stderr, "usage: frame-queue-test [--frames 2000000] [--max-p99-ms 0]\n");
+}
+
+int main(int argc, char **argv) {
+	int frames = 2000000;
+	double maxP99Ms = 0;
+	for (int i = 1; i < argc; ++i) {
+		const char *val = i + 1 < argc ? argv[i + 1] : nullptr;
+		if (!val) {
+			usage();
+			return 2;
+		} else if (!strcmp(argv[i], "--frames")) {
+			frames = atoi(val);
+		} else if (!strcmp(argv[i], "--max-p99-ms")) {
+			maxP99Ms = atof(val);
+		} else {
+			usage();
+			return 2;
+		}
+		++i;
+	}
+
+	FramePool::instance().init(FramePool::MAX_CAPACITY);
+	FrameQueue::instance().setClock(std::make_shared<HostPacerClock>());
+
+	std::mt19937 rng(1);
+	testPolicy(rng);
+	testThreads(frames, maxP99Ms);
+
+	FramePool::instance().deinit();
+	CHECK(g_HostAvFramesLive.load() == 0, "%lld frames leaked", (long long)g_HostAvFramesLive.load());
+
+	printf("%d failures\n", g_failures);
+	return g_failures == 0 ? 0 : 1;
+}
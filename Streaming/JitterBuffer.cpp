@@ -0,0 +1,89 @@
+#include "pch.h"
+#include "JitterBuffer.h"
+
+#include <algorithm>
+#include <cmath>
+
+JitterBuffer::JitterBuffer() {
+}
+
+void JitterBuffer::init(double fps, int maxDepth) {
+	if (fps <= 0.0) {
+		fps = 60.0;
+	}
+
+	m_streamPeriodMs = 1000.0 / fps;
+	m_maxDepth = std::max(0, maxDepth);
+	m_lastPts90k = 0;
+	m_lastArrivalQpc = 0;
+	m_haveLast = false;
+	m_jitterEwmaMs = 0.0;
+	m_peakJitterMs = 0.0;
+	m_lossEwma = 0.0;
+
+	// Start with no buffering, it grows as soon as jitter shows up
+	m_targetDepth.store(0, std::memory_order_release);
+	m_publishedJitterMs.store(0.0, std::memory_order_release);
+}
+
+// Decoder thread only
+void JitterBuffer::observeFrame(int64_t pts90k, int64_t arrivalQpc) {
+	if (m_haveLast) {
+		// Host pts is 90kHz and wraps at 32 bits
+		const uint32_t deltaPts = (uint32_t)(pts90k - m_lastPts90k);
+		const double expectedMs = deltaPts / 90.0;
+		const double actualMs = QpcToMs(arrivalQpc - m_lastArrivalQpc);
+
+		// Ignore discontinuities such as stream restarts or long host stalls
+		if (expectedMs > 0.0 && expectedMs < 250.0) {
+			m_streamPeriodMs = 0.1 * expectedMs + 0.9 * m_streamPeriodMs;
+
+			const double deviationMs = std::fabs(actualMs - expectedMs);
+			m_jitterEwmaMs += (deviationMs - m_jitterEwmaMs) / 16.0;
+
+			// decay the peak so the buffer shrinks again once the jitter is gone
+			const double decay = std::pow(0.5, expectedMs / JITTER_HALF_LIFE_MS);
+			m_peakJitterMs = std::max(deviationMs, m_peakJitterMs * decay);
+
+			updateTarget();
+		}
+	}
+
+	m_lastPts90k = pts90k;
+	m_lastArrivalQpc = arrivalQpc;
+	m_haveLast = true;
+}
+
+// Decoder thread only
+void JitterBuffer::observeNetworkLoss(uint32_t droppedFrames) {
+	const double lost = droppedFrames > 0 ? 1.0 : 0.0;
+	m_lossEwma = LOSS_EWMA_ALPHA * lost + (1.0 - LOSS_EWMA_ALPHA) * m_lossEwma;
+}
+
+void JitterBuffer::updateTarget() {
+	// Cover the worst recent deviation, jitter under a quarter of a frame doesn't need buffering
+	const double needMs = std::max(m_peakJitterMs, 2.0 * m_jitterEwmaMs);
+	int target = static_cast<int>(std::ceil(needMs / m_streamPeriodMs - 0.25));
+
+	// Lossy links tend to deliver late frames in bursts as FEC and retransmits kick in
+	if (m_lossEwma > LOSS_THRESHOLD) {
+		target++;
+	}
+
+	target = std::clamp(target, 0, m_maxDepth);
+
+	int previous = m_targetDepth.exchange(target, std::memory_order_acq_rel);
+	if (previous != target) {
+		FQLog("JitterBuffer: target depth %d -> %d (jitter %.2fms, peak %.2fms, loss %.1f%%)\n",
+		      previous, target, m_jitterEwmaMs, m_peakJitterMs, m_lossEwma * 100.0);
+	}
+	m_publishedJitterMs.store(m_jitterEwmaMs, std::memory_order_release);
+}
+
+int JitterBuffer::targetDepth() const {
+	return m_targetDepth.load(std::memory_order_acquire);
+}
+
+double JitterBuffer::jitterMs() const {
+	return m_publishedJitterMs.load(std::memory_order_acquire);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// This class sizes the frame queue for the Adaptive frame pacing mode.
+//
+// It compares the arrival time of each decoded frame with its host pts to measure how much
+// the network (and decoder) delay frames relative to each other, and tracks the recent packet
+// loss rate. From that it publishes a target queue depth: 0 on a clean link, growing while
+// jitter lasts and decaying back once the link settles.
+//
+// observe*() are called by the decoder thread, targetDepth() may be read from any thread.
+
+class JitterBuffer {
+  public:
+	explicit JitterBuffer();
+
+	// Call once before use
+	void init(double fps, int maxDepth);
+
+	// Decoder thread, called for each decoded frame with the time it became available
+	void observeFrame(int64_t pts90k, int64_t arrivalQpc);
+
+	// Decoder thread, called for each decode unit with the number of frames lost before it
+	void observeNetworkLoss(uint32_t droppedFrames);
+
+	// Lock-free accessors
+	int targetDepth() const;
+	double jitterMs() const;
+
+  private:
+	void updateTarget();
+
+	// Decoder-thread owned state.
+	int64_t m_lastPts90k = 0;
+	int64_t m_lastArrivalQpc = 0;
+	bool m_haveLast = false;
+
+	double m_streamPeriodMs = 1000.0 / 60.0;
+	double m_jitterEwmaMs = 0.0;  // RFC 3550 style smoothed jitter
+	double m_peakJitterMs = 0.0;  // recent worst case, decays with JITTER_HALF_LIFE_MS
+	double m_lossEwma = 0.0;      // fraction of frames lost
+	int m_maxDepth = 3;
+
+	static constexpr double JITTER_HALF_LIFE_MS = 2000.0;
+	static constexpr double LOSS_EWMA_ALPHA = 0.02;
+	static constexpr double LOSS_THRESHOLD = 0.02;
+
+	// Published values
+	std::atomic<int> m_targetDepth{0};
+	std::atomic<double> m_publishedJitterMs{0.0};
+};
@@ -0,0 +1,245 @@
+// clang-format off
+#include "pch.h"
+// clang-format on
+#include "LaunchTimeline.h"
+#include <algorithm>
+#include <vector>
+#include "Utils.hpp"
+
+using namespace moonlight_xbox_dx;
+
+double LaunchReport::msAt(LaunchMilestone milestone) const {
+	const int64_t start = milestoneQpc[LAUNCH_START];
+	const int64_t qpc = milestoneQpc[milestone];
+	if (start == 0 || qpc == 0) {
+		return -1.0;
+	}
+	return QpcToMs(qpc - start);
+}
+
+LaunchTimeline &LaunchTimeline::instance() {
+	static LaunchTimeline inst;
+	return inst;
+}
+
+const char *LaunchTimeline::milestoneName(LaunchMilestone milestone) {
+	switch (milestone) {
+	case LAUNCH_START: return "Launch requested";
+	case LAUNCH_SERVERINFO: return "Serverinfo loaded";
+	case LAUNCH_APP_STARTED: return "App launched on host";
+	case LAUNCH_DECODER_READY: return "Decoder initialized";
+	case LAUNCH_CONNECTION_STARTED: return "Connection started";
+	case LAUNCH_FIRST_DECODE_UNIT: return "First decode unit";
+	case LAUNCH_FIRST_FRAME_DECODED: return "First frame decoded";
+	case LAUNCH_FIRST_PRESENT: return "First frame presented";
+	default: return "Unknown";
+	}
+}
+
+// Called by StartStreaming, a launch that never presented a frame is simply replaced
+void LaunchTimeline::begin() {
+	m_active.store(false, std::memory_order_release);
+	for (auto &slot : m_milestones) {
+		slot.store(0, std::memory_order_relaxed);
+	}
+	for (int i = 0; i < STAGE_MAX; i++) {
+		m_stageStarts[i].store(0, std::memory_order_relaxed);
+		m_stageCompletes[i].store(0, std::memory_order_relaxed);
+	}
+	m_prewarmed.store(false, std::memory_order_relaxed);
+	m_milestones[LAUNCH_START].store(QpcNow(), std::memory_order_relaxed);
+	m_active.store(true, std::memory_order_release);
+}
+
+void LaunchTimeline::mark(LaunchMilestone milestone) {
+	if (!m_active.load(std::memory_order_acquire)) {
+		return;
+	}
+	if (stamp(m_milestones[milestone]) && milestone == LAUNCH_FIRST_PRESENT) {
+		complete();
+	}
+}
+
+void LaunchTimeline::markPrewarmed() {
+	m_prewarmed.store(true, std::memory_order_relaxed);
+}
+
+void LaunchTimeline::stageStarted(int stage) {
+	if (stage <= STAGE_NONE || stage >= STAGE_MAX || !m_active.load(std::memory_order_acquire)) {
+		return;
+	}
+	stamp(m_stageStarts[stage]);
+}
+
+void LaunchTimeline::stageCompleted(int stage) {
+	if (stage <= STAGE_NONE || stage >= STAGE_MAX || !m_active.load(std::memory_order_acquire)) {
+		return;
+	}
+	stamp(m_stageCompletes[stage]);
+}
+
+void LaunchTimeline::abort(int stage, int err) {
+	if (!m_active.exchange(false, std::memory_order_acq_rel)) {
+		return;
+	}
+
+	LaunchReport report;
+	snapshot(report);
+	{
+		std::lock_guard<std::mutex> lock(m_historyMutex);
+		report.number = ++m_launchNumber;
+	}
+
+	char outcome[128];
+	snprintf(outcome, sizeof(outcome), "%s failed with error %d", LiGetStageName(stage), err);
+	log(report, outcome);
+}
+
+// Only the first occurrence counts, returns true if this call recorded it
+bool LaunchTimeline::stamp(std::atomic<int64_t> &slot) {
+	if (slot.load(std::memory_order_relaxed) != 0) {
+		return false;
+	}
+	int64_t expected = 0;
+	return slot.compare_exchange_strong(expected, QpcNow(), std::memory_order_relaxed);
+}
+
+void LaunchTimeline::snapshot(LaunchReport &report) {
+	report.number = 0;
+	report.prewarmed = m_prewarmed.load(std::memory_order_relaxed);
+	for (int i = 0; i < LAUNCH_MILESTONE_COUNT; i++) {
+		report.milestoneQpc[i] = m_milestones[i].load(std::memory_order_relaxed);
+	}
+	for (int i = 0; i < STAGE_MAX; i++) {
+		report.stageStartQpc[i] = m_stageStarts[i].load(std::memory_order_relaxed);
+		report.stageCompleteQpc[i] = m_stageCompletes[i].load(std::memory_order_relaxed);
+	}
+}
+
+// Called once per launch by the render thread, right after the first Present
+void LaunchTimeline::complete() {
+	m_active.store(false, std::memory_order_release);
+
+	LaunchReport report;
+	snapshot(report);
+	{
+		std::lock_guard<std::mutex> lock(m_historyMutex);
+		report.number = ++m_launchNumber;
+		m_history[m_historyNext] = report;
+		m_historyNext = (m_historyNext + 1) % HISTORY_SIZE;
+		m_historyCount = std::min(m_historyCount + 1, HISTORY_SIZE);
+	}
+
+	log(report, "first frame presented");
+}
+
+void LaunchTimeline::log(const LaunchReport &report, const char *outcome) {
+	const int64_t start = report.milestoneQpc[LAUNCH_START];
+
+	// Milestones and stages interleave, so list everything that was reached in time order
+	struct Event {
+		int64_t qpc;
+		const char *name;
+		int64_t stageStartQpc; // stage completions only
+	};
+	std::vector<Event> events;
+	for (int i = 0; i < LAUNCH_MILESTONE_COUNT; i++) {
+		if (report.milestoneQpc[i] != 0) {
+			events.push_back({report.milestoneQpc[i], milestoneName((LaunchMilestone)i), 0});
+		}
+	}
+	for (int i = STAGE_NONE + 1; i < STAGE_MAX; i++) {
+		if (report.stageCompleteQpc[i] != 0) {
+			events.push_back({report.stageCompleteQpc[i], LiGetStageName(i), report.stageStartQpc[i]});
+		} else if (report.stageStartQpc[i] != 0) {
+			events.push_back({report.stageStartQpc[i], LiGetStageName(i), 0}); // the stage that failed
+		}
+	}
+	std::stable_sort(events.begin(), events.end(), [](const Event &a, const Event &b) {
+		return a.qpc < b.qpc;
+	});
+
+	const int64_t end = events.empty() ? start : events.back().qpc;
+	Utils::Logf("Launch #%u: %s after %.1f ms%s\n", report.number, outcome, QpcToMs(end - start),
+	            report.prewarmed ? " (serverinfo was prewarmed)" : "");
+
+	int64_t previous = start;
+	for (const Event &event : events) {
+		if (event.stageStartQpc != 0) {
+			Utils::Logf("  %8.1f ms  +%7.1f  %s (stage took %.1f ms)\n", QpcToMs(event.qpc - start),
+			            QpcToMs(event.qpc - previous), event.name, QpcToMs(event.qpc - event.stageStartQpc));
+		} else {
+			Utils::Logf("  %8.1f ms  +%7.1f  %s\n", QpcToMs(event.qpc - start), QpcToMs(event.qpc - previous),
+			            event.name);
+		}
+		previous = event.qpc;
+	}
+
+	double minMs, medianMs, maxMs;
+	int count;
+	if (historyStats(minMs, medianMs, maxMs, count)) {
+		Utils::Logf("  Time to first frame over the last %d launches min/median/max: %.1f/%.1f/%.1f ms\n",
+		            count, minMs, medianMs, maxMs);
+	}
+}
+
+bool LaunchTimeline::historyStats(double &minMs, double &medianMs, double &maxMs, int &count) {
+	double times[HISTORY_SIZE];
+	{
+		std::lock_guard<std::mutex> lock(m_historyMutex);
+		count = m_historyCount;
+		for (int i = 0; i < count; i++) {
+			times[i] = m_history[i].timeToFirstFrameMs();
+		}
+	}
+	if (count == 0) {
+		return false;
+	}
+
+	std::sort(times, times + count);
+	minMs = times[0];
+	maxMs = times[count - 1];
+	medianMs = (count % 2) ? times[count / 2] : (times[count / 2 - 1] + times[count / 2]) / 2.0;
+	return true;
+}
+
+int LaunchTimeline::format(char *output, size_t length) {
+	LaunchReport last;
+	bool hasLast;
+	{
+		std::lock_guard<std::mutex> lock(m_historyMutex);
+		hasLast = m_historyCount > 0;
+		if (hasLast) {
+			last = m_history[(m_historyNext + HISTORY_SIZE - 1) % HISTORY_SIZE];
+		}
+	}
+
+	int ret;
+	if (!hasLast) {
+		ret = snprintf(output, length,
+		               "Time to first frame: - ms\n"
+		               "Connect/launch/stages/first frame: -/-/-/- ms\n");
+	} else {
+		double minMs, medianMs, maxMs;
+		int count;
+		historyStats(minMs, medianMs, maxMs, count);
+
+		auto segment = [&last](LaunchMilestone from, LaunchMilestone to) {
+			double fromMs = last.msAt(from), toMs = last.msAt(to);
+			return (fromMs >= 0 && toMs >= fromMs) ? toMs - fromMs : 0.0;
+		};
+		ret = snprintf(output, length,
+		               "Time to first frame: %.0f ms (median of last %d: %.0f ms)\n"
+		               "Connect/launch/stages/first frame: %.0f/%.0f/%.0f/%.0f ms\n",
+		               last.timeToFirstFrameMs(), count, medianMs,
+		               segment(LAUNCH_START, LAUNCH_SERVERINFO),
+		               segment(LAUNCH_SERVERINFO, LAUNCH_APP_STARTED),
+		               segment(LAUNCH_APP_STARTED, LAUNCH_CONNECTION_STARTED),
+		               segment(LAUNCH_CONNECTION_STARTED, LAUNCH_FIRST_PRESENT));
+	}
+
+	if (ret < 0 || (size_t)ret >= length) {
+		return -1;
+	}
+	return ret;
+}
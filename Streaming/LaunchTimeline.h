@@ -0,0 +1,94 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+extern "C" {
+#include "Limelight.h"
+}
+
+// Time-to-first-frame breakdown of a stream launch
+//
+// StartStreaming begins a launch and every milestone up to the first Present is stamped with
+// QpcNow(). The first Present completes the launch: its report is logged and kept in a ring of
+// the last HISTORY_SIZE launches, so the stats overlay and the log can compare it with earlier
+// ones. Each milestone only records its first occurrence. Once a launch has completed, mark()
+// is a single atomic load, so the per-frame call sites cost nothing while streaming.
+
+typedef enum {
+	LAUNCH_START,                // StartStreaming called
+	LAUNCH_SERVERINFO,           // serverinfo loaded by Connect/gs_init, or claimed from the prewarmer
+	LAUNCH_APP_STARTED,          // gs_start_app returned
+	LAUNCH_DECODER_READY,        // FFMpegDecoder::Init returned, during the video stream stage
+	LAUNCH_CONNECTION_STARTED,   // moonlight-common-c completed every stage
+	LAUNCH_FIRST_DECODE_UNIT,    // first SubmitDecodeUnit
+	LAUNCH_FIRST_FRAME_DECODED,  // first frame out of avcodec_receive_frame
+	LAUNCH_FIRST_PRESENT,        // first Present, completes the launch
+	LAUNCH_MILESTONE_COUNT
+} LaunchMilestone;
+
+struct LaunchReport {
+	uint32_t number;   // launches since the app started, from 1
+	bool prewarmed;    // serverinfo came from ConnectionPrewarmer
+	int64_t milestoneQpc[LAUNCH_MILESTONE_COUNT]; // 0 = not reached
+	int64_t stageStartQpc[STAGE_MAX];
+	int64_t stageCompleteQpc[STAGE_MAX];
+
+	// Milliseconds from LAUNCH_START, negative if the milestone wasn't reached
+	double msAt(LaunchMilestone milestone) const;
+	double timeToFirstFrameMs() const {
+		return msAt(LAUNCH_FIRST_PRESENT);
+	}
+};
+
+class LaunchTimeline {
+  public:
+	// Singleton
+	static LaunchTimeline &instance();
+
+	void begin();
+	void mark(LaunchMilestone milestone);
+	void markPrewarmed();
+	void stageStarted(int stage);
+	void stageCompleted(int stage);
+
+	// Logs what was reached so far when a stage fails, the launch isn't added to the history
+	void abort(int stage, int err);
+
+	// Writes OVERLAY_LINES lines about the last launch to output, with placeholders if none has
+	// completed yet. Returns the number of characters written, or -1 if output is too small.
+	int format(char *output, size_t length);
+
+	static constexpr int HISTORY_SIZE = 8;
+	static constexpr int OVERLAY_LINES = 2;
+
+	static const char *milestoneName(LaunchMilestone milestone);
+
+  private:
+	LaunchTimeline() = default;
+	LaunchTimeline(const LaunchTimeline &) = delete;
+	LaunchTimeline &operator=(const LaunchTimeline &) = delete;
+
+	bool stamp(std::atomic<int64_t> &slot);
+	void snapshot(LaunchReport &report);
+	void complete();
+	void log(const LaunchReport &report, const char *outcome);
+	bool historyStats(double &minMs, double &medianMs, double &maxMs, int &count);
+
+	// Current launch, written by whichever thread reaches a milestone first
+	std::atomic<bool> m_active{false};
+	std::atomic<bool> m_prewarmed{false};
+	std::atomic<int64_t> m_milestones[LAUNCH_MILESTONE_COUNT] = {};
+	std::atomic<int64_t> m_stageStarts[STAGE_MAX] = {};
+	std::atomic<int64_t> m_stageCompletes[STAGE_MAX] = {};
+
+	// Completed launches, oldest overwritten first
+	std::mutex m_historyMutex;
+	std::array<LaunchReport, HISTORY_SIZE> m_history = {};
+	int m_historyCount = 0;
+	int m_historyNext = 0;
+	uint32_t m_launchNumber = 0;
+};
@@ -3,11 +3,8 @@
 // clang-format on
 #include "Pacer.h"
 #include <algorithm>
-#include <chrono>
-#include <thread>
-#include <windows.h>
-#include "../Plot/ImGuiPlots.h"
-#include "FFmpegDecoder.h"
+#include "FramePool.h"
+#include "PacingTrace.h"
 #include "FrameQueue.h"
 #include "Utils.hpp"
 
@@ -17,24 +14,35 @@
 //
 // Decoder thread (run from moonlight-common-c because DIRECT_SUBMIT)
 //   * calls submitFrame() to queue a new AVFrame to FrameQueue class via FrameQueue::instance().enqueue(frame)
-//   * Frames are dropped at enqueue time, in an alternating manner, when high water mark (default 2 + 1) is exceeded
+//   * Frames are dropped at enqueue time, in an alternating manner, when high water mark (default 2 + 1) is exceeded.
+//     In Adaptive mode the high water mark follows the jitter buffer target
 //   * IDR frames are never dropped
 //
 // vsyncHardware thread:
-//   * low-priority background thread responsible for tracking accurate vsync stats via GetFrameStatistics()
+//   * background thread run by the IVsyncSource, calls updateFrameStats() after every vblank to track
+//     accurate vsync stats via GetFrameStatistics()
+//
+// In Adaptive mode the decoder thread also feeds frame arrival times and network loss to JitterBuffer,
+// which decides how many frames the render thread keeps queued.
 //
 // main render loop thread:
 //   * calls waitForFrame() with a timeout, to wait for new frames to become available in FrameQueue
 //   * calls renderOnMainThread to render decoded video frame via VideoRenderer
 //   * calls waitBeforePresent() using vsync timing data to align with the next vblank interval (or half-vblank for 120hz on Xbox)
 //
+// Time is read through IPacerClock, vsync through IVsyncSource and stats go to IPacerStats (see
+// PacerTiming.h), so Tools/PacerSim can drive the pacing logic with a virtual clock. Only use
+// m_Clock->now() for time in this file, and don't reach for DeviceResources, Stats or the plots.
+//
+// Every pacing event can be recorded to a binary trace file with the host's "Record frame pacing trace"
+// setting, see PacingTrace.h.
+//
 // Calls to FQLog() and functions called within FQLog() are no-op unless you define FRAME_QUEUE_VERBOSE in pch.h
 // and build in Debug mode.
 
 constexpr int FRAME_QUEUE_LOW = 1;
 constexpr int FRAME_QUEUE_HIGH = 3;
 
-using steady_clock = std::chrono::steady_clock;
 using namespace moonlight_xbox_dx;
 
 Pacer &Pacer::instance() {
@@ -44,8 +52,6 @@ Pacer &Pacer::instance() {
 
 Pacer::Pacer()
     : m_Running(false),
-      m_DeviceResources(),
-      m_VsyncThread(),
       m_Stopping(false),
       m_StreamFps(0),
       m_RefreshRate(0.0),
@@ -63,89 +69,93 @@ void Pacer::deinit() {
 	FrameQueue::instance().stop();
 
 	// Stop the vsync thread
-	if (m_VsyncThread.joinable()) {
-		m_VsyncThread.join();
+	if (m_VsyncSource) {
+		m_VsyncSource->stop();
 	}
 
-	m_DeviceResources = nullptr;
+	m_VsyncSource = nullptr;
 
 	if (m_CurrentFrame) {
-		av_frame_free(&m_CurrentFrame);
-		m_CurrentFrame = nullptr;
+		FramePool::instance().release(&m_CurrentFrame);
     }
 
+	PacingTrace::instance().stop();
+
 	Utils::Logf("Pacer: deinit\n");
 }
 
-void Pacer::init(const std::shared_ptr<DX::DeviceResources> &res, int streamFps, double refreshRate, bool framePacingImmediate) {
+static const char *framePacingModeName(FramePacingMode mode) {
+	switch (mode) {
+	case FRAME_PACING_IMMEDIATE:
+		return "immediate";
+	case FRAME_PACING_ADAPTIVE:
+		return "adaptive";
+	default:
+		return "display-locked";
+	}
+}
+
+void Pacer::init(const PacerSources &sources, int streamFps, double refreshRate, FramePacingMode framePacingMode) {
 	m_Stopping.store(false, std::memory_order_release);
-	m_DeviceResources = res;
+	m_Clock = sources.clock;
+	m_VsyncSource = sources.vsync;
+	m_Stats = sources.stats;
 	m_StreamFps = streamFps;
 	m_RefreshRate = refreshRate;
-	m_FramePacingImmediate = framePacingImmediate;
+	m_FramePacingMode = framePacingMode;
 
 	m_FrameCadence.init(m_RefreshRate > 0.0 ? m_RefreshRate : 60.0, static_cast<double>(streamFps));
+	// Adaptive mode needs target + 1 frames queued to render and one more slot to absorb a burst,
+	// so the deepest target is what fits below FrameQueue's capacity, see adaptiveHighWaterMark()
+	m_JitterBuffer.init(static_cast<double>(streamFps), FrameQueue::instance().maxCapacity() - 2);
+	// Stats outlive the stream, don't leave a target from an earlier adaptive stream on the overlay
+	m_Stats->jitterBufferTarget(m_FramePacingMode == FRAME_PACING_ADAPTIVE ? m_JitterBuffer.targetDepth() : -1);
 
 	Utils::Logf("Frame Pacer init: mode %s, streamFps %d, refreshRate %.2f\n",
-		m_FramePacingImmediate ? "immediate" : "display-locked", m_StreamFps, m_RefreshRate);
+		framePacingModeName(m_FramePacingMode), m_StreamFps, m_RefreshRate);
 
 	m_vhsum = 0;
 	m_vhcount = 0;
 	m_vhidx = 0;
 	std::fill(m_vhistory.begin(), m_vhistory.end(), 0);
+	m_LastSyncRefreshCount = 0;
+	m_LastSyncQpc = 0;
 	m_VsyncIntervalQpc = 0;
 	m_LastSyncTarget = 0;
 	m_ewmaVsyncDriftQpc = MsToQpc(0.0001);
 
+	// Records the stream if MoonlightClient asked for a trace
+	PacingTrace::instance().start();
+
 	// Start FrameQueue so it's ready to receive new frames
+	FrameQueue::instance().setClock(m_Clock);
 	FrameQueue::instance().setHighWaterMark(FRAME_QUEUE_HIGH);
 	FrameQueue::instance().start();
 
-	if (!m_VsyncThread.joinable()) {
-		m_VsyncThread = std::thread(&Pacer::vsyncHardware, this);
-	}
+	m_VsyncSource->start([this] { updateFrameStats(); });
 
 	m_Running.store(true, std::memory_order_release);
 }
 
-void Pacer::vsyncHardware() {
-	if (!SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_ABOVE_NORMAL)) {
-		Utils::Logf("Failed to set vsyncHardware priority: %d\n", GetLastError());
-	}
-
-	Utils::Logf("vsyncHardware stats thread started, qpcFreq=%lld ticksPerMs=%lld\n",
-	            QpcFreq(), MsToQpc(1.0));
-
-	while (!stopping()) {
-		// All this thread does is wake up every vsync and record the precise vsync QPC the system
-		// tracks. This data is several frames out of date but it's enough to
-		// very precisely time present calls and to determine the vsync interval.
-		m_DeviceResources->GetDXGIOutput()->WaitForVBlank();
-		updateFrameStats();
-	}
-
-	Utils::Logf("vsyncHardware stats thread stopped\n");
-}
-
 // based on mpv's d3d11_get_vsync()
 void Pacer::updateFrameStats() {
 	std::scoped_lock<std::mutex> lock(m_FrameStatsLock);
 
 	// After we've presented a couple of frames, we can obtain the true vsync interval
-	DXGI_FRAME_STATISTICS stats;
-	if (m_DeviceResources->GetSwapChain()->GetFrameStatistics(&stats) == S_OK &&
-	    (stats.SyncRefreshCount != 0 || stats.SyncQPCTime.QuadPart != 0ULL)) {
-		UINT srcPassed = 0;
-		if (stats.SyncRefreshCount && m_LastSyncRefreshCount) {
-			srcPassed = stats.SyncRefreshCount - m_LastSyncRefreshCount;
+	VsyncSample stats;
+	if (m_VsyncSource->lastVBlank(&stats) && (stats.refreshCount != 0 || stats.qpc != 0)) {
+		uint32_t srcPassed = 0;
+		if (stats.refreshCount && m_LastSyncRefreshCount) {
+			srcPassed = stats.refreshCount - m_LastSyncRefreshCount;
 		}
-		m_LastSyncRefreshCount = stats.SyncRefreshCount;
+		m_LastSyncRefreshCount = stats.refreshCount;
 
 		int64_t sqtPassed = 0;
-		if (stats.SyncQPCTime.QuadPart && m_LastSyncQpc) {
-			sqtPassed = stats.SyncQPCTime.QuadPart - m_LastSyncQpc;
+		if (stats.qpc && m_LastSyncQpc) {
+			sqtPassed = stats.qpc - m_LastSyncQpc;
 		}
-		m_LastSyncQpc = stats.SyncQPCTime.QuadPart;
+		m_LastSyncQpc = stats.qpc;
+		PTrace(PTRACE_VSYNC, m_LastSyncQpc, stats.refreshCount);
 
 		// compare with the last sync target we used in waitBeforePresent
 		int64_t driftQpc = 0;
@@ -197,7 +207,7 @@ void Pacer::updateFrameStats() {
 			}
 		}
 
-		m_LastSyncQpc = QpcNow();
+		m_LastSyncQpc = m_Clock->now();
 		m_VsyncIntervalQpc = MsToQpc(1000.0 / vsyncRR);
 
 		LogOnce("vsyncHardware(): starting up with interval %.2f based on system rate %.2f\n", vsyncRR, m_RefreshRate);
@@ -209,18 +219,24 @@ void Pacer::updateFrameStats() {
 void Pacer::waitForFrame(double timeoutMs) {
 	if (!running()) return;
 
-	// Wait for a decoded frame to be available
-	const int queueHas = 1;
+	// Wait for a decoded frame to be available, on top of the jitter buffer in adaptive mode
+	int queueHas = 1;
+	if (m_FramePacingMode == FRAME_PACING_ADAPTIVE) {
+		queueHas += m_JitterBuffer.targetDepth();
+	}
 	FrameQueue::instance().waitForEnqueue(queueHas, timeoutMs);
 }
 
 // called by render thread
-bool Pacer::renderOnMainThread(std::shared_ptr<VideoRenderer> &sceneRenderer) {
+bool Pacer::renderOnMainThread(IFrameRenderer &sceneRenderer) {
 	if (!running()) return false;
 
-	if (m_FramePacingImmediate) {
+	switch (m_FramePacingMode) {
+	case FRAME_PACING_IMMEDIATE:
 		return renderModeImmediate(sceneRenderer);
-	} else {
+	case FRAME_PACING_ADAPTIVE:
+		return renderModeAdaptive(sceneRenderer);
+	default:
 		return renderModeDisplayLocked(sceneRenderer);
 	}
 }
@@ -229,7 +245,7 @@ bool Pacer::renderOnMainThread(std::shared_ptr<VideoRenderer> &sceneRenderer) {
 // skips Present and relies on the system to continue showing the previous frame.
 // Pros: lowest latency, output framerate matches input framerate
 // Cons: only works well on Xbox Series for some reason
-bool Pacer::renderModeImmediate(std::shared_ptr<VideoRenderer> &sceneRenderer) {
+bool Pacer::renderModeImmediate(IFrameRenderer &sceneRenderer) {
 	AVFrame *newFrame = FrameQueue::instance().dequeue();
 	if (!newFrame) {
 		return false; // no frame, don't Present()
@@ -240,31 +256,38 @@ bool Pacer::renderModeImmediate(std::shared_ptr<VideoRenderer> &sceneRenderer) {
 	if (queueDepth > FRAME_QUEUE_LOW) {
 		AVFrame *newFrame2 = FrameQueue::instance().dequeue();
 		if (newFrame2) {
-			av_frame_free(&newFrame);
+			PTrace(PTRACE_DROP, newFrame->pts, PTRACE_DROP_CATCHUP);
+			FramePool::instance().release(&newFrame);
 			newFrame = newFrame2;
-			ImGuiPlots::instance().observeFloat(PLOT_DROPPED_PACER, 1.0);
+			m_Stats->frameSkipped();
 		}
 	}
 
 	if (m_CurrentFrame) {
-		av_frame_free(&m_CurrentFrame);
+		FramePool::instance().release(&m_CurrentFrame);
 	}
 	m_CurrentFrame = newFrame;
 
-	int64_t beforeRenderQpc = QpcNow();
+	int64_t beforeRenderQpc = m_Clock->now();
 
 	// Render it
 	FQLog("> Frame rendered [pts: %.3f] [%.2ffps] [%.2fhz] [queued %d]\n",
 		m_CurrentFrame->pts / 90.0, m_FrameCadence.streamFps(), m_FrameCadence.displayHz(), FrameQueue::instance().count());
 
-	if (!sceneRenderer->Render(m_CurrentFrame)) {
+	PTrace(PTRACE_RENDER_START, m_CurrentFrame->pts, 0, beforeRenderQpc);
+	bool rendered = sceneRenderer.Render(m_CurrentFrame);
+	PTrace(PTRACE_RENDER_END, m_CurrentFrame->pts, rendered);
+	if (!rendered) {
 		return false; // something went wrong rendering the frame
 	}
 
 	if (m_CurrentFrame->opaque_ref) {
 		// Count time spent in FrameQueue
 		auto *data = reinterpret_cast<MLFrameData *>(m_CurrentFrame->opaque_ref->data);
-		m_DeviceResources->GetStats()->SubmitPacerTime(beforeRenderQpc - data->decodeEndQpc);
+		m_Stats->frameRendered(beforeRenderQpc - data->decodeEndQpc);
+		if (!data->timeline.renderStartQpc) {
+			data->timeline.renderStartQpc = beforeRenderQpc;
+		}
 	}
 
 	// Keep m_CurrentFrame alive until next frame, it's used to calculate frametime
@@ -277,7 +300,7 @@ bool Pacer::renderModeImmediate(std::shared_ptr<VideoRenderer> &sceneRenderer) {
 //       May do a better job with e.g. 24fps needing 3:2 pulldown
 // Cons: higher latency
 //       more difficult to control queue size, requires additional frame drop logic
-bool Pacer::renderModeDisplayLocked(std::shared_ptr<VideoRenderer> &sceneRenderer) {
+bool Pacer::renderModeDisplayLocked(IFrameRenderer &sceneRenderer) {
 	// Consume frame(s) according to cadence
 	int advanceCount = m_FrameCadence.decideAdvanceCount();
 
@@ -296,9 +319,10 @@ bool Pacer::renderModeDisplayLocked(std::shared_ptr<VideoRenderer> &sceneRendere
 		if (m_CurrentFrame) {
 			if (i > 0) {
 				// advanceCount was > 1, so this is a dropped frame
-				ImGuiPlots::instance().observeFloat(PLOT_DROPPED_PACER, 1.0);
+				m_Stats->frameSkipped();
+				PTrace(PTRACE_DROP, m_CurrentFrame->pts, PTRACE_DROP_CATCHUP);
 			}
-			av_frame_free(&m_CurrentFrame);
+			FramePool::instance().release(&m_CurrentFrame);
 		}
 		m_CurrentFrame = newFrame;
 	}
@@ -308,41 +332,109 @@ bool Pacer::renderModeDisplayLocked(std::shared_ptr<VideoRenderer> &sceneRendere
 		return false;
 	}
 
-	int64_t beforeRenderQpc = QpcNow();
+	int64_t beforeRenderQpc = m_Clock->now();
 
 	// Render it
 	FQLog("> Frame rendered [pts: %.3f] [%.2ffps] [%.2fhz] [advanceCount %d] [queued %d]\n",
 	      m_CurrentFrame->pts / 90.0, m_FrameCadence.streamFps(), m_FrameCadence.displayHz(),
 	      advanceCount, queueDepth);
 
-	if (!sceneRenderer->Render(m_CurrentFrame)) {
+	PTrace(PTRACE_RENDER_START, m_CurrentFrame->pts, 0, beforeRenderQpc);
+	bool rendered = sceneRenderer.Render(m_CurrentFrame);
+	PTrace(PTRACE_RENDER_END, m_CurrentFrame->pts, rendered);
+	if (!rendered) {
 		return false; // something went wrong rendering the frame
 	}
 
 	if (m_CurrentFrame->opaque_ref) {
 		// Count time spent in FrameQueue
 		auto *data = reinterpret_cast<MLFrameData *>(m_CurrentFrame->opaque_ref->data);
-		m_DeviceResources->GetStats()->SubmitPacerTime(beforeRenderQpc - data->decodeEndQpc);
+		m_Stats->frameRendered(beforeRenderQpc - data->decodeEndQpc);
+		if (!data->timeline.renderStartQpc) {
+			data->timeline.renderStartQpc = beforeRenderQpc;
+		}
 	}
 
 	// Keep m_CurrentFrame alive in case we need to reuse it on the next present
 	return true; // ok to Present()
 }
 
+// Immediate mode behind a jitter buffer. JitterBuffer picks how many frames to keep queued as a
+// cushion against late frames, and a frame is only rendered once the queue holds more than that.
+// On a clean link the target is 0 and this behaves exactly like renderModeImmediate.
+// Pros: only adds latency while the network is actually jittery
+// Cons: growing the buffer skips a present, shrinking it drops a frame
+bool Pacer::renderModeAdaptive(IFrameRenderer &sceneRenderer) {
+	const int targetDepth = m_JitterBuffer.targetDepth();
+
+	int queueDepth = FrameQueue::instance().count();
+	if (queueDepth <= targetDepth) {
+		return false; // let the buffer fill, don't Present()
+	}
+
+	AVFrame *newFrame = FrameQueue::instance().dequeue();
+	if (!newFrame) {
+		return false;
+	}
+
+	// if we're more than a frame over the target, catch up
+	queueDepth = FrameQueue::instance().count();
+	if (queueDepth > targetDepth + FRAME_QUEUE_LOW) {
+		AVFrame *newFrame2 = FrameQueue::instance().dequeue();
+		if (newFrame2) {
+			PTrace(PTRACE_DROP, newFrame->pts, PTRACE_DROP_CATCHUP);
+			FramePool::instance().release(&newFrame);
+			newFrame = newFrame2;
+			m_Stats->frameSkipped();
+		}
+	}
+
+	if (m_CurrentFrame) {
+		FramePool::instance().release(&m_CurrentFrame);
+	}
+	m_CurrentFrame = newFrame;
+
+	int64_t beforeRenderQpc = m_Clock->now();
+
+	// Render it
+	FQLog("> Frame rendered [pts: %.3f] [%.2ffps] [%.2fhz] [target %d] [queued %d]\n",
+	      m_CurrentFrame->pts / 90.0, m_FrameCadence.streamFps(), m_FrameCadence.displayHz(),
+	      targetDepth, queueDepth);
+
+	PTrace(PTRACE_RENDER_START, m_CurrentFrame->pts, 0, beforeRenderQpc);
+	bool rendered = sceneRenderer.Render(m_CurrentFrame);
+	PTrace(PTRACE_RENDER_END, m_CurrentFrame->pts, rendered);
+	if (!rendered) {
+		return false; // something went wrong rendering the frame
+	}
+
+	if (m_CurrentFrame->opaque_ref) {
+		// Count time spent in FrameQueue
+		auto *data = reinterpret_cast<MLFrameData *>(m_CurrentFrame->opaque_ref->data);
+		m_Stats->frameRendered(beforeRenderQpc - data->decodeEndQpc);
+		if (!data->timeline.renderStartQpc) {
+			data->timeline.renderStartQpc = beforeRenderQpc;
+		}
+	}
+
+	return true; // ok to Present()
+}
+
 // called by render thread, returns true if we waited, false if we missed the target
 bool Pacer::waitBeforePresent(int64_t target) {
 	if (!running()) return false;
 
-	int64_t now = QpcNow();
+	int64_t now = m_Clock->now();
 	if (target <= 0) {
 		target = getNextVBlankQpc(&now);
 	}
 
 	m_LastSyncTarget.store(target, std::memory_order_release);
+	PTrace(PTRACE_PRESENT_TARGET, target, target > now, now);
 
 	if (target > now) {
 		FQLog("waitBeforePresent(): waiting %.3fms\n", QpcToMs(target - now));
-		SleepUntilQpc(target);
+		m_Clock->sleepUntil(target);
 		return true;
 	}
 
@@ -357,23 +449,64 @@ int64_t Pacer::getCurrentFramePts() {
 	return 0;
 }
 
+// called by render thread after Present(), completes the current frame's timeline the first time it is shown
+void Pacer::framePresented(int64_t presentQpc) {
+	if (!m_CurrentFrame || !m_CurrentFrame->opaque_ref) {
+		return;
+	}
+
+	auto *data = reinterpret_cast<MLFrameData *>(m_CurrentFrame->opaque_ref->data);
+	if (data->timeline.presentQpc) {
+		return; // display locked mode presents the same frame again
+	}
+
+	data->timeline.presentQpc = presentQpc;
+	m_Stats->framePresented(data->timeline);
+}
+
 // end main thread
 
+// The queue has to hold targetDepth + 1 frames for renderModeAdaptive() to render anything, and
+// frames arriving in a burst after a late one need a slot too rather than being dropped at enqueue.
+// renderModeAdaptive() skips frames itself once the queue runs past the target.
+static int adaptiveHighWaterMark(int targetDepth) {
+	return std::clamp(targetDepth + 2, FRAME_QUEUE_HIGH, FrameQueue::instance().maxCapacity());
+}
+
 // called by decoder thread
 void Pacer::submitFrame(AVFrame *frame) {
 	// Update cadence from pts if available
 	if (frame->pts) {
 		m_FrameCadence.observeFramePts(frame->pts);
+
+		if (m_FramePacingMode == FRAME_PACING_ADAPTIVE) {
+			// jitter is measured from when the frame's first packet arrived, decode time would only blur it
+			int64_t arrivalQpc = m_Clock->now();
+			if (frame->opaque_ref) {
+				auto *data = reinterpret_cast<MLFrameData *>(frame->opaque_ref->data);
+				if (data->timeline.receiveQpc) {
+					arrivalQpc = data->timeline.receiveQpc;
+				}
+			}
+			m_JitterBuffer.observeFrame(frame->pts, arrivalQpc);
+
+			const int targetDepth = m_JitterBuffer.targetDepth();
+			m_Stats->jitterBufferTarget(targetDepth);
+
+			// we're the producer, so nothing else touches the high water mark while we enqueue
+			FrameQueue::instance().setHighWaterMark(adaptiveHighWaterMark(targetDepth));
+		}
 	}
 
 	int dropCount = FrameQueue::instance().enqueue(frame);
-	if (dropCount) {
-		m_DeviceResources->GetStats()->SubmitDroppedFrame(1);
-	}
+	m_Stats->frameQueued(dropCount, (int)FrameQueue::instance().count());
+}
 
-	ImGuiPlots::instance().observeFloat(PLOT_DROPPED_PACER, (float)dropCount);
-	float avgQueueSize = ImGuiPlots::instance().observeFloatReturnAvg(PLOT_QUEUED_FRAMES, (float)FrameQueue::instance().count());
-	m_DeviceResources->GetStats()->SubmitAvgQueueSize(avgQueueSize);
+// called by decoder thread
+void Pacer::observeNetworkLoss(uint32_t droppedFrames) {
+	if (m_FramePacingMode == FRAME_PACING_ADAPTIVE) {
+		m_JitterBuffer.observeNetworkLoss(droppedFrames);
+	}
 }
 
 // Misc helper functions
@@ -383,7 +516,7 @@ void Pacer::submitFrame(AVFrame *frame) {
 int64_t Pacer::getNextVBlankQpc(int64_t *now) {
 	std::scoped_lock<std::mutex> lock(m_FrameStatsLock);
 	int64_t target = 0, interval = 0;
-	*now = QpcNow();
+	*now = m_Clock->now();
 
 	if (m_LastSyncQpc == 0 || m_VsyncIntervalQpc == 0) {
 		// Fallback until vsyncHardware spins up
@@ -394,7 +527,7 @@ int64_t Pacer::getNextVBlankQpc(int64_t *now) {
 		interval = m_VsyncIntervalQpc;
 		int64_t next = m_LastSyncQpc + static_cast<int64_t>(m_ewmaVsyncDriftQpc);
 
-		while (next < *now) {
+		while (next <= *now) {
 			next += interval;
 		}
 		target = next;
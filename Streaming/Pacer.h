@@ -1,31 +1,39 @@
 #pragma once
 
+#include <array>
 #include <atomic>
-#include <deque>
-#include <set>
-#include <thread>
-#include <utility>
+#include <mutex>
 #include "FrameCadence.h"
+#include "JitterBuffer.h"
+#include "PacerTiming.h"
 #include "Utils.hpp"
-#include "VideoRenderer.h"
 
 extern "C" {
 #include <libavcodec/avcodec.h>
 }
 
+typedef enum {
+	FRAME_PACING_IMMEDIATE,      // present each new frame at the next vblank
+	FRAME_PACING_DISPLAY_LOCKED, // present every vblank, following the stream cadence
+	FRAME_PACING_ADAPTIVE        // like immediate, behind a jitter buffer sized from network conditions
+} FramePacingMode;
+
 class Pacer {
   public:
 	// Singleton accessor
 	static Pacer &instance();
 
 	void deinit();
-	void init(const std::shared_ptr<DX::DeviceResources> &res, int maxVideoFps, double refreshRate, bool framePacingImmediate);
+	// sources supplies time, vblanks and where stats go, see PacerTiming.h
+	void init(const PacerSources &sources, int maxVideoFps, double refreshRate, FramePacingMode framePacingMode);
 	void waitForFrame(double timeoutMs);
-	bool renderOnMainThread(std::shared_ptr<moonlight_xbox_dx::VideoRenderer> &sceneRenderer);
+	bool renderOnMainThread(IFrameRenderer &sceneRenderer);
 	bool waitBeforePresent(int64_t deadline);
 	int64_t getCurrentFramePts();
+	void framePresented(int64_t presentQpc);
 	int64_t getNextVBlankQpc(int64_t *now);
 	void submitFrame(AVFrame *frame);
+	void observeNetworkLoss(uint32_t droppedFrames);
 
   private:
 	Pacer();
@@ -40,25 +48,27 @@ class Pacer {
 		return m_Running.load(std::memory_order_acquire);
 	}
 
-	bool renderModeImmediate(std::shared_ptr<moonlight_xbox_dx::VideoRenderer> &sceneRenderer);
-	bool renderModeDisplayLocked(std::shared_ptr<moonlight_xbox_dx::VideoRenderer> &sceneRenderer);
-	void vsyncHardware();
+	bool renderModeImmediate(IFrameRenderer &sceneRenderer);
+	bool renderModeDisplayLocked(IFrameRenderer &sceneRenderer);
+	bool renderModeAdaptive(IFrameRenderer &sceneRenderer);
 	void updateFrameStats();
 
-	std::shared_ptr<DX::DeviceResources> m_DeviceResources;
-	std::thread m_VsyncThread;
+	std::shared_ptr<IPacerClock> m_Clock;
+	std::shared_ptr<IVsyncSource> m_VsyncSource;
+	std::shared_ptr<IPacerStats> m_Stats;
 	std::atomic<bool> m_Running{false};
 	std::atomic<bool> m_Stopping{false};
 	int m_StreamFps;
 	double m_RefreshRate;
-	bool m_FramePacingImmediate;
+	FramePacingMode m_FramePacingMode;
 
 	FrameCadence m_FrameCadence;
+	JitterBuffer m_JitterBuffer;
 	AVFrame* m_CurrentFrame = nullptr;
 
 	static constexpr int VSYNC_HISTORY_SIZE = 512;
 	std::mutex m_FrameStatsLock;
-	UINT m_LastSyncRefreshCount;
+	uint32_t m_LastSyncRefreshCount;
 	int64_t m_LastSyncQpc;
 	int64_t m_VsyncIntervalQpc;
 	std::array<int64_t, VSYNC_HISTORY_SIZE> m_vhistory{};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+struct AVFrame;
+struct MLFrameTimeline;
+
+// Everything Pacer and FrameQueue need from the outside world.
+//
+// The pacing code never talks to QPC, Win32 events, DXGI, Stats or the plots directly, it goes
+// through these interfaces. DevicePacerTiming.h has the implementations used when streaming,
+// while Tools/PacerSim substitutes a virtual clock, a synthetic display and its own reports to
+// drive the same pacing logic headless and deterministically.
+//
+// All timestamps are in QPC units (QpcFreq() ticks per second), so the QPC helpers in pch.h
+// keep working with a virtual clock.
+
+// Auto-reset event, set by one thread and waited on by one other
+interface IPacerEvent {
+	virtual ~IPacerEvent() = default;
+
+	virtual void set() = 0;
+
+	// Returns true once the event is set, false when deadlineQpc passes first. 0 waits forever.
+	virtual bool waitUntil(int64_t deadlineQpc) = 0;
+};
+
+interface IPacerClock {
+	virtual ~IPacerClock() = default;
+
+	virtual int64_t now() = 0;
+	virtual void sleepUntil(int64_t targetQpc) = 0;
+	virtual std::unique_ptr<IPacerEvent> createEvent() = 0;
+};
+
+// The last vblank the display reported, as DXGI_FRAME_STATISTICS SyncRefreshCount/SyncQPCTime
+struct VsyncSample {
+	uint32_t refreshCount;
+	int64_t qpc;
+};
+
+interface IVsyncSource {
+	virtual ~IVsyncSource() = default;
+
+	// Calls onVBlank once per vblank, from a thread of the source's choosing, until stop()
+	virtual void start(std::function<void()> onVBlank) = 0;
+	virtual void stop() = 0;
+
+	// Returns false if no vblank has been reported yet
+	virtual bool lastVBlank(VsyncSample *sample) = 0;
+};
+
+// Where Pacer reports what it did, called from the thread noted on each method
+interface IPacerStats {
+	virtual ~IPacerStats() = default;
+
+	// Decoder thread, after each frame is queued
+	virtual void frameQueued(int droppedFrames, int queueDepth) = 0;
+	virtual void jitterBufferTarget(int targetDepth) = 0;
+
+	// Render thread
+	virtual void frameSkipped() = 0; // dropped to catch up with the queue
+	virtual void frameRendered(int64_t queuedQpc) = 0;
+	virtual void framePresented(const MLFrameTimeline &timeline) = 0;
+};
+
+// Draws a decoded frame, implemented by VideoRenderer
+interface IFrameRenderer {
+	virtual ~IFrameRenderer() = default;
+
+	virtual bool Render(AVFrame *frame) = 0;
+};
+
+struct PacerSources {
+	std::shared_ptr<IPacerClock> clock;
+	std::shared_ptr<IVsyncSource> vsync;
+	std::shared_ptr<IPacerStats> stats;
+};
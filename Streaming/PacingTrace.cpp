@@ -0,0 +1,147 @@
+// clang-format off
+#include "pch.h"
+// clang-format on
+#include "PacingTrace.h"
+#include <chrono>
+#include <vector>
+#include "Utils.hpp"
+
+using namespace moonlight_xbox_dx;
+
+PacingTrace &PacingTrace::instance() {
+	static PacingTrace inst;
+	return inst;
+}
+
+PacingTrace::PacingTrace() {
+}
+
+void PacingTrace::requestRecording(const std::string &path) {
+	std::scoped_lock<std::mutex> lock(m_PathLock);
+	m_RequestedPath = path;
+}
+
+void PacingTrace::start() {
+	std::string path;
+	{
+		std::scoped_lock<std::mutex> lock(m_PathLock);
+		path.swap(m_RequestedPath);
+	}
+	if (path.empty() || m_Enabled.load(std::memory_order_acquire)) {
+		return;
+	}
+
+	if (!m_Ring) {
+		m_Ring = new Cell[RING_SIZE];
+	}
+	for (uint32_t i = 0; i < RING_SIZE; ++i) {
+		m_Ring[i].seq.store(i, std::memory_order_relaxed);
+	}
+	m_EnqueuePos.store(0, std::memory_order_relaxed);
+	m_DequeuePos = 0;
+	m_Dropped.store(0, std::memory_order_relaxed);
+
+	if (fopen_s(&m_File, path.c_str(), "wb") != 0 || !m_File) {
+		Utils::Logf("PacingTrace: unable to open %s\n", path.c_str());
+		m_File = nullptr;
+		return;
+	}
+
+	PacingTraceHeader header = {{'M', 'L', 'P', 'T'}, PACING_TRACE_VERSION, QpcFreq()};
+	fwrite(&header, sizeof(header), 1, m_File);
+
+	m_Stopping.store(false, std::memory_order_release);
+	m_WriterThread = std::thread(&PacingTrace::writerThread, this);
+	m_Enabled.store(true, std::memory_order_release);
+
+	Utils::Logf("PacingTrace: recording to %s\n", path.c_str());
+}
+
+void PacingTrace::stop() {
+	if (!m_Enabled.exchange(false, std::memory_order_acq_rel)) {
+		return;
+	}
+
+	m_Stopping.store(true, std::memory_order_release);
+	if (m_WriterThread.joinable()) {
+		m_WriterThread.join();
+	}
+
+	fclose(m_File);
+	m_File = nullptr;
+
+	Utils::Logf("PacingTrace: stopped, %llu records dropped\n", m_Dropped.load());
+}
+
+void PacingTrace::record(PacingTraceEvent event, int64_t a, uint32_t b, int64_t qpc) {
+	if (!m_Enabled.load(std::memory_order_acquire)) {
+		return;
+	}
+
+	uint32_t pos = m_EnqueuePos.load(std::memory_order_relaxed);
+	Cell *cell;
+	for (;;) {
+		cell = &m_Ring[pos & RING_MASK];
+		uint32_t seq = cell->seq.load(std::memory_order_acquire);
+		int32_t diff = (int32_t)(seq - pos);
+		if (diff == 0) {
+			if (m_EnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+				break;
+			}
+		} else if (diff < 0) {
+			// writer hasn't caught up, don't wait for it
+			m_Dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		} else {
+			pos = m_EnqueuePos.load(std::memory_order_relaxed);
+		}
+	}
+
+	cell->record.qpc = qpc ? qpc : QpcNow();
+	cell->record.a = a;
+	cell->record.b = b;
+	cell->record.event = event;
+	cell->record.thread = (uint16_t)GetCurrentThreadId();
+	cell->seq.store(pos + 1, std::memory_order_release);
+}
+
+// Writer thread only
+size_t PacingTrace::drain(PacingTraceRecord *out, size_t max) {
+	size_t n = 0;
+	while (n < max) {
+		Cell *cell = &m_Ring[m_DequeuePos & RING_MASK];
+		uint32_t seq = cell->seq.load(std::memory_order_acquire);
+		if (seq != m_DequeuePos + 1) {
+			break;
+		}
+		out[n++] = cell->record;
+		cell->seq.store(m_DequeuePos + RING_SIZE, std::memory_order_release);
+		m_DequeuePos++;
+	}
+	return n;
+}
+
+void PacingTrace::writerThread() {
+	if (!SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL)) {
+		Utils::Logf("Failed to set PacingTrace writer priority: %d\n", GetLastError());
+	}
+
+	std::vector<PacingTraceRecord> batch(4096);
+
+	for (;;) {
+		const bool stopping = m_Stopping.load(std::memory_order_acquire);
+
+		size_t n;
+		while ((n = drain(batch.data(), batch.size())) > 0) {
+			fwrite(batch.data(), sizeof(PacingTraceRecord), n, m_File);
+		}
+
+		if (stopping) {
+			break;
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	}
+
+	fflush(m_File);
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Binary frame pacing trace
+//
+// When "Record frame pacing trace" is enabled in the host settings, every pacing event of the
+// stream is recorded with its QPC timestamp and written to LocalFolder\pacing-<date>-<time>.mlpt.
+// Unlike FQLog this doesn't disturb the timing it measures: PTrace() only copies a 24 byte record
+// into a lock-free ring, and a background thread writes the ring to disk. If the writer falls
+// behind, records are dropped and counted rather than blocking the caller. While no trace is
+// being recorded PTrace() is a single atomic load.
+//
+// Tools/PacingReplay prints the per-frame latency breakdown, drops and missed deadlines of a trace.
+//
+// File format, little endian:
+//   PacingTraceHeader
+//   PacingTraceRecord * N
+//
+// Record fields by event:
+//   PTRACE_DU_ARRIVAL      a = frame number,        b = decode unit bytes     (v1: recorded at decode start)
+//   PTRACE_DECODE_END      a = pts (90kHz),         b = frame number
+//   PTRACE_DECODE_START    a = frame number                                  (v2)
+//   PTRACE_ENQUEUE         a = pts,                 b = queue depth after enqueue
+//   PTRACE_DROP            a = pts,                 b = PacingTraceDropReason
+//   PTRACE_DEQUEUE         a = pts,                 b = queue depth after dequeue
+//   PTRACE_RENDER_START    a = pts
+//   PTRACE_RENDER_END      a = pts,                 b = 1 if the frame rendered successfully
+//   PTRACE_PRESENT_TARGET  a = target vsync QPC,    b = 1 if we waited, 0 if the target was missed
+//   PTRACE_PRESENT         a = pts of the presented frame
+//   PTRACE_VSYNC           a = DXGI SyncQPCTime,    b = DXGI SyncRefreshCount
+
+typedef enum : uint16_t {
+	PTRACE_DU_ARRIVAL = 1,
+	PTRACE_DECODE_END,
+	PTRACE_ENQUEUE,
+	PTRACE_DROP,
+	PTRACE_DEQUEUE,
+	PTRACE_RENDER_START,
+	PTRACE_RENDER_END,
+	PTRACE_PRESENT_TARGET,
+	PTRACE_PRESENT,
+	PTRACE_VSYNC,
+	PTRACE_DECODE_START,
+} PacingTraceEvent;
+
+typedef enum : uint32_t {
+	PTRACE_DROP_NEWEST = 1,  // FrameQueue over the high water mark, incoming frame dropped
+	PTRACE_DROP_OLDEST,      // FrameQueue over the high water mark, oldest frame dropped
+	PTRACE_DROP_FULL,        // FrameQueue full while accepting an IDR or a frame under the high water mark
+	PTRACE_DROP_FLUSH,       // FrameQueue cleared at the end of the stream
+	PTRACE_DROP_CATCHUP,     // Pacer skipped a frame to bring the queue depth back down
+} PacingTraceDropReason;
+
+#pragma pack(push, 1)
+typedef struct {
+	char magic[4];    // "MLPT"
+	uint32_t version; // PACING_TRACE_VERSION
+	int64_t qpcFreq;  // QPC ticks per second
+} PacingTraceHeader;
+
+typedef struct {
+	int64_t qpc;
+	int64_t a;
+	uint32_t b;
+	uint16_t event;  // PacingTraceEvent
+	uint16_t thread; // low 16 bits of the thread id
+} PacingTraceRecord;
+#pragma pack(pop)
+
+static_assert(sizeof(PacingTraceHeader) == 16, "PacingTraceHeader layout changed");
+static_assert(sizeof(PacingTraceRecord) == 24, "PacingTraceRecord layout changed");
+
+constexpr uint32_t PACING_TRACE_VERSION = 2;
+
+class PacingTrace {
+  public:
+	// Singleton
+	static PacingTrace &instance();
+
+	// Call before the stream starts to have it recorded to path
+	void requestRecording(const std::string &path);
+
+	// Called by Pacer init/deinit, start() only records if requestRecording() was called since the last stream
+	void start();
+	void stop();
+
+	bool enabled() const {
+		return m_Enabled.load(std::memory_order_acquire);
+	}
+
+	// Any thread, never blocks. qpc 0 means now.
+	void record(PacingTraceEvent event, int64_t a = 0, uint32_t b = 0, int64_t qpc = 0);
+
+  private:
+	PacingTrace();
+	PacingTrace(const PacingTrace &) = delete;
+	PacingTrace &operator=(const PacingTrace &) = delete;
+
+	void writerThread();
+	size_t drain(PacingTraceRecord *out, size_t max);
+
+	// Bounded MPSC ring, each cell carries a sequence number so producers can claim
+	// cells with a CAS and the writer knows when a cell has been filled.
+	static constexpr uint32_t RING_SIZE = 1 << 16;
+	static constexpr uint32_t RING_MASK = RING_SIZE - 1;
+
+	struct Cell {
+		std::atomic<uint32_t> seq;
+		PacingTraceRecord record;
+	};
+
+	Cell *m_Ring = nullptr;
+	alignas(64) std::atomic<uint32_t> m_EnqueuePos{0};
+	alignas(64) uint32_t m_DequeuePos = 0; // writer thread only
+
+	std::mutex m_PathLock;
+	std::string m_RequestedPath;
+
+	std::atomic<bool> m_Enabled{false};
+	std::atomic<bool> m_Stopping{false};
+	std::atomic<uint64_t> m_Dropped{0};
+	std::thread m_WriterThread;
+	FILE *m_File = nullptr;
+};
+
+// The arguments are only evaluated while recording
+#define PTrace(...)                                 \
+    do {                                            \
+        PacingTrace &_ptrace = PacingTrace::instance(); \
+        if (_ptrace.enabled()) {                    \
+            _ptrace.record(__VA_ARGS__);            \
+        }                                           \
+    } while (0)
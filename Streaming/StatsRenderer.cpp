@@ -28,11 +28,11 @@ void StatsRenderer::Update(DX::StepTimer const &timer) {
 	// We let the Stats class always process even if not visible. Most of the time
 	// it will simply accumulate stats during its 1-second window period. Each second,
 	// when it determines the user-visible text should be updated, it will update outputStr and return true.
-	char outputStr[1024]; // char is used so we can share more of the formatting code with moonlight-qt
+	char outputStr[2048]; // char is used so we can share more of the formatting code with moonlight-qt
 	wchar_t wideStr[2048];
 
 	if (m_stats->ShouldUpdateDisplay(timer, m_visible, outputStr, sizeof(outputStr))) {
-		size_t numChars = mbstowcs(wideStr, outputStr, 1024);
+		size_t numChars = mbstowcs(wideStr, outputStr, _countof(wideStr));
 		if (numChars != -1) {
 			m_console->Clear();
 			m_console->Write(wideStr);
@@ -63,8 +63,12 @@ static inline float clampGetter(void *data, int idx) {
 
 void StatsRenderer::RenderGraphs() {
 	// we malloc a buffer for each stat only once and reuse it each frame
-	assert(PlotCount == 7);
-	static float *buffers[7] = {
+	assert(PlotCount == 11);
+	static float *buffers[11] = {
+	    (float *)malloc(sizeof(float) * 512),
+	    (float *)malloc(sizeof(float) * 512),
+	    (float *)malloc(sizeof(float) * 512),
+	    (float *)malloc(sizeof(float) * 512),
 	    (float *)malloc(sizeof(float) * 512),
 	    (float *)malloc(sizeof(float) * 512),
 	    (float *)malloc(sizeof(float) * 512),
@@ -81,11 +85,13 @@ void StatsRenderer::RenderGraphs() {
 	        graphW, graphH, m_displayWidth, m_displayHeight, opacity);
 
 	// Row 1: 3 graphs
-	// Row 2: 2 graphs left-aligned
+	// Row 2: 3 graphs
+	// Row 3: glass-to-glass latency, audio queue, audio underruns
+	// Row 4: audio decode time, left-aligned
 	float itemSpacingX = ImGui::GetStyle().ItemSpacing.x;
 	float itemSpacingY = ImGui::GetStyle().ItemSpacing.y;
 	float row1Width = (3 * graphW) + (2 * itemSpacingX);
-	float totalHeight = (3 * graphH) + (2 * itemSpacingY) + 50;
+	float totalHeight = (4 * graphH) + (3 * itemSpacingY) + 50;
 
 	// Anchor window to top-right
 	ImVec2 windowPos(m_displayWidth - 10.0f, 10.0f); // 10px margin
@@ -161,8 +167,18 @@ void StatsRenderer::RenderGraphs() {
 		draw_plot(row2[c], graphW, graphH);
 	}
 
-	// 3rd row for quickly graphing something if needed
-	// ImGui::Dummy(ImVec2(1.0f, itemSpacingY));
+	ImGui::Dummy(ImVec2(1.0f, itemSpacingY));
+	const int row3[3] = {PLOT_GLASS_TO_GLASS, PLOT_AUDIO_QUEUE, PLOT_AUDIO_UNDERRUNS};
+	for (int c = 0; c < 3; ++c) {
+		if (c > 0) ImGui::SameLine(0.0f, itemSpacingX);
+		draw_plot(row3[c], graphW, graphH);
+	}
+
+	ImGui::Dummy(ImVec2(1.0f, itemSpacingY));
+	draw_plot(PLOT_AUDIO_DECODE, graphW, graphH);
+
+	// room on the 4th row for quickly graphing something if needed
+	// ImGui::SameLine(0.0f, itemSpacingX);
 	// draw_plot(PLOT_ETC, graphW, graphH);
 
 	ImGui::End();
@@ -187,17 +203,17 @@ void StatsRenderer::CreateWindowSizeDependentResources() {
 	int right = m_displayWidth / 3;
 	int bottom = 0;
 
-	// 13 lines of text
+	// 26 lines of text
 	if (m_displayHeight >= 2160) { // 24pt font
 		left = 20;
 		right = m_displayWidth / 2;
-		bottom = 448;
+		bottom = 901;
 	} else if (m_displayHeight >= 1440) { // 12pt font
 		left = 14;
-		bottom = 224;
+		bottom = 451;
 	} else {
 		left = 10;
-		bottom = 224;
+		bottom = 451;
 	}
 
 #if defined(_DEBUG)
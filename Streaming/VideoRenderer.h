@@ -1,6 +1,7 @@
 ﻿#pragma once
 
 #include "ShaderStructures.h"
+#include "PacerTiming.h"
 #include "Common\StepTimer.h"
 #include "State\MoonlightClient.h"
 #include "State\StreamConfiguration.h"
@@ -29,7 +30,7 @@ namespace moonlight_xbox_dx
 		int frameRate;
 	} DECODER_PARAMETERS, *PDECODER_PARAMETERS;
 
-	class VideoRenderer
+	class VideoRenderer : public IFrameRenderer
 	{
 	public:
 		VideoRenderer(const std::shared_ptr<DX::DeviceResources>& deviceResources,MoonlightClient *client,StreamConfiguration ^sConfig);
@@ -39,7 +40,7 @@ namespace moonlight_xbox_dx
 		void Update(DX::StepTimer const& timer);
 		void scaleSourceToDestinationSurface(IRECT* src, IRECT* dst);
 		void screenSpaceToNormalizedDeviceCoords(IRECT* src, FRECT* dst, int viewportWidth, int viewportHeight);
-		bool Render(AVFrame* frame);
+		bool Render(AVFrame* frame) override;
 		void bindColorConversion(AVFrame* frame, D3D11_TEXTURE2D_DESC frameDesc);
 		void SetHDR(bool enabled);
 		void Stop();
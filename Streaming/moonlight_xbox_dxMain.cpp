@@ -5,6 +5,8 @@
 #include "Utils.hpp"
 #include <Pages/StreamPage.xaml.h>
 #include <Streaming\FFMpegDecoder.h>
+#include <Streaming\PacingTrace.h>
+#include <Streaming\LaunchTimeline.h>
 using namespace Windows::Gaming::Input;
 
 
@@ -153,6 +155,10 @@ void moonlight_xbox_dxMain::StartRenderLoop()
 					auto guard = FFMpegDecoder::Lock();
 					m_deviceResources->Present();
 				}
+				int64_t presentQpc = QpcNow();
+				PTrace(PTRACE_PRESENT, Pacer::instance().getCurrentFramePts(), 0, presentQpc);
+				LaunchTimeline::instance().mark(LAUNCH_FIRST_PRESENT);
+				Pacer::instance().framePresented(presentQpc);
 
 				// Graph frametime only for new frames
 				int64_t currentFramePts = Pacer::instance().getCurrentFramePts();
@@ -464,7 +470,7 @@ bool moonlight_xbox_dxMain::Render()
 		ImGui::NewFrame();
 	}
 
-	bool shouldPresent = Pacer::instance().renderOnMainThread(m_sceneRenderer);
+	bool shouldPresent = Pacer::instance().renderOnMainThread(*m_sceneRenderer);
 	if (shouldPresent) {
 		// avoid useless rendering without an underlying frame change
 		m_LogRenderer->Render();
@@ -0,0 +1,139 @@
+// Contention benchmark for BandwidthTracker
+//
+// The decoder thread calls AddBytes() for every frame while the render thread reads GetAverageMbps()
+// for the bandwidth plot and the overlay. This runs that pattern flat out, once against the tracker
+// as it is and once behind a mutex the way it used to be, and prints what an AddBytes() costs the
+// writer as readers are added.
+//
+// usage: bandwidth-bench [--seconds 0.5] [--max-readers 3]
+//
+// Fails if the tracker doesn't report the bytes it was given.
+
+#include "pch.h"
+#include "../../State/BandwidthTracker.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// What BandwidthTracker did before it went lock-free, every call took the same mutex
+class LockedBandwidthTracker {
+  public:
+	void AddBytes(size_t bytes) {
+		std::lock_guard<std::mutex> lock(m_lock);
+		m_tracker.AddBytes(bytes);
+	}
+	double GetAverageMbps() {
+		std::lock_guard<std::mutex> lock(m_lock);
+		return m_tracker.GetAverageMbps();
+	}
+	double GetPeakMbps() {
+		std::lock_guard<std::mutex> lock(m_lock);
+		return m_tracker.GetPeakMbps();
+	}
+
+  private:
+	std::mutex m_lock;
+	BandwidthTracker m_tracker;
+};
+
+struct BenchResult {
+	double addNs;      // per AddBytes() call on the writer
+	double readsPerMs; // GetAverageMbps() and GetPeakMbps() calls, all readers together
+	double peakMbps;
+};
+
+template <typename Tracker> static BenchResult runBench(int readers, double seconds) {
+	Tracker tracker;
+	std::atomic<bool> stop{false};
+	std::atomic<int> started{0};
+	std::atomic<uint64_t> reads{0};
+
+	std::vector<std::thread> readerThreads;
+	for (int r = 0; r < readers; ++r) {
+		readerThreads.emplace_back([&]() {
+			started.fetch_add(1);
+			uint64_t count = 0;
+			double sink = 0;
+			while (!stop.load(std::memory_order_relaxed)) {
+				sink += (count & 1) ? tracker.GetPeakMbps() : tracker.GetAverageMbps();
+				++count;
+			}
+			reads.fetch_add(count);
+			if (sink < 0) {
+				printf("%f\n", sink);
+			}
+		});
+	}
+	while (started.load() < readers) {
+		std::this_thread::yield();
+	}
+
+	using Clock = std::chrono::steady_clock;
+	const auto begin = Clock::now();
+	const auto end = begin + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+	uint64_t adds = 0;
+	auto now = begin;
+	while (now < end) {
+		for (int i = 0; i < 256; ++i) {
+			tracker.AddBytes(1400);
+		}
+		adds += 256;
+		now = Clock::now();
+	}
+	const double elapsedNs = std::chrono::duration<double, std::nano>(now - begin).count();
+
+	stop.store(true);
+	for (auto &t : readerThreads) {
+		t.join();
+	}
+
+	BenchResult result;
+	result.addNs = elapsedNs / adds;
+	result.readsPerMs = reads.load() / (elapsedNs / 1e6);
+	result.peakMbps = tracker.GetPeakMbps();
+	return result;
+}
+
+static void usage() {
+	fprintf(stderr, "usage: bandwidth-bench [--seconds 0.5] [--max-readers 3]\n");
+}
+
+int main(int argc, char **argv) {
+	double seconds = 0.5;
+	int maxReaders = 3;
+	for (int i = 1; i < argc; ++i) {
+		const char *val = i + 1 < argc ? argv[i + 1] : nullptr;
+		if (!val) {
+			usage();
+			return 2;
+		} else if (!strcmp(argv[i], "--seconds")) {
+			seconds = atof(val);
+		} else if (!strcmp(argv[i], "--max-readers")) {
+			maxReaders = atoi(val);
+		} else {
+			usage();
+			return 2;
+		}
+		++i;
+	}
+
+	bool ok = true;
+	printf("%-8s %10s %14s %10s %14s\n", "readers", "add (ns)", "reads/ms", "locked add", "locked reads");
+	for (int readers = 0; readers <= maxReaders; ++readers) {
+		BenchResult lockFree = runBench<BandwidthTracker>(readers, seconds);
+		BenchResult locked = runBench<LockedBandwidthTracker>(readers, seconds);
+		printf("%-8d %10.1f %14.0f %10.1f %14.0f\n", readers, lockFree.addNs, lockFree.readsPerMs, locked.addNs,
+		       locked.readsPerMs);
+		if (lockFree.peakMbps <= 0.0) {
+			fprintf(stderr, "bandwidth-bench: the tracker lost the bytes it was given\n");
+			ok = false;
+		}
+	}
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,216 @@
+// Copy versus zero-copy cost of handing decode units to ffmpeg
+//
+// FFMpegDecoder gathers every decode unit into a DecodeUnitBuffer, because the buffers
+// moonlight-common-c hands over aren't followed by the zeroed padding ffmpeg requires. This
+// measures what that copy costs against wrapping single-entry units in an AVBufferRef in place,
+// the zero-copy path that would be possible if the receive side allocated padded buffers. Decode
+// units are synthetic, a slice per P-frame sized for the bitrate and an IDR with VPS/SPS/PPS
+// every --idr-interval frames, spread over separately allocated buffers like the receive side's.
+//
+// usage: decode-unit-bench [--mbps 150] [--fps 120] [--frames 20000] [--idr-interval 600]
+//
+// Fails if a gathered unit doesn't match its entries or its padding isn't zero.
+
+#include "pch.h"
+#include "../../Streaming/DecodeUnitBuffer.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+// Enough units that they don't all stay in the fastest cache, like a stream of fresh frames
+static const int UNIT_COUNT = 16;
+
+struct SyntheticUnit {
+	DECODE_UNIT du;
+	std::vector<LENTRY> entries;
+	std::vector<std::vector<char>> buffers;
+};
+
+static void buildUnit(SyntheticUnit &unit, bool idr, int sliceBytes, std::mt19937 &rng) {
+	std::vector<int> sizes;
+	std::vector<int> types;
+	if (idr) {
+		sizes = {24, 40, 8, sliceBytes * 4};
+		types = {BUFFER_TYPE_VPS, BUFFER_TYPE_SPS, BUFFER_TYPE_PPS, BUFFER_TYPE_PICDATA};
+	} else {
+		sizes = {sliceBytes};
+		types = {BUFFER_TYPE_PICDATA};
+	}
+
+	unit.buffers.resize(sizes.size());
+	unit.entries.resize(sizes.size());
+	int fullLength = 0;
+	for (size_t i = 0; i < sizes.size(); i++) {
+		unit.buffers[i].resize(sizes[i]);
+		for (char &c : unit.buffers[i]) {
+			c = (char)rng();
+		}
+		unit.entries[i].data = unit.buffers[i].data();
+		unit.entries[i].length = sizes[i];
+		unit.entries[i].bufferType = types[i];
+		unit.entries[i].next = i + 1 < sizes.size() ? &unit.entries[i + 1] : nullptr;
+		fullLength += sizes[i];
+	}
+
+	memset(&unit.du, 0, sizeof(unit.du));
+	unit.du.frameType = idr ? FRAME_TYPE_IDR : FRAME_TYPE_PFRAME;
+	unit.du.fullLength = fullLength;
+	unit.du.bufferList = unit.entries.data();
+}
+
+static bool gatherMatches(const DecodeUnitBuffer &buffer, const DECODE_UNIT &du) {
+	if (buffer.size() != du.fullLength) {
+		return false;
+	}
+	int offset = 0;
+	for (PLENTRY entry = du.bufferList; entry != nullptr; entry = entry->next) {
+		if (memcmp(buffer.data() + offset, entry->data, entry->length) != 0) {
+			return false;
+		}
+		offset += entry->length;
+	}
+	for (int i = 0; i < AV_INPUT_BUFFER_PADDING_SIZE; i++) {
+		if (buffer.data()[offset + i] != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void noopFree(void *opaque, uint8_t *data) {
+	(*(int *)opaque)++;
+}
+
+struct BenchResult {
+	double nsPerFrame;
+	double bytesCopiedPerFrame;
+};
+
+// What FFMpegDecoder does, every unit is gathered
+static BenchResult runCopy(std::vector<SyntheticUnit> &units, const std::vector<int> &order) {
+	DecodeUnitBuffer buffer;
+	buffer.reserve(256 * 1024);
+	uint8_t sink = 0;
+
+	using Clock = std::chrono::steady_clock;
+	const auto start = Clock::now();
+	for (int index : order) {
+		buffer.gather(&units[index].du);
+		sink ^= buffer.data()[buffer.size() / 2];
+	}
+	const double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+	if (sink == 0x5a) {
+		printf(" ");
+	}
+	return BenchResult{ns / order.size(), (double)buffer.gatheredBytes() / order.size()};
+}
+
+// Single-entry units wrapped in place, only IDR frames gathered
+static BenchResult runZeroCopy(std::vector<SyntheticUnit> &units, const std::vector<int> &order) {
+	DecodeUnitBuffer buffer;
+	buffer.reserve(256 * 1024);
+	int released = 0;
+	uint8_t sink = 0;
+
+	using Clock = std::chrono::steady_clock;
+	const auto start = Clock::now();
+	for (int index : order) {
+		const DECODE_UNIT &du = units[index].du;
+		if (du.bufferList->next == nullptr) {
+			AVBufferRef *ref = av_buffer_create((uint8_t *)du.bufferList->data, du.bufferList->length, noopFree,
+			                                    &released, AV_BUFFER_FLAG_READONLY);
+			sink ^= ref->data[ref->size / 2];
+			av_buffer_unref(&ref);
+		} else {
+			buffer.gather(&du);
+			sink ^= buffer.data()[buffer.size() / 2];
+		}
+	}
+	const double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+	if (sink == 0x5a) {
+		printf(" ");
+	}
+	return BenchResult{ns / order.size(), (double)buffer.gatheredBytes() / order.size()};
+}
+
+static void usage() {
+	fprintf(stderr, "usage: decode-unit-bench [--mbps 150] [--fps 120] [--frames 20000] [--idr-interval 600]\n");
+}
+
+int main(int argc, char **argv) {
+	double mbps = 150;
+	double fps = 120;
+	int frames = 20000;
+	int idrInterval = 600;
+	for (int i = 1; i < argc; ++i) {
+		const char *val = i + 1 < argc ? argv[i + 1] : nullptr;
+		if (!val) {
+			usage();
+			return 2;
+		} else if (!strcmp(argv[i], "--mbps")) {
+			mbps = atof(val);
+		} else if (!strcmp(argv[i], "--fps")) {
+			fps = atof(val);
+		} else if (!strcmp(argv[i], "--frames")) {
+			frames = atoi(val);
+		} else if (!strcmp(argv[i], "--idr-interval")) {
+			idrInterval = atoi(val);
+		} else {
+			usage();
+			return 2;
+		}
+		++i;
+	}
+	if (mbps <= 0 || fps <= 0 || frames <= 0) {
+		usage();
+		return 2;
+	}
+
+	std::mt19937 rng(1);
+	const int sliceBytes = (int)(mbps * 1000000.0 / 8.0 / fps);
+
+	// The last unit is the IDR, the rest are P-frames of +-20% around the average size
+	std::vector<SyntheticUnit> units(UNIT_COUNT);
+	std::uniform_real_distribution<double> sizeJitter(0.8, 1.2);
+	for (int i = 0; i < UNIT_COUNT; i++) {
+		const bool idr = i == UNIT_COUNT - 1;
+		buildUnit(units[i], idr, idr ? sliceBytes : (int)(sliceBytes * sizeJitter(rng)), rng);
+	}
+
+	std::vector<int> order(frames);
+	for (int f = 0; f < frames; f++) {
+		order[f] = (idrInterval > 0 && f % idrInterval == 0) ? UNIT_COUNT - 1 : f % (UNIT_COUNT - 1);
+	}
+
+	bool ok = true;
+	DecodeUnitBuffer check;
+	for (SyntheticUnit &unit : units) {
+		if (!check.gather(&unit.du) || !gatherMatches(check, unit.du)) {
+			fprintf(stderr, "decode-unit-bench: a gathered %s doesn't match its entries\n",
+			        unit.du.frameType == FRAME_TYPE_IDR ? "IDR frame" : "P-frame");
+			ok = false;
+		}
+	}
+
+	// Once untimed to fault everything in
+	runCopy(units, order);
+	runZeroCopy(units, order);
+	const BenchResult copy = runCopy(units, order);
+	const BenchResult zeroCopy = runZeroCopy(units, order);
+
+	const double frameIntervalNs = 1e9 / fps;
+	printf("%.0f Mbps at %.0f fps, %d byte slices, IDR every %d frames, %d frames\n", mbps, fps, sliceBytes,
+	       idrInterval, frames);
+	printf("%-10s %12s %16s %14s\n", "", "ns/frame", "copied/frame", "% of interval");
+	printf("%-10s %12.0f %16.0f %13.3f%%\n", "copy", copy.nsPerFrame, copy.bytesCopiedPerFrame,
+	       100.0 * copy.nsPerFrame / frameIntervalNs);
+	printf("%-10s %12.0f %16.0f %13.3f%%\n", "zero-copy", zeroCopy.nsPerFrame, zeroCopy.bytesCopiedPerFrame,
+	       100.0 * zeroCopy.nsPerFrame / frameIntervalNs);
+	return ok ? 0 : 1;
+}
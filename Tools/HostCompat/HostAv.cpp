@@ -0,0 +1,166 @@
+#include "pch.h"
+#include <cstdlib>
+#include <mutex>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/buffer.h>
+}
+
+// Just enough of ffmpeg's frames and buffer pools to run FramePool. Pooled buffers go back to
+// their pool on unref, and the pool is freed once it is uninitialized and the last buffer is back.
+// Like ffmpeg's, a pool can be used from several threads at once.
+// Allocations are counted so tests can check FramePool doesn't make any in steady state.
+
+std::atomic<uint64_t> g_HostAvBufferAllocs{0};
+std::atomic<int64_t> g_HostAvBuffersLive{0};
+std::atomic<uint64_t> g_HostAvFrameAllocs{0};
+std::atomic<int64_t> g_HostAvFramesLive{0};
+
+struct AVBufferPool {
+	size_t size;
+	void *opaque;
+	AVBufferRef *(*alloc)(void *opaque, size_t size);
+	void (*pool_free)(void *opaque);
+	std::mutex lock;
+	std::vector<AVBufferRef *> free;
+	int outstanding = 0;
+	bool uninit = false;
+};
+
+static void freeBuffer(AVBufferRef *buf) {
+	if (buf->free) {
+		buf->free(buf->opaque, buf->data);
+	} else {
+		std::free(buf->data);
+		g_HostAvBuffersLive--;
+	}
+	delete buf;
+}
+
+// Once it is uninitialized and the last buffer is back, with the lock no longer held
+static void freePool(AVBufferPool *pool) {
+	for (AVBufferRef *buf : pool->free) {
+		freeBuffer(buf);
+	}
+	if (pool->pool_free) {
+		pool->pool_free(pool->opaque);
+	}
+	delete pool;
+}
+
+AVBufferRef *av_buffer_alloc(size_t size) {
+	AVBufferRef *buf = new AVBufferRef();
+	buf->data = static_cast<uint8_t *>(std::calloc(1, size ? size : 1));
+	g_HostAvBufferAllocs++;
+	g_HostAvBuffersLive++;
+	buf->size = size;
+	buf->pool = nullptr;
+	return buf;
+}
+
+AVBufferRef *av_buffer_create(uint8_t *data, size_t size, void (*free)(void *opaque, uint8_t *data), void *opaque,
+                              int flags) {
+	AVBufferRef *buf = new AVBufferRef();
+	buf->data = data;
+	buf->size = size;
+	buf->free = free;
+	buf->opaque = opaque;
+	return buf;
+}
+
+void av_buffer_unref(AVBufferRef **buf) {
+	if (!buf || !*buf) {
+		return;
+	}
+	AVBufferRef *b = *buf;
+	*buf = nullptr;
+
+	if (AVBufferPool *pool = b->pool) {
+		std::unique_lock<std::mutex> lock(pool->lock);
+		pool->outstanding--;
+		if (pool->uninit) {
+			b->pool = nullptr;
+			freeBuffer(b);
+			const bool last = pool->outstanding == 0;
+			lock.unlock();
+			if (last) {
+				freePool(pool);
+			}
+		} else {
+			pool->free.push_back(b);
+		}
+		return;
+	}
+	freeBuffer(b);
+}
+
+AVBufferPool *av_buffer_pool_init2(size_t size, void *opaque,
+                                   AVBufferRef *(*alloc)(void *opaque, size_t size),
+                                   void (*pool_free)(void *opaque)) {
+	AVBufferPool *pool = new AVBufferPool();
+	pool->size = size;
+	pool->opaque = opaque;
+	pool->alloc = alloc;
+	pool->pool_free = pool_free;
+	return pool;
+}
+
+AVBufferRef *av_buffer_pool_get(AVBufferPool *pool) {
+	std::lock_guard<std::mutex> lock(pool->lock);
+	AVBufferRef *buf = nullptr;
+	if (!pool->free.empty()) {
+		buf = pool->free.back();
+		pool->free.pop_back();
+	} else {
+		buf = pool->alloc ? pool->alloc(pool->opaque, pool->size) : av_buffer_alloc(pool->size);
+		if (!buf) {
+			return nullptr;
+		}
+		buf->pool = pool;
+	}
+	pool->outstanding++;
+	return buf;
+}
+
+void av_buffer_pool_uninit(AVBufferPool **pool) {
+	if (!pool || !*pool) {
+		return;
+	}
+	AVBufferPool *p = *pool;
+	*pool = nullptr;
+	bool last;
+	{
+		std::lock_guard<std::mutex> lock(p->lock);
+		p->uninit = true;
+		last = p->outstanding == 0;
+	}
+	if (last) {
+		freePool(p);
+	}
+}
+
+AVFrame *av_frame_alloc(void) {
+	g_HostAvFrameAllocs++;
+	g_HostAvFramesLive++;
+	return new AVFrame();
+}
+
+void av_frame_unref(AVFrame *frame) {
+	if (!frame) {
+		return;
+	}
+	av_buffer_unref(&frame->opaque_ref);
+	*frame = AVFrame{};
+}
+
+void av_frame_free(AVFrame **frame) {
+	if (!frame || !*frame) {
+		return;
+	}
+	av_frame_unref(*frame);
+	delete *frame;
+	g_HostAvFramesLive--;
+	*frame = nullptr;
+}
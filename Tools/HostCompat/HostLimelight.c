@@ -0,0 +1,13 @@
+// The two moonlight-common-c calls libgamestream makes, so it links without the streaming library
+
+#include "Limelight.h"
+
+#include <string.h>
+
+void LiInitializeServerInformation(PSERVER_INFORMATION serverInfo) {
+	memset(serverInfo, 0, sizeof(*serverInfo));
+}
+
+const char *LiGetLaunchUrlQueryParameters(void) {
+	return "";
+}
@@ -0,0 +1,47 @@
+#include "pch.h"
+#include "HostPacerClock.h"
+
+#include <chrono>
+#include <condition_variable>
+
+static std::chrono::steady_clock::time_point toTimePoint(int64_t qpc) {
+	return std::chrono::steady_clock::now() + std::chrono::microseconds(QpcToUs(qpc - QpcNow()));
+}
+
+// Auto-reset like the Win32 event QpcClock uses
+class HostPacerEvent : public IPacerEvent {
+  public:
+	void set() override {
+		std::lock_guard<std::mutex> lock(m_Lock);
+		m_Set = true;
+		m_Cond.notify_one();
+	}
+
+	bool waitUntil(int64_t deadlineQpc) override {
+		std::unique_lock<std::mutex> lock(m_Lock);
+		if (!deadlineQpc) {
+			m_Cond.wait(lock, [this] { return m_Set; });
+		} else if (!m_Cond.wait_until(lock, toTimePoint(deadlineQpc), [this] { return m_Set; })) {
+			return false;
+		}
+		m_Set = false;
+		return true;
+	}
+
+  private:
+	std::mutex m_Lock;
+	std::condition_variable m_Cond;
+	bool m_Set = false;
+};
+
+int64_t HostPacerClock::now() {
+	return QpcNow();
+}
+
+void HostPacerClock::sleepUntil(int64_t targetQpc) {
+	std::this_thread::sleep_until(toTimePoint(targetQpc));
+}
+
+std::unique_ptr<IPacerEvent> HostPacerClock::createEvent() {
+	return std::make_unique<HostPacerEvent>();
+}
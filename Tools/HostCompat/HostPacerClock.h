@@ -0,0 +1,13 @@
+#pragma once
+
+#include "pch.h"
+#include "../../Streaming/PacerTiming.h"
+
+// The host's counterpart of QpcClock, for tools that run the pacing code on real threads.
+// Time is QpcNow(), and events are a condition variable rather than a Win32 event.
+class HostPacerClock : public IPacerClock {
+  public:
+	int64_t now() override;
+	void sleepUntil(int64_t targetQpc) override;
+	std::unique_ptr<IPacerEvent> createEvent() override;
+};
@@ -0,0 +1,198 @@
+#include "HostStubServer.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <csignal>
+#include <netinet/in.h>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+HostStubServer::HostStubServer(Handler handler) : m_Handler(std::move(handler)) {
+	// SSL_write() to a client that hung up would raise SIGPIPE, plain sockets use MSG_NOSIGNAL
+	signal(SIGPIPE, SIG_IGN);
+	m_Http.https = false;
+	if (listenOn(m_Http, m_HttpPort)) {
+		m_Http.thread = std::thread(&HostStubServer::acceptLoop, this, &m_Http);
+	}
+}
+
+HostStubServer::~HostStubServer() {
+	m_Stopping.store(true);
+	// shutdown() wakes accept() and recv() on Linux
+	for (Listener *listener : {&m_Http, &m_Https}) {
+		if (listener->fd >= 0) {
+			shutdown(listener->fd, SHUT_RDWR);
+		}
+		if (listener->thread.joinable()) {
+			listener->thread.join();
+		}
+		if (listener->fd >= 0) {
+			close(listener->fd);
+		}
+	}
+
+	std::vector<std::thread> threads;
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		for (int fd : m_ClientFds) {
+			shutdown(fd, SHUT_RDWR);
+		}
+		threads.swap(m_ClientThreads);
+	}
+	for (std::thread &t : threads) {
+		t.join();
+	}
+	if (m_SslCtx) {
+		SSL_CTX_free(m_SslCtx);
+	}
+}
+
+bool HostStubServer::startHttps(const char *certFile, const char *keyFile) {
+	m_SslCtx = SSL_CTX_new(TLS_server_method());
+	if (!m_SslCtx || SSL_CTX_use_certificate_file(m_SslCtx, certFile, SSL_FILETYPE_PEM) != 1 ||
+	    SSL_CTX_use_PrivateKey_file(m_SslCtx, keyFile, SSL_FILETYPE_PEM) != 1) {
+		ERR_print_errors_fp(stderr);
+		return false;
+	}
+
+	m_Https.https = true;
+	if (!listenOn(m_Https, m_HttpsPort)) {
+		return false;
+	}
+	m_Https.thread = std::thread(&HostStubServer::acceptLoop, this, &m_Https);
+	return true;
+}
+
+void HostStubServer::setHandler(Handler handler) {
+	std::lock_guard<std::mutex> lock(m_Lock);
+	m_Handler = std::move(handler);
+}
+
+bool HostStubServer::listenOn(Listener &listener, unsigned short &port) {
+	listener.fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (listener.fd < 0) {
+		return false;
+	}
+
+	sockaddr_in addr = {};
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t len = sizeof(addr);
+	if (bind(listener.fd, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(listener.fd, 16) != 0 ||
+	    getsockname(listener.fd, (sockaddr *)&addr, &len) != 0) {
+		close(listener.fd);
+		listener.fd = -1;
+		return false;
+	}
+	port = ntohs(addr.sin_port);
+	return true;
+}
+
+void HostStubServer::acceptLoop(Listener *listener) {
+	while (!m_Stopping.load()) {
+		int fd = accept(listener->fd, nullptr, nullptr);
+		if (fd < 0) {
+			continue;
+		}
+		m_Connections++;
+
+		std::lock_guard<std::mutex> lock(m_Lock);
+		if (m_Stopping.load()) {
+			close(fd);
+			break;
+		}
+		m_ClientFds.push_back(fd);
+		m_ClientThreads.emplace_back(&HostStubServer::serve, this, fd, listener->https);
+	}
+}
+
+HostStubServer::Response HostStubServer::handle(const Request &request) {
+	Handler handler;
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		handler = m_Handler;
+	}
+	return handler(request);
+}
+
+static const char *reason(int status) {
+	switch (status) {
+	case 200:
+		return "OK";
+	case 304:
+		return "Not Modified";
+	case 404:
+		return "Not Found";
+	default:
+		return "Error";
+	}
+}
+
+// One connection, answering requests until the client closes it
+void HostStubServer::serve(int fd, bool https) {
+	SSL *ssl = nullptr;
+	if (https) {
+		ssl = SSL_new(m_SslCtx);
+		SSL_set_fd(ssl, fd);
+		if (SSL_accept(ssl) != 1) {
+			SSL_free(ssl);
+			ssl = nullptr;
+		}
+	}
+
+	std::string buffer;
+	char chunk[4096];
+	while (!https || ssl) {
+		size_t end = buffer.find("\r\n\r\n");
+		if (end == std::string::npos) {
+			int n = ssl ? SSL_read(ssl, chunk, sizeof(chunk)) : (int)recv(fd, chunk, sizeof(chunk), 0);
+			if (n <= 0) {
+				break;
+			}
+			buffer.append(chunk, n);
+			continue;
+		}
+
+		// GET only, so a request ends with its headers
+		const std::string head = buffer.substr(0, end);
+		buffer.erase(0, end + 4);
+
+		Request request;
+		request.https = https;
+		const size_t pathStart = head.find(' ') + 1;
+		const std::string target = head.substr(pathStart, head.find(' ', pathStart) - pathStart);
+		const size_t queryStart = target.find('?');
+		request.path = target.substr(0, queryStart);
+		request.query = queryStart == std::string::npos ? "" : target.substr(queryStart + 1);
+		for (size_t line = head.find("\r\n"); line != std::string::npos; line = head.find("\r\n", line + 2)) {
+			static const char IF_NONE_MATCH[] = "If-None-Match:";
+			if (!strncasecmp(head.c_str() + line + 2, IF_NONE_MATCH, sizeof(IF_NONE_MATCH) - 1)) {
+				const size_t value = head.find_first_not_of(' ', line + 2 + sizeof(IF_NONE_MATCH) - 1);
+				request.ifNoneMatch = head.substr(value, head.find("\r\n", value) - value);
+			}
+		}
+
+		m_Requests++;
+		const Response response = handle(request);
+		const std::string &body = response.status == 304 ? std::string() : response.body;
+		std::string out = "HTTP/1.1 " + std::to_string(response.status) + " " + reason(response.status) + "\r\n";
+		if (!response.etag.empty()) {
+			out += "ETag: " + response.etag + "\r\n";
+		}
+		out += "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+		int written = ssl ? SSL_write(ssl, out.data(), (int)out.size()) : (int)send(fd, out.data(), out.size(), MSG_NOSIGNAL);
+		if (written != (int)out.size()) {
+			break;
+		}
+	}
+
+	if (ssl) {
+		SSL_free(ssl);
+	}
+	std::lock_guard<std::mutex> lock(m_Lock);
+	m_ClientFds.erase(std::find(m_ClientFds.begin(), m_ClientFds.end(), fd));
+	close(fd);
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef struct ssl_ctx_st SSL_CTX;
+
+// A GameStream host on loopback for the libgamestream tests. It speaks HTTP/1.1 with keep-alive
+// on one port and, once given a certificate, HTTPS on a second one. Every request is answered by
+// the handler, and the connections accepted and requests served are counted so a test can tell a
+// reused connection from a new one. POSIX sockets, so not built on Windows.
+class HostStubServer {
+  public:
+	struct Request {
+		bool https;
+		std::string path;  // without the query
+		std::string query;
+		std::string ifNoneMatch;
+	};
+
+	struct Response {
+		int status = 200;
+		std::string body;
+		std::string etag;
+	};
+
+	typedef std::function<Response(const Request &)> Handler;
+
+	explicit HostStubServer(Handler handler);
+	~HostStubServer();
+
+	// Serves HTTPS with the PEM certificate and key, false if they can't be loaded
+	bool startHttps(const char *certFile, const char *keyFile);
+
+	unsigned short httpPort() const { return m_HttpPort; }
+	unsigned short httpsPort() const { return m_HttpsPort; }
+
+	int connections() const { return m_Connections.load(); }
+	int requests() const { return m_Requests.load(); }
+
+	void setHandler(Handler handler);
+
+  private:
+	struct Listener {
+		int fd = -1;
+		bool https = false;
+		std::thread thread;
+	};
+
+	bool listenOn(Listener &listener, unsigned short &port);
+	void acceptLoop(Listener *listener);
+	void serve(int fd, bool https);
+	Response handle(const Request &request);
+
+	Handler m_Handler;
+	std::mutex m_Lock;
+	SSL_CTX *m_SslCtx = nullptr;
+	Listener m_Http, m_Https;
+	unsigned short m_HttpPort = 0, m_HttpsPort = 0;
+	std::atomic<bool> m_Stopping{false};
+	std::atomic<int> m_Connections{0};
+	std::atomic<int> m_Requests{0};
+	std::vector<int> m_ClientFds;
+	std::vector<std::thread> m_ClientThreads;
+};
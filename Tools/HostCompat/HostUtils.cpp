@@ -0,0 +1,34 @@
+#include "pch.h"
+#include "Utils.hpp"
+
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+
+static int64_t steadyQpcNow() {
+	using namespace std::chrono;
+	return duration_cast<duration<int64_t, std::ratio<1, 10000000>>>(steady_clock::now().time_since_epoch()).count();
+}
+
+int64_t (*g_HostQpcNow)() = steadyQpcNow;
+bool g_HostIsXbox = false;
+bool g_HostVerbose = false;
+
+namespace moonlight_xbox_dx {
+	namespace Utils {
+		void Log(const char* msg) {
+			if (g_HostVerbose) {
+				fputs(msg, stderr);
+			}
+		}
+
+		void Logf(const char* msg, ...) {
+			if (g_HostVerbose) {
+				va_list args;
+				va_start(args, msg);
+				vfprintf(stderr, msg, args);
+				va_end(args);
+			}
+		}
+	}
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+// The slice of moonlight-common-c's Limelight.h the host tools need. Names follow the real
+// header, only the fields the tools use are here.
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Video decode units, as handed to DECODER_RENDERER_CALLBACKS::submitDecodeUnit
+#define BUFFER_TYPE_PICDATA 0x00
+#define BUFFER_TYPE_SPS 0x01
+#define BUFFER_TYPE_PPS 0x02
+#define BUFFER_TYPE_VPS 0x03
+
+typedef struct _LENTRY {
+	struct _LENTRY *next;
+	char *data;
+	int length;
+	int bufferType;
+} LENTRY, *PLENTRY;
+
+#define FRAME_TYPE_PFRAME 0x00
+#define FRAME_TYPE_IDR 0x01
+
+typedef struct _DECODE_UNIT {
+	int frameNumber;
+	int frameType;
+	uint16_t frameHostProcessingLatency;
+	uint64_t receiveTimeUs;
+	uint64_t enqueueTimeUs;
+	uint32_t rtpTimestamp;
+	int fullLength;
+	PLENTRY bufferList;
+} DECODE_UNIT, *PDECODE_UNIT;
+
+// What libgamestream fills in and hands to LiStartConnection
+#define SCM_H264 0x00001
+#define VIDEO_FORMAT_MASK_10BIT 0xAA00
+
+typedef struct _SERVER_INFORMATION {
+	const char *address;
+	const char *serverInfoAppVersion;
+	const char *serverInfoGfeVersion;
+	const char *rtspSessionUrl;
+	int serverCodecModeSupport;
+} SERVER_INFORMATION, *PSERVER_INFORMATION;
+
+typedef struct _STREAM_CONFIGURATION {
+	int width;
+	int height;
+	int fps;
+	int bitrate;
+	int packetSize;
+	int streamingRemotely;
+	int audioConfiguration;
+	int supportedVideoFormats;
+	int clientRefreshRateX100;
+	int colorSpace;
+	int colorRange;
+	int encryptionFlags;
+	char remoteInputAesKey[16];
+	char remoteInputAesIv[16];
+} STREAM_CONFIGURATION, *PSTREAM_CONFIGURATION;
+
+#define SURROUNDAUDIOINFO_FROM_AUDIO_CONFIGURATION(x) (((x) >> 16) & 0xFFFF) | ((((x) >> 8) & 0xFF) << 16)
+
+void LiInitializeServerInformation(PSERVER_INFORMATION serverInfo);
+const char *LiGetLaunchUrlQueryParameters(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,13 @@
+#pragma once
+#include "pch.h"
+
+// The logging half of the app's Utils.hpp. Logs go to stderr when g_HostVerbose is set.
+
+extern bool g_HostVerbose;
+
+namespace moonlight_xbox_dx {
+	namespace Utils {
+		void Log(const char* msg);
+		void Logf(const char* msg, ...);
+	}
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+// The slice of AVFrame the pacing code touches, implemented by HostAv.cpp, and the packet padding
+// DecodeUnitBuffer adds.
+
+#include <atomic>
+#include <cstdint>
+#include "../libavutil/buffer.h"
+
+#define AV_INPUT_BUFFER_PADDING_SIZE 64
+
+enum AVPictureType {
+	AV_PICTURE_TYPE_NONE = 0,
+	AV_PICTURE_TYPE_I,
+	AV_PICTURE_TYPE_P,
+};
+
+typedef struct AVFrame {
+	int64_t pts;
+	enum AVPictureType pict_type;
+	int format;
+	AVBufferRef *opaque_ref;
+} AVFrame;
+
+// Host only, AVFrames allocated so far and how many haven't been freed
+extern std::atomic<uint64_t> g_HostAvFrameAllocs;
+extern std::atomic<int64_t> g_HostAvFramesLive;
+
+AVFrame *av_frame_alloc(void);
+void av_frame_free(AVFrame **frame);
+void av_frame_unref(AVFrame *frame);
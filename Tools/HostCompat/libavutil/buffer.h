@@ -0,0 +1,37 @@
+#pragma once
+
+// The slice of libavutil/buffer.h FramePool and DecodeUnitBench use, implemented by HostAv.cpp.
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+
+#define AVERROR(e) (-(e))
+
+typedef struct AVBufferPool AVBufferPool;
+
+typedef struct AVBufferRef {
+	uint8_t *data;
+	size_t size;
+	AVBufferPool *pool; // set while the buffer belongs to a pool
+	void (*free)(void *opaque, uint8_t *data);
+	void *opaque;
+} AVBufferRef;
+
+#define AV_BUFFER_FLAG_READONLY (1 << 0)
+
+// Host only, heap allocations made for buffer data so far and how many are still allocated
+extern std::atomic<uint64_t> g_HostAvBufferAllocs;
+extern std::atomic<int64_t> g_HostAvBuffersLive;
+
+AVBufferRef *av_buffer_alloc(size_t size);
+AVBufferRef *av_buffer_create(uint8_t *data, size_t size, void (*free)(void *opaque, uint8_t *data), void *opaque,
+                              int flags);
+void av_buffer_unref(AVBufferRef **buf);
+
+AVBufferPool *av_buffer_pool_init2(size_t size, void *opaque,
+                                   AVBufferRef *(*alloc)(void *opaque, size_t size),
+                                   void (*pool_free)(void *opaque));
+AVBufferRef *av_buffer_pool_get(AVBufferPool *pool);
+void av_buffer_pool_uninit(AVBufferPool **pool);
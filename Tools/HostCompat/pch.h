@@ -0,0 +1,112 @@
+#pragma once
+
+// Stands in for the app's pch.h when Streaming/ code is built on a desktop OS by Tools/CMakeLists.txt.
+//
+// Only what the portable parts of the streaming code need is here: the QPC helpers, with QPC
+// replaced by a hook the tool can point at a virtual clock, the logging and Xbox helpers, and
+// stand-ins for the handful of Win32 calls they make.
+// The time helpers must stay identical to the ones in the app's pch.h.
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#define interface struct
+
+// Time helpers, 10MHz like the QPC on Xbox
+extern int64_t (*g_HostQpcNow)();
+
+static inline int64_t QpcFreq() {
+	return INT64_C(10000000);
+}
+
+static inline int64_t QpcNow() {
+	return g_HostQpcNow();
+}
+
+static inline int64_t UsToQpc(int64_t us) {
+	const int64_t f = QpcFreq();
+	return (us / INT64_C(1000000)) * f +
+	       (us % INT64_C(1000000)) * f / INT64_C(1000000);
+}
+
+static inline int64_t QpcToUs(int64_t qpc) {
+	const int64_t f = QpcFreq();
+	int64_t q = qpc / f;
+	int64_t r = qpc % f;
+	if (r < 0) {
+		--q;
+		r += f;
+	}
+	return q * INT64_C(1000000) + (r * INT64_C(1000000)) / f;
+}
+
+static inline double QpcToMsD(double qpc) {
+	return qpc * 1000.0 / (double)QpcFreq();
+}
+
+static inline double QpcToMs(int64_t qpc) {
+	return QpcToMsD(static_cast<double>(qpc));
+}
+
+static inline int64_t MsToQpc(double ms) {
+	const double us_d = ms * 1000.0;
+	const int64_t us = static_cast<int64_t>(us_d >= 0.0 ? us_d + 0.5 : us_d - 0.5);
+	return UsToQpc(us);
+}
+
+// Log something only once, safe to use in hot areas of the code
+#define CONCAT(a, b)   CONCAT2(a, b)
+#define CONCAT2(a, b)  a##b
+#define LogOnce(fmt, ...)                                    \
+    do {                                                     \
+        static std::once_flag CONCAT(_onceFlag_, __LINE__);  \
+        std::call_once(CONCAT(_onceFlag_, __LINE__), [&] {   \
+            moonlight_xbox_dx::Utils::Logf(fmt, ##__VA_ARGS__); \
+        });                                                  \
+    } while (0)
+
+#define FQLog(fmt, ...) do {} while(0)
+
+// The few Win32 calls made by the portable code
+#define THREAD_PRIORITY_BELOW_NORMAL (-1)
+#define THREAD_PRIORITY_ABOVE_NORMAL 1
+
+#define ZeroMemory(dst, length) memset((dst), 0, (length))
+
+static inline void *GetCurrentThread() {
+	return nullptr;
+}
+
+static inline bool SetThreadPriority(void *, int) {
+	return true;
+}
+
+static inline uint32_t GetLastError() {
+	return 0;
+}
+
+static inline uint32_t GetCurrentThreadId() {
+	return static_cast<uint32_t>(std::hash<std::thread::id>()(std::this_thread::get_id()));
+}
+
+static inline int fopen_s(FILE **file, const char *path, const char *mode) {
+	*file = fopen(path, mode);
+	return *file ? 0 : errno;
+}
+
+// Xbox helpers, the tool decides which console it is pretending to be
+extern bool g_HostIsXbox;
+
+static inline bool IsXbox() {
+	return g_HostIsXbox;
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+// The app's miniaudio, with only the parts the host tools use. Whichever tool needs the
+// implementation defines MINIAUDIO_IMPLEMENTATION before including it, as AudioPlayer.cpp does.
+
+#define MA_NO_DEVICE_IO
+#define MA_NO_DECODING
+#define MA_NO_ENCODING
+#define MA_NO_GENERATION
+#include "../../../third_party/miniaudio.h"
@@ -0,0 +1,634 @@
+// Headless frame pacing simulator
+//
+// Runs the real Pacer, FrameQueue, FrameCadence, JitterBuffer and FramePool against a virtual
+// clock, a synthetic display and a synthetic decoder, then reports how the frames landed on the
+// display. Everything runs on one thread in virtual time, so a given set of options always
+// produces the same result and a minute of streaming takes a fraction of a second.
+//
+// The three threads of the app are modelled as events on the virtual clock:
+//   * decoder: frame N is sent by the host at N / fps, arrives after the base latency plus
+//     jitter (or a per-frame delay read from --trace), in order, and is decoded one at a time
+//     before Pacer::submitFrame()
+//   * vsyncHardware: the display fires a vblank every 1 / hz, scans out the latest Present()
+//     and then calls Pacer's vblank callback
+//   * render loop: the same loop as moonlight_xbox_dxMain, blocking calls run the clock
+//     forward, which is when the other two get to run
+//
+// usage: pacer-sim [--hz 59.94] [--fps 60] [--seconds 30] [--mode all|immediate|display-locked|adaptive]
+//                  [--jitter-ms 0] [--latency-ms 5] [--loss 0] [--trace file] [--decode-ms 2]
+//                  [--render-ms 3] [--present-ms 0.5] [--seed 1] [--max-hold 0]
+//                  [--record prefix] [--xbox] [--verbose]
+//
+// --record writes a pacing trace of each mode to <prefix>-<mode>.mlpt, for Tools/PacingReplay.
+//
+// --max-hold makes the run fail if any frame stays on screen for more than that many vblanks, so
+// ctest can catch a mode that stalls.
+//
+// A trace file has one line per frame, either the network delay of the frame in ms or "lost".
+// Blank lines and lines starting with # are skipped, and the trace repeats until --seconds runs out.
+
+#include "pch.h"
+#include "Utils.hpp"
+
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include "../../Streaming/FramePool.h"
+#include "../../Streaming/FrameQueue.h"
+#include "../../Streaming/Pacer.h"
+#include "../../Streaming/PacingTrace.h"
+
+// Virtual clock, a deterministic discrete event scheduler
+
+class SimClock : public IPacerClock {
+  public:
+	explicit SimClock(int64_t startQpc) : m_Now(startQpc) {}
+
+	int64_t now() override {
+		return m_Now;
+	}
+
+	void sleepUntil(int64_t targetQpc) override {
+		runUntil(targetQpc, nullptr);
+	}
+
+	std::unique_ptr<IPacerEvent> createEvent() override;
+
+	// Events at the same time run in the order they were scheduled
+	void schedule(int64_t atQpc, std::function<void()> fn) {
+		m_Queue.push(Item{std::max(atQpc, m_Now), m_Seq++, std::move(fn)});
+	}
+
+	// Runs events up to targetQpc, or until *stop is set. Returns true if *stop was set.
+	// A targetQpc of 0 runs until *stop is set or no events are left.
+	bool runUntil(int64_t targetQpc, const bool *stop) {
+		const int64_t limit = targetQpc ? targetQpc : INT64_MAX;
+		while (!(stop && *stop)) {
+			if (m_Queue.empty() || m_Queue.top().at > limit) {
+				if (targetQpc && targetQpc > m_Now) {
+					m_Now = targetQpc;
+				}
+				return false;
+			}
+			Item item = m_Queue.top();
+			m_Queue.pop();
+			m_Now = item.at;
+			item.fn();
+		}
+		return true;
+	}
+
+  private:
+	struct Item {
+		int64_t at;
+		uint64_t seq;
+		std::function<void()> fn;
+	};
+
+	struct Later {
+		bool operator()(const Item &a, const Item &b) const {
+			return a.at != b.at ? a.at > b.at : a.seq > b.seq;
+		}
+	};
+
+	std::priority_queue<Item, std::vector<Item>, Later> m_Queue;
+	int64_t m_Now;
+	uint64_t m_Seq = 0;
+};
+
+class SimEvent : public IPacerEvent {
+  public:
+	explicit SimEvent(SimClock &clock) : m_Clock(clock) {}
+
+	void set() override {
+		m_Set = true;
+	}
+
+	bool waitUntil(int64_t deadlineQpc) override {
+		if (!m_Set) {
+			m_Clock.runUntil(deadlineQpc, &m_Set);
+		}
+		const bool wasSet = m_Set;
+		m_Set = false;
+		return wasSet;
+	}
+
+  private:
+	SimClock &m_Clock;
+	bool m_Set = false;
+};
+
+std::unique_ptr<IPacerEvent> SimClock::createEvent() {
+	return std::make_unique<SimEvent>(*this);
+}
+
+static SimClock *s_CurrentClock = nullptr;
+
+static int64_t simQpcNow() {
+	return s_CurrentClock->now();
+}
+
+// Synthetic display, flips to the latest Present() at each vblank
+
+class SimDisplay : public IVsyncSource {
+  public:
+	SimDisplay(SimClock &clock, double hz) : m_Clock(clock), m_PeriodQpc(QpcFreq() / hz) {}
+
+	void start(std::function<void()> onVBlank) override {
+		m_OnVBlank = std::move(onVBlank);
+		m_Running = true;
+		m_FirstVBlankQpc = m_Clock.now() + static_cast<int64_t>(m_PeriodQpc);
+		scheduleNext();
+	}
+
+	void stop() override {
+		m_Running = false;
+	}
+
+	bool lastVBlank(VsyncSample *sample) override {
+		if (!m_RefreshCount) {
+			return false;
+		}
+		sample->refreshCount = m_RefreshCount;
+		sample->qpc = m_LastVBlankQpc;
+		return true;
+	}
+
+	// Shown from the first vblank at or after presentQpc. Pacer aims Present() at the vblank
+	// itself, so a present on the vblank tick still makes it even though the vblank event ran first.
+	void present(int frameIndex, int64_t presentQpc) {
+		if (m_PendingIndex >= 0 && m_PendingIndex != frameIndex && m_PendingIndex != m_ShownIndex) {
+			++m_Overwritten;
+		}
+		if (m_RefreshCount && presentQpc == m_LastVBlankQpc) {
+			m_ShownIndex = frameIndex;
+			m_Scanout.back() = frameIndex;
+		}
+		m_PendingIndex = frameIndex;
+		m_PendingQpc = presentQpc;
+	}
+
+	// Frame on screen during each vblank, -1 before the first frame
+	const std::vector<int> &scanout() const {
+		return m_Scanout;
+	}
+	const std::vector<int64_t> &scanoutQpc() const {
+		return m_ScanoutQpc;
+	}
+	int overwritten() const {
+		return m_Overwritten;
+	}
+
+  private:
+	void scheduleNext() {
+		const int64_t at = m_FirstVBlankQpc + std::llround(m_RefreshCount * m_PeriodQpc);
+		m_Clock.schedule(at, [this] { vblank(); });
+	}
+
+	void vblank() {
+		if (!m_Running) {
+			return;
+		}
+
+		++m_RefreshCount;
+		m_LastVBlankQpc = m_Clock.now();
+
+		if (m_PendingIndex >= 0 && m_PendingQpc < m_LastVBlankQpc) {
+			m_ShownIndex = m_PendingIndex;
+		}
+		m_Scanout.push_back(m_ShownIndex);
+		m_ScanoutQpc.push_back(m_LastVBlankQpc);
+
+		scheduleNext();
+		m_OnVBlank();
+	}
+
+	SimClock &m_Clock;
+	const double m_PeriodQpc;
+	std::function<void()> m_OnVBlank;
+	bool m_Running = false;
+	int64_t m_FirstVBlankQpc = 0;
+	uint32_t m_RefreshCount = 0;
+	int64_t m_LastVBlankQpc = 0;
+
+	int m_PendingIndex = -1;
+	int64_t m_PendingQpc = 0;
+	int m_ShownIndex = -1;
+	int m_Overwritten = 0;
+	std::vector<int> m_Scanout;
+	std::vector<int64_t> m_ScanoutQpc;
+};
+
+class SimStats : public IPacerStats {
+  public:
+	void frameQueued(int droppedFrames, int) override {
+		queueDrops += droppedFrames;
+	}
+	void jitterBufferTarget(int targetDepth) override {
+		maxJitterTarget = std::max(maxJitterTarget, targetDepth);
+	}
+	void frameSkipped() override {
+		++pacerSkips;
+	}
+	void frameRendered(int64_t) override {
+		++rendered;
+	}
+	void framePresented(const MLFrameTimeline &timeline) override {
+		++presented;
+		decodeToRenderMs.push_back(QpcToMs(timeline.renderStartQpc - timeline.decodeStartQpc) - decodeMs);
+	}
+
+	int queueDrops = 0;
+	int pacerSkips = 0;
+	int rendered = 0;
+	int presented = 0;
+	int maxJitterTarget = 0;
+	double decodeMs = 0.0;
+	std::vector<double> decodeToRenderMs;
+};
+
+class SimRenderer : public IFrameRenderer {
+  public:
+	SimRenderer(SimClock &clock, int64_t costQpc) : m_Clock(clock), m_CostQpc(costQpc) {}
+
+	bool Render(AVFrame *) override {
+		m_Clock.sleepUntil(m_Clock.now() + m_CostQpc);
+		return true;
+	}
+
+  private:
+	SimClock &m_Clock;
+	int64_t m_CostQpc;
+};
+
+// splitmix64, so runs don't depend on the standard library's generators
+class SimRandom {
+  public:
+	explicit SimRandom(uint64_t seed) : m_State(seed) {}
+
+	double uniform() {
+		uint64_t z = (m_State += 0x9E3779B97F4A7C15ull);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+		z ^= z >> 31;
+		return (z >> 11) * (1.0 / 9007199254740992.0);
+	}
+
+  private:
+	uint64_t m_State;
+};
+
+struct SimOptions {
+	double hz = 59.94;
+	int fps = 60;
+	double seconds = 30.0;
+	std::string mode = "all";
+	double latencyMs = 5.0;
+	double jitterMs = 0.0;
+	double loss = 0.0;
+	std::string trace;
+	double decodeMs = 2.0;
+	double renderMs = 3.0;
+	double presentMs = 0.5;
+	uint64_t seed = 1;
+	int maxHold = 0;
+	std::string record;
+};
+
+struct SimFrame {
+	int number;
+	int64_t pts;
+	bool lost;
+	int lostBefore;
+	int64_t arrivalQpc;
+	int64_t decodeStartQpc;
+	int64_t decodeEndQpc;
+};
+
+static bool loadTrace(const std::string &path, std::vector<double> *delays) {
+	std::ifstream in(path);
+	if (!in) {
+		return false;
+	}
+	std::string line;
+	while (std::getline(in, line)) {
+		size_t start = line.find_first_not_of(" \t\r");
+		if (start == std::string::npos || line[start] == '#') {
+			continue;
+		}
+		// NaN marks a lost frame
+		delays->push_back(line.compare(start, 4, "lost") == 0 ? NAN : atof(line.c_str() + start));
+	}
+	return !delays->empty();
+}
+
+static std::vector<SimFrame> buildSchedule(const SimOptions &opt, const std::vector<double> &trace, int64_t startQpc) {
+	SimRandom rng(opt.seed);
+	const int count = static_cast<int>(opt.seconds * opt.fps);
+	const int64_t decodeQpc = MsToQpc(opt.decodeMs);
+
+	std::vector<SimFrame> frames;
+	frames.reserve(count);
+	int64_t lastArrival = 0, lastDecodeEnd = 0;
+	int lostBefore = 0;
+	for (int i = 1; i <= count; ++i) {
+		SimFrame f{};
+		f.number = i;
+		f.pts = (static_cast<int64_t>(i) * 90000) / opt.fps;
+
+		double delayMs;
+		if (!trace.empty()) {
+			delayMs = trace[(i - 1) % trace.size()];
+			f.lost = std::isnan(delayMs);
+		} else {
+			// exponential jitter with a mean of --jitter-ms on top of the base latency
+			delayMs = opt.latencyMs - opt.jitterMs * std::log(1.0 - rng.uniform());
+			f.lost = rng.uniform() < opt.loss;
+		}
+
+		if (f.lost) {
+			++lostBefore;
+		} else {
+			const int64_t sendQpc = startQpc + (static_cast<int64_t>(i) * QpcFreq()) / opt.fps;
+			f.arrivalQpc = std::max(sendQpc + MsToQpc(delayMs), lastArrival); // in order delivery
+			f.decodeStartQpc = std::max(f.arrivalQpc, lastDecodeEnd);
+			f.decodeEndQpc = f.decodeStartQpc + decodeQpc;
+			f.lostBefore = lostBefore;
+			lastArrival = f.arrivalQpc;
+			lastDecodeEnd = f.decodeEndQpc;
+			lostBefore = 0;
+		}
+		frames.push_back(f);
+	}
+	return frames;
+}
+
+static double percentile(std::vector<double> v, double q) {
+	if (v.empty()) {
+		return 0.0;
+	}
+	std::sort(v.begin(), v.end());
+	size_t i = std::min(v.size() - 1, static_cast<size_t>(q * v.size()));
+	return v[i];
+}
+
+static void printLatency(const char *name, const std::vector<double> &v) {
+	printf("  %-20s p50 %6.2f  p95 %6.2f  p99 %6.2f  max %6.2f ms\n", name,
+	       percentile(v, 0.50), percentile(v, 0.95), percentile(v, 0.99), percentile(v, 1.0));
+}
+
+static bool runMode(const SimOptions &opt, FramePacingMode mode, const char *modeName, const std::vector<double> &trace) {
+	const int64_t startQpc = QpcFreq() * 10;
+	auto clock = std::make_shared<SimClock>(startQpc);
+	s_CurrentClock = clock.get();
+	g_HostQpcNow = simQpcNow;
+
+	auto display = std::make_shared<SimDisplay>(*clock, opt.hz);
+	auto stats = std::make_shared<SimStats>();
+	stats->decodeMs = opt.decodeMs;
+	SimRenderer renderer(*clock, MsToQpc(opt.renderMs));
+	const int64_t presentQpc = MsToQpc(opt.presentMs);
+
+	const std::vector<SimFrame> frames = buildSchedule(opt, trace, startQpc);
+	int sent = 0, lost = 0;
+
+	if (!opt.record.empty()) {
+		PacingTrace::instance().requestRecording(opt.record + "-" + modeName + ".mlpt");
+	}
+
+	Pacer &pacer = Pacer::instance();
+	FramePool::instance().init(FrameQueue::instance().maxCapacity() + 3);
+	pacer.init(PacerSources{clock, display, stats}, opt.fps, opt.hz, mode);
+
+	bool firstFrame = true;
+	for (const SimFrame &f : frames) {
+		++sent;
+		if (f.lost) {
+			++lost;
+			continue;
+		}
+		const bool idr = firstFrame;
+		firstFrame = false;
+		clock->schedule(f.decodeEndQpc, [&pacer, &f, idr] {
+			PTrace(PTRACE_DU_ARRIVAL, f.number, 0, f.arrivalQpc);
+			PTrace(PTRACE_DECODE_START, f.number, 0, f.decodeStartQpc);
+
+			AVFrame *frame = FramePool::instance().acquire();
+			frame->pts = f.pts;
+			frame->pict_type = idr ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_P;
+
+			MLFrameTimeline timeline{};
+			timeline.receiveQpc = f.arrivalQpc;
+			timeline.decodeStartQpc = f.decodeStartQpc;
+			FramePool::instance().attachUserData(frame, f.decodeEndQpc, timeline);
+			PTrace(PTRACE_DECODE_END, f.pts, f.number, f.decodeEndQpc);
+
+			if (f.lostBefore) {
+				pacer.observeNetworkLoss(f.lostBefore);
+			}
+			pacer.submitFrame(frame);
+		});
+	}
+
+	// moonlight_xbox_dxMain's render loop
+	const int64_t endQpc = startQpc + static_cast<int64_t>(opt.seconds * QpcFreq()) + MsToQpc(100.0);
+	const double bufferMs = 1.5, alphaUp = 0.25, alphaDown = 0.05;
+	double ewmaRenderMs = 3.0;
+	int deadlineMisses = 0;
+	while (clock->now() < endQpc) {
+		int64_t t0 = 0;
+		int64_t deadline = pacer.getNextVBlankQpc(&t0);
+
+		double maxWaitMs = std::max(0.0, QpcToMs(deadline - t0) - ewmaRenderMs - bufferMs);
+		pacer.waitForFrame(maxWaitMs);
+
+		int64_t t1 = clock->now();
+		bool rendered = pacer.renderOnMainThread(renderer);
+		int64_t t2 = clock->now();
+
+		bool hitDeadline = pacer.waitBeforePresent(deadline);
+		if (!rendered) {
+			continue;
+		}
+		if (!hitDeadline) {
+			++deadlineMisses;
+		}
+
+		// Present() blocks for a while, the flip happens at the first vblank after the call
+		const int64_t pts = pacer.getCurrentFramePts();
+		display->present(static_cast<int>(std::llround(pts * opt.fps / 90000.0)), clock->now());
+		clock->sleepUntil(clock->now() + presentQpc);
+		PTrace(PTRACE_PRESENT, pts, 0, clock->now());
+		pacer.framePresented(clock->now());
+
+		double renderMs = std::clamp(QpcToMs(t2 - t1), 0.0, QpcToMs(deadline - t0));
+		double alpha = (renderMs > ewmaRenderMs) ? alphaUp : alphaDown;
+		ewmaRenderMs = (renderMs * alpha) + (ewmaRenderMs * (1.0 - alpha));
+	}
+
+	pacer.deinit();
+	FramePool::instance().deinit();
+
+	// How long each frame stayed on screen, in vblanks. The last run is cut short by the end of the
+	// simulation so it isn't counted.
+	const std::vector<int> &scanout = display->scanout();
+	const std::vector<int64_t> &scanoutQpc = display->scanoutQpc();
+	std::map<int, int> holds;
+	std::vector<double> glassMs;
+	int displayed = 0;
+	for (size_t i = 0; i < scanout.size();) {
+		size_t j = i;
+		while (j < scanout.size() && scanout[j] == scanout[i]) {
+			++j;
+		}
+		if (scanout[i] >= 1) {
+			++displayed;
+			const SimFrame &f = frames[scanout[i] - 1];
+			glassMs.push_back(QpcToMs(scanoutQpc[i] - f.arrivalQpc));
+			if (j < scanout.size()) {
+				holds[static_cast<int>(j - i)]++;
+			}
+		}
+		i = j;
+	}
+
+	const double ratio = opt.hz / opt.fps;
+	const int minHold = std::max(1, static_cast<int>(std::floor(ratio + 1e-3)));
+	const int maxHold = std::max(1, static_cast<int>(std::ceil(ratio - 1e-3)));
+	int judder = 0;
+	for (const auto &h : holds) {
+		if (h.first < minHold || h.first > maxHold) {
+			judder += h.second;
+		}
+	}
+
+	printf("%s: %.2fHz display, %dfps stream, %.0fs, latency %.1fms, jitter %.1fms, loss %.2f%%%s\n",
+	       modeName, opt.hz, opt.fps, opt.seconds, opt.latencyMs, opt.jitterMs, opt.loss * 100.0,
+	       trace.empty() ? "" : ", from trace");
+	printf("  frames               %d sent, %d lost, %d queue drops, %d pacer skips, %d rendered, %d presented, %d overwritten, %d displayed\n",
+	       sent, lost, stats->queueDrops, stats->pacerSkips, stats->rendered, stats->presented,
+	       display->overwritten(), displayed);
+	printf("  holds (vblanks)     ");
+	for (const auto &h : holds) {
+		printf(" %d:%d", h.first, h.second);
+	}
+	printf("\n");
+	printf("  judder               %d holds outside %d..%d vblanks, %d frames never displayed\n",
+	       judder, minHold, maxHold, sent - lost - displayed);
+	printLatency("queue residency", stats->decodeToRenderMs);
+	printLatency("arrival to glass", glassMs);
+	printf("  deadline misses      %d", deadlineMisses);
+	if (mode == FRAME_PACING_ADAPTIVE) {
+		printf(", jitter buffer peaked at %d frames", stats->maxJitterTarget);
+	}
+	printf("\n");
+
+	const int longestHold = holds.empty() ? 0 : holds.rbegin()->first;
+	if (opt.maxHold && (longestHold > opt.maxHold || !displayed)) {
+		printf("  FAILED: longest hold %d vblanks, limit %d\n", longestHold, opt.maxHold);
+		return false;
+	}
+	return true;
+}
+
+static void usage() {
+	fprintf(stderr,
+	        "usage: pacer-sim [--hz 59.94] [--fps 60] [--seconds 30] [--mode all|immediate|display-locked|adaptive]\n"
+	        "                 [--jitter-ms 0] [--latency-ms 5] [--loss 0] [--trace file] [--decode-ms 2]\n"
+	        "                 [--render-ms 3] [--present-ms 0.5] [--seed 1] [--max-hold 0]\n"
+	        "                 [--record prefix] [--xbox] [--verbose]\n");
+}
+
+int main(int argc, char **argv) {
+	SimOptions opt;
+	for (int i = 1; i < argc; ++i) {
+		const char *arg = argv[i];
+		const char *val = i + 1 < argc ? argv[i + 1] : nullptr;
+		bool consumed = true;
+		if (!strcmp(arg, "--xbox")) {
+			g_HostIsXbox = true;
+			consumed = false;
+		} else if (!strcmp(arg, "--verbose")) {
+			g_HostVerbose = true;
+			consumed = false;
+		} else if (!val) {
+			usage();
+			return 2;
+		} else if (!strcmp(arg, "--hz")) {
+			opt.hz = atof(val);
+		} else if (!strcmp(arg, "--fps")) {
+			opt.fps = atoi(val);
+		} else if (!strcmp(arg, "--seconds")) {
+			opt.seconds = atof(val);
+		} else if (!strcmp(arg, "--mode")) {
+			opt.mode = val;
+		} else if (!strcmp(arg, "--latency-ms")) {
+			opt.latencyMs = atof(val);
+		} else if (!strcmp(arg, "--jitter-ms")) {
+			opt.jitterMs = atof(val);
+		} else if (!strcmp(arg, "--loss")) {
+			opt.loss = atof(val);
+		} else if (!strcmp(arg, "--trace")) {
+			opt.trace = val;
+		} else if (!strcmp(arg, "--decode-ms")) {
+			opt.decodeMs = atof(val);
+		} else if (!strcmp(arg, "--render-ms")) {
+			opt.renderMs = atof(val);
+		} else if (!strcmp(arg, "--present-ms")) {
+			opt.presentMs = atof(val);
+		} else if (!strcmp(arg, "--seed")) {
+			opt.seed = strtoull(val, nullptr, 10);
+		} else if (!strcmp(arg, "--max-hold")) {
+			opt.maxHold = atoi(val);
+		} else if (!strcmp(arg, "--record")) {
+			opt.record = val;
+		} else {
+			usage();
+			return 2;
+		}
+		if (consumed) {
+			++i;
+		}
+	}
+
+	if (opt.hz <= 0.0 || opt.fps <= 0 || opt.seconds <= 0.0) {
+		usage();
+		return 2;
+	}
+
+	std::vector<double> trace;
+	if (!opt.trace.empty() && !loadTrace(opt.trace, &trace)) {
+		fprintf(stderr, "pacer-sim: can't read trace %s\n", opt.trace.c_str());
+		return 1;
+	}
+
+	static const struct {
+		const char *name;
+		FramePacingMode mode;
+	} modes[] = {
+		{"immediate", FRAME_PACING_IMMEDIATE},
+		{"display-locked", FRAME_PACING_DISPLAY_LOCKED},
+		{"adaptive", FRAME_PACING_ADAPTIVE},
+	};
+
+	bool ran = false, ok = true;
+	for (const auto &m : modes) {
+		if (opt.mode == "all" || opt.mode == m.name) {
+			ok = runMode(opt, m.mode, m.name, trace) && ok;
+			ran = true;
+		}
+	}
+	if (!ran) {
+		usage();
+		return 2;
+	}
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,406 @@
+// Offline reader for the frame pacing traces written by PacingTrace
+//
+// Rebuilds each frame's path through the client from the trace records and prints where its
+// latency went, why frames were dropped and what made the render loop miss its present deadlines.
+//
+// usage: pacing-replay [--frames] trace.mlpt
+//
+// --frames also lists every frame and every missed deadline.
+//
+// Stages of a frame, all in ms:
+//   receive  first packet arrived -> decode started (reassembly and the decoder thread's backlog)
+//   decode   decode started -> decode finished
+//   queue    enqueued in FrameQueue -> dequeued by the render thread
+//   render   render started -> render finished
+//   wait     render finished -> Present(), the pacing wait for the vblank
+//   scanout  Present() -> the first vblank after it
+//   total    first packet arrived -> first vblank it was shown at
+//
+// Version 1 traces recorded PTRACE_DU_ARRIVAL at decode start, so their receive stage is empty.
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "../../Streaming/PacingTrace.h"
+
+struct FrameTrace {
+	int64_t pts = 0;
+	uint32_t number = 0;
+	int64_t arrivalQpc = 0;
+	int64_t decodeStartQpc = 0;
+	int64_t decodeEndQpc = 0;
+	int64_t enqueueQpc = 0;
+	int64_t dequeueQpc = 0;
+	int64_t renderStartQpc = 0;
+	int64_t renderEndQpc = 0;
+	int64_t presentQpc = 0;
+	int64_t scanoutQpc = 0;
+	uint32_t dropReason = 0;
+};
+
+struct DecodeUnitTrace {
+	int64_t arrivalQpc = 0;
+	int64_t decodeStartQpc = 0;
+};
+
+enum MissCause {
+	MISS_LOOP_LATE,
+	MISS_SLOW_RENDER,
+	MISS_SLOW_DECODE,
+	MISS_LATE_ARRIVAL,
+	MISS_CAUSE_COUNT
+};
+
+static const char *missCauseName(int cause) {
+	switch (cause) {
+	case MISS_SLOW_RENDER:
+		return "render took over half a vblank";
+	case MISS_SLOW_DECODE:
+		return "frame decoded too late, slow decode";
+	case MISS_LATE_ARRIVAL:
+		return "frame decoded too late, late arrival";
+	default:
+		return "render loop woke up too late";
+	}
+}
+
+static const char *dropReasonName(uint32_t reason) {
+	switch (reason) {
+	case PTRACE_DROP_NEWEST:
+		return "queue over high water mark, newest dropped";
+	case PTRACE_DROP_OLDEST:
+		return "queue over high water mark, oldest dropped";
+	case PTRACE_DROP_FULL:
+		return "queue full";
+	case PTRACE_DROP_FLUSH:
+		return "flushed at end of stream";
+	case PTRACE_DROP_CATCHUP:
+		return "skipped by Pacer to catch up";
+	default:
+		return "unknown";
+	}
+}
+
+static double percentile(std::vector<double> v, double q) {
+	if (v.empty()) {
+		return 0.0;
+	}
+	std::sort(v.begin(), v.end());
+	return v[std::min(v.size() - 1, static_cast<size_t>(q * v.size()))];
+}
+
+static void usage() {
+	fprintf(stderr, "usage: pacing-replay [--frames] trace.mlpt\n");
+}
+
+int main(int argc, char **argv) {
+	bool listFrames = false;
+	const char *path = nullptr;
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "--frames")) {
+			listFrames = true;
+		} else if (!path && argv[i][0] != '-') {
+			path = argv[i];
+		} else {
+			usage();
+			return 2;
+		}
+	}
+	if (!path) {
+		usage();
+		return 2;
+	}
+
+	FILE *file = fopen(path, "rb");
+	if (!file) {
+		fprintf(stderr, "pacing-replay: can't open %s\n", path);
+		return 1;
+	}
+
+	PacingTraceHeader header;
+	if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, "MLPT", 4) != 0) {
+		fprintf(stderr, "pacing-replay: %s is not a pacing trace\n", path);
+		fclose(file);
+		return 1;
+	}
+	if (header.version < 1 || header.version > PACING_TRACE_VERSION || header.qpcFreq <= 0) {
+		fprintf(stderr, "pacing-replay: unsupported trace version %u\n", header.version);
+		fclose(file);
+		return 1;
+	}
+
+	std::vector<PacingTraceRecord> records;
+	PacingTraceRecord rec;
+	while (fread(&rec, sizeof(rec), 1, file) == 1) {
+		records.push_back(rec);
+	}
+	fclose(file);
+
+	if (records.empty()) {
+		printf("%s: no records\n", path);
+		return 0;
+	}
+
+	// The writer drains the ring in claim order, which is close to but not exactly time order
+	std::stable_sort(records.begin(), records.end(),
+	                 [](const PacingTraceRecord &a, const PacingTraceRecord &b) { return a.qpc < b.qpc; });
+
+	const int64_t baseQpc = records.front().qpc;
+	auto toMs = [&](int64_t qpc) { return qpc * 1000.0 / header.qpcFreq; };
+
+	std::map<uint32_t, DecodeUnitTrace> units;
+	std::map<int64_t, FrameTrace> frames;
+	std::vector<int64_t> vblanks;
+	std::vector<std::pair<int64_t, uint32_t>> vsyncSamples;
+	std::map<uint32_t, int> drops;
+	int presents = 0;
+
+	for (const PacingTraceRecord &r : records) {
+		switch (r.event) {
+		case PTRACE_DU_ARRIVAL: {
+			DecodeUnitTrace &du = units[static_cast<uint32_t>(r.a)];
+			du.arrivalQpc = r.qpc;
+			if (header.version == 1) {
+				du.decodeStartQpc = r.qpc;
+			}
+			break;
+		}
+		case PTRACE_DECODE_START:
+			units[static_cast<uint32_t>(r.a)].decodeStartQpc = r.qpc;
+			break;
+		case PTRACE_DECODE_END: {
+			FrameTrace &f = frames[r.a];
+			f.pts = r.a;
+			f.number = r.b;
+			f.decodeEndQpc = r.qpc;
+			auto du = units.find(r.b);
+			if (du != units.end()) {
+				f.arrivalQpc = du->second.arrivalQpc;
+				f.decodeStartQpc = du->second.decodeStartQpc;
+			}
+			break;
+		}
+		case PTRACE_ENQUEUE:
+			if (!frames[r.a].enqueueQpc) {
+				frames[r.a].enqueueQpc = r.qpc;
+			}
+			break;
+		case PTRACE_DROP:
+			frames[r.a].dropReason = r.b;
+			drops[r.b]++;
+			break;
+		case PTRACE_DEQUEUE:
+			if (!frames[r.a].dequeueQpc) {
+				frames[r.a].dequeueQpc = r.qpc;
+			}
+			break;
+		case PTRACE_RENDER_START:
+			if (!frames[r.a].renderStartQpc) {
+				frames[r.a].renderStartQpc = r.qpc;
+			}
+			break;
+		case PTRACE_RENDER_END:
+			if (!frames[r.a].renderEndQpc) {
+				frames[r.a].renderEndQpc = r.qpc;
+			}
+			break;
+		case PTRACE_PRESENT:
+			++presents;
+			if (!frames[r.a].presentQpc) {
+				frames[r.a].presentQpc = r.qpc;
+			}
+			break;
+		case PTRACE_VSYNC:
+			vblanks.push_back(r.a);
+			vsyncSamples.emplace_back(r.a, r.b);
+			break;
+		default:
+			break;
+		}
+	}
+
+	std::sort(vblanks.begin(), vblanks.end());
+	vblanks.erase(std::unique(vblanks.begin(), vblanks.end()), vblanks.end());
+
+	// vblank interval from consecutive vsync samples, per refresh in case some were skipped
+	std::vector<double> intervals;
+	for (size_t i = 1; i < vsyncSamples.size(); ++i) {
+		const uint32_t refreshes = vsyncSamples[i].second - vsyncSamples[i - 1].second;
+		const int64_t qpc = vsyncSamples[i].first - vsyncSamples[i - 1].first;
+		if (refreshes > 0 && refreshes < 8 && qpc > 0) {
+			intervals.push_back(toMs(qpc) / refreshes);
+		}
+	}
+	const double vblankMs = intervals.empty() ? 1000.0 / 60.0 : percentile(intervals, 0.5);
+
+	// Per-stage latency of every frame that made it to the screen
+	std::vector<double> receive, decode, queue, render, wait, scanout, total;
+	int decoded = 0, displayed = 0, neverShown = 0;
+	for (auto &entry : frames) {
+		FrameTrace &f = entry.second;
+		if (!f.decodeEndQpc) {
+			continue; // a drop or dequeue of a frame decoded before the trace started
+		}
+		++decoded;
+		if (!f.presentQpc) {
+			if (!f.dropReason) {
+				++neverShown;
+			}
+			continue;
+		}
+
+		auto vb = std::upper_bound(vblanks.begin(), vblanks.end(), f.presentQpc);
+		if (vb != vblanks.end()) {
+			f.scanoutQpc = *vb;
+		}
+		++displayed;
+
+		if (f.arrivalQpc && f.decodeStartQpc) {
+			receive.push_back(toMs(f.decodeStartQpc - f.arrivalQpc));
+			decode.push_back(toMs(f.decodeEndQpc - f.decodeStartQpc));
+		}
+		if (f.enqueueQpc && f.dequeueQpc) {
+			queue.push_back(toMs(f.dequeueQpc - f.enqueueQpc));
+		}
+		if (f.renderStartQpc && f.renderEndQpc) {
+			render.push_back(toMs(f.renderEndQpc - f.renderStartQpc));
+			wait.push_back(toMs(f.presentQpc - f.renderEndQpc));
+		}
+		if (f.scanoutQpc) {
+			scanout.push_back(toMs(f.scanoutQpc - f.presentQpc));
+			if (f.arrivalQpc) {
+				total.push_back(toMs(f.scanoutQpc - f.arrivalQpc));
+			}
+		}
+	}
+
+	// Missed deadlines: each PTRACE_PRESENT_TARGET ends one render loop iteration, blame the iteration's
+	// render or the frame it rendered
+	std::map<int64_t, const FrameTrace *> byRenderStart;
+	for (const auto &entry : frames) {
+		if (entry.second.renderStartQpc) {
+			byRenderStart[entry.second.renderStartQpc] = &entry.second;
+		}
+	}
+
+	struct Miss {
+		int64_t qpc;
+		int64_t targetQpc;
+		int cause;
+		int64_t pts;
+	};
+	std::vector<Miss> misses;
+	int targets = 0;
+	int64_t iterationStart = 0, renderStart = 0, renderEnd = 0, renderPts = 0;
+	for (const PacingTraceRecord &r : records) {
+		if (r.event == PTRACE_RENDER_START) {
+			renderStart = r.qpc;
+			renderEnd = 0;
+			renderPts = r.a;
+		} else if (r.event == PTRACE_RENDER_END) {
+			renderEnd = r.qpc;
+		} else if (r.event == PTRACE_PRESENT_TARGET) {
+			++targets;
+			if (!r.b) {
+				Miss miss = {r.qpc, r.a, MISS_LOOP_LATE, 0};
+				if (renderStart > iterationStart && renderEnd) {
+					miss.pts = renderPts;
+					const double renderMs = toMs(renderEnd - renderStart);
+					auto f = frames.find(renderPts);
+					if (renderMs > vblankMs / 2) {
+						miss.cause = MISS_SLOW_RENDER;
+					} else if (f != frames.end() && f->second.decodeEndQpc &&
+					           f->second.decodeEndQpc + (renderEnd - renderStart) >= r.a) {
+						const FrameTrace &late = f->second;
+						const bool slowDecode = late.decodeStartQpc &&
+						                        toMs(late.decodeEndQpc - late.decodeStartQpc) > vblankMs / 2;
+						miss.cause = slowDecode ? MISS_SLOW_DECODE : MISS_LATE_ARRIVAL;
+					}
+				}
+				misses.push_back(miss);
+			}
+			iterationStart = r.qpc;
+		}
+	}
+
+	const double durationMs = toMs(records.back().qpc - baseQpc);
+	printf("%s: version %u, %zu records over %.1fs, vblank %.3fms (%.2fHz)\n", path, header.version,
+	       records.size(), durationMs / 1000.0, vblankMs, 1000.0 / vblankMs);
+	printf("  frames          %d decoded, %d displayed, %d dropped, %d never presented, %d presents\n",
+	       decoded, displayed, static_cast<int>(std::count_if(frames.begin(), frames.end(), [](const auto &e) {
+		       return e.second.decodeEndQpc && e.second.dropReason;
+	       })),
+	       neverShown, presents);
+
+	printf("\nlatency (ms)        p50      p95      p99      max\n");
+	const struct {
+		const char *name;
+		const std::vector<double> *v;
+	} stages[] = {
+		{"receive", &receive}, {"decode", &decode}, {"queue", &queue}, {"render", &render},
+		{"wait", &wait},       {"scanout", &scanout}, {"total", &total},
+	};
+	for (const auto &s : stages) {
+		printf("  %-12s %8.2f %8.2f %8.2f %8.2f\n", s.name, percentile(*s.v, 0.50), percentile(*s.v, 0.95),
+		       percentile(*s.v, 0.99), percentile(*s.v, 1.0));
+	}
+
+	printf("\ndrops\n");
+	if (drops.empty()) {
+		printf("  none\n");
+	}
+	for (const auto &d : drops) {
+		printf("  %6d  %s\n", d.second, dropReasonName(d.first));
+	}
+
+	printf("\nmissed deadlines: %zu of %d presents targeted\n", misses.size(), targets);
+	int causes[MISS_CAUSE_COUNT] = {};
+	for (const Miss &m : misses) {
+		causes[m.cause]++;
+	}
+	for (int c = 0; c < MISS_CAUSE_COUNT; ++c) {
+		if (causes[c]) {
+			printf("  %6d  %s\n", causes[c], missCauseName(c));
+		}
+	}
+
+	if (!listFrames) {
+		return 0;
+	}
+
+	printf("\n%8s %10s %10s %8s %8s %8s %8s %8s %8s %8s  %s\n", "frame", "pts", "arrival", "receive", "decode",
+	       "queue", "render", "wait", "scanout", "total", "fate");
+	std::vector<const FrameTrace *> ordered;
+	for (const auto &entry : frames) {
+		if (entry.second.decodeEndQpc) {
+			ordered.push_back(&entry.second);
+		}
+	}
+	std::sort(ordered.begin(), ordered.end(),
+	          [](const FrameTrace *a, const FrameTrace *b) { return a->decodeEndQpc < b->decodeEndQpc; });
+	for (const FrameTrace *f : ordered) {
+		auto stage = [&](int64_t from, int64_t to) { return from && to ? toMs(to - from) : 0.0; };
+		const char *fate = f->presentQpc ? (f->scanoutQpc ? "shown" : "presented")
+		                                 : (f->dropReason ? dropReasonName(f->dropReason) : "never presented");
+		printf("%8u %10" PRId64 " %10.3f %8.2f %8.2f %8.2f %8.2f %8.2f %8.2f %8.2f  %s\n", f->number, f->pts,
+		       toMs((f->arrivalQpc ? f->arrivalQpc : f->decodeEndQpc) - baseQpc),
+		       stage(f->arrivalQpc, f->decodeStartQpc), stage(f->decodeStartQpc, f->decodeEndQpc),
+		       stage(f->enqueueQpc, f->dequeueQpc), stage(f->renderStartQpc, f->renderEndQpc),
+		       stage(f->renderEndQpc, f->presentQpc), stage(f->presentQpc, f->scanoutQpc),
+		       stage(f->arrivalQpc, f->scanoutQpc), fate);
+	}
+
+	if (!misses.empty()) {
+		printf("\n%10s %10s %10s  %s\n", "at", "late by", "pts", "cause");
+		for (const Miss &m : misses) {
+			printf("%10.3f %10.3f %10" PRId64 "  %s\n", toMs(m.qpc - baseQpc), toMs(m.qpc - m.targetQpc), m.pts,
+			       missCauseName(m.cause));
+		}
+	}
+	return 0;
+}
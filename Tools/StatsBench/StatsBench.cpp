@@ -0,0 +1,151 @@
+// Cost of the Stats::Submit* hooks, and what releasing the per-thread slots buys
+//
+// A stream is a decoder, a render and a vsync thread submitting what the app's threads submit for
+// every frame, flat out, and the CPU time of a frame's submits is printed for each of them. Streams
+// run one after another on the same Stats, once releasing the slots between streams the way
+// FFMpegDecoder::Cleanup() does, and once without, where the threads of later streams find every
+// slot taken and end up sharing one.
+//
+// usage: stats-bench [--frames 200000] [--streams 3] [--graphs 0]
+//
+// --graphs 1 also feeds the overlay graphs, which the app only does when they're turned on.
+// Fails if, with the slots released, a stream's threads don't each claim one again.
+
+#include "pch.h"
+#include "../../Plot/ImGuiPlots.h"
+#include "../../State/Stats.h"
+#include "../../Streaming/FramePool.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <thread>
+#include <vector>
+
+using namespace moonlight_xbox_dx;
+
+static const int STREAM_THREADS = 3;
+
+struct StreamResult {
+	int slotsClaimed;
+	double decoderNs;
+	double renderNs;
+	double vsyncNs;
+};
+
+static double threadCpuNs() {
+	timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Thread CPU time rather than wall time, so the other threads getting the CPU doesn't count
+template <typename Submit>
+static double timePerFrame(int frames, Submit submit) {
+	const double start = threadCpuNs();
+	for (int f = 0; f < frames; f++) {
+		submit(f);
+	}
+	return (threadCpuNs() - start) / frames;
+}
+
+static StreamResult runStream(Stats &stats, int frames) {
+	StreamResult result = {};
+
+	// FFMpegDecoder::SubmitDecodeUnit()
+	std::thread decoder([&]() {
+		DECODE_UNIT du = {};
+		du.frameHostProcessingLatency = 20;
+		result.decoderNs = timePerFrame(frames, [&](int f) {
+			du.receiveTimeUs = (uint64_t)f * 8333;
+			du.enqueueTimeUs = du.receiveTimeUs + 500 + f % 300;
+			du.rtpTimestamp = (uint32_t)f * 750;
+			stats.SubmitVideoBytesAndReassemblyTime(150000 + f % 4096, &du, f % 1000 == 0 ? 1 : 0);
+			stats.SubmitDecodeMs(1.5 + (f % 100) / 100.0);
+		});
+	});
+
+	// The render loop and Pacer::renderOnMainThread()
+	std::thread render([&]() {
+		result.renderNs = timePerFrame(frames, [&](int f) {
+			stats.SubmitPacerTime(UsToQpc(200 + f % 800));
+			stats.SubmitPresentPacing(0.5);
+			stats.SubmitRenderStats(4000, 1200 + f % 500, 300, f % 500 != 0);
+		});
+	});
+
+	// Pacer::updateFrameStats() once the frame is on screen
+	std::thread vsync([&]() {
+		MLFrameTimeline timeline = {};
+		timeline.hostProcessingLatency = 20;
+		result.vsyncNs = timePerFrame(frames, [&](int f) {
+			timeline.receiveQpc = (int64_t)f * 83333 + 1;
+			timeline.presentQpc = timeline.receiveQpc + 150000 + f % 20000;
+			stats.SubmitFrameTimeline(timeline);
+		});
+	});
+
+	decoder.join();
+	render.join();
+	vsync.join();
+	result.slotsClaimed = stats.ThreadSlotsClaimed();
+	return result;
+}
+
+static void usage() {
+	fprintf(stderr, "usage: stats-bench [--frames 200000] [--streams 3] [--graphs 0]\n");
+}
+
+int main(int argc, char **argv) {
+	int frames = 200000;
+	int streams = 3;
+	bool graphs = false;
+	for (int i = 1; i < argc; ++i) {
+		const char *val = i + 1 < argc ? argv[i + 1] : nullptr;
+		if (!val) {
+			usage();
+			return 2;
+		} else if (!strcmp(argv[i], "--frames")) {
+			frames = atoi(val);
+		} else if (!strcmp(argv[i], "--streams")) {
+			streams = atoi(val);
+		} else if (!strcmp(argv[i], "--graphs")) {
+			graphs = atoi(val) != 0;
+		} else {
+			usage();
+			return 2;
+		}
+		++i;
+	}
+	if (frames <= 0 || streams <= 0) {
+		usage();
+		return 2;
+	}
+
+	ImGuiPlots::instance().setEnabled(graphs);
+
+	bool ok = true;
+	printf("%d frames per stream, graphs %s, CPU ns per frame of submits on each thread\n", frames,
+	       graphs ? "on" : "off");
+	printf("%-16s %8s %8s %8s %8s\n", "", "claimed", "decoder", "render", "vsync");
+	for (bool release : {true, false}) {
+		Stats stats;
+		for (int s = 0; s < streams; s++) {
+			const StreamResult r = runStream(stats, frames);
+			if (release) {
+				stats.ReleaseThreadSlots();
+				if (r.slotsClaimed != STREAM_THREADS) {
+					fprintf(stderr, "stats-bench: stream %d claimed %d slots, expected one for each of its %d threads\n",
+					        s + 1, r.slotsClaimed, STREAM_THREADS);
+					ok = false;
+				}
+			}
+
+			char label[32];
+			snprintf(label, sizeof(label), "%s %d", release ? "released" : "kept", s + 1);
+			printf("%-16s %8d %8.0f %8.0f %8.0f\n", label, r.slotsClaimed, r.decoderNs, r.renderNs, r.vsyncNs);
+		}
+	}
+	return ok ? 0 : 1;
+}
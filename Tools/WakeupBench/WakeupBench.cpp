@@ -0,0 +1,182 @@
+// Wake-up latency of the render thread waiting for a frame
+//
+// FrameQueue::dequeueWithTimeout() used to poll dequeue() with 100us sleeps, which Windows rounds
+// up to about 1ms. It now blocks on the enqueue event. This feeds frames to the queue at a steady
+// rate from a decoder thread and has the render thread wait for each one, once through
+// dequeueWithTimeout() and once through the old polling loop, and prints how long after
+// enqueue() each frame was picked up and the CPU time the render thread spent waiting for it.
+//
+// usage: wakeup-bench [--fps 240] [--frames 1000] [--poll-us 100] [--max-p99-us 0]
+//
+// --poll-us 1000 approximates the old loop on Windows. Fails if a frame is neither picked up nor
+// dropped by enqueue(), or if --max-p99-us is given and the event wait's p99 is over it.
+
+#include "pch.h"
+#include "HostPacerClock.h"
+#include "../../Streaming/FramePool.h"
+#include "../../Streaming/FrameQueue.h"
+#include "../../Utils/LatencyHistogram.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <random>
+#include <thread>
+
+// Render thread timeout, well past the frame interval so it never fires while frames arrive
+static const double DEQUEUE_TIMEOUT_S = 0.1;
+
+struct WaitResult {
+	LatencyHistogram latencyUs;
+	uint64_t frames;
+	uint64_t dropped;
+	double cpuUs;
+};
+
+static double threadCpuUs() {
+	timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// dequeueWithTimeout() before it waited on the event
+static AVFrame *pollingDequeue(FrameQueue &queue, double timeoutSeconds, int pollUs) {
+	const int64_t deadlineQpc = QpcNow() + MsToQpc(timeoutSeconds * 1000.0);
+	int round = 0;
+	do {
+		if (round > 0) {
+			std::this_thread::sleep_for(std::chrono::microseconds(pollUs));
+		}
+		AVFrame *frame = queue.dequeue();
+		if (frame) {
+			return frame;
+		}
+		round++;
+	} while (QpcNow() < deadlineQpc);
+	return nullptr;
+}
+
+static void run(WaitResult &result, bool polling, double fps, int frames, int pollUs) {
+	FrameQueue &queue = FrameQueue::instance();
+	queue.start();
+	result.latencyUs.reset();
+	result.frames = 0;
+	result.dropped = 0;
+	result.cpuUs = 0;
+
+	std::atomic<bool> producerDone{false};
+	std::thread renderThread([&]() {
+		const double cpuStart = threadCpuUs();
+		for (;;) {
+			AVFrame *frame = polling ? pollingDequeue(queue, DEQUEUE_TIMEOUT_S, pollUs)
+			                         : queue.dequeueWithTimeout(DEQUEUE_TIMEOUT_S);
+			if (!frame) {
+				if (producerDone.load()) {
+					break;
+				}
+				continue;
+			}
+			const MLFrameData *data = (const MLFrameData *)frame->opaque_ref->data;
+			result.latencyUs.record((uint64_t)QpcToUs(QpcNow() - data->decodeEndQpc));
+			result.frames++;
+			FramePool::instance().release(&frame);
+		}
+		result.cpuUs = threadCpuUs() - cpuStart;
+	});
+
+	// Frames arrive on a steady cadence with up to a quarter of an interval of jitter, like the network
+	std::mt19937 rng(1);
+	const int64_t intervalQpc = MsToQpc(1000.0 / fps);
+	std::uniform_int_distribution<int64_t> jitter(0, intervalQpc / 4);
+	const int64_t startQpc = QpcNow();
+	for (int f = 0; f < frames; f++) {
+		const int64_t dueQpc = startQpc + f * intervalQpc + jitter(rng);
+		std::this_thread::sleep_for(std::chrono::microseconds(std::max<int64_t>(0, QpcToUs(dueQpc - QpcNow()))));
+
+		AVFrame *frame = FramePool::instance().acquire();
+		frame->pts = f;
+		MLFrameTimeline timeline = {};
+		FramePool::instance().attachUserData(frame, QpcNow(), timeline);
+		result.dropped += queue.enqueue(frame);
+	}
+	producerDone.store(true);
+	renderThread.join();
+	queue.stop();
+}
+
+static void print(const char *label, const WaitResult &r) {
+	printf("%-16s %8llu %8llu %8llu %8llu %8llu %10.1f\n", label, (unsigned long long)r.latencyUs.percentile(50),
+	       (unsigned long long)r.latencyUs.percentile(99), (unsigned long long)r.latencyUs.max(),
+	       (unsigned long long)r.frames, (unsigned long long)r.dropped, r.frames ? r.cpuUs / r.frames : 0.0);
+}
+
+static void usage() {
+	fprintf(stderr, "usage: wakeup-bench [--fps 240] [--frames 1000] [--poll-us 100] [--max-p99-us 0]\n");
+}
+
+int main(int argc, char **argv) {
+	double fps = 240;
+	int frames = 1000;
+	int pollUs = 100;
+	double maxP99Us = 0;
+	for (int i = 1; i < argc; ++i) {
+		const char *val = i + 1 < argc ? argv[i + 1] : nullptr;
+		if (!val) {
+			usage();
+			return 2;
+		} else if (!strcmp(argv[i], "--fps")) {
+			fps = atof(val);
+		} else if (!strcmp(argv[i], "--frames")) {
+			frames = atoi(val);
+		} else if (!strcmp(argv[i], "--poll-us")) {
+			pollUs = atoi(val);
+		} else if (!strcmp(argv[i], "--max-p99-us")) {
+			maxP99Us = atof(val);
+		} else {
+			usage();
+			return 2;
+		}
+		++i;
+	}
+	if (fps <= 0 || frames <= 0 || pollUs <= 0) {
+		usage();
+		return 2;
+	}
+
+	FramePool::instance().init(FramePool::MAX_CAPACITY);
+	FrameQueue::instance().setClock(std::make_shared<HostPacerClock>());
+	// One frame in flight at a time, frames are only dropped if the render thread doesn't get the CPU
+	FrameQueue::instance().setHighWaterMark(3);
+
+	static WaitResult event, polling;
+	run(event, false, fps, frames, pollUs);
+	run(polling, true, fps, frames, pollUs);
+	FramePool::instance().deinit();
+
+	printf("%d frames at %.0f fps, polling every %dus\n", frames, fps, pollUs);
+	printf("%-16s %8s %8s %8s %8s %8s %10s\n", "us after enqueue", "p50", "p99", "max", "frames", "dropped",
+	       "cpu us/frm");
+	char pollingLabel[32];
+	snprintf(pollingLabel, sizeof(pollingLabel), "%dus polling", pollUs);
+	print("event wait", event);
+	print(pollingLabel, polling);
+
+	bool ok = true;
+	for (const WaitResult *r : {&event, &polling}) {
+		if (r->frames + r->dropped != (uint64_t)frames) {
+			fprintf(stderr, "wakeup-bench: frames were lost, %llu picked up and %llu dropped of %d\n",
+			        (unsigned long long)r->frames, (unsigned long long)r->dropped, frames);
+			ok = false;
+		}
+	}
+	if (maxP99Us > 0 && event.latencyUs.percentile(99) > maxP99Us) {
+		fprintf(stderr, "wakeup-bench: the event wait's p99 of %lluus is over %.0fus\n",
+		        (unsigned long long)event.latencyUs.percentile(99), maxP99Us);
+		ok = false;
+	}
+	return ok ? 0 : 1;
+}
@@ -1,6 +1,6 @@
 #include "pch.h"
 #include "FloatBuffer.h"
-#include "../Utils.hpp"
+#include "Utils.hpp"
 
 #include <algorithm>
 #include <cfloat>
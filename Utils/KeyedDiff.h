@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Computes the edits that turn one keyed list into another, so a bound collection can be updated
+// in place instead of being cleared and refilled.
+//
+// Items present in both lists keep their object. The longest run of them that is already in the
+// target order stays where it is, the rest are moved by removing and re-inserting them. Applying
+// result.ops in order to a list laid out like `from` yields a list laid out like `to`. Keys must
+// be unique within each list. The code has no platform dependencies.
+
+struct KeyedDiffOp
+{
+	enum class Type
+	{
+		Remove,
+		Insert
+	};
+
+	static constexpr size_t NONE = (size_t)-1;
+
+	Type type;
+	size_t index;    // position in the list at the time the op is applied
+	size_t toIndex;  // Insert: index in `to` of the item being inserted
+	size_t fromIndex; // Remove: index in `from` of the item. Insert: index in `from` of a moved item, NONE for new ones
+};
+
+struct KeyedDiffResult
+{
+	std::vector<KeyedDiffOp> ops;
+	std::vector<std::pair<size_t, size_t>> retained; // (from, to) indices of every item present in both lists
+};
+
+template <typename Key, typename Hash = std::hash<Key>>
+KeyedDiffResult KeyedDiff(const std::vector<Key> &from, const std::vector<Key> &to)
+{
+	KeyedDiffResult result;
+
+	std::unordered_map<Key, size_t, Hash> toIndexOf;
+	toIndexOf.reserve(to.size());
+	for (size_t i = 0; i < to.size(); i++)
+		toIndexOf.emplace(to[i], i);
+
+	// Target position of every old item, NONE if it is gone
+	std::vector<size_t> target(from.size(), KeyedDiffOp::NONE);
+	std::vector<size_t> retainedFrom;
+	for (size_t i = 0; i < from.size(); i++) {
+		auto it = toIndexOf.find(from[i]);
+		if (it != toIndexOf.end()) {
+			target[i] = it->second;
+			retainedFrom.push_back(i);
+			result.retained.emplace_back(i, it->second);
+		}
+	}
+
+	// Longest increasing subsequence of target positions: these items are already in order
+	std::vector<bool> stays(from.size(), false);
+	{
+		std::vector<size_t> tails;     // index into retainedFrom of the smallest tail of each length
+		std::vector<size_t> previous(retainedFrom.size(), KeyedDiffOp::NONE);
+		for (size_t r = 0; r < retainedFrom.size(); r++) {
+			size_t value = target[retainedFrom[r]];
+			auto pos = std::lower_bound(tails.begin(), tails.end(), value, [&](size_t t, size_t v) {
+				return target[retainedFrom[t]] < v;
+			});
+			if (pos != tails.begin())
+				previous[r] = *(pos - 1);
+			if (pos == tails.end())
+				tails.push_back(r);
+			else
+				*pos = r;
+		}
+		for (size_t r = tails.empty() ? KeyedDiffOp::NONE : tails.back(); r != KeyedDiffOp::NONE; r = previous[r])
+			stays[retainedFrom[r]] = true;
+	}
+
+	// Remove everything that goes away or moves, back to front so earlier indices stay valid
+	for (size_t i = from.size(); i-- > 0;) {
+		if (!stays[i])
+			result.ops.push_back({KeyedDiffOp::Type::Remove, i, KeyedDiffOp::NONE, i});
+	}
+
+	// What's left is in target order, so inserting in ascending target order lands every item in place
+	std::vector<size_t> fromIndexOf(to.size(), KeyedDiffOp::NONE);
+	for (auto &pair : result.retained)
+		fromIndexOf[pair.second] = pair.first;
+
+	for (size_t i = 0; i < to.size(); i++) {
+		size_t source = fromIndexOf[i];
+		if (source == KeyedDiffOp::NONE || !stays[source])
+			result.ops.push_back({KeyedDiffOp::Type::Insert, i, i, source});
+	}
+
+	return result;
+}
@@ -0,0 +1,214 @@
+// Edit script suite for KeyedDiff, built on the host rather than into the app
+//
+// Random before/after lists of unique app IDs are diffed and the ops are applied the way
+// MoonlightHost::UpdateApps() applies them to Apps, with RemoveAt() and InsertAt(). The result
+// must list the target IDs in order, every retained app must still be the object it was, and a
+// moved app must be inserted from where it was removed. The op count may never exceed one remove
+// for every old item and one insert for every new item outside the longest run already in target
+// order, worked out here with a plain O(n^2) search rather than the header's.
+//
+// Built through Tools/CMakeLists.txt.
+
+#include "pch.h"
+#include "KeyedDiff.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <numeric>
+#include <random>
+#include <vector>
+
+static int g_failures = 0;
+
+#define CHECK(cond, ...)                                     \
+	do {                                                     \
+		if (!(cond)) {                                       \
+			fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+			fprintf(stderr, __VA_ARGS__);                    \
+			fprintf(stderr, "\n");                           \
+			g_failures++;                                    \
+		}                                                    \
+	} while (0)
+
+// Stands in for a MoonlightApp^, the object a tile is bound to
+struct Tile {
+	int id;
+	int object; // which object this is, new ones get -1
+};
+
+// Length of the longest run of items in both lists that is in the same order in each
+static size_t longestCommonRun(const std::vector<int> &from, const std::vector<int> &to) {
+	std::vector<size_t> positions;
+	for (int id : from) {
+		auto it = std::find(to.begin(), to.end(), id);
+		if (it != to.end()) {
+			positions.push_back(it - to.begin());
+		}
+	}
+	std::vector<size_t> longest(positions.size(), 1);
+	size_t best = 0;
+	for (size_t i = 0; i < positions.size(); i++) {
+		for (size_t j = 0; j < i; j++) {
+			if (positions[j] < positions[i]) {
+				longest[i] = std::max(longest[i], longest[j] + 1);
+			}
+		}
+		best = std::max(best, longest[i]);
+	}
+	return best;
+}
+
+// Applies the diff like UpdateApps() does, returns false with a message if an op is out of range
+static bool apply(const std::vector<int> &from, const std::vector<int> &to, const KeyedDiffResult &diff,
+                  std::vector<Tile> &tiles, int &moved) {
+	tiles.clear();
+	for (size_t i = 0; i < from.size(); i++) {
+		tiles.push_back({from[i], (int)i});
+	}
+
+	// Retained apps keep their object, new ones get a fresh one
+	std::vector<Tile> result;
+	for (int id : to) {
+		result.push_back({id, -1});
+	}
+	for (auto &r : diff.retained) {
+		result[r.second].object = (int)r.first;
+	}
+
+	moved = 0;
+	std::vector<bool> removed(from.size(), false);
+	for (const KeyedDiffOp &op : diff.ops) {
+		if (op.type == KeyedDiffOp::Type::Remove) {
+			if (op.index >= tiles.size() || op.fromIndex >= from.size() || tiles[op.index].object != (int)op.fromIndex) {
+				fprintf(stderr, "remove at %zu doesn't remove item %zu\n", op.index, op.fromIndex);
+				return false;
+			}
+			removed[op.fromIndex] = true;
+			tiles.erase(tiles.begin() + op.index);
+		} else {
+			if (op.index > tiles.size() || op.toIndex >= to.size()) {
+				fprintf(stderr, "insert at %zu of item %zu is out of range\n", op.index, op.toIndex);
+				return false;
+			}
+			if (op.fromIndex != KeyedDiffOp::NONE) {
+				if (op.fromIndex >= from.size() || !removed[op.fromIndex] || result[op.toIndex].object != (int)op.fromIndex) {
+					fprintf(stderr, "insert of item %zu isn't a move of item %zu\n", op.toIndex, op.fromIndex);
+					return false;
+				}
+				moved++;
+			}
+			tiles.insert(tiles.begin() + op.index, result[op.toIndex]);
+		}
+	}
+	return true;
+}
+
+static std::vector<int> randomList(std::mt19937 &rng, std::vector<int> &pool, size_t size) {
+	std::shuffle(pool.begin(), pool.end(), rng);
+	return std::vector<int>(pool.begin(), pool.begin() + std::min(size, pool.size()));
+}
+
+static void checkDiff(const std::vector<int> &from, const std::vector<int> &to, const char *name) {
+	const KeyedDiffResult diff = KeyedDiff(from, to);
+
+	std::vector<Tile> tiles;
+	int moved = 0;
+	if (!apply(from, to, diff, tiles, moved)) {
+		CHECK(false, "%s: the ops can't be applied", name);
+		return;
+	}
+
+	bool inOrder = tiles.size() == to.size();
+	for (size_t i = 0; inOrder && i < to.size(); i++) {
+		inOrder = tiles[i].id == to[i];
+	}
+	CHECK(inOrder, "%s: applying %zu ops to %zu items didn't give the %zu target items", name, diff.ops.size(),
+	      from.size(), to.size());
+
+	size_t common = 0;
+	for (size_t i = 0; i < tiles.size() && i < to.size(); i++) {
+		auto it = std::find(from.begin(), from.end(), to[i]);
+		if (it == from.end()) {
+			CHECK(tiles[i].object == -1, "%s: new app %d got an old object", name, to[i]);
+		} else {
+			common++;
+			CHECK(tiles[i].object == it - from.begin(), "%s: app %d didn't keep its object", name, to[i]);
+		}
+	}
+	CHECK(diff.retained.size() == common, "%s: %zu apps retained, %zu are in both lists", name, diff.retained.size(),
+	      common);
+
+	const size_t run = longestCommonRun(from, to);
+	const size_t bound = (from.size() - run) + (to.size() - run);
+	CHECK(diff.ops.size() <= bound, "%s: %zu ops, the bound is %zu", name, diff.ops.size(), bound);
+	CHECK(moved == (int)(common - run), "%s: %d apps moved, expected %zu", name, moved, common - run);
+}
+
+static void testCases() {
+	checkDiff({}, {}, "empty");
+	checkDiff({}, {1, 2, 3}, "fill");
+	checkDiff({1, 2, 3}, {}, "clear");
+	checkDiff({1, 2, 3, 4}, {1, 2, 3, 4}, "unchanged");
+	checkDiff({1, 2, 3, 4}, {4, 3, 2, 1}, "reversed");
+	checkDiff({1, 2, 3, 4}, {2, 3, 4, 1}, "first to last");
+	checkDiff({1, 2, 3, 4}, {4, 1, 2, 3}, "last to first");
+	checkDiff({1, 2, 3}, {1, 5, 2, 3, 6}, "inserted");
+	checkDiff({1, 5, 2, 3, 6}, {1, 2, 3}, "removed");
+	checkDiff({1, 2, 3}, {4, 5, 6}, "replaced");
+
+	// Nothing changed, nothing to do
+	CHECK(KeyedDiff(std::vector<int>{7, 3, 9}, std::vector<int>{7, 3, 9}).ops.empty(), "an unchanged list has ops");
+	// A rename keeps the ID, a new app costs one insert
+	CHECK(KeyedDiff(std::vector<int>{1, 2, 3}, std::vector<int>{1, 2, 9, 3}).ops.size() == 1,
+	      "one new app took more than one op");
+	// One app moving costs a remove and an insert
+	CHECK(KeyedDiff(std::vector<int>{1, 2, 3, 4, 5}, std::vector<int>{1, 3, 4, 5, 2}).ops.size() == 2,
+	      "one app moving took more than two ops");
+}
+
+static void testRandom(std::mt19937 &rng) {
+	std::vector<int> pool(64);
+	std::iota(pool.begin(), pool.end(), 1);
+
+	char name[64];
+	for (int round = 0; round < 2000; round++) {
+		std::uniform_int_distribution<size_t> size(0, round < 1000 ? 8 : 40);
+		std::vector<int> from = randomList(rng, pool, size(rng));
+		std::vector<int> to;
+		if (round % 3 == 0) {
+			// Like a real refresh: mostly the same list, a few apps added, removed or moved
+			to = from;
+			std::uniform_int_distribution<int> edits(0, 3);
+			for (int e = edits(rng); e > 0 && !to.empty(); e--) {
+				std::uniform_int_distribution<size_t> at(0, to.size() - 1);
+				switch (edits(rng)) {
+				case 0:
+					to.erase(to.begin() + at(rng));
+					break;
+				case 1:
+					if (std::find(to.begin(), to.end(), 100 + e) == to.end()) {
+						to.insert(to.begin() + at(rng), 100 + e);
+					}
+					break;
+				default:
+					std::swap(to[at(rng)], to[at(rng)]);
+					break;
+				}
+			}
+		} else {
+			to = randomList(rng, pool, size(rng));
+		}
+		snprintf(name, sizeof(name), "round %d", round);
+		checkDiff(from, to, name);
+	}
+}
+
+int main(int argc, char **argv) {
+	std::mt19937 rng(1);
+
+	testCases();
+	testRandom(rng);
+
+	printf("%d failures\n", g_failures);
+	return g_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,97 @@
+#include "pch.h"
+#include "LatencyHistogram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+static inline int highestBit(uint64_t value)
+{
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanReverse64(&index, value);
+	return (int)index;
+#else
+	return 63 - __builtin_clzll(value);
+#endif
+}
+
+int LatencyHistogram::bucketIndex(uint64_t value)
+{
+	if (value < SUB_BUCKET_COUNT) {
+		return (int)value;
+	}
+	value = std::min(value, MAX_TRACKABLE_VALUE);
+
+	// shift so the value lands in [SUB_BUCKET_HALF, SUB_BUCKET_COUNT)
+	const int shift = highestBit(value) - SUB_BUCKET_BITS + 1;
+	return SUB_BUCKET_COUNT + (shift - 1) * SUB_BUCKET_HALF + (int)((value >> shift) - SUB_BUCKET_HALF);
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(int index)
+{
+	if (index < SUB_BUCKET_COUNT) {
+		return (uint64_t)index;
+	}
+
+	const int k = index - SUB_BUCKET_COUNT;
+	const int shift = k / SUB_BUCKET_HALF + 1;
+	const uint64_t lower = (uint64_t)(k % SUB_BUCKET_HALF + SUB_BUCKET_HALF) << shift;
+	return lower + (UINT64_C(1) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t value)
+{
+	m_counts[bucketIndex(value)]++;
+	m_count++;
+	m_max = std::max(m_max, value);
+}
+
+void LatencyHistogram::addToBucket(int index, uint32_t count, uint64_t maxValue)
+{
+	if (index < 0 || index >= BUCKET_COUNT || count == 0) {
+		return;
+	}
+	m_counts[index] += count;
+	m_count += count;
+	m_max = std::max(m_max, maxValue);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &other)
+{
+	for (int i = 0; i < BUCKET_COUNT; i++) {
+		m_counts[i] += other.m_counts[i];
+	}
+	m_count += other.m_count;
+	m_max = std::max(m_max, other.m_max);
+}
+
+void LatencyHistogram::reset()
+{
+	memset(this, 0, sizeof(*this));
+}
+
+uint64_t LatencyHistogram::percentile(double percentile) const
+{
+	if (m_count == 0) {
+		return 0;
+	}
+
+	percentile = std::clamp(percentile, 0.0, 100.0);
+	uint64_t target = (uint64_t)std::ceil(percentile / 100.0 * (double)m_count);
+	target = std::max(target, (uint64_t)1);
+
+	uint64_t seen = 0;
+	for (int i = 0; i < BUCKET_COUNT; i++) {
+		seen += m_counts[i];
+		if (seen >= target) {
+			// never report more than we actually saw
+			return std::min(bucketUpperBound(i), m_max);
+		}
+	}
+	return m_max;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// Fixed-size log-linear histogram for latency values, in the spirit of HdrHistogram.
+//
+// Values below SUB_BUCKET_COUNT are counted exactly. Above that each power of two is split into
+// SUB_BUCKET_COUNT / 2 linear buckets, so any value is reported within 1/16 (6.25%) of its true
+// value. Values up to MAX_TRACKABLE_VALUE are tracked, larger values are clamped into the top
+// bucket but still reported exactly by max().
+//
+// The class is plain data: zeroed memory is an empty histogram and it can be memcpy'd, so it
+// lives directly inside VIDEO_STATS. record() never allocates. It is not thread-safe, callers
+// that record from several threads keep their own counts and use bucketIndex()/addToBucket().
+
+class LatencyHistogram
+{
+  public:
+	static constexpr int SUB_BUCKET_BITS = 5;
+	static constexpr int SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;      // 32
+	static constexpr int SUB_BUCKET_HALF = SUB_BUCKET_COUNT / 2;       // 16
+	static constexpr int MAX_VALUE_BITS = 27;                          // ~134s in microseconds
+	static constexpr int BUCKET_COUNT = SUB_BUCKET_COUNT + (MAX_VALUE_BITS - SUB_BUCKET_BITS) * SUB_BUCKET_HALF;
+	static constexpr uint64_t MAX_TRACKABLE_VALUE = (UINT64_C(1) << MAX_VALUE_BITS) - 1;
+
+	void record(uint64_t value);
+	void merge(const LatencyHistogram &other);
+	void reset();
+
+	// Used to accumulate counts kept elsewhere
+	static int bucketIndex(uint64_t value);
+	void addToBucket(int index, uint32_t count, uint64_t maxValue);
+
+	uint64_t count() const
+	{
+		return m_count;
+	}
+	uint64_t max() const
+	{
+		return m_max;
+	}
+
+	// Highest value that is equivalent to the percentile (0-100), 0 when empty
+	uint64_t percentile(double percentile) const;
+
+  private:
+	static uint64_t bucketUpperBound(int index);
+
+	uint32_t m_counts[BUCKET_COUNT];
+	uint64_t m_count;
+	uint64_t m_max;
+};
+
+static_assert(std::is_trivially_copyable<LatencyHistogram>::value, "LatencyHistogram must stay plain data");
@@ -0,0 +1,205 @@
+// Accuracy suite for LatencyHistogram, built on the host rather than into the app
+//
+// Samples from several latency-like distributions are recorded and every percentile is checked
+// against the nearest-rank value of the same samples sorted: it may never be below it, and never
+// more than 1/16 (6.25%) above it. max() and the 100th percentile must be exact. merge() of two
+// halves must match recording everything into one histogram, and reset() must leave a histogram
+// that behaves like a new one.
+//
+// Built through Tools/CMakeLists.txt.
+
+#include "pch.h"
+#include "LatencyHistogram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <vector>
+
+static int g_failures = 0;
+
+#define CHECK(cond, ...)                                     \
+	do {                                                     \
+		if (!(cond)) {                                       \
+			fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+			fprintf(stderr, __VA_ARGS__);                    \
+			fprintf(stderr, "\n");                           \
+			g_failures++;                                    \
+		}                                                    \
+	} while (0)
+
+static const double PERCENTILES[] = {0, 1, 50, 90, 95, 99, 99.9, 100};
+
+// Same rank percentile() looks for
+static uint64_t nearestRank(const std::vector<uint64_t> &sorted, double percentile) {
+	uint64_t rank = (uint64_t)std::ceil(percentile / 100.0 * (double)sorted.size());
+	rank = std::max(rank, (uint64_t)1);
+	return sorted[rank - 1];
+}
+
+// Checks every percentile of h against samples, returns the worst relative error seen
+static double checkAgainst(const char *name, const LatencyHistogram &h, std::vector<uint64_t> samples) {
+	std::sort(samples.begin(), samples.end());
+	CHECK(h.count() == samples.size(), "%s: count() is %llu, recorded %zu", name, (unsigned long long)h.count(),
+	      samples.size());
+	CHECK(h.max() == samples.back(), "%s: max() is %llu, expected %llu", name, (unsigned long long)h.max(),
+	      (unsigned long long)samples.back());
+
+	double worst = 0;
+	for (double p : PERCENTILES) {
+		const uint64_t expected = nearestRank(samples, p);
+		const uint64_t actual = h.percentile(p);
+		CHECK(actual >= expected, "%s: p%g is %llu, below the true %llu", name, p, (unsigned long long)actual,
+		      (unsigned long long)expected);
+		CHECK(actual <= expected + expected / 16, "%s: p%g is %llu, more than 6.25%% over the true %llu", name, p,
+		      (unsigned long long)actual, (unsigned long long)expected);
+		if (expected > 0) {
+			worst = std::max(worst, ((double)actual - (double)expected) / (double)expected);
+		}
+	}
+	CHECK(h.percentile(100) == samples.back(), "%s: p100 is %llu, expected max %llu", name,
+	      (unsigned long long)h.percentile(100), (unsigned long long)samples.back());
+	return worst;
+}
+
+static void testAccuracy(std::mt19937_64 &rng) {
+	struct Distribution {
+		const char *name;
+		std::function<uint64_t()> next;
+	};
+
+	std::uniform_int_distribution<uint64_t> small(0, LatencyHistogram::SUB_BUCKET_COUNT - 1);
+	std::uniform_real_distribution<double> logUniform(0, LatencyHistogram::MAX_VALUE_BITS);
+	std::exponential_distribution<double> exponential(1.0 / 8000.0);
+	std::normal_distribution<double> vsync(16667, 400);
+	std::lognormal_distribution<double> lognormal(8.0, 1.2);
+	std::uniform_int_distribution<int> coin(0, 9);
+
+	const Distribution distributions[] = {
+		{"exact range", [&] { return small(rng); }},
+		{"log-uniform", [&] { return (uint64_t)std::exp2(logUniform(rng)); }},
+		{"exponential", [&] { return (uint64_t)exponential(rng); }},
+		{"vsync", [&] { return (uint64_t)std::max(0.0, vsync(rng)); }},
+		{"lognormal", [&] { return std::min((uint64_t)lognormal(rng), LatencyHistogram::MAX_TRACKABLE_VALUE); }},
+		// frames that are usually fast with a slow tail, like decode times around an IDR frame
+		{"bimodal", [&] { return coin(rng) == 0 ? 40000 + small(rng) * 100 : 1500 + small(rng) * 10; }},
+		{"constant", [&] { return (uint64_t)12345; }},
+	};
+
+	printf("%-12s %8s %10s %10s %10s %10s\n", "", "samples", "p50", "p99", "max", "worst err");
+	for (const Distribution &d : distributions) {
+		for (size_t n : {(size_t)1, (size_t)7, (size_t)1000, (size_t)200000}) {
+			LatencyHistogram h;
+			h.reset();
+			std::vector<uint64_t> samples;
+			for (size_t i = 0; i < n; i++) {
+				samples.push_back(d.next());
+				h.record(samples.back());
+			}
+			const double worst = checkAgainst(d.name, h, samples);
+			if (n == 200000) {
+				printf("%-12s %8zu %10llu %10llu %10llu %9.2f%%\n", d.name, n, (unsigned long long)h.percentile(50),
+				       (unsigned long long)h.percentile(99), (unsigned long long)h.max(), worst * 100);
+			}
+		}
+	}
+}
+
+// Values past MAX_TRACKABLE_VALUE land in the top bucket, only max() still knows them exactly
+static void testClamped() {
+	LatencyHistogram h;
+	h.reset();
+	h.record(10);
+	h.record(LatencyHistogram::MAX_TRACKABLE_VALUE * 4);
+	CHECK(h.max() == LatencyHistogram::MAX_TRACKABLE_VALUE * 4, "max() lost a value past the trackable range");
+	CHECK(h.percentile(100) == LatencyHistogram::MAX_TRACKABLE_VALUE, "p100 of a clamped value is %llu",
+	      (unsigned long long)h.percentile(100));
+	CHECK(h.percentile(50) == 10, "p50 of {10, huge} is %llu", (unsigned long long)h.percentile(50));
+	CHECK(LatencyHistogram::bucketIndex(UINT64_MAX) == LatencyHistogram::BUCKET_COUNT - 1,
+	      "a huge value isn't in the top bucket");
+}
+
+static void testMerge(std::mt19937_64 &rng) {
+	std::lognormal_distribution<double> lognormal(8.0, 1.5);
+	std::uniform_int_distribution<int> side(0, 2);
+
+	LatencyHistogram all, a, b, empty;
+	all.reset();
+	a.reset();
+	b.reset();
+	empty.reset();
+	std::vector<uint64_t> samples;
+	for (int i = 0; i < 100000; i++) {
+		const uint64_t value = std::min((uint64_t)lognormal(rng), LatencyHistogram::MAX_TRACKABLE_VALUE);
+		samples.push_back(value);
+		all.record(value);
+		// uneven halves, so a merge isn't just doubling
+		(side(rng) == 0 ? a : b).record(value);
+	}
+
+	LatencyHistogram merged = a;
+	merged.merge(b);
+	merged.merge(empty);
+	CHECK(memcmp(&merged, &all, sizeof(merged)) == 0, "merging two halves doesn't match recording everything into one");
+	checkAgainst("merged", merged, samples);
+
+	LatencyHistogram intoEmpty = empty;
+	intoEmpty.merge(all);
+	CHECK(memcmp(&intoEmpty, &all, sizeof(all)) == 0, "merging into an empty histogram isn't a copy");
+
+	// What Stats does with the counts its threads keep
+	LatencyHistogram buckets;
+	buckets.reset();
+	uint64_t maxValue = 0;
+	for (uint64_t value : samples) {
+		buckets.addToBucket(LatencyHistogram::bucketIndex(value), 1, 0);
+		maxValue = std::max(maxValue, value);
+	}
+	buckets.addToBucket(0, 0, maxValue);
+	buckets.addToBucket(LatencyHistogram::BUCKET_COUNT, 1, UINT64_MAX);
+	CHECK(buckets.count() == samples.size() && buckets.max() == 0,
+	      "addToBucket() took an empty or out of range bucket");
+	buckets.addToBucket(LatencyHistogram::bucketIndex(samples[0]), 1, maxValue);
+	all.record(samples[0]);
+	CHECK(memcmp(&buckets, &all, sizeof(all)) == 0, "addToBucket() doesn't match record()");
+}
+
+static void testReset(std::mt19937_64 &rng) {
+	std::exponential_distribution<double> exponential(1.0 / 3000.0);
+
+	LatencyHistogram h;
+	h.reset();
+	for (int i = 0; i < 10000; i++) {
+		h.record((uint64_t)exponential(rng));
+	}
+	h.reset();
+	CHECK(h.count() == 0 && h.max() == 0 && h.percentile(50) == 0 && h.percentile(100) == 0,
+	      "a reset histogram isn't empty");
+
+	// Zeroed memory is an empty histogram, VIDEO_STATS relies on that
+	LatencyHistogram zeroed;
+	memset(&zeroed, 0, sizeof(zeroed));
+	CHECK(memcmp(&zeroed, &h, sizeof(h)) == 0, "reset() isn't the same as zeroed memory");
+
+	std::vector<uint64_t> samples;
+	for (int i = 0; i < 10000; i++) {
+		samples.push_back((uint64_t)exponential(rng));
+		h.record(samples.back());
+	}
+	checkAgainst("after reset", h, samples);
+}
+
+int main(int argc, char **argv) {
+	std::mt19937_64 rng(1);
+
+	testAccuracy(rng);
+	testClamped();
+	testMerge(rng);
+	testReset(rng);
+
+	printf("%d failures\n", g_failures);
+	return g_failures == 0 ? 0 : 1;
+}
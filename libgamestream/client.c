@@ -33,8 +33,11 @@
 #include <curl/curl.h>
 #ifdef _WIN32
 #define PATH_MAX 4096
+#include <windows.h>
 #include "winrt.h"
 #else
+#include <arpa/inet.h>
+#include <pthread.h>
 #include <uuid/uuid.h>
 #endif // !_WIN32
 #include <openssl/sha.h>
@@ -52,9 +55,32 @@
 #define UNIQUEID_CHARS (UNIQUEID_BYTES*2)
 
 static char unique_id[UNIQUEID_CHARS+1];
-static X509 *cert;
-static char cert_hex[4096];
-static EVP_PKEY *privateKey;
+
+/*
+ * The client identity only changes when the key files are regenerated, so it is
+ * loaded from disk once and shared by every gs_init. Code that uses the
+ * certificate or key holds a reference, so a reload can't free them underneath it.
+ */
+typedef struct _CLIENT_IDENTITY {
+  int refs;
+  X509 *cert;
+  EVP_PKEY *privateKey;
+  char certHex[4096];
+} CLIENT_IDENTITY, *PCLIENT_IDENTITY;
+
+static PCLIENT_IDENTITY cachedIdentity;
+static char identityDirectory[PATH_MAX];
+static int debug; /* log level given to gs_init, reused when gs_pair reloads the identity */
+
+#ifdef _WIN32
+static SRWLOCK identityLock = SRWLOCK_INIT;
+#define identity_lock() AcquireSRWLockExclusive(&identityLock)
+#define identity_unlock() ReleaseSRWLockExclusive(&identityLock)
+#else
+static pthread_mutex_t identityLock = PTHREAD_MUTEX_INITIALIZER;
+#define identity_lock() pthread_mutex_lock(&identityLock)
+#define identity_unlock() pthread_mutex_unlock(&identityLock)
+#endif
 
 const char* gs_error;
 
@@ -99,7 +125,7 @@ static int load_unique_id(const char* keyDirectory) {
   snprintf(uniqueFilePath, PATH_MAX, "%s/%s", keyDirectory, UNIQUE_FILE_NAME);
 
   FILE *fd = fopen(uniqueFilePath, "r");
-  if (fd == NULL || fread(unique_id, UNIQUEID_CHARS, 1, fd) != UNIQUEID_CHARS) {
+  if (fd == NULL || fread(unique_id, UNIQUEID_CHARS, 1, fd) != 1) {
     snprintf(unique_id,UNIQUEID_CHARS+1,"0123456789ABCDEF");
 
     if (fd)
@@ -116,7 +142,7 @@ static int load_unique_id(const char* keyDirectory) {
   return GS_OK;
 }
 
-static int load_cert(const char* keyDirectory) {
+static int load_cert(const char* keyDirectory, PCLIENT_IDENTITY id) {
   char certificateFilePath[PATH_MAX];
   snprintf(certificateFilePath, PATH_MAX, "%s/%s", keyDirectory, CERTIFICATE_FILE_NAME);
 
@@ -142,8 +168,9 @@ static int load_cert(const char* keyDirectory) {
     return GS_FAILED;
   }
 
-  if (!(cert = PEM_read_X509(fd, NULL, NULL, NULL))) {
+  if (!(id->cert = PEM_read_X509(fd, NULL, NULL, NULL))) {
     gs_error = "Error loading cert into memory";
+    fclose(fd);
     return GS_FAILED;
   }
 
@@ -151,11 +178,11 @@ static int load_cert(const char* keyDirectory) {
 
   int c;
   int length = 0;
-  while ((c = fgetc(fd)) != EOF) {
-    sprintf(cert_hex + length, "%02x", c);
+  while ((c = fgetc(fd)) != EOF && length + 2 < sizeof(id->certHex)) {
+    sprintf(id->certHex + length, "%02x", c);
     length += 2;
   }
-  cert_hex[length] = 0;
+  id->certHex[length] = 0;
 
   fclose(fd);
 
@@ -165,102 +192,161 @@ static int load_cert(const char* keyDirectory) {
     return GS_FAILED;
   }
 
-  PEM_read_PrivateKey(fd, &privateKey, NULL, NULL);
+  id->privateKey = PEM_read_PrivateKey(fd, NULL, NULL, NULL);
   fclose(fd);
+  if (id->privateKey == NULL) {
+    gs_error = "Error loading key into memory";
+    return GS_FAILED;
+  }
 
   return GS_OK;
 }
 
-static int load_serverinfo(PSERVER_DATA server, bool https) {
-  uuid_t uuid;
-  char uuid_str[UUID_STRLEN];
-  char url[4096];
-  int ret = GS_INVALID;
-  char *pairedText = NULL;
-  char *currentGameText = NULL;
-  char *stateText = NULL;
-  char *serverCodecModeSupportText = NULL;
-  char *httpsPortText = NULL;
+static void identity_free(PCLIENT_IDENTITY id) {
+  X509_free(id->cert);
+  EVP_PKEY_free(id->privateKey);
+  free(id);
+}
 
-  uuid_generate_random(&uuid);
-  uuid_unparse(&uuid, uuid_str);
+static void identity_release(PCLIENT_IDENTITY id) {
+  identity_lock();
+  bool last = --id->refs == 0;
+  identity_unlock();
 
-  snprintf(url, sizeof(url), "%s://%s:%d/serverinfo?uniqueid=%s&uuid=%s",
-    https ? "https" : "http", server->serverInfo.address, https ? server->httpsPort : server->httpPort, unique_id, uuid_str);
+  if (last)
+    identity_free(id);
+}
 
-  PHTTP_DATA data = http_create_data();
-  CURL* curl = get_curl_handle();
-  if (data == NULL) {
-    ret = GS_OUT_OF_MEMORY;
-    goto cleanup;
+/*
+ * Returns a reference to the client identity, loading it from keyDirectory if it
+ * isn't cached yet. A NULL keyDirectory reuses the directory of the last load.
+ * Release the reference with identity_release().
+ */
+static PCLIENT_IDENTITY identity_acquire(const char* keyDirectory, int logLevel) {
+  PCLIENT_IDENTITY id = NULL;
+
+  identity_lock();
+  if (keyDirectory == NULL)
+    keyDirectory = identityDirectory;
+
+  if (cachedIdentity != NULL && strcmp(identityDirectory, keyDirectory) == 0) {
+    id = cachedIdentity;
+    id->refs++;
+    identity_unlock();
+    return id;
   }
-  if (http_request(curl, url, data) != GS_OK) {
-    ret = GS_IO_ERROR;
-    goto cleanup;
+
+  if (keyDirectory[0] == 0) {
+    gs_error = "Client identity hasn't been loaded";
+    goto out;
   }
 
-  if (xml_status(data->memory, data->size) == GS_ERROR) {
-    ret = GS_ERROR;
-    goto cleanup;
+  mkdirtree(keyDirectory);
+  if (load_unique_id(keyDirectory) != GS_OK)
+    goto out;
+
+  id = calloc(1, sizeof(CLIENT_IDENTITY));
+  if (id == NULL) {
+    gs_error = "Out of memory";
+    goto out;
   }
 
-  if (xml_search(data->memory, data->size, "hostname", &server->serverName) != GS_OK) {
-      goto cleanup;
+  if (load_cert(keyDirectory, id) != GS_OK) {
+    identity_free(id);
+    id = NULL;
+    goto out;
   }
 
-  if (xml_search(data->memory, data->size, "uniqueid", &server->uniqueId) != GS_OK) {
-      goto cleanup;
+  if (http_init(keyDirectory, logLevel) != GS_OK) {
+    gs_error = "Can't load client certificate for HTTPS";
+    identity_free(id);
+    id = NULL;
+    goto out;
   }
 
-  if (xml_search(data->memory, data->size, "currentgame", &currentGameText) != GS_OK) {
-    goto cleanup;
+  // One reference for the cache, one for the caller
+  if (cachedIdentity != NULL && --cachedIdentity->refs == 0)
+    identity_free(cachedIdentity);
+  id->refs = 2;
+  cachedIdentity = id;
+  if (keyDirectory != identityDirectory) {
+    strncpy(identityDirectory, keyDirectory, PATH_MAX - 1);
+    identityDirectory[PATH_MAX - 1] = 0;
   }
 
-  if (xml_search(data->memory, data->size, "PairStatus", &pairedText) != GS_OK)
-    goto cleanup;
+  out:
+  identity_unlock();
+  return id;
+}
 
-  if (xml_search(data->memory, data->size, "appversion", (char**) &server->serverInfo.serverInfoAppVersion) != GS_OK)
-    goto cleanup;
+void gs_reset_identity() {
+  identity_lock();
+  PCLIENT_IDENTITY id = cachedIdentity;
+  cachedIdentity = NULL;
+  identity_unlock();
 
-  if (xml_search(data->memory, data->size, "state", &stateText) != GS_OK)
-    goto cleanup;
+  if (id != NULL)
+    identity_release(id);
 
-  if (xml_search(data->memory, data->size, "ServerCodecModeSupport", &serverCodecModeSupportText) != GS_OK)
-    goto cleanup;
+  // Pooled connections authenticated with the old certificate
+  http_flush_connections();
+}
 
-  if (xml_search(data->memory, data->size, "gputype", &server->gpuType) != GS_OK)
-    goto cleanup;
+static int load_serverinfo(PSERVER_DATA server, bool https) {
+  uuid_t uuid;
+  char uuid_str[UUID_STRLEN];
+  char url[4096];
+  int ret = GS_INVALID;
+  SERVERINFO_XML info;
 
-  if (xml_search(data->memory, data->size, "GsVersion", &server->gsVersion) != GS_OK)
-    goto cleanup;
+  uuid_generate_random(&uuid);
+  uuid_unparse(&uuid, uuid_str);
 
-  if (xml_search(data->memory, data->size, "GfeVersion", (char**) &server->serverInfo.serverInfoGfeVersion) != GS_OK)
-    goto cleanup;
+  snprintf(url, sizeof(url), "%s://%s:%d/serverinfo?uniqueid=%s&uuid=%s",
+    https ? "https" : "http", server->serverInfo.address, https ? server->httpsPort : server->httpPort, unique_id, uuid_str);
 
-  if (xml_search(data->memory, data->size, "HttpsPort", &httpsPortText) != GS_OK)
+  PHTTP_DATA data = http_create_data();
+  CURL* curl = get_curl_handle(server->serverInfo.address);
+  if (data == NULL) {
+    ret = GS_OUT_OF_MEMORY;
     goto cleanup;
+  }
+  http_set_timeout(curl, server->requestTimeoutMs);
+  if (http_request(curl, url, data) != GS_OK) {
+    ret = GS_IO_ERROR;
+    goto cleanup;
+  }
 
-  if (xml_search(data->memory, data->size, "mac", &server->macAddress) != GS_OK)
-      goto cleanup;
-
-  if (xml_modelist(data->memory, data->size, &server->modes) != GS_OK)
+  if ((ret = xml_serverinfo(data->memory, data->size, &info)) != GS_OK)
     goto cleanup;
 
+  server->modes = info.modes;
+
   // These fields are present on all version of GFE that this client supports
-  if (!strlen(currentGameText) || !strlen(pairedText) || !strlen(server->serverInfo.serverInfoAppVersion) || !strlen(stateText))
+  if (!strlen(info.currentGame) || !strlen(info.pairStatus) || !strlen(info.appVersion) || !strlen(info.state)) {
+    ret = GS_INVALID;
     goto cleanup;
+  }
 
-  server->paired = pairedText != NULL && strcmp(pairedText, "1") == 0;
-  server->currentGame = currentGameText == NULL ? 0 : atoi(currentGameText);
-  server->serverInfo.serverCodecModeSupport = serverCodecModeSupportText == NULL ? SCM_H264 : atoi(serverCodecModeSupportText);
-  server->serverMajorVersion = atoi(server->serverInfo.serverInfoAppVersion);
-  server->isNvidiaSoftware = strstr(stateText, "MJOLNIR") != NULL;
-
-  server->httpsPort = atoi(httpsPortText);
+  server->serverName = _strdup(info.hostname);
+  server->uniqueId = _strdup(info.uniqueId);
+  server->serverInfo.serverInfoAppVersion = _strdup(info.appVersion);
+  server->gpuType = _strdup(info.gpuType);
+  server->gsVersion = _strdup(info.gsVersion);
+  server->serverInfo.serverInfoGfeVersion = _strdup(info.gfeVersion);
+  server->macAddress = _strdup(info.mac);
+
+  server->paired = strcmp(info.pairStatus, "1") == 0;
+  server->currentGame = atoi(info.currentGame);
+  server->serverInfo.serverCodecModeSupport = strlen(info.codecModeSupport) ? atoi(info.codecModeSupport) : SCM_H264;
+  server->serverMajorVersion = atoi(info.appVersion);
+  server->isNvidiaSoftware = strstr(info.state, "MJOLNIR") != NULL;
+
+  server->httpsPort = atoi(info.httpsPort);
   if (!server->httpsPort)
     server->httpsPort = 47984;
 
-  if (strstr(stateText, "_SERVER_BUSY") == NULL) {
+  if (strstr(info.state, "_SERVER_BUSY") == NULL) {
     // After GFE 2.8, current game remains set even after streaming
     // has ended. We emulate the old behavior by forcing it to zero
     // if streaming is not active.
@@ -272,18 +358,6 @@ static int load_serverinfo(PSERVER_DATA server, bool https) {
   if (data != NULL)
     http_free_data(data);
 
-  if (pairedText != NULL)
-    free(pairedText);
-
-  if (currentGameText != NULL)
-    free(currentGameText);
-
-  if (serverCodecModeSupportText != NULL)
-    free(serverCodecModeSupportText);
-
-  if (httpsPortText != NULL)
-    free(httpsPortText);
-  
   http_cleanup(curl);
 
   return ret;
@@ -322,6 +396,70 @@ static int load_server_status(PSERVER_DATA server) {
   return ret;
 }
 
+/*
+ * Cheap refresh for polling a host gs_init already succeeded on. It makes a single
+ * serverinfo request on the pooled connection and only updates what changes while
+ * the host is up, the pairing state and the running game. *changed reports whether
+ * either of them did. A host that only answers over HTTP counts as up, but leaves
+ * both unchanged.
+ */
+int gs_status(PSERVER_DATA server, bool* changed) {
+  uuid_t uuid;
+  char uuid_str[UUID_STRLEN];
+  char url[4096];
+  int ret;
+  SERVERINFO_XML info;
+  // Only HTTPS reports the pairing state reliably. gs_init always knows the HTTPS port,
+  // HTTP is just the fallback for a host that refuses us there.
+  bool https = server->httpsPort != 0;
+
+  *changed = false;
+
+  PHTTP_DATA data = http_create_data();
+  if (data == NULL)
+    return GS_OUT_OF_MEMORY;
+
+  CURL* curl = get_curl_handle(server->serverInfo.address);
+  for (;;) {
+    uuid_generate_random(&uuid);
+    uuid_unparse(&uuid, uuid_str);
+    snprintf(url, sizeof(url), "%s://%s:%d/serverinfo?uniqueid=%s&uuid=%s",
+      https ? "https" : "http", server->serverInfo.address, https ? server->httpsPort : server->httpPort, unique_id, uuid_str);
+
+    http_set_timeout(curl, server->requestTimeoutMs);
+    ret = http_request(curl, url, data);
+    if (ret == GS_OK)
+      ret = xml_serverinfo(data->memory, data->size, &info);
+    if (ret == GS_OK || !https)
+      break;
+
+    // The host may have dropped our pairing, ask again over HTTP
+    https = false;
+  }
+
+  if (ret == GS_OK) {
+    xml_free_modes(info.modes);
+
+    if (!strlen(info.currentGame) || !strlen(info.pairStatus) || !strlen(info.state)) {
+      ret = GS_INVALID;
+    } else if (https) {
+      bool paired = strcmp(info.pairStatus, "1") == 0;
+      // Same as load_serverinfo, currentgame is only meaningful while streaming
+      int currentGame = strstr(info.state, "_SERVER_BUSY") != NULL ? atoi(info.currentGame) : 0;
+
+      *changed = paired != server->paired || currentGame != server->currentGame;
+      server->paired = paired;
+      server->currentGame = currentGame;
+    }
+    // Over HTTP the host is up, but its answer can't be trusted for either field, so
+    // they stay as they were until the next gs_init
+  }
+
+  http_free_data(data);
+  http_cleanup(curl);
+  return ret;
+}
+
 static void bytes_to_hex(unsigned char *in, char *out, size_t len) {
   for (int i = 0; i < len; i++) {
     sprintf(out + i * 2, "%02x", in[i]);
@@ -432,11 +570,14 @@ int gs_unpair(PSERVER_DATA server) {
   uuid_generate_random(&uuid);
   uuid_unparse(&uuid, uuid_str);
   snprintf(url, sizeof(url), "http://%s:%u/unpair?uniqueid=%s&uuid=%s", server->serverInfo.address, server->httpPort, unique_id, uuid_str);
-  CURL* curl = get_curl_handle();
+  CURL* curl = get_curl_handle(server->serverInfo.address);
   ret = http_request(curl, url, data);
 
   http_free_data(data);
   http_cleanup(curl);
+
+  // The host checks our certificate during the TLS handshake, don't resume sessions from before
+  http_flush_connections();
   return ret;
 }
 
@@ -452,6 +593,12 @@ int gs_pair(PSERVER_DATA server, char* pin) {
     return GS_WRONG_STATE;
   }
 
+  // Re-read the key files in case they were regenerated since the last pairing
+  gs_reset_identity();
+  PCLIENT_IDENTITY id = identity_acquire(NULL, debug);
+  if (id == NULL)
+    return GS_FAILED;
+
   unsigned char salt_data[16];
   char salt_hex[SIZEOF_AS_HEX_STR(salt_data)];
   RAND_bytes(salt_data, sizeof(salt_data));
@@ -459,12 +606,13 @@ int gs_pair(PSERVER_DATA server, char* pin) {
 
   uuid_generate_random(&uuid);
   uuid_unparse(&uuid, uuid_str);
-  snprintf(url, sizeof(url), "http://%s:%u/pair?uniqueid=%s&uuid=%s&devicename=roth&updateState=1&phrase=getservercert&salt=%s&clientcert=%s", server->serverInfo.address, server->httpPort, unique_id, uuid_str, salt_hex, cert_hex);
+  snprintf(url, sizeof(url), "http://%s:%u/pair?uniqueid=%s&uuid=%s&devicename=roth&updateState=1&phrase=getservercert&salt=%s&clientcert=%s", server->serverInfo.address, server->httpPort, unique_id, uuid_str, salt_hex, id->certHex);
   PHTTP_DATA data = http_create_data();
-  CURL *curl = get_curl_handle();
-  if (data == NULL)
-    return GS_OUT_OF_MEMORY;
-  else if ((ret = http_request(curl,url, data)) != GS_OK)
+  CURL *curl = get_curl_handle(server->serverInfo.address);
+  if (data == NULL) {
+    ret = GS_OUT_OF_MEMORY;
+    goto cleanup;
+  } else if ((ret = http_request(curl,url, data)) != GS_OK)
     goto cleanup;
 
   if ((ret = xml_status(data->memory, data->size) != GS_OK))
@@ -559,7 +707,7 @@ int gs_pair(PSERVER_DATA server, char* pin) {
   RAND_bytes(client_secret_data, sizeof(client_secret_data));
 
   const ASN1_BIT_STRING *asnSignature;
-  X509_get0_signature(&asnSignature, NULL, cert);
+  X509_get0_signature(&asnSignature, NULL, id->cert);
 
   char challenge_response[16 + SIGNATURE_LEN + sizeof(client_secret_data)];
   char challenge_response_hash[32];
@@ -622,7 +770,7 @@ int gs_pair(PSERVER_DATA server, char* pin) {
 
   unsigned char *signature = NULL;
   size_t s_len;
-  if (sign_it(client_secret_data, sizeof(client_secret_data), &signature, &s_len, privateKey) != GS_OK) {
+  if (sign_it(client_secret_data, sizeof(client_secret_data), &signature, &s_len, id->privateKey) != GS_OK) {
       gs_error = "Failed to sign data";
       ret = GS_FAILED;
       goto cleanup;
@@ -682,6 +830,10 @@ int gs_pair(PSERVER_DATA server, char* pin) {
     free(result);
   http_cleanup(curl);
   http_free_data(data);
+  identity_release(id);
+
+  // Pairing changed whether the host trusts our certificate, start over with fresh TLS sessions
+  http_flush_connections();
 
   // If we failed when attempting to pair with a game running, that's likely the issue.
   // Sunshine supports pairing with an active session, but GFE does not.
@@ -705,7 +857,7 @@ int gs_applist(PSERVER_DATA server, PAPP_LIST *list) {
   uuid_generate_random(&uuid);
   uuid_unparse(&uuid, uuid_str);
   snprintf(url, sizeof(url), "https://%s:%u/applist?uniqueid=%s&uuid=%s", server->serverInfo.address, server->httpsPort, unique_id, uuid_str);
-  CURL* curl = get_curl_handle();
+  CURL* curl = get_curl_handle(server->serverInfo.address);
   if (http_request(curl,url, data) != GS_OK)
     ret = GS_IO_ERROR;
   else if (xml_status(data->memory, data->size) == GS_ERROR)
@@ -764,7 +916,7 @@ int gs_start_app(PSERVER_DATA server, STREAM_CONFIGURATION *config, int appId, b
   snprintf(url, sizeof(url), "https://%s:%u/%s?uniqueid=%s&uuid=%s&appid=%d&mode=%dx%dx%d&additionalStates=1&sops=%d&rikey=%s&rikeyid=%d&localAudioPlayMode=%d&surroundAudioInfo=%d&remoteControllersBitmap=%d&gcmap=%d%s%s",
       server->serverInfo.address, server->httpsPort, server->currentGame ? "resume" : "launch", unique_id, uuid_str, appId, config->width, config->height, fps, sops, rikey_hex, rikeyid, localaudio, surround_info, gamepad_mask, gamepad_mask,
       (config->supportedVideoFormats & VIDEO_FORMAT_MASK_10BIT) ? "&hdrMode=1&clientHdrCapVersion=0&clientHdrCapSupportedFlagsInUint32=0&clientHdrCapMetaDataId=NV_STATIC_METADATA_TYPE_1&clientHdrCapDisplayData=0x0x0x0x0x0x0x0x0x0x0" : "", LiGetLaunchUrlQueryParameters());
-  CURL* curl = get_curl_handle();
+  CURL* curl = get_curl_handle(server->serverInfo.address);
   if ((ret = http_request(curl, url, data)) == GS_OK)
     server->currentGame = appId;
   else
@@ -811,7 +963,7 @@ int gs_quit_app(PSERVER_DATA server) {
   uuid_generate_random(&uuid);
   uuid_unparse(&uuid, uuid_str);
   snprintf(url, sizeof(url), "https://%s:%u/cancel?uniqueid=%s&uuid=%s", server->serverInfo.address, server->httpsPort, unique_id, uuid_str);
-  CURL* curl = get_curl_handle();
+  CURL* curl = get_curl_handle(server->serverInfo.address);
   if ((ret = http_request(curl, url, data)) != GS_OK)
     goto cleanup;
 
@@ -834,41 +986,92 @@ int gs_quit_app(PSERVER_DATA server) {
   return ret;
 }
 
-int gs_init(PSERVER_DATA server, char *address, unsigned short httpPort, const char *keyDirectory, int log_level, bool unsupported) {
-  mkdirtree(keyDirectory);
-  if (load_unique_id(keyDirectory) != GS_OK)
-    return GS_FAILED;
-
-  if (load_cert(keyDirectory))
+/* timeoutMs limits each serverinfo request, 0 waits as long as curl does */
+int gs_init(PSERVER_DATA server, char *address, unsigned short httpPort, const char *keyDirectory, int log_level, bool unsupported, long timeoutMs) {
+  // Only touches the disk the first time, later calls share the cached identity
+  debug = log_level;
+  PCLIENT_IDENTITY id = identity_acquire(keyDirectory, log_level);
+  if (id == NULL)
     return GS_FAILED;
-
-  http_init(keyDirectory, log_level);
+  identity_release(id);
 
   LiInitializeServerInformation(&server->serverInfo);
   server->serverInfo.address = address;
   server->unsupported = unsupported;
   server->httpPort = httpPort ? httpPort : 47989;
   server->httpsPort = 0; /* Populated by load_server_status() */
+  server->requestTimeoutMs = timeoutMs;
   return load_server_status(server);
 }
 
-int gs_appasset(PSERVER_DATA server, const char *keyDirectory, int appId) {
-    int ret = GS_OK;
-    char url[4096];    
-    char* result = NULL;
-
-    snprintf(url, sizeof(url), "https://%s:%u/appasset?appid=%d&AssetType=2&AssetIdx=0", server->serverInfo.address, server->httpsPort, appId);
-    char uniqueFilePath[PATH_MAX];
-    snprintf(uniqueFilePath, PATH_MAX, "%s%d.png", keyDirectory, appId);
-    FILE* fd = fopen(uniqueFilePath, "wb");
-    CURL* curl = get_curl_handle();
-    if ((ret = http_request_binary(curl, url, fd)) != GS_OK)
-        goto cleanup;
-    fclose(fd);
+static int replace_file(const char* from, const char* to) {
+#ifdef _WIN32
+  return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) ? 0 : -1;
+#else
+  return rename(from, to);
+#endif
+}
+
+/*
+ * Downloads the box art of appId to filePath. The file is written to a temporary
+ * path first and moved into place once complete, so filePath never holds a partial
+ * image. If asset->etag is set the download is skipped when the host still has the
+ * same image, which is reported through asset->notModified. Errors are reported in
+ * asset->error rather than gs_error, so several downloads can run at once.
+ */
+int gs_appasset(PSERVER_DATA server, const char *filePath, int appId, PAPP_ASSET asset) {
+  int ret = GS_OK;
+  char url[4096];
+  char tempFilePath[PATH_MAX];
+  char etag[sizeof(asset->etag)];
+  long responseCode = 0;
+  const char* error = NULL;
 
-cleanup:
-    if (result != NULL)
-        free(result);
-    http_cleanup(curl);
-    return ret;
+  asset->notModified = false;
+  asset->size = 0;
+  asset->error[0] = 0;
+
+  snprintf(url, sizeof(url), "https://%s:%u/appasset?appid=%d&AssetType=2&AssetIdx=0", server->serverInfo.address, server->httpsPort, appId);
+  snprintf(tempFilePath, PATH_MAX, "%s.tmp", filePath);
+
+  FILE* fd = fopen(tempFilePath, "wb");
+  if (fd == NULL) {
+    snprintf(asset->error, sizeof(asset->error), "Can't create box art file");
+    return GS_IO_ERROR;
+  }
+
+  CURL* curl = get_curl_handle(server->serverInfo.address);
+  ret = http_request_file(curl, url, fd, asset->etag, etag, sizeof(etag), &responseCode, &error);
+  http_cleanup(curl);
+  if (ret != GS_OK)
+    snprintf(asset->error, sizeof(asset->error), "%s", error);
+
+  long size = ftell(fd);
+  if (fclose(fd) != 0 && ret == GS_OK) {
+    snprintf(asset->error, sizeof(asset->error), "Can't write box art file");
+    ret = GS_IO_ERROR;
+  }
+
+  if (ret == GS_OK && responseCode == 304) {
+    asset->notModified = true;
+  } else if (ret == GS_OK && responseCode != 200) {
+    // An error page isn't an image, don't let it replace the cached box art
+    snprintf(asset->error, sizeof(asset->error), "Host answered with HTTP status %ld", responseCode);
+    ret = GS_FAILED;
+  } else if (ret == GS_OK && size <= 0) {
+    snprintf(asset->error, sizeof(asset->error), "Host sent empty box art");
+    ret = GS_FAILED;
+  } else if (ret == GS_OK) {
+    if (replace_file(tempFilePath, filePath) != 0) {
+      snprintf(asset->error, sizeof(asset->error), "Can't move box art into place");
+      ret = GS_IO_ERROR;
+    } else {
+      asset->size = size;
+      strcpy(asset->etag, etag);
+      return GS_OK;
+    }
+  }
+
+  remove(tempFilePath);
+  return ret;
 }
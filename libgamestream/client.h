@@ -43,12 +43,22 @@ typedef struct _SERVER_DATA {
   char* serverName;
   char* uniqueId;
   char* macAddress;
+  long requestTimeoutMs;
 } SERVER_DATA, *PSERVER_DATA;
 
-int gs_init(PSERVER_DATA server, char* address, unsigned short httpPort, const char *keyDirectory, int logLevel, bool unsupported);
+typedef struct _APP_ASSET {
+  char etag[128];   /* in: validator of the cached copy, out: the one the host sent */
+  long long size;   /* out: size of the downloaded file */
+  bool notModified; /* out: the cached copy is still current, nothing was written */
+  char error[128];  /* out: why the download failed */
+} APP_ASSET, *PAPP_ASSET;
+
+int gs_init(PSERVER_DATA server, char* address, unsigned short httpPort, const char *keyDirectory, int logLevel, bool unsupported, long timeoutMs);
+int gs_status(PSERVER_DATA server, bool* changed);
 int gs_start_app(PSERVER_DATA server, PSTREAM_CONFIGURATION config, int appId, bool sops, bool localaudio, int gamepad_mask);
 int gs_applist(PSERVER_DATA server, PAPP_LIST *app_list);
 int gs_unpair(PSERVER_DATA server);
 int gs_pair(PSERVER_DATA server, char* pin);
 int gs_quit_app(PSERVER_DATA server);
-int gs_appasset(PSERVER_DATA server, const char *keyDirectory, int appId);
+int gs_appasset(PSERVER_DATA server, const char *filePath, int appId, PAPP_ASSET asset);
+void gs_reset_identity();
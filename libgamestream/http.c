@@ -22,14 +22,56 @@
 
 #include <stdbool.h>
 #include <string.h>
+#include <time.h>
 #include <curl/curl.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <strings.h>
+#define _strnicmp strncasecmp
+#endif
+
 static const char *pCertFile = "./client.pem";
 static const char *pKeyFile = "./key.pem";
 
 static bool debug;
 static struct curl_blob certBlob, keyBlob;
 
+/*
+ * Finished handles are kept for reuse instead of being destroyed, so that their
+ * keep-alive connections and TLS sessions survive between gs_* calls. Each idle
+ * handle remembers the host it last talked to and is preferably handed out again
+ * for that host. Handles idle for longer than HTTP_POOL_IDLE_SECONDS are closed.
+ */
+#define HTTP_POOL_SIZE 8
+#define HTTP_POOL_IDLE_SECONDS 30
+
+typedef struct _HTTP_POOL_ENTRY {
+  CURL *curl;
+  char host[256];
+  time_t lastUsed;
+  unsigned int generation;
+  bool inUse;
+} HTTP_POOL_ENTRY;
+
+static HTTP_POOL_ENTRY pool[HTTP_POOL_SIZE];
+static unsigned int poolGeneration;
+
+/* Clock for the idle timeout, tests step it past HTTP_POOL_IDLE_SECONDS */
+time_t (*http_pool_clock)(time_t*) = time;
+
+#ifdef _WIN32
+static SRWLOCK poolLock = SRWLOCK_INIT;
+#define pool_lock() AcquireSRWLockExclusive(&poolLock)
+#define pool_unlock() ReleaseSRWLockExclusive(&poolLock)
+#else
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+#define pool_lock() pthread_mutex_lock(&poolLock)
+#define pool_unlock() pthread_mutex_unlock(&poolLock)
+#endif
+
 
 static size_t _write_curl(void *contents, size_t size, size_t nmemb, void *userp)
 {
@@ -53,21 +95,137 @@ static size_t _write_curl_binary(void* contents, size_t size, size_t nmemb, void
     return written;
 }
 
-CURL* get_curl_handle() {
+typedef struct _HEADER_ETAG {
+  char* etag;
+  size_t len;
+} HEADER_ETAG;
+
+static size_t _header_etag(char* buffer, size_t size, size_t nitems, void* userp)
+{
+  size_t length = size * nitems;
+  HEADER_ETAG* out = (HEADER_ETAG*)userp;
+
+  if (length > 5 && _strnicmp(buffer, "ETag:", 5) == 0) {
+    const char* value = buffer + 5;
+    const char* end = buffer + length;
+    while (value < end && (*value == ' ' || *value == '\t'))
+      value++;
+    while (end > value && (end[-1] == '\r' || end[-1] == '\n' || end[-1] == ' '))
+      end--;
+
+    size_t valueLength = end - value;
+    if (valueLength < out->len) {
+      memcpy(out->etag, value, valueLength);
+      out->etag[valueLength] = 0;
+    }
+  }
+  return length;
+}
+
+static CURL* create_curl_handle() {
     CURL* curl = curl_easy_init();
-    if (!curl) return GS_FAILED;
+    if (!curl) return NULL;
     curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
     curl_easy_setopt(curl, CURLOPT_SSLENGINE_DEFAULT, 1L);
     curl_easy_setopt(curl, CURLOPT_SSLCERTTYPE, "PEM");
-    curl_easy_setopt(curl, CURLOPT_SSLCERT_BLOB, certBlob);
+    curl_easy_setopt(curl, CURLOPT_SSLCERT_BLOB, &certBlob);
     curl_easy_setopt(curl, CURLOPT_SSLKEYTYPE, "PEM");
-    curl_easy_setopt(curl, CURLOPT_SSLKEY_BLOB, keyBlob);
+    curl_easy_setopt(curl, CURLOPT_SSLKEY_BLOB, &keyBlob);
     curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
     curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
-    curl_easy_setopt(curl, CURLOPT_SSL_SESSIONID_CACHE, 0L);
+    curl_easy_setopt(curl, CURLOPT_SSL_SESSIONID_CACHE, 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_MAXAGE_CONN, (long)HTTP_POOL_IDLE_SECONDS);
     return curl;
 }
 
+static void pool_evict(HTTP_POOL_ENTRY *entry) {
+  curl_easy_cleanup(entry->curl);
+  memset(entry, 0, sizeof(*entry));
+}
+
+CURL* get_curl_handle(const char* host) {
+  CURL* curl = NULL;
+  HTTP_POOL_ENTRY *entry = NULL, *lru = NULL, *empty = NULL;
+  time_t now = http_pool_clock(NULL);
+
+  if (host == NULL)
+    host = "";
+
+  pool_lock();
+  for (int i = 0; i < HTTP_POOL_SIZE; i++) {
+    HTTP_POOL_ENTRY *e = &pool[i];
+    if (e->curl != NULL && !e->inUse && now - e->lastUsed > HTTP_POOL_IDLE_SECONDS)
+      pool_evict(e);
+
+    if (e->curl == NULL) {
+      if (empty == NULL)
+        empty = e;
+    } else if (!e->inUse) {
+      if (entry == NULL && strcmp(e->host, host) == 0)
+        entry = e;
+      else if (lru == NULL || e->lastUsed < lru->lastUsed)
+        lru = e;
+    }
+  }
+
+  if (entry == NULL) {
+    // No warm handle for this host, take a free slot or recycle the least recently used one
+    entry = empty;
+    if (entry == NULL && lru != NULL) {
+      pool_evict(lru);
+      entry = lru;
+    }
+    if (entry != NULL) {
+      entry->curl = create_curl_handle();
+      entry->generation = poolGeneration;
+      strncpy(entry->host, host, sizeof(entry->host) - 1);
+    }
+  }
+
+  if (entry != NULL && entry->curl != NULL) {
+    entry->inUse = true;
+    curl = entry->curl;
+    http_set_timeout(curl, 0);
+  } else {
+    // Every slot is busy, fall back to a one-off handle
+    curl = create_curl_handle();
+  }
+  pool_unlock();
+
+  return curl;
+}
+
+/* Applies to the connection and the whole transfer, 0 restores curl's defaults */
+void http_set_timeout(CURL* curl, long timeoutMs) {
+  if (curl == NULL)
+    return;
+
+  curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, timeoutMs);
+  curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, timeoutMs);
+}
+
+static void* read_file(const char* path, size_t* size) {
+  FILE* fp = fopen(path, "rb");
+  if (fp == NULL)
+    return NULL;
+
+  fseek(fp, 0, SEEK_END);
+  long length = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+
+  void* buffer = length > 0 ? malloc(length) : NULL;
+  if (buffer != NULL && fread(buffer, 1, length, fp) != (size_t)length) {
+    free(buffer);
+    buffer = NULL;
+  }
+  fclose(fp);
+
+  *size = buffer != NULL ? length : 0;
+  return buffer;
+}
+
+/* Loads the client certificate and key used for HTTPS. Called once per identity load by gs_init */
 int http_init(const char* keyDirectory, int logLevel) {
   debug = logLevel >= 2;
 
@@ -77,27 +235,29 @@ int http_init(const char* keyDirectory, int logLevel) {
   char keyFilePath[4096];
   sprintf(&keyFilePath[0], "%s%s", keyDirectory, KEY_FILE_NAME);
 
-  FILE* fp = fopen(certificateFilePath, "r");
-  if (fp == NULL)return 1;
-  fseek(fp, 0, SEEK_END);
-  int size = ftell(fp);
-  void* certificateBuffer = malloc(size);
-  fseek(fp, 0, SEEK_SET);
-  int a = fread(certificateBuffer, 1, size, fp);
+  size_t certSize, keySize;
+  void* certificateBuffer = read_file(certificateFilePath, &certSize);
+  void* keyBuffer = read_file(keyFilePath, &keySize);
+  if (certificateBuffer == NULL || keyBuffer == NULL) {
+    free(certificateBuffer);
+    free(keyBuffer);
+    return GS_FAILED;
+  }
+
+  // Handles copy the blobs when they're created, so the old buffers can go once nobody is creating one
+  pool_lock();
+  void* oldCert = certBlob.data;
+  void* oldKey = keyBlob.data;
   certBlob.data = certificateBuffer;
-  certBlob.len = size;
+  certBlob.len = certSize;
   certBlob.flags = CURL_BLOB_COPY;
-  fp = fopen(keyFilePath, "r");
-  if (fp == NULL)return 1;
-  fseek(fp, 0, SEEK_END);
-  size = ftell(fp);
-  void* keyBuffer = malloc(size);
-  fseek(fp, 0, SEEK_SET);
-  a = fread(keyBuffer, 1, size, fp);
   keyBlob.data = keyBuffer;
-  keyBlob.len = size;
+  keyBlob.len = keySize;
   keyBlob.flags = CURL_BLOB_COPY;
-  
+  pool_unlock();
+
+  free(oldCert);
+  free(oldKey);
   return GS_OK;
 }
 
@@ -126,33 +286,99 @@ int http_request(CURL* curl, char* url, PHTTP_DATA data) {
     return GS_OUT_OF_MEMORY;
   }
 
-  if (debug)
-    printf("Response:\n%s\n\n", data->memory);
+  if (debug) {
+    long newConnections = 0;
+    curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &newConnections);
+    printf("Response (%s connection):\n%s\n\n", newConnections > 0 ? "new" : "reused", data->memory);
+  }
 
   return GS_OK;
 }
 
-int http_request_binary(CURL *curl, char* url, FILE *data) {
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, data);
-    curl_easy_setopt(curl, CURLOPT_URL, url);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, _write_curl_binary);
+/*
+ * Downloads url into fp. If etag is set the request is conditional, and a 304
+ * response leaves fp empty. The ETag the server sent, if any, is copied to etagOut.
+ * Failures are described through error instead of gs_error, since several
+ * downloads run at once.
+ */
+int http_request_file(CURL *curl, char* url, FILE *fp, const char* etag, char* etagOut, size_t etagOutLen, long* responseCode, const char** error) {
+  struct curl_slist* headers = NULL;
+  HEADER_ETAG headerEtag = { etagOut, etagOutLen };
 
-    if (debug)
-        printf("Request %s\n", url);
+  if (etagOut != NULL && etagOutLen > 0)
+    etagOut[0] = 0;
 
-    CURLcode res = curl_easy_perform(curl);
+  if (etag != NULL && etag[0] != 0) {
+    char header[160];
+    snprintf(header, sizeof(header), "If-None-Match: %s", etag);
+    headers = curl_slist_append(headers, header);
+  }
 
-    if (res != CURLE_OK) {
-        gs_error = curl_easy_strerror(res);
-        return GS_FAILED;
-    }
-    return GS_OK;
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, fp);
+  curl_easy_setopt(curl, CURLOPT_URL, url);
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, _write_curl_binary);
+  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+  if (etagOut != NULL && etagOutLen > 0) {
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, _header_etag);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &headerEtag);
+  }
+
+  if (debug)
+    printf("Request %s%s\n", url, headers != NULL ? " (conditional)" : "");
+
+  CURLcode res = curl_easy_perform(curl);
+
+  // The handle goes back to the pool, don't leave it pointing at our stack
+  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, NULL);
+  curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, NULL);
+  curl_easy_setopt(curl, CURLOPT_HEADERDATA, NULL);
+  curl_slist_free_all(headers);
+
+  if (res != CURLE_OK) {
+    *error = curl_easy_strerror(res);
+    return GS_FAILED;
+  }
+
+  if (responseCode != NULL)
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, responseCode);
+  return GS_OK;
 }
 
 void http_cleanup(CURL *curl) {
+  if (curl == NULL)
+    return;
+
+  pool_lock();
+  for (int i = 0; i < HTTP_POOL_SIZE; i++) {
+    HTTP_POOL_ENTRY *e = &pool[i];
+    if (e->curl == curl) {
+      if (e->generation == poolGeneration) {
+        // Keep it, along with its open connection
+        e->inUse = false;
+        e->lastUsed = http_pool_clock(NULL);
+        pool_unlock();
+        return;
+      }
+      memset(e, 0, sizeof(*e));
+      break;
+    }
+  }
+  pool_unlock();
+
   curl_easy_cleanup(curl);
 }
 
+void http_flush_connections() {
+  pool_lock();
+  // Handles in use are closed when they are returned
+  poolGeneration++;
+  for (int i = 0; i < HTTP_POOL_SIZE; i++) {
+    if (pool[i].curl != NULL && !pool[i].inUse)
+      pool_evict(&pool[i]);
+  }
+  pool_unlock();
+}
+
 PHTTP_DATA http_create_data() {
   PHTTP_DATA data = malloc(sizeof(HTTP_DATA));
   if (data == NULL)
@@ -19,7 +19,9 @@
 
 #pragma once
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 #include <curl/curl.h>
 #define CERTIFICATE_FILE_NAME "client.pem"
 #define KEY_FILE_NAME "key.pem"
@@ -32,7 +34,11 @@ typedef struct _HTTP_DATA {
 int http_init(const char* keyDirectory, int logLevel);
 PHTTP_DATA http_create_data();
 int http_request(CURL *curl, char* url, PHTTP_DATA data);
-int http_request_binary(CURL *curl, char* url, void *fp);
+int http_request_file(CURL *curl, char* url, FILE *fp, const char* etag, char* etagOut, size_t etagOutLen, long* responseCode, const char** error);
 void http_free_data(PHTTP_DATA data);
 void http_cleanup(CURL* curl);
-CURL* get_curl_handle();
\ No newline at end of file
+void http_flush_connections();
+void http_set_timeout(CURL* curl, long timeoutMs);
+CURL* get_curl_handle(const char* host);
+
+extern time_t (*http_pool_clock)(time_t*);
\ No newline at end of file
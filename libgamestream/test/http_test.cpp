@@ -0,0 +1,177 @@
+// Connection reuse suite for http.c, built on the host rather than into the app
+//
+// Requests go to stub hosts on loopback that count the TCP connections they accept. Handles
+// taken with get_curl_handle() and returned with http_cleanup() must keep their connection, so
+// any number of sequential requests to a host costs one connect, also with a second host in
+// between. A handle idle for longer than the pool's timeout must be closed, which is checked on
+// a virtual clock, and http_flush_connections() must close the idle ones right away. A request
+// to a host that stalls must give up at the timeout HostProbeScheduler sets, and the next user of
+// the pooled handle must not inherit that timeout.
+//
+// Built through Tools/CMakeLists.txt.
+
+#include "HostStubServer.h"
+
+extern "C" {
+#include "errors.h"
+#include "http.h"
+}
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+
+static int g_failures = 0;
+
+#define CHECK(cond, ...)                                     \
+	do {                                                     \
+		if (!(cond)) {                                       \
+			fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+			fprintf(stderr, __VA_ARGS__);                    \
+			fprintf(stderr, "\n");                           \
+			g_failures++;                                    \
+		}                                                    \
+	} while (0)
+
+// HTTP_POOL_IDLE_SECONDS
+static const time_t POOL_IDLE_SECONDS = 30;
+static const int REQUESTS = 50;
+
+static time_t g_now;
+
+static time_t virtualTime(time_t *out) {
+	if (out) {
+		*out = g_now;
+	}
+	return g_now;
+}
+
+static HostStubServer::Response serverinfo(const HostStubServer::Request &request) {
+	HostStubServer::Response response;
+	response.body = "<root status_code=\"200\"><path>" + request.path + "</path></root>";
+	return response;
+}
+
+// One gs_* call's worth: a pooled handle, a request, and the handle back to the pool
+static bool request(const HostStubServer &server, const char *path) {
+	char url[256];
+	snprintf(url, sizeof(url), "http://127.0.0.1:%u%s?uniqueid=0123456789ABCDEF", server.httpPort(), path);
+
+	PHTTP_DATA data = http_create_data();
+	CURL *curl = get_curl_handle("127.0.0.1");
+	http_set_timeout(curl, 5000);
+	int ret = http_request(curl, url, data);
+	const bool ok = ret == GS_OK && strstr(data->memory, path) != nullptr;
+	CHECK(ok, "request to %s failed: %s", url, ret == GS_OK ? data->memory : gs_error);
+	http_free_data(data);
+	http_cleanup(curl);
+	return ok;
+}
+
+static void testReuse() {
+	HostStubServer server(serverinfo);
+	for (int i = 0; i < REQUESTS; i++) {
+		request(server, i % 2 ? "/serverinfo" : "/applist");
+	}
+	printf("%d sequential requests: %d connections\n", server.requests(), server.connections());
+	CHECK(server.requests() == REQUESTS, "the host served %d of %d requests", server.requests(), REQUESTS);
+	CHECK(server.connections() == 1, "%d requests took %d connections", REQUESTS, server.connections());
+}
+
+// Polling two hosts in turn, like the host list does, mustn't make them trade connections
+static void testTwoHosts() {
+	HostStubServer a(serverinfo), b(serverinfo);
+	for (int i = 0; i < REQUESTS; i++) {
+		request(i % 2 ? a : b, "/serverinfo");
+	}
+	printf("%d requests alternating between two hosts: %d and %d connections\n", REQUESTS, a.connections(),
+	       b.connections());
+	CHECK(a.connections() == 1 && b.connections() == 1, "alternating hosts took %d and %d connections",
+	      a.connections(), b.connections());
+}
+
+static void testIdleTimeout() {
+	HostStubServer server(serverinfo);
+	g_now = time(NULL);
+	http_pool_clock = virtualTime;
+
+	request(server, "/serverinfo");
+	g_now += POOL_IDLE_SECONDS;
+	request(server, "/serverinfo");
+	CHECK(server.connections() == 1, "a handle idle for exactly the timeout was closed");
+
+	g_now += POOL_IDLE_SECONDS + 1;
+	request(server, "/serverinfo");
+	CHECK(server.connections() == 2, "a handle idle past the timeout wasn't closed, %d connections",
+	      server.connections());
+
+	// Idle time is counted from when the handle came back, not from when it was created
+	for (int i = 0; i < 4; i++) {
+		g_now += POOL_IDLE_SECONDS - 1;
+		request(server, "/serverinfo");
+	}
+	CHECK(server.connections() == 2, "a handle used every %lld s was closed, %d connections",
+	      (long long)(POOL_IDLE_SECONDS - 1), server.connections());
+	printf("idle timeout: %d requests, %d connections\n", server.requests(), server.connections());
+
+	http_pool_clock = time;
+}
+
+static void testFlush() {
+	HostStubServer server(serverinfo);
+	request(server, "/serverinfo");
+	request(server, "/serverinfo");
+	http_flush_connections();
+	request(server, "/serverinfo");
+	request(server, "/serverinfo");
+	printf("flush: %d requests, %d connections\n", server.requests(), server.connections());
+	CHECK(server.connections() == 2, "http_flush_connections() left %d connections, expected 2",
+	      server.connections());
+}
+
+static void testTimeout() {
+	const int timeoutMs = 200;
+	const int stallMs = 1000;
+	HostStubServer server([&](const HostStubServer::Request &request) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(stallMs));
+		return serverinfo(request);
+	});
+
+	char url[256];
+	snprintf(url, sizeof(url), "http://127.0.0.1:%u/serverinfo", server.httpPort());
+	PHTTP_DATA data = http_create_data();
+
+	// What a probe does through gs_init()
+	CURL *curl = get_curl_handle("127.0.0.1");
+	http_set_timeout(curl, timeoutMs);
+	auto start = std::chrono::steady_clock::now();
+	int ret = http_request(curl, url, data);
+	const double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	http_cleanup(curl);
+	printf("stalled host: gave up after %.0f ms with a %d ms timeout\n", elapsedMs, timeoutMs);
+	CHECK(ret != GS_OK, "a request to a host that stalls for %d ms beat a %d ms timeout", stallMs, timeoutMs);
+	CHECK(elapsedMs < stallMs - 200, "a %d ms timeout took %.0f ms", timeoutMs, elapsedMs);
+
+	// Anything else taking the handle has no timeout, and waits for the host
+	curl = get_curl_handle("127.0.0.1");
+	ret = http_request(curl, url, data);
+	http_cleanup(curl);
+	CHECK(ret == GS_OK, "the probe's timeout stayed on the pooled handle: %s", gs_error);
+	http_free_data(data);
+}
+
+int main(int argc, char **argv) {
+	curl_global_init(CURL_GLOBAL_ALL);
+
+	testReuse();
+	testTwoHosts();
+	testIdleTimeout();
+	testFlush();
+	testTimeout();
+
+	curl_global_cleanup();
+	printf("%d failures\n", g_failures);
+	return g_failures == 0 ? 0 : 1;
+}
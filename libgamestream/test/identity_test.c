@@ -0,0 +1,174 @@
+/*
+ * Reference counting suite for the client identity cache in client.c, built on
+ * the host rather than into the app.
+ *
+ * identity_acquire() and identity_release() are static, so client.c is included
+ * here. A reference must keep its certificate and key usable after
+ * gs_reset_identity() dropped the cached copy, and the next acquire must load a
+ * new one. Then threads acquire and release references flat out while another
+ * resets the identity, and the cache must end up holding exactly its own
+ * reference. Built with AddressSanitizer, so a reference dropped one time too
+ * many shows up as a use after free.
+ *
+ * Built through Tools/CMakeLists.txt.
+ */
+
+#include "../client.c"
+
+#include <pthread.h>
+#include <unistd.h>
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                                     \
+  do {                                                       \
+    if (!(cond)) {                                           \
+      fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__);   \
+      fprintf(stderr, __VA_ARGS__);                          \
+      fprintf(stderr, "\n");                                 \
+      failures++;                                            \
+    }                                                        \
+  } while (0)
+
+#define THREADS 8
+#define ITERATIONS 2000
+#define RESETS 200
+
+static char keyDirectory[PATH_MAX];
+
+/* Signs with the key and checks the signature against the certificate */
+static bool identity_usable(PCLIENT_IDENTITY id) {
+  static const char message[] = "clientpairingsecret";
+  unsigned char *signature = NULL;
+  size_t signatureLength = 0;
+  if (sign_it(message, sizeof(message), &signature, &signatureLength, id->privateKey) != GS_OK)
+    return false;
+
+  char *pem = NULL;
+  BIO *bio = BIO_new(BIO_s_mem());
+  PEM_write_bio_X509(bio, id->cert);
+  long pemLength = BIO_get_mem_data(bio, &pem);
+  char *cert = strndup(pem, pemLength);
+  BIO_free(bio);
+
+  bool ok = verifySignature(message, sizeof(message), (char *)signature, signatureLength, cert);
+  free(cert);
+  OPENSSL_free(signature);
+  return ok && strlen(id->certHex) > 0;
+}
+
+static void test_cache() {
+  PCLIENT_IDENTITY a = identity_acquire(keyDirectory, 0);
+  CHECK(a != NULL, "first acquire failed: %s", gs_error);
+  if (a == NULL)
+    return;
+  CHECK(a->refs == 2 && cachedIdentity == a, "a new identity has %d references, expected the cache's and ours", a->refs);
+
+  PCLIENT_IDENTITY b = identity_acquire(NULL, 0);
+  CHECK(b == a && a->refs == 3, "acquire without a directory didn't share the cached identity");
+  identity_release(b);
+  identity_release(a);
+  CHECK(cachedIdentity == a && a->refs == 1, "the cache holds %d references once everyone released", a->refs);
+}
+
+static void test_reset_while_held() {
+  PCLIENT_IDENTITY held = identity_acquire(keyDirectory, 0);
+  CHECK(held != NULL, "acquire failed: %s", gs_error);
+  if (held == NULL)
+    return;
+
+  gs_reset_identity();
+  CHECK(cachedIdentity == NULL, "gs_reset_identity() left the identity cached");
+  CHECK(held->refs == 1, "a held identity has %d references after a reset, expected ours", held->refs);
+  CHECK(identity_usable(held), "a held identity is unusable after a reset");
+
+  // The next user loads it again, while the old reference stays good
+  PCLIENT_IDENTITY fresh = identity_acquire(NULL, 0);
+  CHECK(fresh != NULL && fresh != held, "acquire after a reset didn't load a new identity");
+  if (fresh != NULL) {
+    CHECK(fresh->refs == 2, "the reloaded identity has %d references", fresh->refs);
+    CHECK(strcmp(fresh->certHex, held->certHex) == 0, "the reloaded identity has a different certificate");
+    CHECK(identity_usable(held) && identity_usable(fresh), "an identity became unusable after the reload");
+    identity_release(fresh);
+  }
+
+  identity_release(held);
+  CHECK(cachedIdentity == fresh && cachedIdentity->refs == 1, "the reloaded identity is cached with %d references",
+        cachedIdentity ? cachedIdentity->refs : 0);
+}
+
+static int unusable;
+
+static void *acquire_loop(void *arg) {
+  const bool withDirectory = (intptr_t)arg % 2 == 0;
+  for (int i = 0; i < ITERATIONS; i++) {
+    PCLIENT_IDENTITY id = identity_acquire(withDirectory ? keyDirectory : NULL, 0);
+    if (id == NULL) {
+      // A NULL directory can only fail if nothing was ever loaded
+      __atomic_add_fetch(&unusable, 1, __ATOMIC_RELAXED);
+      continue;
+    }
+    if (id->cert == NULL || id->privateKey == NULL || id->certHex[0] == 0)
+      __atomic_add_fetch(&unusable, 1, __ATOMIC_RELAXED);
+    if (i % 64 == 0 && !identity_usable(id))
+      __atomic_add_fetch(&unusable, 1, __ATOMIC_RELAXED);
+    identity_release(id);
+  }
+  return NULL;
+}
+
+static void *reset_loop(void *arg) {
+  for (int i = 0; i < RESETS; i++) {
+    gs_reset_identity();
+    usleep(100);
+  }
+  return NULL;
+}
+
+static void test_concurrent() {
+  pthread_t threads[THREADS], resetter;
+  for (intptr_t t = 0; t < THREADS; t++)
+    pthread_create(&threads[t], NULL, acquire_loop, (void *)t);
+  pthread_create(&resetter, NULL, reset_loop, NULL);
+
+  for (int t = 0; t < THREADS; t++)
+    pthread_join(threads[t], NULL);
+  pthread_join(resetter, NULL);
+
+  printf("%d threads, %d acquires each, %d resets: %d unusable references\n", THREADS, ITERATIONS, RESETS, unusable);
+  CHECK(unusable == 0, "%d acquires returned no identity or an unusable one", unusable);
+  CHECK(cachedIdentity == NULL || cachedIdentity->refs == 1, "the cache holds %d references after the threads finished",
+        cachedIdentity->refs);
+
+  PCLIENT_IDENTITY id = identity_acquire(NULL, 0);
+  CHECK(id != NULL && id->refs == 2, "acquire after the threads finished has %d references", id ? id->refs : 0);
+  if (id != NULL)
+    identity_release(id);
+}
+
+int main(int argc, char **argv) {
+  char directory[] = "/tmp/gamestream-identity-test-XXXXXX";
+  if (mkdtemp(directory) == NULL) {
+    perror("mkdtemp");
+    return 1;
+  }
+  snprintf(keyDirectory, sizeof(keyDirectory), "%s/", directory);
+
+  test_cache();
+  test_reset_while_held();
+  test_concurrent();
+
+  // Drop the cache's reference too, so LeakSanitizer sees everything freed
+  gs_reset_identity();
+
+  const char *files[] = { CERTIFICATE_FILE_NAME, KEY_FILE_NAME, P12_FILE_NAME, UNIQUE_FILE_NAME };
+  for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s%s", keyDirectory, files[i]);
+    unlink(path);
+  }
+  rmdir(directory);
+
+  printf("%d failures\n", failures);
+  return failures == 0 ? 0 : 1;
+}
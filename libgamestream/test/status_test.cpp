@@ -0,0 +1,202 @@
+// Polling suite for gs_status(), built on the host rather than into the app
+//
+// A stub host serves serverinfo over HTTP and HTTPS from a state the test changes between polls.
+// Every poll must cost exactly one request, made over HTTPS whenever the HTTPS port is known,
+// whether or not the client thinks it's paired, and on the pooled connection. *changed must be
+// set on the poll that sees the pairing state or the running game change and on no other, with
+// the running game zeroed unless the host is _SERVER_BUSY. A host that refuses HTTPS but answers
+// over HTTP counts as up and leaves both alone, and a host that's gone fails without touching them.
+//
+// Built through Tools/CMakeLists.txt.
+
+#include "HostStubServer.h"
+
+extern "C" {
+#include "client.h"
+#include "errors.h"
+#include "http.h"
+#include "mkcert.h"
+}
+
+#include <cstdio>
+#include <initializer_list>
+#include <string>
+#include <unistd.h>
+
+static int g_failures = 0;
+
+#define CHECK(cond, ...)                                     \
+	do {                                                     \
+		if (!(cond)) {                                       \
+			fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+			fprintf(stderr, __VA_ARGS__);                    \
+			fprintf(stderr, "\n");                           \
+			g_failures++;                                    \
+		}                                                    \
+	} while (0)
+
+// The host's side of /serverinfo
+struct StatusHost {
+	bool paired = true;
+	int currentGame = 0;
+	bool busy = false;
+	bool refuseHttps = false;
+	int httpsRequests = 0;
+	int httpRequests = 0;
+
+	HostStubServer::Response handle(const HostStubServer::Request &request) {
+		HostStubServer::Response response;
+		(request.https ? httpsRequests : httpRequests)++;
+		if (request.https && refuseHttps) {
+			response.status = 401;
+			return response;
+		}
+		// Over HTTP GFE doesn't know who's asking, so it never reports a pairing
+		const bool reportPaired = request.https && paired;
+		response.body = "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n<root status_code=\"200\">\n"
+		                "  <hostname>GAMING-PC</hostname>\n"
+		                "  <appversion>7.1.431.-1</appversion>\n"
+		                "  <PairStatus>" + std::string(reportPaired ? "1" : "0") + "</PairStatus>\n"
+		                "  <currentgame>" + std::to_string(currentGame) + "</currentgame>\n"
+		                "  <state>" + std::string(busy ? "SUNSHINE_SERVER_BUSY" : "SUNSHINE_SERVER_FREE") + "</state>\n"
+		                "</root>\n";
+		return response;
+	}
+};
+
+// One gs_status() call, checking it cost exactly one request over the expected scheme
+static int poll(SERVER_DATA &server, StatusHost &state, HostStubServer &host, bool &changed, const char *what) {
+	const int before = host.requests(), httpsBefore = state.httpsRequests;
+	const int ret = gs_status(&server, &changed);
+	CHECK(host.requests() == before + 1, "%s: the poll took %d requests", what, host.requests() - before);
+	CHECK(state.httpsRequests == httpsBefore + 1, "%s: the poll wasn't made over HTTPS", what);
+	return ret;
+}
+
+static void testPolls(HostStubServer &host, StatusHost &state) {
+	char address[] = "127.0.0.1";
+	SERVER_DATA server = {};
+	server.serverInfo.address = address;
+	server.httpPort = host.httpPort();
+	server.httpsPort = host.httpsPort();
+	server.paired = true;
+	server.requestTimeoutMs = 5000;
+
+	bool changed = true;
+	for (int i = 0; i < 10; i++) {
+		CHECK(poll(server, state, host, changed, "idle") == GS_OK, "polling an idle host failed: %s", gs_error);
+		CHECK(!changed, "poll %d of an unchanged host reported a change", i);
+	}
+
+	// A game starts
+	state.currentGame = 42;
+	state.busy = true;
+	CHECK(poll(server, state, host, changed, "game started") == GS_OK, "poll failed");
+	CHECK(changed && server.currentGame == 42, "a started game came out as %d, changed %d", server.currentGame, changed);
+	CHECK(poll(server, state, host, changed, "game running") == GS_OK && !changed, "a running game kept reporting a change");
+
+	// GFE leaves currentgame set once the stream ended, only _SERVER_BUSY says it's running
+	state.busy = false;
+	CHECK(poll(server, state, host, changed, "game ended") == GS_OK, "poll failed");
+	CHECK(changed && server.currentGame == 0, "an ended game came out as %d, changed %d", server.currentGame, changed);
+	CHECK(poll(server, state, host, changed, "game ended") == GS_OK && !changed, "an ended game kept reporting a change");
+
+	// The host drops the pairing but still answers over HTTPS
+	state.paired = false;
+	CHECK(poll(server, state, host, changed, "unpaired") == GS_OK, "poll failed");
+	CHECK(changed && !server.paired, "unpairing wasn't reported");
+
+	// The client thinks it isn't paired, it must still ask over HTTPS and see the pairing come back
+	state.paired = true;
+	CHECK(poll(server, state, host, changed, "paired again") == GS_OK, "poll failed");
+	CHECK(changed && server.paired, "pairing again wasn't picked up, an unpaired client didn't poll over HTTPS");
+	CHECK(state.httpRequests == 0, "%d polls went over HTTP", state.httpRequests);
+
+	printf("polls: %d requests over %d connections\n", host.requests(), host.connections());
+	CHECK(host.connections() == 1, "polling took %d connections, expected the pooled one", host.connections());
+}
+
+static void testHttpFallback(HostStubServer &host, StatusHost &state) {
+	char address[] = "127.0.0.1";
+	SERVER_DATA server = {};
+	server.serverInfo.address = address;
+	server.httpPort = host.httpPort();
+	server.httpsPort = host.httpsPort();
+	server.paired = true;
+	server.currentGame = 7;
+	server.requestTimeoutMs = 5000;
+
+	// HTTP reports unpaired and no game, neither may be taken from it
+	state.refuseHttps = true;
+	state.busy = false;
+	const int https = state.httpsRequests, http = state.httpRequests;
+	bool changed = true;
+	CHECK(gs_status(&server, &changed) == GS_OK, "a host answering over HTTP counted as down: %s", gs_error);
+	CHECK(state.httpsRequests == https + 1 && state.httpRequests == http + 1,
+	      "the fallback took %d HTTPS and %d HTTP requests", state.httpsRequests - https, state.httpRequests - http);
+	CHECK(!changed && server.paired && server.currentGame == 7,
+	      "the HTTP answer changed the state: paired %d, currentGame %d, changed %d", server.paired, server.currentGame,
+	      changed);
+	state.refuseHttps = false;
+}
+
+static void testHostGone(const std::string &certFile, const std::string &keyFile) {
+	char address[] = "127.0.0.1";
+	SERVER_DATA server = {};
+	server.serverInfo.address = address;
+	server.paired = true;
+	server.currentGame = 3;
+	server.requestTimeoutMs = 2000;
+	{
+		HostStubServer gone([](const HostStubServer::Request &) { return HostStubServer::Response(); });
+		gone.startHttps(certFile.c_str(), keyFile.c_str());
+		server.httpPort = gone.httpPort();
+		server.httpsPort = gone.httpsPort();
+	}
+
+	bool changed = true;
+	CHECK(gs_status(&server, &changed) != GS_OK, "polling a host that's gone succeeded");
+	CHECK(!changed && server.paired && server.currentGame == 3, "a failed poll changed the state");
+}
+
+int main(int argc, char **argv) {
+	curl_global_init(CURL_GLOBAL_ALL);
+
+	char directory[] = "/tmp/gamestream-status-test-XXXXXX";
+	if (!mkdtemp(directory)) {
+		perror("mkdtemp");
+		return 1;
+	}
+	const std::string dir = std::string(directory) + "/";
+	const std::string certFile = dir + CERTIFICATE_FILE_NAME;
+	const std::string keyFile = dir + KEY_FILE_NAME;
+	const std::string p12File = dir + "client.p12";
+
+	// The host and the client share one certificate, neither side checks the other's
+	CERT_KEY_PAIR cert = mkcert_generate();
+	mkcert_save(certFile.c_str(), p12File.c_str(), keyFile.c_str(), cert);
+	mkcert_free(cert);
+	http_init(dir.c_str(), 0);
+
+	{
+		StatusHost state;
+		HostStubServer host([&](const HostStubServer::Request &request) { return state.handle(request); });
+		if (host.startHttps(certFile.c_str(), keyFile.c_str())) {
+			testPolls(host, state);
+			testHttpFallback(host, state);
+		} else {
+			CHECK(false, "the stub host can't serve HTTPS");
+		}
+	}
+	testHostGone(certFile, keyFile);
+
+	http_flush_connections();
+	for (const std::string &file : {certFile, keyFile, p12File}) {
+		unlink(file.c_str());
+	}
+	rmdir(directory);
+	curl_global_cleanup();
+
+	printf("%d failures\n", g_failures);
+	return g_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,348 @@
+// Fixture suite for xml_serverinfo(), built on the host rather than into the app
+//
+// load_serverinfo() used to make one xml_search() per field, plus xml_status() and
+// xml_modelist(). Those calls are still in xml.c, so every fixture is read both ways: each field
+// of SERVERINFO_XML must equal what xml_search() finds, cut to fit the field, and the display
+// modes must match xml_modelist(). Then the fixture is served by a stub host and gs_init() must
+// come up with what the old load_serverinfo() derived from the same text: the same result code,
+// pairing state, running game (zeroed unless the host is _SERVER_BUSY), HTTPS port and the rest.
+//
+// Built through Tools/CMakeLists.txt.
+
+#include "HostStubServer.h"
+
+extern "C" {
+#include "client.h"
+#include "errors.h"
+#include "http.h"
+#include "xml.h"
+}
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+static int g_failures = 0;
+
+#define CHECK(cond, ...)                                     \
+	do {                                                     \
+		if (!(cond)) {                                       \
+			fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+			fprintf(stderr, __VA_ARGS__);                    \
+			fprintf(stderr, "\n");                           \
+			g_failures++;                                    \
+		}                                                    \
+	} while (0)
+
+#define FIELD(node, member) {node, offsetof(SERVERINFO_XML, member), sizeof(SERVERINFO_XML::member)}
+
+static const struct Field {
+	const char *node;
+	size_t offset;
+	size_t size;
+} FIELDS[] = {
+	FIELD("hostname", hostname),
+	FIELD("uniqueid", uniqueId),
+	FIELD("currentgame", currentGame),
+	FIELD("PairStatus", pairStatus),
+	FIELD("appversion", appVersion),
+	FIELD("state", state),
+	FIELD("ServerCodecModeSupport", codecModeSupport),
+	FIELD("gputype", gpuType),
+	FIELD("GsVersion", gsVersion),
+	FIELD("GfeVersion", gfeVersion),
+	FIELD("HttpsPort", httpsPort),
+	FIELD("mac", mac),
+};
+
+static const size_t FIELD_COUNT = sizeof(FIELDS) / sizeof(FIELDS[0]);
+
+struct Fixture {
+	const char *name;
+	std::string xml;
+};
+
+static std::string serverinfoXml(const char *status, const std::vector<std::pair<std::string, std::string>> &fields,
+                                 bool modes) {
+	std::string xml = "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n<root " + std::string(status) + ">\n";
+	for (const auto &field : fields) {
+		xml += "  <" + field.first + ">" + field.second + "</" + field.first + ">\n";
+	}
+	if (modes) {
+		xml += "  <SupportedDisplayMode>\n";
+		for (const char *mode : {"3840 2160 60", "2560 1440 120", "1920 1080 60"}) {
+			unsigned width, height, refresh;
+			sscanf(mode, "%u %u %u", &width, &height, &refresh);
+			xml += "    <DisplayMode><Width>" + std::to_string(width) + "</Width><Height>" + std::to_string(height) +
+			       "</Height><RefreshRate>" + std::to_string(refresh) + "</RefreshRate></DisplayMode>\n";
+		}
+		xml += "  </SupportedDisplayMode>\n";
+	}
+	return xml + "</root>\n";
+}
+
+static std::vector<Fixture> fixtures() {
+	const char *ok = "status_code=\"200\"";
+	const std::vector<std::pair<std::string, std::string>> gfe = {
+		{"hostname", "GAMING-PC"},
+		{"appversion", "7.1.431.-1"},
+		{"GfeVersion", "3.27.0.120"},
+		{"uniqueid", "7bd0dec0-1234-5678-9abc-def012345678"},
+		{"HttpsPort", "47984"},
+		{"ExternalPort", "47989"},
+		{"mac", "00:11:22:33:44:55"},
+		{"ServerCodecModeSupport", "259"},
+		{"PairStatus", "1"},
+		{"currentgame", "1234567"},
+		{"state", "MJOLNIR_STATE_SERVER_BUSY"},
+		{"gputype", "NVIDIA GeForce RTX 3080"},
+		{"GsVersion", "7.1.431.0"},
+	};
+
+	auto with = [&](const char *node, const std::string &value) {
+		auto fields = gfe;
+		for (auto &field : fields) {
+			if (field.first == node) {
+				field.second = value;
+			}
+		}
+		return fields;
+	};
+	auto without = [&](std::initializer_list<const char *> nodes) {
+		auto fields = gfe;
+		for (const char *node : nodes) {
+			for (size_t i = 0; i < fields.size(); i++) {
+				if (fields[i].first == node) {
+					fields.erase(fields.begin() + i);
+				}
+			}
+		}
+		return fields;
+	};
+
+	std::vector<Fixture> list = {
+		{"gfe busy", serverinfoXml(ok, gfe, true)},
+		{"gfe free, stale currentgame", serverinfoXml(ok, with("state", "MJOLNIR_STATE_SERVER_FREE"), true)},
+		{"sunshine busy", serverinfoXml(ok, with("state", "SUNSHINE_SERVER_BUSY"), false)},
+		{"not paired", serverinfoXml(ok, with("PairStatus", "0"), true)},
+		{"no ServerCodecModeSupport", serverinfoXml(ok, without({"ServerCodecModeSupport"}), true)},
+		{"no HttpsPort", serverinfoXml(ok, without({"HttpsPort"}), true)},
+		{"no mac or gputype", serverinfoXml(ok, without({"mac", "gputype"}), false)},
+		{"no currentgame", serverinfoXml(ok, without({"currentgame"}), true)},
+		{"no PairStatus", serverinfoXml(ok, without({"PairStatus"}), true)},
+		{"no appversion", serverinfoXml(ok, without({"appversion"}), true)},
+		{"no state", serverinfoXml(ok, without({"state"}), true)},
+		{"empty state", serverinfoXml(ok, with("state", ""), true)},
+		{"long hostname", serverinfoXml(ok, with("hostname", std::string(400, 'h')), true)},
+		{"long state, busy cut off", serverinfoXml(ok, with("state", std::string(70, 'S') + "_SERVER_BUSY"), true)},
+		{"long currentgame", serverinfoXml(ok, with("currentgame", "123456789012345678901234"), true)},
+		{"long HttpsPort", serverinfoXml(ok, with("HttpsPort", "479840000"), true)},
+		{"long gputype with entities", serverinfoXml(ok, with("gputype", std::string(60, 'G') + "&amp;&lt;" +
+		                                                                     std::string(100, 'g')), true)},
+		{"error status", serverinfoXml("status_code=\"401\" status_message=\"The client is not authorized\"", gfe, true)},
+		{"no status", serverinfoXml("", gfe, true)},
+		{"not xml", "<root status_code=\"200\"><hostname>GAMING-PC</hostname>"},
+	};
+
+	// A repeated element is read twice by both
+	std::string repeated = serverinfoXml(ok, gfe, true);
+	repeated.insert(repeated.find("</root>"), "  <mac>66:77:88:99:aa:bb</mac>\n");
+	list.push_back({"repeated mac", repeated});
+	return list;
+}
+
+// The old parse, one xml_search() per field, with each value cut to what SERVERINFO_XML holds
+struct Legacy {
+	int ret;
+	std::string fields[FIELD_COUNT];
+	std::vector<DISPLAY_MODE> modes;
+
+	const std::string &operator[](const char *node) const {
+		for (size_t i = 0; i < FIELD_COUNT; i++) {
+			if (!strcmp(FIELDS[i].node, node)) {
+				return fields[i];
+			}
+		}
+		abort();
+	}
+};
+
+static Legacy legacyParse(std::string xml) {
+	Legacy legacy = {};
+	if (xml_status(&xml[0], xml.size()) == GS_ERROR) {
+		legacy.ret = GS_ERROR;
+		return legacy;
+	}
+
+	legacy.ret = GS_OK;
+	for (size_t i = 0; i < FIELD_COUNT; i++) {
+		char *text = nullptr;
+		if (xml_search(&xml[0], xml.size(), (char *)FIELDS[i].node, &text) != GS_OK) {
+			legacy.ret = GS_INVALID;
+			return legacy;
+		}
+		legacy.fields[i] = std::string(text).substr(0, FIELDS[i].size - 1);
+		free(text);
+	}
+
+	PDISPLAY_MODE modes = nullptr;
+	if (xml_modelist(&xml[0], xml.size(), &modes) != GS_OK) {
+		legacy.ret = GS_INVALID;
+		return legacy;
+	}
+	for (PDISPLAY_MODE mode = modes; mode; mode = mode->next) {
+		legacy.modes.push_back(*mode);
+	}
+	xml_free_modes(modes);
+	return legacy;
+}
+
+static void checkParse(const Fixture &fixture, const Legacy &legacy) {
+	std::string xml = fixture.xml;
+	SERVERINFO_XML info;
+	const int ret = xml_serverinfo(&xml[0], xml.size(), &info);
+	CHECK(ret == legacy.ret, "%s: xml_serverinfo() returned %d, the old parse %d", fixture.name, ret, legacy.ret);
+	if (ret != GS_OK) {
+		CHECK(info.modes == nullptr, "%s: modes left behind after an error", fixture.name);
+		return;
+	}
+
+	for (size_t i = 0; i < FIELD_COUNT; i++) {
+		const char *value = (const char *)&info + FIELDS[i].offset;
+		CHECK(legacy.fields[i] == value, "%s: <%s> is \"%s\", the old parse found \"%s\"", fixture.name, FIELDS[i].node,
+		      value, legacy.fields[i].c_str());
+	}
+
+	size_t count = 0;
+	for (PDISPLAY_MODE mode = info.modes; mode; mode = mode->next, count++) {
+		if (count < legacy.modes.size()) {
+			const DISPLAY_MODE &expect = legacy.modes[count];
+			CHECK(mode->width == expect.width && mode->height == expect.height && mode->refresh == expect.refresh,
+			      "%s: mode %zu is %ux%u@%u, the old parse found %ux%u@%u", fixture.name, count, mode->width,
+			      mode->height, mode->refresh, expect.width, expect.height, expect.refresh);
+		}
+	}
+	CHECK(count == legacy.modes.size(), "%s: %zu modes, the old parse found %zu", fixture.name, count,
+	      legacy.modes.size());
+	xml_free_modes(info.modes);
+}
+
+// What the old load_serverinfo() made of the fields
+struct Expected {
+	int ret;
+	bool paired;
+	int currentGame;
+	int codecModeSupport;
+	unsigned short httpsPort;
+	int serverMajorVersion;
+	bool isNvidiaSoftware;
+};
+
+static Expected legacyLoad(const Legacy &legacy) {
+	Expected e = {};
+	e.ret = legacy.ret;
+	if (e.ret != GS_OK) {
+		return e;
+	}
+	if (legacy["currentgame"].empty() || legacy["PairStatus"].empty() || legacy["appversion"].empty() ||
+	    legacy["state"].empty()) {
+		e.ret = GS_INVALID;
+		return e;
+	}
+
+	e.paired = legacy["PairStatus"] == "1";
+	e.currentGame = atoi(legacy["currentgame"].c_str());
+	// The one intended change, a missing element means H.264 only rather than 0
+	e.codecModeSupport = legacy["ServerCodecModeSupport"].empty() ? SCM_H264 : atoi(legacy["ServerCodecModeSupport"].c_str());
+	e.serverMajorVersion = atoi(legacy["appversion"].c_str());
+	e.isNvidiaSoftware = legacy["state"].find("MJOLNIR") != std::string::npos;
+	e.httpsPort = (unsigned short)atoi(legacy["HttpsPort"].c_str());
+	if (!e.httpsPort) {
+		e.httpsPort = 47984;
+	}
+	if (legacy["state"].find("_SERVER_BUSY") == std::string::npos) {
+		e.currentGame = 0;
+	}
+	return e;
+}
+
+static void checkLoad(const Fixture &fixture, const Legacy &legacy, const char *keyDirectory) {
+	const Expected expect = legacyLoad(legacy);
+	HostStubServer host([&](const HostStubServer::Request &request) {
+		HostStubServer::Response response;
+		response.body = fixture.xml;
+		return response;
+	});
+
+	SERVER_DATA server = {};
+	char address[] = "127.0.0.1";
+	const int ret = gs_init(&server, address, host.httpPort(), keyDirectory, 0, true, 5000);
+	CHECK(ret == expect.ret, "%s: gs_init() returned %d, the old load_serverinfo() %d", fixture.name, ret, expect.ret);
+	if (ret != GS_OK || expect.ret != GS_OK) {
+		return;
+	}
+
+	CHECK(server.paired == expect.paired, "%s: paired is %d, expected %d", fixture.name, server.paired, expect.paired);
+	CHECK(server.currentGame == expect.currentGame, "%s: currentGame is %d, expected %d", fixture.name,
+	      server.currentGame, expect.currentGame);
+	CHECK(server.serverInfo.serverCodecModeSupport == expect.codecModeSupport,
+	      "%s: serverCodecModeSupport is %d, expected %d", fixture.name, server.serverInfo.serverCodecModeSupport,
+	      expect.codecModeSupport);
+	CHECK(server.httpsPort == expect.httpsPort, "%s: httpsPort is %u, expected %u", fixture.name, server.httpsPort,
+	      expect.httpsPort);
+	CHECK(server.serverMajorVersion == expect.serverMajorVersion, "%s: serverMajorVersion is %d, expected %d",
+	      fixture.name, server.serverMajorVersion, expect.serverMajorVersion);
+	CHECK(server.isNvidiaSoftware == expect.isNvidiaSoftware, "%s: isNvidiaSoftware is %d, expected %d", fixture.name,
+	      server.isNvidiaSoftware, expect.isNvidiaSoftware);
+
+	const struct {
+		const char *node;
+		const char *value;
+	} strings[] = {
+		{"hostname", server.serverName},
+		{"uniqueid", server.uniqueId},
+		{"appversion", server.serverInfo.serverInfoAppVersion},
+		{"gputype", server.gpuType},
+		{"GsVersion", server.gsVersion},
+		{"GfeVersion", server.serverInfo.serverInfoGfeVersion},
+		{"mac", server.macAddress},
+	};
+	for (const auto &s : strings) {
+		CHECK(s.value && legacy[s.node] == s.value, "%s: <%s> came out as \"%s\", expected \"%s\"", fixture.name,
+		      s.node, s.value ? s.value : "(null)", legacy[s.node].c_str());
+		free((void *)s.value);
+	}
+	xml_free_modes(server.modes);
+}
+
+int main(int argc, char **argv) {
+	char keyDirectory[] = "/tmp/gamestream-xml-test-XXXXXX";
+	if (!mkdtemp(keyDirectory)) {
+		perror("mkdtemp");
+		return 1;
+	}
+	const std::string keyPath = std::string(keyDirectory) + "/";
+
+	const std::vector<Fixture> list = fixtures();
+	for (const Fixture &fixture : list) {
+		const Legacy legacy = legacyParse(fixture.xml);
+		checkParse(fixture, legacy);
+		checkLoad(fixture, legacy, keyPath.c_str());
+		printf("%-30s %s\n", fixture.name,
+		       legacy.ret == GS_OK ? (legacyLoad(legacy).ret == GS_OK ? "loaded" : "rejected, missing a field")
+		                           : (legacy.ret == GS_ERROR ? "rejected, error status" : "rejected, bad xml"));
+	}
+
+	for (const char *file : {CERTIFICATE_FILE_NAME, KEY_FILE_NAME, "client.p12", "uniqueid.dat"}) {
+		unlink((keyPath + file).c_str());
+	}
+	rmdir(keyDirectory);
+
+	printf("%d failures\n", g_failures);
+	return g_failures == 0 ? 0 : 1;
+}
@@ -21,6 +21,7 @@
 #include "errors.h"
 
 #include <expat.h>
+#include <stddef.h>
 #include <string.h>
 
 #define STATUS_OK 200
@@ -32,6 +33,35 @@ struct xml_query {
   void* data;
 };
 
+struct xml_serverinfo_query {
+  PSERVERINFO_XML info;
+  char *text;         /* buffer for the element being read, NULL if we don't want it */
+  size_t textSize;
+  size_t textLen;
+  char modeText[16];  /* Width, Height or RefreshRate of the current DisplayMode */
+};
+
+#define SERVERINFO_FIELD(node, member) { node, offsetof(SERVERINFO_XML, member), sizeof(((PSERVERINFO_XML)0)->member) }
+
+static const struct {
+  const char *node;
+  size_t offset;
+  size_t size;
+} serverinfo_fields[] = {
+  SERVERINFO_FIELD("hostname", hostname),
+  SERVERINFO_FIELD("uniqueid", uniqueId),
+  SERVERINFO_FIELD("currentgame", currentGame),
+  SERVERINFO_FIELD("PairStatus", pairStatus),
+  SERVERINFO_FIELD("appversion", appVersion),
+  SERVERINFO_FIELD("state", state),
+  SERVERINFO_FIELD("ServerCodecModeSupport", codecModeSupport),
+  SERVERINFO_FIELD("gputype", gpuType),
+  SERVERINFO_FIELD("GsVersion", gsVersion),
+  SERVERINFO_FIELD("GfeVersion", gfeVersion),
+  SERVERINFO_FIELD("HttpsPort", httpsPort),
+  SERVERINFO_FIELD("mac", mac),
+};
+
 static void XMLCALL _xml_start_element(void *userData, const char *name, const char **atts) {
   struct xml_query *search = (struct xml_query*) userData;
   if (strcmp(search->data, name) == 0)
@@ -124,6 +154,72 @@ static void XMLCALL _xml_start_status_element(void *userData, const char *name,
 
 static void XMLCALL _xml_end_status_element(void *userData, const char *name) { }
 
+static void XMLCALL _xml_start_serverinfo_element(void *userData, const char *name, const char **atts) {
+  struct xml_serverinfo_query *query = (struct xml_serverinfo_query*) userData;
+  PSERVERINFO_XML info = query->info;
+
+  if (strcmp("root", name) == 0) {
+    _xml_start_status_element(&info->status, name, atts);
+  } else if (strcmp("DisplayMode", name) == 0) {
+    PDISPLAY_MODE mode = calloc(1, sizeof(DISPLAY_MODE));
+    if (mode != NULL) {
+      mode->next = info->modes;
+      info->modes = mode;
+    }
+  } else if (info->modes != NULL && (strcmp("Height", name) == 0 || strcmp("Width", name) == 0 || strcmp("RefreshRate", name) == 0)) {
+    query->text = query->modeText;
+    query->textSize = sizeof(query->modeText);
+    query->textLen = 0;
+  } else {
+    for (size_t i = 0; i < sizeof(serverinfo_fields) / sizeof(serverinfo_fields[0]); i++) {
+      if (strcmp(serverinfo_fields[i].node, name) == 0) {
+        // Repeated elements are appended, like xml_search() does
+        query->text = (char*) info + serverinfo_fields[i].offset;
+        query->textSize = serverinfo_fields[i].size;
+        query->textLen = strlen(query->text);
+        break;
+      }
+    }
+  }
+}
+
+static void XMLCALL _xml_end_serverinfo_element(void *userData, const char *name) {
+  struct xml_serverinfo_query *query = (struct xml_serverinfo_query*) userData;
+  if (query->text == query->modeText) {
+    PDISPLAY_MODE mode = query->info->modes;
+    if (strcmp("Width", name) == 0)
+      mode->width = atoi(query->modeText);
+    else if (strcmp("Height", name) == 0)
+      mode->height = atoi(query->modeText);
+    else if (strcmp("RefreshRate", name) == 0)
+      mode->refresh = atoi(query->modeText);
+  }
+  query->text = NULL;
+}
+
+/* Writes straight into the fixed size field, anything that doesn't fit is dropped */
+static void XMLCALL _xml_write_serverinfo_data(void *userData, const XML_Char *s, int len) {
+  struct xml_serverinfo_query *query = (struct xml_serverinfo_query*) userData;
+  if (query->text == NULL)
+    return;
+
+  size_t n = query->textSize - 1 - query->textLen;
+  if ((size_t) len < n)
+    n = len;
+
+  memcpy(&query->text[query->textLen], s, n);
+  query->textLen += n;
+  query->text[query->textLen] = 0;
+}
+
+void xml_free_modes(PDISPLAY_MODE modes) {
+  while (modes != NULL) {
+    PDISPLAY_MODE next = modes->next;
+    free(modes);
+    modes = next;
+  }
+}
+
 static void XMLCALL _xml_write_data(void *userData, const XML_Char *s, int len) {
   struct xml_query *search = (struct xml_query*) userData;
   if (search->start > 0) {
@@ -208,6 +304,39 @@ int xml_modelist(char* data, size_t len, PDISPLAY_MODE *mode_list) {
 
 }
 
+/*
+ * Reads every field of a serverinfo response in one pass, instead of one xml_search()
+ * per field. Returns GS_ERROR if the host reported an error status.
+ */
+int xml_serverinfo(char* data, size_t len, PSERVERINFO_XML info) {
+  struct xml_serverinfo_query query = {0};
+  memset(info, 0, sizeof(*info));
+  query.info = info;
+
+  XML_Parser parser = XML_ParserCreate("UTF-8");
+  XML_SetUserData(parser, &query);
+  XML_SetElementHandler(parser, _xml_start_serverinfo_element, _xml_end_serverinfo_element);
+  XML_SetCharacterDataHandler(parser, _xml_write_serverinfo_data);
+  if (! XML_Parse(parser, data, len, 1)) {
+    int code = XML_GetErrorCode(parser);
+    gs_error = XML_ErrorString(code);
+    XML_ParserFree(parser);
+    xml_free_modes(info->modes);
+    info->modes = NULL;
+    return GS_INVALID;
+  }
+
+  XML_ParserFree(parser);
+
+  if (info->status != STATUS_OK) {
+    xml_free_modes(info->modes);
+    info->modes = NULL;
+    return GS_ERROR;
+  }
+
+  return GS_OK;
+}
+
 int xml_status(char* data, size_t len) {
   int status = 0;
   XML_Parser parser = XML_ParserCreate("UTF-8");
@@ -33,7 +33,27 @@ typedef struct _DISPLAY_MODE {
   struct _DISPLAY_MODE *next;
 } DISPLAY_MODE, *PDISPLAY_MODE;
 
+/* Everything load_serverinfo() needs from a serverinfo response */
+typedef struct _SERVERINFO_XML {
+  int status;
+  char hostname[256];
+  char uniqueId[64];
+  char currentGame[16];
+  char pairStatus[8];
+  char appVersion[32];
+  char state[64];
+  char codecModeSupport[16];
+  char gpuType[128];
+  char gsVersion[32];
+  char gfeVersion[32];
+  char httpsPort[8];
+  char mac[32];
+  PDISPLAY_MODE modes;
+} SERVERINFO_XML, *PSERVERINFO_XML;
+
 int xml_search(char* data, size_t len, char* node, char** result);
+int xml_serverinfo(char* data, size_t len, PSERVERINFO_XML info);
 int xml_applist(char* data, size_t len, PAPP_LIST *app_list);
 int xml_modelist(char* data, size_t len, PDISPLAY_MODE *mode_list);
+void xml_free_modes(PDISPLAY_MODE modes);
 int xml_status(char* data, size_t len);